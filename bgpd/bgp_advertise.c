@@ -25,6 +25,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "prefix.h"
 #include "hash.h"
 #include "thread.h"
+#include "vector.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -152,23 +153,89 @@ bgp_advertise_unintern (struct hash *hash, struct bgp_advertise_attr *baa)
     }
 }
 
+/* Every peer owns a slot number, and a node keeps its adjacencies in
+   an array by slot besides the rn->adj_out list, so that finding the
+   one for a given peer does not scan the entries of all other peers the
+   node is advertised to.  The array is sized for all slots in use when
+   it first grows, which on a route server is every client anyway.  */
+static vector adj_out_slots;
+
+static struct bgp_adj_out *
+bgp_adj_out_find (struct bgp_node *rn, struct peer *peer)
+{
+  if (peer->adj_out_slot >= rn->adj_out_slots)
+    return NULL;
+  return rn->adj_out_slot[peer->adj_out_slot];
+}
+
+static void
+bgp_adj_out_link (struct bgp_node *rn, struct bgp_adj_out *adj)
+{
+  unsigned int slot = adj->peer->adj_out_slot;
+  unsigned int size;
+
+  if (slot >= rn->adj_out_slots)
+    {
+      size = MAX (slot + 1, vector_active (adj_out_slots));
+      rn->adj_out_slot = XREALLOC (MTYPE_BGP_ADJ_OUT_SLOT, rn->adj_out_slot,
+				   size * sizeof (struct bgp_adj_out *));
+      memset (rn->adj_out_slot + rn->adj_out_slots, 0,
+	      (size - rn->adj_out_slots) * sizeof (struct bgp_adj_out *));
+      rn->adj_out_slots = size;
+    }
+  rn->adj_out_slot[slot] = adj;
+
+  adj->rn = rn;
+  BGP_ADJ_OUT_ADD (rn, adj);
+  BGP_PEER_LIST_ADD (adj->peer->adj_outs[rn->table->afi][rn->table->safi],
+		     adj);
+}
+
 /* BGP adjacency keeps minimal advertisement information.  */
 static void
 bgp_adj_out_free (struct bgp_adj_out *adj)
 {
+  struct bgp_node *rn = adj->rn;
+
+  if (rn)
+    {
+      rn->adj_out_slot[adj->peer->adj_out_slot] = NULL;
+      BGP_PEER_LIST_DEL (adj->peer->adj_outs[rn->table->afi][rn->table->safi],
+			 adj);
+    }
   peer_unlock (adj->peer); /* adj_out peer reference */
   XFREE (MTYPE_BGP_ADJ_OUT, adj);
 }
 
+/* Move ADJ to the node for its prefix in TABLE, when its peer moves
+   to another RS-client table.  */
+void
+bgp_adj_out_move (struct bgp_adj_out *adj, struct bgp_table *table)
+{
+  struct bgp_node *old = adj->rn;
+  struct bgp_node *rn;
+
+  rn = bgp_node_get (table, &old->p);
+
+  BGP_ADJ_OUT_DEL (old, adj);
+  old->adj_out_slot[adj->peer->adj_out_slot] = NULL;
+  BGP_PEER_LIST_DEL (adj->peer->adj_outs[old->table->afi][old->table->safi],
+		     adj);
+
+  /* The bgp_node_get() lock is the adjacency's from now on. */
+  bgp_adj_out_link (rn, adj);
+  if (adj->adv)
+    adj->adv->rn = rn;
+  bgp_unlock_node (old);
+}
+
 int
 bgp_adj_out_lookup (struct peer *peer, struct prefix *p,
 		    afi_t afi, safi_t safi, struct bgp_node *rn)
 {
   struct bgp_adj_out *adj;
 
-  for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
+  adj = bgp_adj_out_find (rn, peer);
 
   if (! adj)
     return 0;
@@ -225,11 +292,7 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
 
   /* Look for adjacency information. */
   if (rn)
-    {
-      for (adj = rn->adj_out; adj; adj = adj->next)
-	if (adj->peer == peer)
-	  break;
-    }
+    adj = bgp_adj_out_find (rn, peer);
 
   if (! adj)
     {
@@ -238,7 +301,7 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
       
       if (rn)
         {
-          BGP_ADJ_OUT_ADD (rn, adj);
+          bgp_adj_out_link (rn, adj);
           bgp_lock_node (rn);
         }
     }
@@ -277,9 +340,7 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
     return;
 
   /* Lookup existing adjacency, if it is not there return immediately.  */
-  for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
+  adj = bgp_adj_out_find (rn, peer);
 
   if (! adj)
     return;
@@ -348,7 +409,9 @@ bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
   adj = XCALLOC (MTYPE_BGP_ADJ_IN, sizeof (struct bgp_adj_in));
   adj->peer = peer_lock (peer); /* adj_in peer reference */
   adj->attr = bgp_attr_intern (attr);
+  adj->rn = rn;
   BGP_ADJ_IN_ADD (rn, adj);
+  BGP_PEER_LIST_ADD (peer->adj_ins[rn->table->afi][rn->table->safi], adj);
   bgp_lock_node (rn);
 }
 
@@ -357,6 +420,7 @@ bgp_adj_in_remove (struct bgp_node *rn, struct bgp_adj_in *bai)
 {
   bgp_attr_unintern (bai->attr);
   BGP_ADJ_IN_DEL (rn, bai);
+  BGP_PEER_LIST_DEL (bai->peer->adj_ins[rn->table->afi][rn->table->safi], bai);
   peer_unlock (bai->peer); /* adj_in peer reference */
   XFREE (MTYPE_BGP_ADJ_IN, bai);
 }
@@ -395,6 +459,10 @@ bgp_sync_init (struct peer *peer)
 	peer->sync[afi][safi] = sync;
 	peer->hash[afi][safi] = hash_create (baa_hash_key, baa_hash_cmp);
       }
+
+  if (adj_out_slots == NULL)
+    adj_out_slots = vector_init (1);
+  peer->adj_out_slot = vector_set (adj_out_slots, peer);
 }
 
 void
@@ -414,4 +482,7 @@ bgp_sync_delete (struct peer *peer)
 	  hash_free (peer->hash[afi][safi]);
 	peer->hash[afi][safi] = NULL;
       }
+
+  /* No adjacency refers to the peer any more, the slot can be reused. */
+  vector_unset (adj_out_slots, peer->adj_out_slot);
 }
@@ -73,6 +73,14 @@ struct bgp_adj_out
   /* Advertised peer.  */
   struct peer *peer;
 
+  /* Node this adjacency hangs off, in whose adj_out_slot array it sits
+     at the peer's adj_out_slot.  */
+  struct bgp_node *rn;
+
+  /* The peer's other adjacencies out, see BGP_PEER_LIST_ADD.  */
+  struct bgp_adj_out *peer_next;
+  struct bgp_adj_out *peer_prev;
+
   /* Advertised attribute.  */
   struct attr *attr;
 
@@ -90,6 +98,13 @@ struct bgp_adj_in
   /* Received peer.  */
   struct peer *peer;
 
+  /* Node this adjacency hangs off.  */
+  struct bgp_node *rn;
+
+  /* The peer's other adjacencies in, see BGP_PEER_LIST_ADD.  */
+  struct bgp_adj_in *peer_next;
+  struct bgp_adj_in *peer_prev;
+
   /* Received attribute.  */
   struct attr *attr;
 };
@@ -127,6 +142,27 @@ struct bgp_synchronize
 #define BGP_ADJ_OUT_ADD(N,A)   BGP_INFO_ADD(N,A,adj_out)
 #define BGP_ADJ_OUT_DEL(N,A)   BGP_INFO_DEL(N,A,adj_out)
 
+/* Per peer lists of paths and adjacencies, by AFI/SAFI of the table
+   they sit in, so that clearing a peer need not walk whole tables.  */
+#define BGP_PEER_LIST_ADD(H,A)                        \
+  do {                                                \
+    (A)->peer_prev = NULL;                            \
+    (A)->peer_next = (H);                             \
+    if (H)                                            \
+      (H)->peer_prev = (A);                           \
+    (H) = (A);                                        \
+  } while (0)
+
+#define BGP_PEER_LIST_DEL(H,A)                        \
+  do {                                                \
+    if ((A)->peer_next)                               \
+      (A)->peer_next->peer_prev = (A)->peer_prev;     \
+    if ((A)->peer_prev)                               \
+      (A)->peer_prev->peer_next = (A)->peer_next;     \
+    else                                              \
+      (H) = (A)->peer_next;                           \
+  } while (0)
+
 /* Prototypes.  */
 extern void bgp_adj_out_set (struct bgp_node *, struct peer *, struct prefix *,
 		      struct attr *, afi_t, safi_t, struct bgp_info *);
@@ -134,6 +170,7 @@ extern void bgp_adj_out_unset (struct bgp_node *, struct peer *, struct prefix *
 			afi_t, safi_t);
 extern void bgp_adj_out_remove (struct bgp_node *, struct bgp_adj_out *, 
 			 struct peer *, afi_t, safi_t);
+extern void bgp_adj_out_move (struct bgp_adj_out *, struct bgp_table *);
 extern int bgp_adj_out_lookup (struct peer *, struct prefix *, afi_t, safi_t,
 			struct bgp_node *);
 
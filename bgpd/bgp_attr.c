@@ -28,6 +28,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "stream.h"
 #include "log.h"
 #include "hash.h"
+#include "jhash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_attr.h"
@@ -208,6 +209,7 @@ static void
 cluster_init (void)
 {
   cluster_hash = hash_create (cluster_hash_key_make, cluster_hash_cmp);
+  hash_set_name (cluster_hash, "BGP cluster lists");
 }
 
 static void
@@ -293,6 +295,7 @@ static void
 transit_init (void)
 {
   transit_hash = hash_create (transit_hash_key_make, transit_hash_cmp);
+  hash_set_name (transit_hash, "BGP transit attrs");
 }
 
 static void
@@ -449,6 +452,7 @@ static void
 attrhash_init (void)
 {
   attrhash = hash_create_size (256*1024, attrhash_key_make, attrhash_cmp);
+  hash_set_name (attrhash, "BGP attributes");
 }
 
 static void
@@ -548,6 +552,29 @@ bgp_attr_intern (struct attr *attr)
 }
 
 
+/* Are all the parts of the attribute interned, so that interning it
+   takes no new references besides its own? */
+int
+bgp_attr_parts_interned (struct attr *attr)
+{
+  if (attr->aspath && ! attr->aspath->refcnt)
+    return 0;
+  if (attr->community && ! attr->community->refcnt)
+    return 0;
+  if (attr->extra)
+    {
+      struct attr_extra *attre = attr->extra;
+
+      if (attre->ecommunity && ! attre->ecommunity->refcnt)
+	return 0;
+      if (attre->cluster && ! attre->cluster->refcnt)
+	return 0;
+      if (attre->transit && ! attre->transit->refcnt)
+	return 0;
+    }
+  return 1;
+}
+
 /* Make network statement's attribute. */
 struct attr *
 bgp_attr_default_set (struct attr *attr, u_char origin)
@@ -1791,6 +1818,222 @@ bgp_attr_unknown (struct peer *peer, struct attr *attr, u_char flag,
   return 0;
 }
 
+/* Raw attribute cache.  A peer sending a full table repeats the same
+   attribute block in UPDATE after UPDATE, only the NLRI behind it
+   changes.  Each peer therefore keeps a small direct-mapped table
+   from the raw bytes of a block it sent to what bgp_attr_parse()
+   made of them, so that a repeat costs a hash and a memcmp instead
+   of decoding and interning every attribute again.  An entry holds a
+   reference on each interned part of its attr.
+
+   Blocks with MP_REACH_NLRI or MP_UNREACH_NLRI are not cached, as the
+   prefixes and next hop are inside them.  What else the outcome of
+   parsing depends on is either in the context word or fixed for the
+   life of a session; the cache is flushed when the session goes
+   down.  */
+#define BGP_ATTR_CACHE_SIZE		1024
+
+#define BGP_ATTR_CACHE_CTX_AS4		(1 << 0)
+#define BGP_ATTR_CACHE_CTX_FIRST_AS	(1 << 1)
+#define BGP_ATTR_CACHE_CTX_SORT_SHIFT	2
+
+struct bgp_attr_cache_entry
+{
+  u_int32_t key;
+  u_int32_t context;
+  bgp_size_t length;
+  struct attr attr;
+  u_char *data;
+};
+
+struct bgp_attr_cache
+{
+  struct bgp_attr_cache_entry *slot[BGP_ATTR_CACHE_SIZE];
+};
+
+static unsigned long attr_cache_count;
+static unsigned long attr_cache_hits;
+static unsigned long attr_cache_misses;
+
+static u_int32_t
+bgp_attr_cache_context (struct peer *peer)
+{
+  u_int32_t context;
+
+  context = peer_sort (peer) << BGP_ATTR_CACHE_CTX_SORT_SHIFT;
+  if (CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV))
+    context |= BGP_ATTR_CACHE_CTX_AS4;
+  if (peer->bgp && bgp_flag_check (peer->bgp, BGP_FLAG_ENFORCE_FIRST_AS))
+    context |= BGP_ATTR_CACHE_CTX_FIRST_AS;
+  return context;
+}
+
+/* Does the attribute block at P carry NLRI of its own? */
+static int
+bgp_attr_cache_has_nlri (const u_char *p, bgp_size_t size)
+{
+  const u_char *end = p + size;
+  bgp_size_t length;
+
+  while (end - p >= BGP_ATTR_MIN_LEN)
+    {
+      if (p[1] == BGP_ATTR_MP_REACH_NLRI || p[1] == BGP_ATTR_MP_UNREACH_NLRI)
+	return 1;
+
+      if (CHECK_FLAG (p[0], BGP_ATTR_FLAG_EXTLEN))
+	{
+	  if (end - p < BGP_ATTR_MIN_LEN + 1)
+	    return 1;
+	  length = (p[2] << 8) | p[3];
+	  p += 4;
+	}
+      else
+	{
+	  length = p[2];
+	  p += 3;
+	}
+      p += length;
+    }
+  return 0;
+}
+
+/* Take and drop the references an attr returned by bgp_attr_parse()
+   holds on its interned parts. */
+static void
+bgp_attr_cache_ref (struct attr *attr)
+{
+  if (attr->aspath)
+    attr->aspath->refcnt++;
+  if (attr->community)
+    attr->community->refcnt++;
+  if (attr->extra)
+    {
+      if (attr->extra->ecommunity)
+	attr->extra->ecommunity->refcnt++;
+      if (attr->extra->cluster)
+	attr->extra->cluster->refcnt++;
+      if (attr->extra->transit)
+	attr->extra->transit->refcnt++;
+    }
+}
+
+static void
+bgp_attr_cache_unref (struct attr *attr)
+{
+  if (attr->aspath)
+    aspath_unintern (attr->aspath);
+  if (attr->community)
+    community_unintern (attr->community);
+  if (attr->extra)
+    {
+      if (attr->extra->ecommunity)
+	ecommunity_unintern (attr->extra->ecommunity);
+      if (attr->extra->cluster)
+	cluster_unintern (attr->extra->cluster);
+      if (attr->extra->transit)
+	transit_unintern (attr->extra->transit);
+      bgp_attr_extra_free (attr);
+    }
+}
+
+static void
+bgp_attr_cache_entry_free (struct bgp_attr_cache_entry *entry)
+{
+  bgp_attr_cache_unref (&entry->attr);
+  XFREE (MTYPE_BGP_ATTR_CACHE, entry);
+  attr_cache_count--;
+}
+
+/* Fill ATTR from the peer's cache if the SIZE bytes at DATA were seen
+   before. */
+static int
+bgp_attr_cache_get (struct peer *peer, struct attr *attr,
+		    const u_char *data, bgp_size_t size,
+		    u_int32_t key, u_int32_t context)
+{
+  struct bgp_attr_cache_entry *entry;
+
+  if (! peer->attr_cache)
+    return 0;
+
+  entry = peer->attr_cache->slot[key % BGP_ATTR_CACHE_SIZE];
+  if (! entry
+      || entry->key != key
+      || entry->context != context
+      || entry->length != size
+      || memcmp (entry->data, data, size) != 0)
+    return 0;
+
+  bgp_attr_dup (attr, &entry->attr);
+  bgp_attr_cache_ref (attr);
+
+  peer->attr_cache_hit++;
+  attr_cache_hits++;
+  return 1;
+}
+
+/* Remember what bgp_attr_parse() made of the SIZE bytes at DATA. */
+static void
+bgp_attr_cache_put (struct peer *peer, struct attr *attr,
+		    const u_char *data, bgp_size_t size,
+		    u_int32_t key, u_int32_t context)
+{
+  struct bgp_attr_cache_entry *entry;
+  struct bgp_attr_cache_entry **slot;
+
+  if (bgp_attr_cache_has_nlri (data, size))
+    return;
+
+  if (! peer->attr_cache)
+    peer->attr_cache = XCALLOC (MTYPE_BGP_ATTR_CACHE,
+				sizeof (struct bgp_attr_cache));
+
+  slot = &peer->attr_cache->slot[key % BGP_ATTR_CACHE_SIZE];
+  if (*slot)
+    bgp_attr_cache_entry_free (*slot);
+
+  entry = XMALLOC (MTYPE_BGP_ATTR_CACHE,
+		   sizeof (struct bgp_attr_cache_entry) + size);
+  entry->key = key;
+  entry->context = context;
+  entry->length = size;
+  entry->data = (u_char *) (entry + 1);
+  memcpy (entry->data, data, size);
+  bgp_attr_dup (&entry->attr, attr);
+  bgp_attr_cache_ref (&entry->attr);
+  *slot = entry;
+  attr_cache_count++;
+
+  peer->attr_cache_miss++;
+  attr_cache_misses++;
+}
+
+/* Drop the peer's cache, with the references it holds. */
+void
+bgp_attr_cache_flush (struct peer *peer)
+{
+  int i;
+
+  if (! peer->attr_cache)
+    return;
+
+  for (i = 0; i < BGP_ATTR_CACHE_SIZE; i++)
+    if (peer->attr_cache->slot[i])
+      bgp_attr_cache_entry_free (peer->attr_cache->slot[i]);
+
+  XFREE (MTYPE_BGP_ATTR_CACHE, peer->attr_cache);
+  peer->attr_cache = NULL;
+}
+
+void
+bgp_attr_cache_stats (unsigned long *count, unsigned long *hits,
+		      unsigned long *misses)
+{
+  *count = attr_cache_count;
+  *hits = attr_cache_hits;
+  *misses = attr_cache_misses;
+}
+
 /* Read attribute of update packet.  This function is called from
    bgp_update() in bgpd.c.  */
 int
@@ -1809,6 +2052,19 @@ bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
   struct aspath *as4_path = NULL;
   as_t as4_aggregator = 0;
   struct in_addr as4_aggregator_addr = { 0 };
+  u_char *rawp;
+  u_int32_t key;
+  u_int32_t context;
+
+  /* Seen this block before? */
+  rawp = BGP_INPUT_PNT (peer);
+  context = bgp_attr_cache_context (peer);
+  key = jhash (rawp, size, context);
+  if (bgp_attr_cache_get (peer, attr, rawp, size, key, context))
+    {
+      stream_forward_getp (BGP_INPUT (peer), size);
+      return 0;
+    }
 
   /* Initialize bitmap. */
   memset (seen, 0, BGP_ATTR_BITMAP_SIZE);
@@ -2036,6 +2292,8 @@ bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
   if (attr->extra && attr->extra->transit)
     attr->extra->transit = transit_intern (attr->extra->transit);
 
+  bgp_attr_cache_put (peer, attr, rawp, size, key, context);
+
   return 0;
 }
 
@@ -346,6 +346,47 @@ bgp_damp_scan (struct bgp_info *binfo, afi_t afi, safi_t safi)
   return 0;
 }
 
+/* Run bgp_damp_scan over the dampening information of BGP in AFI/SAFI,
+   from the dampening lists instead of the whole table.  */
+void
+bgp_damp_scan_all (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct bgp_damp_info *bdi;
+  struct bgp_damp_info *next;
+  struct bgp_damp_info *list;
+  struct bgp_info *binfo;
+  struct bgp_node *rn;
+  u_int16_t flags;
+  unsigned int i;
+
+  for (i = 0; i <= damp->reuse_list_size; i++)
+    {
+      list = (i < damp->reuse_list_size) ? damp->reuse_list[i]
+					 : damp->no_reuse_list;
+
+      for (bdi = list; bdi; bdi = next)
+	{
+	  next = bdi->next;
+
+	  if (bdi->afi != afi || bdi->safi != safi
+	      || bdi->binfo->peer->bgp != bgp)
+	    continue;
+
+	  /* bdi may be gone after the scan. */
+	  binfo = bdi->binfo;
+	  rn = bdi->rn;
+	  flags = binfo->flags;
+
+	  if (bgp_damp_scan (binfo, afi, safi))
+	    bgp_aggregate_increment (bgp, &rn->p, binfo, afi, safi);
+	  else if (binfo->flags == flags)
+	    continue;
+
+	  bgp_process (bgp, rn, afi, safi);
+	}
+    }
+}
+
 void
 bgp_damp_info_free (struct bgp_damp_info *bdi, int withdraw)
 {
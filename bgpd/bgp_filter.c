@@ -24,6 +24,11 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "memory.h"
 #include "buffer.h"
+#include "prefix.h"
+#include "routemap.h"
+#include "hash.h"
+#include "jhash.h"
+#include "thread.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_aspath.h"
@@ -63,8 +68,31 @@ struct as_filter
 
   regex_t *reg;
   char *reg_str;
+
+  /* The regex as a plain run of ASNs, if it is one. */
+  struct bgp_regex_asns *asns;
+
+  /* How often the filter was tried, and the time taken by one in
+     AS_FILTER_SAMPLE of those, in microseconds.  A single run often
+     takes less than the clock resolution, the average over many is
+     still right.  */
+  unsigned long runs;
+  unsigned long timed;
+  u_int64_t usecs;
+};
+
+/* Time one in this many filter runs. */
+#define AS_FILTER_SAMPLE 16
+
+/* Remembered result of a list for an interned AS path. */
+struct as_list_cache_entry
+{
+  struct aspath *aspath;
+  enum as_filter_type type;
 };
 
+#define AS_LIST_CACHE_MAX 65536
+
 enum as_list_type
 {
   ACCESS_TYPE_STRING,
@@ -83,6 +111,11 @@ struct as_list
 
   struct as_filter *head;
   struct as_filter *tail;
+
+  /* Results by AS path, see as_list_apply (). */
+  struct hash *cache;
+  unsigned long cache_hit;
+  unsigned long cache_miss;
 };
 
 /* ip as-path access-list 10 permit AS1. */
@@ -108,6 +141,8 @@ as_filter_free (struct as_filter *asfilter)
 {
   if (asfilter->reg)
     bgp_regex_free (asfilter->reg);
+  if (asfilter->asns)
+    bgp_regex_asns_free (asfilter->asns);
   if (asfilter->reg_str)
     XFREE (MTYPE_AS_FILTER_STR, asfilter->reg_str);
   XFREE (MTYPE_AS_FILTER, asfilter);
@@ -123,6 +158,7 @@ as_filter_make (regex_t *reg, const char *reg_str, enum as_filter_type type)
   asfilter->reg = reg;
   asfilter->type = type;
   asfilter->reg_str = XSTRDUP (MTYPE_AS_FILTER_STR, reg_str);
+  asfilter->asns = bgp_regcomp_asns (reg_str);
 
   return asfilter;
 }
@@ -139,6 +175,56 @@ as_filter_lookup (struct as_list *aslist, const char *reg_str,
   return NULL;
 }
 
+/* AS list result cache.  AS paths are interned and a list's result
+   only depends on the path, so it is kept per interned path until the
+   list changes.  An entry holds a reference on its path, so that the
+   pointer is not reused for another path while it is cached. */
+static unsigned int
+as_list_cache_hash_key (void *p)
+{
+  struct as_list_cache_entry *entry = p;
+
+  return jhash_1word ((u_int32_t) (uintptr_t) entry->aspath, 0);
+}
+
+static int
+as_list_cache_hash_cmp (const void *p1, const void *p2)
+{
+  const struct as_list_cache_entry *e1 = p1;
+  const struct as_list_cache_entry *e2 = p2;
+
+  return e1->aspath == e2->aspath;
+}
+
+static void *
+as_list_cache_entry_alloc (void *p)
+{
+  struct as_list_cache_entry *val = p;
+  struct as_list_cache_entry *entry;
+
+  entry = XMALLOC (MTYPE_AS_LIST_CACHE, sizeof (struct as_list_cache_entry));
+  entry->aspath = val->aspath;
+  entry->aspath->refcnt++;
+  entry->type = val->type;
+  return entry;
+}
+
+static void
+as_list_cache_entry_free (void *p)
+{
+  struct as_list_cache_entry *entry = p;
+
+  aspath_unintern (entry->aspath);
+  XFREE (MTYPE_AS_LIST_CACHE, entry);
+}
+
+static void
+as_list_cache_reset (struct as_list *aslist)
+{
+  if (aslist->cache)
+    hash_clean (aslist->cache, as_list_cache_entry_free);
+}
+
 static void
 as_list_filter_add (struct as_list *aslist, struct as_filter *asfilter)
 {
@@ -150,6 +236,11 @@ as_list_filter_add (struct as_list *aslist, struct as_filter *asfilter)
   else
     aslist->head = asfilter;
   aslist->tail = asfilter;
+
+  as_list_cache_reset (aslist);
+
+  /* Route maps matching on the list must look again. */
+  route_map_cache_flush ();
 }
 
 /* Lookup as_list from list of as_list by name. */
@@ -181,6 +272,9 @@ as_list_new (void)
 static void
 as_list_free (struct as_list *aslist)
 {
+  as_list_cache_reset (aslist);
+  if (aslist->cache)
+    hash_free (aslist->cache);
   if (aslist->name)
     {
       free (aslist->name);
@@ -336,6 +430,8 @@ as_list_delete (struct as_list *aslist)
     list->head = aslist->next;
 
   as_list_free (aslist);
+
+  route_map_cache_flush ();
 }
 
 static int
@@ -361,6 +457,8 @@ as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
     aslist->head = asfilter->next;
 
   as_filter_free (asfilter);
+  as_list_cache_reset (aslist);
+  route_map_cache_flush ();
 
   /* If access_list becomes empty delete it from access_master. */
   if (as_list_empty (aslist))
@@ -371,32 +469,88 @@ as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
     (*as_list_master.delete_hook) ();
 }
 
+static u_int64_t
+as_filter_clock (void)
+{
+  struct timeval tv;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &tv);
+  return (u_int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 static int
 as_filter_match (struct as_filter *asfilter, struct aspath *aspath)
 {
-  if (bgp_regexec (asfilter->reg, aspath) != REG_NOMATCH)
-    return 1;
-  return 0;
+  u_int64_t start = 0;
+  int sample;
+  int ret;
+
+  sample = (asfilter->runs++ % AS_FILTER_SAMPLE) == 0;
+  if (sample)
+    start = as_filter_clock ();
+
+  if (asfilter->asns)
+    ret = bgp_regexec_asns (asfilter->asns, aspath);
+  else
+    ret = (bgp_regexec (asfilter->reg, aspath) != REG_NOMATCH);
+
+  if (sample)
+    {
+      asfilter->usecs += as_filter_clock () - start;
+      asfilter->timed++;
+    }
+  return ret;
+}
+
+static enum as_filter_type
+as_list_match (struct as_list *aslist, struct aspath *aspath)
+{
+  struct as_filter *asfilter;
+
+  for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
+    {
+      if (as_filter_match (asfilter, aspath))
+	return asfilter->type;
+    }
+  return AS_FILTER_DENY;
 }
 
 /* Apply AS path filter to AS. */
 enum as_filter_type
 as_list_apply (struct as_list *aslist, void *object)
 {
-  struct as_filter *asfilter;
+  struct as_list_cache_entry lookup;
   struct aspath *aspath;
+  struct as_list_cache_entry *entry;
 
   aspath = (struct aspath *) object;
 
   if (aslist == NULL)
     return AS_FILTER_DENY;
 
-  for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
+  /* Only interned paths can be remembered. */
+  if (aspath->refcnt == 0)
+    return as_list_match (aslist, aspath);
+
+  if (! aslist->cache)
+    aslist->cache = hash_create (as_list_cache_hash_key,
+				 as_list_cache_hash_cmp);
+
+  lookup.aspath = aspath;
+  entry = hash_lookup (aslist->cache, &lookup);
+  if (entry)
     {
-      if (as_filter_match (asfilter, aspath))
-	return asfilter->type;
+      aslist->cache_hit++;
+      return entry->type;
     }
-  return AS_FILTER_DENY;
+
+  if (aslist->cache->count >= AS_LIST_CACHE_MAX)
+    as_list_cache_reset (aslist);
+
+  lookup.type = as_list_match (aslist, aspath);
+  hash_get (aslist->cache, &lookup, as_list_cache_entry_alloc);
+  aslist->cache_miss++;
+  return lookup.type;
 }
 
 /* Add hook function. */
@@ -588,36 +742,30 @@ as_list_show (struct vty *vty, struct as_list *aslist)
     {
       vty_out (vty, "    %s %s%s", filter_type_str (asfilter->type),
 	       asfilter->reg_str, VTY_NEWLINE);
+      if (asfilter->runs)
+	vty_out (vty, "      %s match, %lu runs, %.3f usec each%s",
+		 asfilter->asns ? "ASN" : "regex", asfilter->runs,
+		 asfilter->timed
+		 ? (double) asfilter->usecs / asfilter->timed : 0.0,
+		 VTY_NEWLINE);
     }
+
+  if (aslist->cache_hit || aslist->cache_miss)
+    vty_out (vty, "    result cache: %lu entries, %lu hits, %lu misses%s",
+	     aslist->cache ? aslist->cache->count : 0,
+	     aslist->cache_hit, aslist->cache_miss, VTY_NEWLINE);
 }
 
 static void
 as_list_show_all (struct vty *vty)
 {
   struct as_list *aslist;
-  struct as_filter *asfilter;
 
   for (aslist = as_list_master.num.head; aslist; aslist = aslist->next)
-    {
-      vty_out (vty, "AS path access list %s%s", aslist->name, VTY_NEWLINE);
-
-      for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
-	{
-	  vty_out (vty, "    %s %s%s", filter_type_str (asfilter->type),
-		   asfilter->reg_str, VTY_NEWLINE);
-	}
-    }
+    as_list_show (vty, aslist);
 
   for (aslist = as_list_master.str.head; aslist; aslist = aslist->next)
-    {
-      vty_out (vty, "AS path access list %s%s", aslist->name, VTY_NEWLINE);
-
-      for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
-	{
-	  vty_out (vty, "    %s %s%s", filter_type_str (asfilter->type),
-		   asfilter->reg_str, VTY_NEWLINE);
-	}
-    }
+    as_list_show (vty, aslist);
 }
 
 DEFUN (show_ip_as_path_access_list,
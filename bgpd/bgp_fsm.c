@@ -40,6 +40,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
+#include "bgpd/bgp_io.h"
+#include "bgpd/bgp_updgrp.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -194,8 +196,13 @@ bgp_timer_set (struct peer *peer)
 	{
 	  BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer,
 			peer->v_holdtime);
-	  BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
-			peer->v_keepalive);
+
+	  /* The I/O thread sends its own keepalives.  */
+	  if (peer->io)
+	    BGP_TIMER_OFF (peer->t_keepalive);
+	  else
+	    BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
+			  peer->v_keepalive);
 	}
       BGP_TIMER_OFF (peer->t_asorig);
       break;
@@ -257,10 +264,24 @@ static int
 bgp_holdtime_timer (struct thread *thread)
 {
   struct peer *peer;
+  time_t age;
 
   peer = THREAD_ARG (thread);
   peer->t_holdtime = NULL;
 
+  /* Messages read by the I/O thread may still wait their turn, what
+     counts is when they arrived.  */
+  if (peer->io)
+    {
+      age = bgp_io_read_age (peer);
+      if (age < peer->v_holdtime)
+	{
+	  BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer,
+			peer->v_holdtime - age);
+	  return 0;
+	}
+    }
+
   if (BGP_DEBUG (fsm, FSM))
     zlog (peer->log, LOG_DEBUG,
 	  "%s [FSM] Timer (holdtime timer expire)",
@@ -438,6 +459,9 @@ bgp_stop (struct peer *peer)
   safi_t safi;
   char orf_name[BUFSIZ];
 
+  /* Take the socket back from the I/O thread before closing it.  */
+  bgp_io_peer_stop (peer);
+
   /* Can't do this in Clearing; events are used for state transitions */
   if (peer->status != Clearing)
     {
@@ -514,10 +538,13 @@ bgp_stop (struct peer *peer)
   /* Clear input and output buffer.  */
   if (peer->ibuf)
     stream_reset (peer->ibuf);
+  if (peer->rbuf)
+    stream_reset (peer->rbuf);
   if (peer->work)
     stream_reset (peer->work);
   if (peer->obuf)
     stream_fifo_clean (peer->obuf);
+  bgp_attr_cache_flush (peer);
 
   /* Close of file descriptor. */
   if (peer->fd >= 0)
@@ -775,6 +802,8 @@ bgp_establish (struct peer *peer)
   safi_t safi;
   int nsf_af_count = 0;
 
+  update_group_config_changed ();
+
   /* Reset capability open status flag. */
   if (! CHECK_FLAG (peer->sflags, PEER_STATUS_CAPABILITY_OPEN))
     SET_FLAG (peer->sflags, PEER_STATUS_CAPABILITY_OPEN);
@@ -846,6 +875,7 @@ bgp_establish (struct peer *peer)
 
   /* Reset uptime, send keepalive, send current table. */
   peer->uptime = bgp_clock ();
+  bgp_io_peer_start (peer);
 
   /* Send route-refresh when ORF is enabled */
   for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
@@ -0,0 +1,1325 @@
+/*
+ * BGP I/O thread.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* With "bgp io-thread" configured, the sockets of Established
+   sessions are handed to a separate thread.  It reads and frames the
+   messages, writes the packets the main thread builds and sends the
+   keepalives itself.  Parsing, best path selection and building
+   updates stay in the main thread, but however busy that gets,
+   keepalives still go out on time and the hold timer looks at when a
+   message arrived rather than when it was processed.
+
+   The thread and the main thread talk as the zebra dataplane thread
+   does: a lock free list each way, each with an eventfd, or a pipe,
+   to wake up the other side.  The socket is read in chunks and each
+   whole message copied into one of a small pool of buffers per peer,
+   which the main thread hands back once it has processed it.  With all
+   of them in use the thread stops reading from that peer, and TCP
+   flow control does the rest.  Queued packets go out with writev().
+
+   The thread must not allocate from the memory statistics, log or use
+   the thread master; everything it needs is allocated beforehand by
+   the main thread.  The one exception is its poll set, which comes
+   from the C library.  */
+
+#include <zebra.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <poll.h>
+#endif /* HAVE_PTHREAD */
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif /* HAVE_SYS_EVENTFD_H */
+
+#include "command.h"
+#include "memory.h"
+#include "thread.h"
+#include "log.h"
+#include "network.h"
+#include "stream.h"
+#include "linklist.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_debug.h"
+#include "bgpd/bgp_fsm.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
+
+#ifdef HAVE_PTHREAD
+
+/* Messages read ahead of the main thread, per peer.  */
+#define BGP_IO_MSG_POOL		8
+
+/* Bytes handed to the thread for a peer before bgp_write() holds
+   back, and below which it goes on again.  */
+#define BGP_IO_WRITE_HIGH	(64 * 1024)
+#define BGP_IO_WRITE_LOW	(16 * 1024)
+
+/* Results handled per run of the main thread.  */
+#define BGP_IO_PROCESS_MAX	64
+
+enum bgp_io_kind
+{
+  /* Main thread to I/O thread.  */
+  BGP_IO_ATTACH,
+  BGP_IO_DETACH,
+  BGP_IO_SEND,
+
+  /* I/O thread to main thread.  */
+  BGP_IO_MSG,
+  BGP_IO_SENT,
+  BGP_IO_UNSENT,
+  BGP_IO_ERROR,
+  BGP_IO_CLOSED,
+};
+
+struct bgp_io_item
+{
+  struct bgp_io_item *next;
+
+  enum bgp_io_kind kind;
+  struct bgp_io_peer *pio;
+
+  /* A packet to write, or a message read.  S is only set for packets
+     from the main thread, which allocated the item as well.  */
+  struct stream *s;
+  u_char *buf;
+  size_t len;
+
+  /* BGP_IO_UNSENT: bytes written already.  */
+  size_t off;
+
+  /* BGP_IO_ERROR: header error subcode, BGP_IO_CLOSED: errno, or zero
+     when the peer closed the connection.  */
+  int err;
+};
+
+/* Kept by the I/O thread, added to the peer's by the main thread.  */
+struct bgp_io_counts
+{
+  unsigned long keepalive_out;
+  unsigned long read_calls;
+  unsigned long read_msgs;
+  unsigned long write_calls;
+  unsigned long write_msgs;
+};
+
+struct bgp_io_peer
+{
+  struct peer *peer;
+  int fd;
+  time_t v_keepalive;
+
+  /* The I/O thread's, from attaching until it acknowledges the
+     detach.  */
+  struct bgp_io_peer *next;
+  struct bgp_io_item *out_head;
+  struct bgp_io_item *out_tail;
+  size_t out_off;
+  int out_blocked;
+  struct bgp_io_item *spare;
+  size_t rstart;
+  size_t rend;
+  time_t next_keepalive;
+  int keepalive_queued;
+  int failed;
+  int pollidx;
+
+  /* Shared.  */
+  struct bgp_io_item *volatile free;
+  volatile time_t last_read;
+  volatile int stalled;
+  volatile struct bgp_io_counts counts;
+  int detached;			/* Under bgp_io.mtx.  */
+
+  /* Main thread only.  */
+  struct bgp_io_counts seen;
+  size_t queued;
+  int blocked;
+
+  struct bgp_io_item attach;
+  struct bgp_io_item detach;
+  struct bgp_io_item error;
+  struct bgp_io_item closed;
+  struct bgp_io_item keepalive;
+  struct bgp_io_item msgs[BGP_IO_MSG_POOL];
+  u_char msgbuf[BGP_IO_MSG_POOL][BGP_MAX_PACKET_SIZE];
+  u_char rbuf[BGP_READ_BUF_SIZE];
+};
+
+struct bgp_io_event
+{
+  int rfd;
+  int wfd;
+};
+
+static struct
+{
+  /* Configured, the thread runs.  */
+  int enabled;
+
+  pthread_t thread;
+  volatile int stop;
+
+  /* Main thread to I/O thread, and back.  */
+  struct bgp_io_item *volatile in;
+  struct bgp_io_item *volatile out;
+  struct bgp_io_event wake;
+  struct bgp_io_event done;
+  struct thread *t_read;
+  struct thread *t_process;
+
+  /* Detaching a peer waits here for the thread to let go.  */
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+
+  /* Main thread: peers handed over, and results not handled yet.  */
+  struct list *peers;
+  struct bgp_io_item *pending;
+  struct bgp_io_item *pending_tail;
+
+  /* I/O thread: peers it serves, and the poll set for them.  */
+  struct bgp_io_peer *attached;
+  int nattached;
+  struct pollfd *pfds;
+  int pfds_size;
+
+  /* Statistics, the last one kept by the I/O thread.  */
+  unsigned long msgs_in;
+  unsigned long msgs_out;
+  unsigned long pending_max;
+  volatile unsigned long stalls;
+} bgp_io;
+
+static u_char bgp_io_keepalive_msg[BGP_HEADER_SIZE] =
+{
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0, BGP_HEADER_SIZE, BGP_MSG_KEEPALIVE
+};
+
+static time_t
+bgp_io_now (void)
+{
+#ifdef HAVE_CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+#else
+  return time (NULL);
+#endif /* HAVE_CLOCK_MONOTONIC */
+}
+
+static int
+bgp_io_event_open (struct bgp_io_event *ev)
+{
+#ifdef HAVE_EVENTFD
+  ev->rfd = ev->wfd = eventfd (0, 0);
+  if (ev->rfd < 0)
+    return -1;
+#else
+  int fds[2];
+
+  if (pipe (fds) < 0)
+    return -1;
+  ev->rfd = fds[0];
+  ev->wfd = fds[1];
+#endif /* HAVE_EVENTFD */
+  set_nonblocking (ev->rfd);
+  return 0;
+}
+
+static void
+bgp_io_event_close (struct bgp_io_event *ev)
+{
+  close (ev->rfd);
+  if (ev->wfd != ev->rfd)
+    close (ev->wfd);
+  ev->rfd = ev->wfd = -1;
+}
+
+static void
+bgp_io_event_post (struct bgp_io_event *ev)
+{
+  u_int64_t one = 1;
+
+  while (write (ev->wfd, &one, sizeof one) < 0 && errno == EINTR)
+    ;
+}
+
+static void
+bgp_io_event_clear (struct bgp_io_event *ev)
+{
+  u_int64_t buf[8];
+
+  while (read (ev->rfd, buf, sizeof buf) < 0 && errno == EINTR)
+    ;
+}
+
+/* Returns true if the list was empty, only then the consumer needs
+   waking up.  */
+static int
+bgp_io_push (struct bgp_io_item *volatile *head, struct bgp_io_item *item)
+{
+  struct bgp_io_item *old;
+
+  do
+    {
+      old = *head;
+      item->next = old;
+    }
+  while (! __sync_bool_compare_and_swap (head, old, item));
+
+  return old == NULL;
+}
+
+/* Take everything queued on HEAD, oldest first.  */
+static struct bgp_io_item *
+bgp_io_take (struct bgp_io_item *volatile *head)
+{
+  struct bgp_io_item *list;
+  struct bgp_io_item *fifo = NULL;
+  struct bgp_io_item *next;
+
+  do
+    list = *head;
+  while (list && ! __sync_bool_compare_and_swap (head, list, NULL));
+
+  for (; list; list = next)
+    {
+      next = list->next;
+      list->next = fifo;
+      fifo = list;
+    }
+  return fifo;
+}
+
+/* I/O thread.  */
+
+static void
+bgp_io_post (struct bgp_io_item *item)
+{
+  if (bgp_io_push (&bgp_io.out, item))
+    bgp_io_event_post (&bgp_io.done);
+}
+
+/* The session is done for, the main thread detaches the peer once it
+   has dealt with ITEM.  */
+static void
+bgp_io_fail (struct bgp_io_peer *pio, struct bgp_io_item *item, int err)
+{
+  pio->failed = 1;
+  item->err = err;
+  bgp_io_post (item);
+}
+
+static void
+bgp_io_queue (struct bgp_io_peer *pio, struct bgp_io_item *item)
+{
+  item->next = NULL;
+  if (pio->out_tail)
+    pio->out_tail->next = item;
+  else
+    pio->out_head = item;
+  pio->out_tail = item;
+}
+
+static void
+bgp_io_write (struct bgp_io_peer *pio)
+{
+  struct iovec iov[BGP_WRITE_IOV_MAX];
+  struct bgp_io_item *item;
+  size_t total;
+  size_t len;
+  ssize_t num;
+  int iovcnt;
+  int full;
+
+  while (pio->out_head && ! pio->failed)
+    {
+      iovcnt = 0;
+      total = 0;
+      for (item = pio->out_head; item && iovcnt < BGP_WRITE_IOV_MAX;
+	   item = item->next)
+	{
+	  len = item->len;
+	  iov[iovcnt].iov_base = item->buf;
+	  if (item == pio->out_head)
+	    {
+	      iov[iovcnt].iov_base = item->buf + pio->out_off;
+	      len -= pio->out_off;
+	    }
+	  iov[iovcnt].iov_len = len;
+	  total += len;
+	  iovcnt++;
+	}
+
+      num = writev (pio->fd, iov, iovcnt);
+      if (num < 0)
+	{
+	  if (ERRNO_IO_RETRY (errno))
+	    pio->out_blocked = 1;
+	  else
+	    bgp_io_fail (pio, &pio->closed, errno);
+	  return;
+	}
+      pio->counts.write_calls++;
+      full = ((size_t) num < total);
+
+      while (num > 0)
+	{
+	  item = pio->out_head;
+	  len = item->len - pio->out_off;
+	  if ((size_t) num < len)
+	    {
+	      pio->out_off += num;
+	      break;
+	    }
+	  num -= len;
+
+	  pio->out_off = 0;
+	  pio->out_head = item->next;
+	  if (! pio->out_head)
+	    pio->out_tail = NULL;
+	  pio->counts.write_msgs++;
+
+	  if (item == &pio->keepalive)
+	    {
+	      pio->keepalive_queued = 0;
+	      pio->counts.keepalive_out++;
+	    }
+	  else
+	    {
+	      item->kind = BGP_IO_SENT;
+	      bgp_io_post (item);
+	    }
+	}
+
+      /* The socket is full.  */
+      if (full)
+	{
+	  pio->out_blocked = 1;
+	  return;
+	}
+    }
+}
+
+static struct bgp_io_item *
+bgp_io_spare (struct bgp_io_peer *pio)
+{
+  struct bgp_io_item *item;
+
+  if (! pio->spare)
+    pio->spare = bgp_io_take (&pio->free);
+
+  item = pio->spare;
+  if (item)
+    pio->spare = item->next;
+  return item;
+}
+
+/* Hand out the whole messages read so far.  Returns zero if that has
+   to wait for buffers, or the session failed.  */
+static int
+bgp_io_deliver (struct bgp_io_peer *pio, time_t now)
+{
+  struct bgp_io_item *item;
+  u_char *pnt;
+  size_t avail;
+  bgp_size_t size;
+  int ret;
+
+  while ((avail = pio->rend - pio->rstart) >= BGP_HEADER_SIZE)
+    {
+      pnt = pio->rbuf + pio->rstart;
+      ret = bgp_packet_check_header (pnt, &size);
+      if (ret)
+	{
+	  pio->error.buf = pnt;
+	  bgp_io_fail (pio, &pio->error, ret);
+	  return 0;
+	}
+      if (avail < size)
+	break;
+
+      item = bgp_io_spare (pio);
+      if (! item)
+	{
+	  /* Every buffer waits for the main thread, it is not the peer
+	     that is slow.  */
+	  if (! pio->stalled)
+	    {
+	      pio->stalled = 1;
+	      bgp_io.stalls++;
+	    }
+	  return 0;
+	}
+      pio->stalled = 0;
+
+      memcpy (item->buf, pnt, size);
+      item->kind = BGP_IO_MSG;
+      item->len = size;
+      pio->rstart += size;
+      pio->last_read = now;
+      pio->counts.read_msgs++;
+      bgp_io_post (item);
+    }
+
+  /* Move the start of the next message to the front.  */
+  if (pio->rstart)
+    {
+      memmove (pio->rbuf, pio->rbuf + pio->rstart, avail);
+      pio->rstart = 0;
+      pio->rend = avail;
+    }
+  return 1;
+}
+
+static void
+bgp_io_read (struct bgp_io_peer *pio, time_t now)
+{
+  ssize_t nbytes;
+  size_t room;
+
+  while (! pio->failed && bgp_io_deliver (pio, now))
+    {
+      room = sizeof (pio->rbuf) - pio->rend;
+      nbytes = read (pio->fd, pio->rbuf + pio->rend, room);
+      if (nbytes < 0)
+	{
+	  if (! ERRNO_IO_RETRY (errno))
+	    bgp_io_fail (pio, &pio->closed, errno);
+	  return;
+	}
+      if (nbytes == 0)
+	{
+	  bgp_io_fail (pio, &pio->closed, 0);
+	  return;
+	}
+      pio->rend += nbytes;
+      pio->counts.read_calls++;
+
+      /* The socket is drained, hand out what came.  */
+      if ((size_t) nbytes < room)
+	{
+	  bgp_io_deliver (pio, now);
+	  return;
+	}
+    }
+}
+
+/* Give the peer back to the main thread, with whatever was not
+   written yet.  */
+static void
+bgp_io_release (struct bgp_io_peer *pio)
+{
+  struct bgp_io_peer **pp;
+  struct bgp_io_item *item;
+  struct bgp_io_item *next;
+
+  for (pp = &bgp_io.attached; *pp; pp = &(*pp)->next)
+    if (*pp == pio)
+      {
+	*pp = pio->next;
+	bgp_io.nattached--;
+	break;
+      }
+
+  for (item = pio->out_head; item; item = next)
+    {
+      next = item->next;
+      item->kind = BGP_IO_UNSENT;
+      item->off = (item == pio->out_head) ? pio->out_off : 0;
+      bgp_io_post (item);
+    }
+  pio->out_head = pio->out_tail = NULL;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  pio->detached = 1;
+  pthread_cond_broadcast (&bgp_io.cond);
+  pthread_mutex_unlock (&bgp_io.mtx);
+}
+
+static void
+bgp_io_commands (time_t now)
+{
+  struct bgp_io_item *item;
+  struct bgp_io_item *next;
+  struct bgp_io_peer *pio;
+  struct pollfd *pfds;
+  int size;
+
+  for (item = bgp_io_take (&bgp_io.in); item; item = next)
+    {
+      next = item->next;
+      pio = item->pio;
+
+      switch (item->kind)
+	{
+	case BGP_IO_ATTACH:
+	  pio->next = bgp_io.attached;
+	  bgp_io.attached = pio;
+	  bgp_io.nattached++;
+	  pio->next_keepalive = now + pio->v_keepalive;
+
+	  if (bgp_io.nattached + 1 > bgp_io.pfds_size)
+	    {
+	      size = bgp_io.pfds_size ? bgp_io.pfds_size * 2 : 64;
+	      pfds = realloc (bgp_io.pfds, size * sizeof (struct pollfd));
+	      if (pfds)
+		{
+		  bgp_io.pfds = pfds;
+		  bgp_io.pfds_size = size;
+		}
+	      else
+		bgp_io_fail (pio, &pio->closed, ENOMEM);
+	    }
+	  break;
+	case BGP_IO_SEND:
+	  bgp_io_queue (pio, item);
+	  break;
+	case BGP_IO_DETACH:
+	  bgp_io_release (pio);
+	  break;
+	default:
+	  break;
+	}
+    }
+}
+
+static void *
+bgp_io_thread (void *arg)
+{
+  struct bgp_io_peer *pio;
+  struct pollfd *pfd;
+  time_t now;
+  int timeout;
+  int n;
+
+  while (! bgp_io.stop)
+    {
+      now = bgp_io_now ();
+      bgp_io_commands (now);
+
+      pfd = &bgp_io.pfds[0];
+      pfd->fd = bgp_io.wake.rfd;
+      pfd->events = POLLIN;
+      pfd->revents = 0;
+      n = 1;
+      timeout = -1;
+
+      for (pio = bgp_io.attached; pio; pio = pio->next)
+	{
+	  pio->pollidx = -1;
+	  if (pio->failed || n >= bgp_io.pfds_size)
+	    continue;
+
+	  if (pio->v_keepalive)
+	    {
+	      if (now >= pio->next_keepalive)
+		{
+		  if (! pio->keepalive_queued)
+		    {
+		      pio->keepalive_queued = 1;
+		      bgp_io_queue (pio, &pio->keepalive);
+		    }
+		  pio->next_keepalive = now + pio->v_keepalive;
+		}
+	      if (timeout < 0 || (pio->next_keepalive - now) * 1000 < timeout)
+		timeout = (pio->next_keepalive - now) * 1000;
+	    }
+
+	  /* Don't wait for poll() to write what just came in, or to hand
+	     out what is read already once buffers are back.  */
+	  if (pio->out_head && ! pio->out_blocked)
+	    bgp_io_write (pio);
+	  if (pio->stalled && pio->free)
+	    bgp_io_deliver (pio, now);
+	  if (pio->failed)
+	    continue;
+
+	  pfd = &bgp_io.pfds[n];
+	  pfd->fd = pio->fd;
+	  pfd->events = 0;
+	  pfd->revents = 0;
+	  if (! pio->stalled)
+	    pfd->events |= POLLIN;
+	  if (pio->out_head)
+	    pfd->events |= POLLOUT;
+	  if (pfd->events)
+	    pio->pollidx = n++;
+	}
+
+      if (poll (bgp_io.pfds, n, timeout) <= 0)
+	continue;
+
+      if (bgp_io.pfds[0].revents)
+	bgp_io_event_clear (&bgp_io.wake);
+
+      now = bgp_io_now ();
+      for (pio = bgp_io.attached; pio; pio = pio->next)
+	{
+	  if (pio->pollidx < 0)
+	    continue;
+	  pfd = &bgp_io.pfds[pio->pollidx];
+
+	  if (pfd->revents & (POLLOUT | POLLERR | POLLHUP))
+	    {
+	      pio->out_blocked = 0;
+	      bgp_io_write (pio);
+	    }
+	  if (pfd->revents & (POLLIN | POLLERR | POLLHUP))
+	    bgp_io_read (pio, now);
+	}
+    }
+
+  return NULL;
+}
+
+/* Main thread.  */
+
+static void
+bgp_io_command (struct bgp_io_item *item)
+{
+  if (bgp_io_push (&bgp_io.in, item))
+    bgp_io_event_post (&bgp_io.wake);
+}
+
+/* Fold what the thread counted into the peer.  */
+static void
+bgp_io_fold (struct bgp_io_peer *pio)
+{
+  struct peer *peer = pio->peer;
+  struct bgp_io_counts now;
+
+  now = pio->counts;
+  peer->keepalive_out += now.keepalive_out - pio->seen.keepalive_out;
+  peer->read_calls += now.read_calls - pio->seen.read_calls;
+  peer->read_msgs += now.read_msgs - pio->seen.read_msgs;
+  peer->write_calls += now.write_calls - pio->seen.write_calls;
+  peer->write_msgs += now.write_msgs - pio->seen.write_msgs;
+  pio->seen = now;
+}
+
+/* Move the thread's results behind those not handled yet.  */
+static void
+bgp_io_collect (void)
+{
+  struct bgp_io_item *item;
+  unsigned long count = 0;
+
+  item = bgp_io_take (&bgp_io.out);
+  if (! item)
+    return;
+
+  if (bgp_io.pending_tail)
+    bgp_io.pending_tail->next = item;
+  else
+    bgp_io.pending = item;
+
+  for (; item->next; item = item->next)
+    ;
+  bgp_io.pending_tail = item;
+
+  for (item = bgp_io.pending; item; item = item->next)
+    count++;
+  if (count > bgp_io.pending_max)
+    bgp_io.pending_max = count;
+}
+
+static void
+bgp_io_sent (struct bgp_io_item *item)
+{
+  struct bgp_io_peer *pio = item->pio;
+  struct peer *peer = pio->peer;
+
+  pio->queued -= item->len;
+  stream_free (item->s);
+  XFREE (MTYPE_BGP_IO_ITEM, item);
+
+  if (pio->blocked && pio->queued < BGP_IO_WRITE_LOW && peer->io == pio)
+    {
+      pio->blocked = 0;
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+    }
+}
+
+static void
+bgp_io_result (struct bgp_io_item *item)
+{
+  struct bgp_io_peer *pio = item->pio;
+  struct peer *peer = pio->peer;
+  u_char type;
+
+  switch (item->kind)
+    {
+    case BGP_IO_MSG:
+      bgp_io.msgs_in++;
+
+      stream_reset (peer->ibuf);
+      stream_put (peer->ibuf, item->buf, item->len);
+      stream_set_getp (peer->ibuf, BGP_HEADER_SIZE);
+      peer->packet_size = item->len;
+
+      type = item->buf[BGP_MARKER_SIZE + 2];
+      if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
+	zlog_debug ("%s rcv message type %d, length (excl. header) %d",
+		   peer->host, type, (int) (item->len - BGP_HEADER_SIZE));
+
+      /* The buffer is free again, processing may well detach the
+	 peer.  */
+      if (peer->io == pio && bgp_io_push (&pio->free, item))
+	bgp_io_event_post (&bgp_io.wake);
+
+      peer_lock (peer);
+      bgp_packet_process (peer);
+      peer_unlock (peer);
+      break;
+    case BGP_IO_SENT:
+      bgp_io_sent (item);
+      break;
+    case BGP_IO_ERROR:
+      bgp_packet_header_error (peer, item->buf, item->err);
+      break;
+    case BGP_IO_CLOSED:
+      bgp_packet_read_error (peer, item->err);
+      break;
+    default:
+      break;
+    }
+}
+
+static int
+bgp_io_process (struct thread *thread)
+{
+  struct bgp_io_item *item;
+  int count = 0;
+
+  bgp_io.t_process = NULL;
+
+  while (count++ < BGP_IO_PROCESS_MAX && (item = bgp_io.pending) != NULL)
+    {
+      bgp_io.pending = item->next;
+      if (! bgp_io.pending)
+	bgp_io.pending_tail = NULL;
+      bgp_io_result (item);
+    }
+
+  /* Let everything else have a go before the rest.  */
+  if (bgp_io.pending && ! bgp_io.t_process)
+    bgp_io.t_process = thread_add_background (master, bgp_io_process,
+					      NULL, 0);
+  return 0;
+}
+
+static int
+bgp_io_read_done (struct thread *thread)
+{
+  bgp_io.t_read = NULL;
+
+  bgp_io_event_clear (&bgp_io.done);
+  bgp_io_collect ();
+  if (! bgp_io.t_process)
+    bgp_io_process (NULL);
+
+  bgp_io.t_read = thread_add_read (master, bgp_io_read_done, NULL,
+				   bgp_io.done.rfd);
+  return 0;
+}
+
+/* Put the packets the thread did not write back in front of the
+   peer's output queue.  */
+static void
+bgp_io_requeue (struct peer *peer, struct bgp_io_item *list)
+{
+  struct stream_fifo *fifo;
+  struct bgp_io_item *item;
+  struct stream *s;
+
+  fifo = stream_fifo_new ();
+  for (item = list; item; item = item->next)
+    {
+      if (item->s)
+	{
+	  s = item->s;
+	  item->s = NULL;
+	}
+      else if (item->off)
+	{
+	  /* A keepalive half way out has to be finished.  */
+	  s = stream_new (BGP_HEADER_SIZE);
+	  stream_put (s, item->buf, item->len);
+	}
+      else
+	continue;
+
+      stream_forward_getp (s, item->off);
+      stream_fifo_push (fifo, s);
+    }
+
+  while ((s = stream_fifo_pop (peer->obuf)) != NULL)
+    stream_fifo_push (fifo, s);
+  while ((s = stream_fifo_pop (fifo)) != NULL)
+    stream_fifo_push (peer->obuf, s);
+  stream_fifo_free (fifo);
+}
+
+/* Take the peer back from the thread.  With KEEP the session goes on
+   in the main thread: messages read already are processed and what was
+   not written yet goes back on the output queue.  Otherwise the
+   session is going down, and all that is dropped.  */
+static void
+bgp_io_detach (struct bgp_io_peer *pio, int keep)
+{
+  struct peer *peer = pio->peer;
+  struct bgp_io_item *mine = NULL;
+  struct bgp_io_item **tail = &mine;
+  struct bgp_io_item *unsent = NULL;
+  struct bgp_io_item **utail = &unsent;
+  struct bgp_io_item **ip;
+  struct bgp_io_item *item;
+  struct bgp_io_item *next;
+
+  peer->io = NULL;
+  BGP_WRITE_OFF (peer->t_write);
+
+  bgp_io_command (&pio->detach);
+  pthread_mutex_lock (&bgp_io.mtx);
+  while (! pio->detached)
+    pthread_cond_wait (&bgp_io.cond, &bgp_io.mtx);
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  bgp_io_fold (pio);
+
+  /* All the thread had for the peer is among the results now, pick it
+     out.  */
+  bgp_io_collect ();
+  bgp_io.pending_tail = NULL;
+  for (ip = &bgp_io.pending; (item = *ip) != NULL; )
+    {
+      if (item->pio != pio)
+	{
+	  bgp_io.pending_tail = item;
+	  ip = &item->next;
+	  continue;
+	}
+      *ip = item->next;
+      item->next = NULL;
+      if (item->kind == BGP_IO_UNSENT)
+	{
+	  *utail = item;
+	  utail = &item->next;
+	}
+      else
+	{
+	  *tail = item;
+	  tail = &item->next;
+	}
+    }
+
+  if (keep)
+    bgp_io_requeue (peer, unsent);
+  for (item = unsent; item; item = next)
+    {
+      next = item->next;
+      if (item->s)
+	{
+	  stream_free (item->s);
+	  item->s = NULL;
+	}
+      if (item != &pio->keepalive)
+	XFREE (MTYPE_BGP_IO_ITEM, item);
+    }
+
+  for (item = mine; item; item = next)
+    {
+      next = item->next;
+      if (item->kind == BGP_IO_SENT)
+	bgp_io_sent (item);
+      else if (keep && peer->status == Established)
+	bgp_io_result (item);
+    }
+
+  if (keep && peer->status == Established)
+    {
+      /* Read and not handed out yet.  */
+      if (pio->rend > pio->rstart && ! pio->failed)
+	{
+	  stream_put (peer->rbuf, pio->rbuf + pio->rstart,
+		      pio->rend - pio->rstart);
+	  bgp_read_buffered (peer);
+	}
+
+      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      bgp_timer_set (peer);
+    }
+
+  listnode_delete (bgp_io.peers, pio);
+  XFREE (MTYPE_BGP_IO_PEER, pio);
+  peer_unlock (peer);
+}
+
+void
+bgp_io_peer_start (struct peer *peer)
+{
+  struct bgp_io_peer *pio;
+  struct bgp_io_item *item;
+  size_t len;
+  int i;
+
+  if (! bgp_io.enabled || peer->io || peer->fd < 0
+      || peer->status != Established)
+    return;
+
+  pio = XCALLOC (MTYPE_BGP_IO_PEER, sizeof (struct bgp_io_peer));
+  pio->peer = peer_lock (peer);
+  pio->fd = peer->fd;
+  pio->v_keepalive = peer->v_holdtime ? peer->v_keepalive : 0;
+  pio->last_read = bgp_io_now ();
+
+  pio->attach.kind = BGP_IO_ATTACH;
+  pio->detach.kind = BGP_IO_DETACH;
+  pio->error.kind = BGP_IO_ERROR;
+  pio->closed.kind = BGP_IO_CLOSED;
+  pio->keepalive.kind = BGP_IO_SEND;
+  pio->keepalive.buf = bgp_io_keepalive_msg;
+  pio->keepalive.len = BGP_HEADER_SIZE;
+  pio->attach.pio = pio->detach.pio = pio->error.pio = pio;
+  pio->closed.pio = pio->keepalive.pio = pio;
+
+  for (i = 0; i < BGP_IO_MSG_POOL; i++)
+    {
+      item = &pio->msgs[i];
+      item->pio = pio;
+      item->buf = pio->msgbuf[i];
+      item->next = pio->spare;
+      pio->spare = item;
+    }
+
+  /* The start of the next message may be in already.  */
+  len = STREAM_READABLE (peer->rbuf);
+  if (len)
+    {
+      memcpy (pio->rbuf, STREAM_PNT (peer->rbuf), len);
+      pio->rend = len;
+      stream_reset (peer->rbuf);
+    }
+
+  BGP_READ_OFF (peer->t_read);
+  BGP_WRITE_OFF (peer->t_write);
+  BGP_TIMER_OFF (peer->t_keepalive);
+  set_nonblocking (peer->fd);
+
+  peer->io = pio;
+  listnode_add (bgp_io.peers, pio);
+  bgp_io_command (&pio->attach);
+
+  BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+}
+
+void
+bgp_io_peer_stop (struct peer *peer)
+{
+  if (peer->io)
+    bgp_io_detach (peer->io, 0);
+}
+
+void
+bgp_io_send (struct peer *peer, struct stream *s)
+{
+  struct bgp_io_peer *pio = peer->io;
+  struct bgp_io_item *item;
+
+  item = XCALLOC (MTYPE_BGP_IO_ITEM, sizeof (struct bgp_io_item));
+  item->kind = BGP_IO_SEND;
+  item->pio = pio;
+  item->s = s;
+  item->buf = STREAM_PNT (s);
+  item->len = stream_get_endp (s) - stream_get_getp (s);
+
+  pio->queued += item->len;
+  bgp_io.msgs_out++;
+  bgp_io_command (item);
+}
+
+int
+bgp_io_writable (struct peer *peer)
+{
+  struct bgp_io_peer *pio = peer->io;
+
+  if (pio->queued < BGP_IO_WRITE_HIGH)
+    return 1;
+
+  pio->blocked = 1;
+  return 0;
+}
+
+time_t
+bgp_io_read_age (struct peer *peer)
+{
+  struct bgp_io_peer *pio = peer->io;
+
+  if (pio->stalled)
+    return 0;
+  return bgp_io_now () - pio->last_read;
+}
+
+void
+bgp_io_peer_stats (struct peer *peer)
+{
+  if (peer->io)
+    bgp_io_fold (peer->io);
+}
+
+static int
+bgp_io_start (void)
+{
+  sigset_t all, old;
+  int ret;
+
+  if (bgp_io_event_open (&bgp_io.wake) < 0)
+    return -1;
+  if (bgp_io_event_open (&bgp_io.done) < 0)
+    {
+      bgp_io_event_close (&bgp_io.wake);
+      return -1;
+    }
+
+  bgp_io.pfds_size = 64;
+  bgp_io.pfds = calloc (bgp_io.pfds_size, sizeof (struct pollfd));
+  if (! bgp_io.pfds)
+    {
+      bgp_io_event_close (&bgp_io.wake);
+      bgp_io_event_close (&bgp_io.done);
+      return -1;
+    }
+  bgp_io.stop = 0;
+  bgp_io.enabled = 1;
+
+  /* Signals are for the main thread.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  ret = pthread_create (&bgp_io.thread, NULL, bgp_io_thread, NULL);
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  if (ret != 0)
+    {
+      zlog_err ("Can't start BGP I/O thread: %s", safe_strerror (ret));
+      bgp_io.enabled = 0;
+      free (bgp_io.pfds);
+      bgp_io.pfds = NULL;
+      bgp_io.pfds_size = 0;
+      bgp_io_event_close (&bgp_io.wake);
+      bgp_io_event_close (&bgp_io.done);
+      return -1;
+    }
+
+  bgp_io.t_read = thread_add_read (master, bgp_io_read_done, NULL,
+				   bgp_io.done.rfd);
+  return 0;
+}
+
+/* Take all peers back and stop the thread.  With KEEP the sessions
+   carry on in the main thread.  */
+static void
+bgp_io_stop (int keep)
+{
+  struct bgp_io_peer *pio;
+
+  if (! bgp_io.enabled)
+    return;
+
+  while (bgp_io.peers->head)
+    {
+      pio = listgetdata (bgp_io.peers->head);
+      bgp_io_detach (pio, keep);
+    }
+
+  bgp_io.stop = 1;
+  bgp_io_event_post (&bgp_io.wake);
+  pthread_join (bgp_io.thread, NULL);
+  bgp_io.enabled = 0;
+
+  THREAD_OFF (bgp_io.t_read);
+  THREAD_OFF (bgp_io.t_process);
+
+  free (bgp_io.pfds);
+  bgp_io.pfds = NULL;
+  bgp_io.pfds_size = 0;
+
+  bgp_io_event_close (&bgp_io.wake);
+  bgp_io_event_close (&bgp_io.done);
+}
+
+void
+bgp_io_finish (void)
+{
+  bgp_io_stop (0);
+}
+
+DEFUN (bgp_io_thread_on,
+       bgp_io_thread_cmd,
+       "bgp io-thread",
+       BGP_STR
+       "Handle the sockets of established sessions in a separate thread\n")
+{
+  struct listnode *mnode, *node;
+  struct bgp *bgp;
+  struct peer *peer;
+
+  if (bgp_io.enabled)
+    return CMD_SUCCESS;
+
+  if (bgp_io_start () < 0)
+    {
+      vty_out (vty, "Can't start the BGP I/O thread%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, mnode, bgp))
+    for (ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
+      bgp_io_peer_start (peer);
+
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_bgp_io_thread,
+       no_bgp_io_thread_cmd,
+       "no bgp io-thread",
+       NO_STR
+       BGP_STR
+       "Handle the sockets of established sessions in a separate thread\n")
+{
+  bgp_io_stop (1);
+  return CMD_SUCCESS;
+}
+
+DEFUN (show_ip_bgp_io_thread,
+       show_ip_bgp_io_thread_cmd,
+       "show ip bgp io-thread",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "BGP I/O thread\n")
+{
+  struct listnode *node;
+  struct bgp_io_peer *pio;
+
+  vty_out (vty, "BGP I/O thread is %s%s",
+	   bgp_io.enabled ? "running" : "not running", VTY_NEWLINE);
+  if (! bgp_io.enabled)
+    return CMD_SUCCESS;
+
+  vty_out (vty, "Peers %d, messages read %lu, packets written %lu%s",
+	   listcount (bgp_io.peers), bgp_io.msgs_in, bgp_io.msgs_out,
+	   VTY_NEWLINE);
+  vty_out (vty, "Results waiting at most %lu, reads held back %lu%s",
+	   bgp_io.pending_max, bgp_io.stalls, VTY_NEWLINE);
+
+  vty_out (vty, "%s%-25s %10s %8s%s", VTY_NEWLINE,
+	   "Neighbor", "Queued", "Read", VTY_NEWLINE);
+  for (ALL_LIST_ELEMENTS_RO (bgp_io.peers, node, pio))
+    vty_out (vty, "%-25s %10lu %8s%s", pio->peer->host,
+	     (unsigned long) pio->queued,
+	     pio->stalled ? "held" : "ok", VTY_NEWLINE);
+
+  return CMD_SUCCESS;
+}
+
+int
+bgp_io_config_write (struct vty *vty)
+{
+  if (! bgp_io.enabled)
+    return 0;
+
+  vty_out (vty, "bgp io-thread%s", VTY_NEWLINE);
+  return 1;
+}
+
+void
+bgp_io_init (void)
+{
+  bgp_io.wake.rfd = bgp_io.wake.wfd = -1;
+  bgp_io.done.rfd = bgp_io.done.wfd = -1;
+  bgp_io.peers = list_new ();
+  pthread_mutex_init (&bgp_io.mtx, NULL);
+  pthread_cond_init (&bgp_io.cond, NULL);
+
+  install_element (CONFIG_NODE, &bgp_io_thread_cmd);
+  install_element (CONFIG_NODE, &no_bgp_io_thread_cmd);
+  install_element (VIEW_NODE, &show_ip_bgp_io_thread_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_io_thread_cmd);
+}
+
+#else /* ! HAVE_PTHREAD */
+
+void
+bgp_io_peer_start (struct peer *peer)
+{
+}
+
+void
+bgp_io_peer_stop (struct peer *peer)
+{
+}
+
+void
+bgp_io_send (struct peer *peer, struct stream *s)
+{
+}
+
+int
+bgp_io_writable (struct peer *peer)
+{
+  return 1;
+}
+
+time_t
+bgp_io_read_age (struct peer *peer)
+{
+  return 0;
+}
+
+void
+bgp_io_peer_stats (struct peer *peer)
+{
+}
+
+void
+bgp_io_finish (void)
+{
+}
+
+int
+bgp_io_config_write (struct vty *vty)
+{
+  return 0;
+}
+
+void
+bgp_io_init (void)
+{
+}
+
+#endif /* HAVE_PTHREAD */
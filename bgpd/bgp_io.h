@@ -0,0 +1,52 @@
+/*
+ * BGP I/O thread.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_IO_H
+#define _QUAGGA_BGP_IO_H
+
+#include "stream.h"
+#include "vty.h"
+
+/* Hand the socket of an Established peer over to the I/O thread, if
+   it runs, and take it back.  Stopping a peer the thread does not
+   own does nothing.  */
+extern void bgp_io_peer_start (struct peer *);
+extern void bgp_io_peer_stop (struct peer *);
+
+/* Queue packet S for a peer the I/O thread owns.  */
+extern void bgp_io_send (struct peer *, struct stream *);
+
+/* May more packets be queued for the peer?  If not, bgp_write() is
+   scheduled again once the I/O thread catches up.  */
+extern int bgp_io_writable (struct peer *);
+
+/* Seconds since the I/O thread last received a message from the
+   peer.  */
+extern time_t bgp_io_read_age (struct peer *);
+
+/* Bring the peer's counters up to date with the I/O thread's.  */
+extern void bgp_io_peer_stats (struct peer *);
+
+extern void bgp_io_finish (void);
+extern int bgp_io_config_write (struct vty *);
+extern void bgp_io_init (void);
+
+#endif /* _QUAGGA_BGP_IO_H */
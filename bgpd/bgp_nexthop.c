@@ -58,16 +58,20 @@ static int bgp_scan_interval;
 /* BGP import interval. */
 static int bgp_import_interval;
 
+/* Re-check of directly connected EBGP routes after connected change. */
+static struct thread *bgp_connected_thread = NULL;
+
 /* Route table for next-hop lookup cache. */
 static struct bgp_table *bgp_nexthop_cache_table[AFI_MAX];
-static struct bgp_table *cache1_table[AFI_MAX];
-static struct bgp_table *cache2_table[AFI_MAX];
 
 /* Route table for connected route. */
 static struct bgp_table *bgp_connected_table[AFI_MAX];
 
 /* BGP nexthop lookup query client. */
 struct zclient *zlookup = NULL;
+
+/* Nexthop tracking goes over the main zebra client. */
+extern struct zclient *zclient;
 
 /* Add nexthop to the end of the list.  */
 static void
@@ -211,180 +215,306 @@ bgp_nexthop_onlink (afi_t afi, struct attr *attr)
 }
 
 static void
-bnct_init (const afi_t afi)
+bgp_nexthop_register (int command, struct bgp_node *rn)
 {
-  cache1_table[afi] = bgp_nexthop_cache_table[afi] = bgp_table_init (afi, SAFI_UNICAST);
-  cache2_table[afi] = bgp_table_init (afi, SAFI_UNICAST);
-}
+  if (! zclient || zclient->sock < 0)
+    return;
 
-static struct bgp_table *
-bnct_active (const afi_t afi)
-{
-  return bgp_nexthop_cache_table[afi];
+  zebra_nexthop_register_send (command, zclient, &rn->p);
 }
 
-static struct bgp_table *
-bnct_inactive (const afi_t afi)
+/* Find or create the cache entry for nexthop P.  A new entry is
+   resolved right away and registered with zebra, which keeps it up to
+   date from then on.  */
+static struct bgp_nexthop_cache *
+bgp_nexthop_get (afi_t afi, struct prefix *p)
 {
-  return bgp_nexthop_cache_table[afi] == cache1_table[afi] ? cache2_table[afi] : cache1_table[afi];
+  struct bgp_node *rn;
+  struct bgp_nexthop_cache *bnc = NULL;
+
+  rn = bgp_node_get (bgp_nexthop_cache_table[afi], p);
+  if (rn->info)
+    {
+      bgp_unlock_node (rn);
+      return rn->info;
+    }
+
+  if (afi == AFI_IP)
+    bnc = zlookup_query (p->u.prefix4);
+#ifdef HAVE_IPV6
+  else if (afi == AFI_IP6)
+    bnc = zlookup_query_ipv6 (&p->u.prefix6);
+#endif /* HAVE_IPV6 */
+  if (bnc == NULL)
+    bnc = bnc_new ();
+
+  bnc->node = rn;
+  rn->info = bnc;
+  bgp_nexthop_register (ZEBRA_NEXTHOP_REGISTER, rn);
+
+  return bnc;
 }
 
+/* Make RI one of the routes depending on BNC.  */
 static void
-bnct_swap (const afi_t afi)
+bgp_nexthop_link (struct bgp_nexthop_cache *bnc, struct bgp_info *ri)
 {
-  bgp_nexthop_cache_table[afi] = bnct_inactive (afi);
+  if (ri->nexthop == bnc)
+    return;
+
+  bgp_nexthop_unlink (ri);
+
+  ri->nexthop = bnc;
+  ri->nh_prev = NULL;
+  ri->nh_next = bnc->paths;
+  if (bnc->paths)
+    bnc->paths->nh_prev = ri;
+  bnc->paths = ri;
 }
 
-static void
-bnct_finish (const afi_t afi)
+/* RI no longer resolves through its nexthop.  The last route going
+   drops the cache entry and tells zebra to stop tracking it.  */
+void
+bgp_nexthop_unlink (struct bgp_info *ri)
 {
-  bgp_table_unlock (cache1_table[afi]);
-  bgp_table_unlock (cache2_table[afi]);
-  cache1_table[afi] = cache2_table[afi] = NULL;
+  struct bgp_nexthop_cache *bnc;
+  struct bgp_node *rn;
+
+  if ((bnc = ri->nexthop) == NULL)
+    return;
+
+  if (ri->nh_next)
+    ri->nh_next->nh_prev = ri->nh_prev;
+  if (ri->nh_prev)
+    ri->nh_prev->nh_next = ri->nh_next;
+  else
+    bnc->paths = ri->nh_next;
+  ri->nexthop = NULL;
+  ri->nh_next = ri->nh_prev = NULL;
+
+  if (bnc->paths)
+    return;
+
+  rn = bnc->node;
+  bgp_nexthop_register (ZEBRA_NEXTHOP_UNREGISTER, rn);
+  bnc_free (bnc);
+  rn->info = NULL;
+  bgp_unlock_node (rn);
 }
 
-#ifdef HAVE_IPV6
 /* Check specified next-hop is reachable or not. */
-static int
-bgp_nexthop_lookup_ipv6 (struct peer *peer, struct bgp_info *ri, int *changed,
-			 int *metricchanged)
+int
+bgp_nexthop_lookup (afi_t afi, struct peer *peer, struct bgp_info *ri)
 {
-  struct bgp_node *rn;
   struct prefix p;
   struct bgp_nexthop_cache *bnc;
   struct attr *attr;
 
-  /* Only check IPv6 global address only nexthop. */
   attr = ri->attr;
 
-  if (attr->extra->mp_nexthop_len != 16 
-      || IN6_IS_ADDR_LINKLOCAL (&attr->extra->mp_nexthop_global))
-    return 1;
-
   memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET6;
-  p.prefixlen = IPV6_MAX_BITLEN;
-  p.u.prefix6 = attr->extra->mp_nexthop_global;
-
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bnct_active (AFI_IP6), &p);
-
-  if (rn->info)
+#ifdef HAVE_IPV6
+  if (afi == AFI_IP6)
     {
-      bnc = rn->info;
-      bgp_unlock_node (rn);
+      /* Only check IPv6 global address only nexthop. */
+      if (attr->extra->mp_nexthop_len != 16 
+	  || IN6_IS_ADDR_LINKLOCAL (&attr->extra->mp_nexthop_global))
+	{
+	  bgp_nexthop_unlink (ri);
+	  return 1;
+	}
+
+      p.family = AF_INET6;
+      p.prefixlen = IPV6_MAX_BITLEN;
+      p.u.prefix6 = attr->extra->mp_nexthop_global;
     }
   else
+#endif /* HAVE_IPV6 */
     {
-      if (NULL == (bnc = zlookup_query_ipv6 (&attr->extra->mp_nexthop_global)))
-	bnc = bnc_new ();
-      else
-	{
-	  if (changed)
-	    {
-	      struct bgp_node *oldrn;
-
-	      oldrn = bgp_node_lookup (bnct_inactive (AFI_IP6), &p);
-	      if (oldrn)
-		{
-		  struct bgp_nexthop_cache *oldbnc = oldrn->info;
-
-		  bnc->changed = bgp_nexthop_cache_different (bnc, oldbnc);
-
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
-
-                  bgp_unlock_node (oldrn);
-		}
-	    }
-	}
-      rn->info = bnc;
+      p.family = AF_INET;
+      p.prefixlen = IPV4_MAX_BITLEN;
+      p.u.prefix4 = attr->nexthop;
     }
 
-  if (changed)
-    *changed = bnc->changed;
-
-  if (metricchanged)
-    *metricchanged = bnc->metricchanged;
+  /* IBGP or ebgp-multihop */
+  bnc = bgp_nexthop_get (afi, &p);
+  bgp_nexthop_link (bnc, ri);
 
   if (bnc->valid && bnc->metric)
-    (bgp_info_extra_get (ri))->igpmetric = bnc->metric;
+    (bgp_info_extra_get(ri))->igpmetric = bnc->metric;
   else if (ri->extra)
     ri->extra->igpmetric = 0;
 
   return bnc->valid;
 }
-#endif /* HAVE_IPV6 */
 
-/* Check specified next-hop is reachable or not. */
+/* ZEBRA_NEXTHOP_UPDATE: the IGP route a tracked nexthop resolves
+   through changed.  Only the routes using that nexthop are looked at
+   again.  */
 int
-bgp_nexthop_lookup (afi_t afi, struct peer *peer, struct bgp_info *ri,
-		    int *changed, int *metricchanged)
+bgp_nexthop_update (int command, struct zclient *zclient,
+		    zebra_size_t length)
 {
-  struct bgp_node *rn;
+  struct stream *s;
   struct prefix p;
+  struct bgp_node *rn;
   struct bgp_nexthop_cache *bnc;
-  struct in_addr addr;
+  struct bgp_nexthop_cache *new;
+  struct bgp_info *ri;
+  struct bgp_info *next;
+  struct nexthop *nexthop;
+  struct bgp *bgp;
+  int i;
+  int changed;
+  int valid;
+  int current;
+
+  s = zclient->ibuf;
 
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = stream_getc (s);
+  switch (p.family)
+    {
+    case AF_INET:
+      p.prefixlen = IPV4_MAX_BITLEN;
+      p.u.prefix4.s_addr = stream_get_ipv4 (s);
+      break;
 #ifdef HAVE_IPV6
-  if (afi == AFI_IP6)
-    return bgp_nexthop_lookup_ipv6 (peer, ri, changed, metricchanged);
+    case AF_INET6:
+      p.prefixlen = IPV6_MAX_BITLEN;
+      stream_get (&p.u.prefix6, s, 16);
+      break;
 #endif /* HAVE_IPV6 */
+    default:
+      zlog_warn ("%s: unknown address family %u", __func__, p.family);
+      return -1;
+    }
 
-  addr = ri->attr->nexthop;
+  new = bnc_new ();
+  new->metric = stream_getl (s);
+  new->nexthop_num = stream_getc (s);
+  new->valid = (new->nexthop_num != 0);
+  for (i = 0; i < new->nexthop_num; i++)
+    {
+      nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      nexthop->type = stream_getc (s);
+      switch (nexthop->type)
+	{
+	case ZEBRA_NEXTHOP_IPV4:
+	  nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
+	  break;
+	case ZEBRA_NEXTHOP_IFINDEX:
+	case ZEBRA_NEXTHOP_IFNAME:
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#ifdef HAVE_IPV6
+	case ZEBRA_NEXTHOP_IPV6:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  break;
+	case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#endif /* HAVE_IPV6 */
+	default:
+	  /* do nothing */
+	  break;
+	}
+      bnc_nexthop_add (new, nexthop);
+    }
 
-  memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_BITLEN;
-  p.u.prefix4 = addr;
+  /* Unregistered meanwhile. */
+  rn = bgp_node_lookup (bgp_nexthop_cache_table[family2afi (p.family)], &p);
+  if (! rn)
+    {
+      bnc_free (new);
+      return 0;
+    }
+  bgp_unlock_node (rn);
+  bnc = rn->info;
 
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bnct_active (AFI_IP), &p);
+  changed = (bnc->valid != new->valid
+	     || bgp_nexthop_cache_different (bnc, new));
+  if (! changed && bnc->metric == new->metric)
+    {
+      bnc_free (new);
+      return 0;
+    }
 
-  if (rn->info)
+  if (BGP_DEBUG (nexthop, NEXTHOP))
     {
-      bnc = rn->info;
-      bgp_unlock_node (rn);
+      char buf[INET6_ADDRSTRLEN];
+
+      zlog_debug ("%s: %s %s, metric %u", __func__,
+		  inet_ntop (p.family, &p.u.prefix, buf, INET6_ADDRSTRLEN),
+		  new->valid ? "reachable" : "unreachable", new->metric);
     }
-  else
+
+  bnc_nexthop_free (bnc);
+  bnc->valid = new->valid;
+  bnc->metric = new->metric;
+  bnc->nexthop_num = new->nexthop_num;
+  bnc->nexthop = new->nexthop;
+  new->nexthop = NULL;
+  bnc_free (new);
+
+  for (ri = bnc->paths; ri; ri = next)
     {
-      if (NULL == (bnc = zlookup_query (addr)))
-	bnc = bnc_new ();
-      else
-	{
-	  if (changed)
-	    {
-	      struct bgp_node *oldrn;
+      next = ri->nh_next;
 
-	      oldrn = bgp_node_lookup (bnct_inactive (AFI_IP), &p);
-	      if (oldrn)
-		{
-		  struct bgp_nexthop_cache *oldbnc = oldrn->info;
+      if (ri->net == NULL || CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+	continue;
 
-		  bnc->changed = bgp_nexthop_cache_different (bnc, oldbnc);
+      rn = ri->net;
+      bgp = ri->peer->bgp;
 
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
+      if (bnc->valid && bnc->metric)
+	(bgp_info_extra_get (ri))->igpmetric = bnc->metric;
+      else if (ri->extra)
+	ri->extra->igpmetric = 0;
 
-                  bgp_unlock_node (oldrn);
-		}
+      if (changed)
+	SET_FLAG (ri->flags, BGP_INFO_IGP_CHANGED);
+
+      valid = bnc->valid;
+      current = CHECK_FLAG (ri->flags, BGP_INFO_VALID) ? 1 : 0;
+
+      if (valid != current)
+	{
+	  if (CHECK_FLAG (ri->flags, BGP_INFO_VALID))
+	    {
+	      bgp_aggregate_decrement (bgp, &rn->p, ri,
+				       rn->table->afi, rn->table->safi);
+	      bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
+	    }
+	  else
+	    {
+	      bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+	      bgp_aggregate_increment (bgp, &rn->p, ri,
+				       rn->table->afi, rn->table->safi);
 	    }
 	}
-      rn->info = bnc;
-    }
 
-  if (changed)
-    *changed = bnc->changed;
+      bgp_process (bgp, rn, rn->table->afi, rn->table->safi);
+    }
 
-  if (metricchanged)
-    *metricchanged = bnc->metricchanged;
+  return 0;
+}
 
-  if (bnc->valid && bnc->metric)
-    (bgp_info_extra_get(ri))->igpmetric = bnc->metric;
-  else if (ri->extra)
-    ri->extra->igpmetric = 0;
+/* (Re)connected to zebra, which has forgotten what we track. */
+void
+bgp_nexthop_register_all (struct zclient *zclient)
+{
+  struct bgp_node *rn;
+  afi_t afi;
 
-  return bnc->valid;
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    if (bgp_nexthop_cache_table[afi])
+      for (rn = bgp_table_top (bgp_nexthop_cache_table[afi]); rn;
+	   rn = bgp_route_next (rn))
+	if (rn->info)
+	  bgp_nexthop_register (ZEBRA_NEXTHOP_REGISTER, rn);
 }
 
 /* Reset and free all BGP nexthop cache. */
@@ -393,10 +523,13 @@ bgp_nexthop_cache_reset (struct bgp_table *table)
 {
   struct bgp_node *rn;
   struct bgp_nexthop_cache *bnc;
+  struct bgp_info *ri;
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
     if ((bnc = rn->info) != NULL)
       {
+	for (ri = bnc->paths; ri; ri = ri->nh_next)
+	  ri->nexthop = NULL;
 	bnc_free (bnc);
 	rn->info = NULL;
 	bgp_unlock_node (rn);
@@ -522,23 +655,55 @@ verify_ipv4_rgates (struct bgp_table *nhtable, struct route_table *pfxlist)
   while (recv_verified_desync_prefixes (pfxlist));
 }
 
+/* Routes under P were installed with a stale IGP gateway, have them
+   reinstalled.  */
 static void
-bgp_scan (afi_t afi, safi_t safi)
+bgp_scan_desync (struct bgp *bgp, afi_t afi, struct prefix *p)
 {
+  struct bgp_node *top;
   struct bgp_node *rn;
-  struct bgp *bgp;
   struct bgp_info *bi;
-  struct bgp_info *next;
+  int found;
+
+  if (BGP_DEBUG (nexthop, NEXTHOP))
+    {
+      char buf[INET_ADDRSTRLEN];
+      inet_ntop (AF_INET, &p->u.prefix4, buf, INET_ADDRSTRLEN);
+      zlog_debug ("%s: rgate out of sync for %s/%u", __func__, buf, p->prefixlen);
+    }
+
+  top = bgp_node_get (bgp->rib[afi][SAFI_UNICAST], p);
+  bgp_lock_node (top);
+  for (rn = top; rn; rn = bgp_route_next_until (rn, top))
+    {
+      found = 0;
+      for (bi = rn->info; bi; bi = bi->next)
+	if (bi->type == ZEBRA_ROUTE_BGP && bi->sub_type == BGP_ROUTE_NORMAL)
+	  {
+	    /* Setting this flag will eventually lead to the old BGP RIB
+	     * entry of the prefix withdrawn at zebra side of the socket
+	     * and reinstalled using freshly resolved IGP gateway.
+	     */
+	    SET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
+	    found = 1;
+	  }
+      if (found)
+	bgp_process (bgp, rn, afi, SAFI_UNICAST);
+    }
+  bgp_unlock_node (top);
+}
+
+/* Nexthop reachability is pushed by zebra as it changes, see
+   bgp_nexthop_update.  The periodic scan is left with housekeeping
+   that does not need a walk of the whole table.  */
+static void
+bgp_scan (afi_t afi, safi_t safi)
+{
+  struct bgp *bgp;
   struct peer *peer;
   struct listnode *node, *nnode;
   struct route_table *desyncpfxs;
   struct route_node *dprn;
-  int valid;
-  int current;
-  int changed;
-  int metricchanged;
-
-  bnct_swap (afi);
 
   /* Get default bgp. */
   bgp = bgp_get_default ();
@@ -562,93 +727,89 @@ bgp_scan (afi_t afi, safi_t safi)
 	bgp_maximum_prefix_overflow (peer, afi, SAFI_MPLS_VPN, 1);
     }
 
+  if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST], BGP_CONFIG_DAMPENING))
+    bgp_damp_scan_all (bgp, afi, SAFI_UNICAST);
+
   if (afi == AFI_IP)
     {
       desyncpfxs = route_table_init();
-      verify_ipv4_rgates (bnct_inactive (afi), desyncpfxs);
+      verify_ipv4_rgates (bgp_nexthop_cache_table[afi], desyncpfxs);
+      for (dprn = route_top (desyncpfxs); dprn; dprn = route_next (dprn))
+	if (dprn->info)
+	  {
+	    bgp_scan_desync (bgp, afi, &dprn->p);
+	    dprn->info = NULL;
+	  }
+      route_table_finish (desyncpfxs);
     }
+}
 
-  for (rn = bgp_table_top (bgp->rib[afi][SAFI_UNICAST]); rn;
-       rn = bgp_route_next (rn))
-    {
-      for (bi = rn->info; bi; bi = next)
-	{
-	  next = bi->next;
+/* A connected network came or went, check directly connected EBGP
+   routes against it again. */
+static int
+bgp_connected_scan (struct thread *t)
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  struct bgp_info *bi;
+  afi_t afi;
+  int valid;
+  int current;
+  int changed;
 
-	  if (bi->type == ZEBRA_ROUTE_BGP && bi->sub_type == BGP_ROUTE_NORMAL)
-	    {
-	      changed = 0;
-	      metricchanged = 0;
-
-              if (afi == AFI_IP)
-                if ((dprn = route_node_match (desyncpfxs, &rn->p)))
-                  {
-                    /* The current prefix failed zebra nexthop verification,
-                     * further checks can be omitted.
-                     */
-                    route_unlock_node (dprn);
-                    if (BGP_DEBUG (nexthop, NEXTHOP))
-                      {
-                        char buf[INET_ADDRSTRLEN];
-                        inet_ntop (AF_INET, &rn->p.u.prefix4, buf, INET_ADDRSTRLEN);
-                        zlog_debug ("%s: rgate out of sync for %s/%u", __func__, buf, rn->p.prefixlen);
-                      }
-                    /* Setting this flag will eventually lead to the old BGP RIB
-                     * entry of the prefix withdrawn at zebra side of the socket
-                     * and reinstalled using freshly resolved IGP gateway.
-                     */
-                    SET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-                    goto nextprefix;
-                  }
-
-	      if (peer_sort (bi->peer) == BGP_PEER_EBGP && bi->peer->ttl == 1)
-		valid = bgp_nexthop_onlink (afi, bi->attr);
-	      else
-		valid = bgp_nexthop_lookup (afi, bi->peer, bi,
-					    &changed, &metricchanged);
-
-	      current = CHECK_FLAG (bi->flags, BGP_INFO_VALID) ? 1 : 0;
-
-	      if (changed)
-		SET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-	      else
-		UNSET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-
-	      if (valid != current)
-		{
-		  if (CHECK_FLAG (bi->flags, BGP_INFO_VALID))
-		    {
-		      bgp_aggregate_decrement (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		      bgp_info_unset_flag (rn, bi, BGP_INFO_VALID);
-		    }
-		  else
-		    {
-		      bgp_info_set_flag (rn, bi, BGP_INFO_VALID);
-		      bgp_aggregate_increment (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		    }
-		}
+  bgp_connected_thread = NULL;
 
-              if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST],
-		  BGP_CONFIG_DAMPENING)
-                  &&  bi->extra && bi->extra->damp_info )
-                if (bgp_damp_scan (bi, afi, SAFI_UNICAST))
-		  bgp_aggregate_increment (bgp, &rn->p, bi,
-					   afi, SAFI_UNICAST);
-nextprefix: ;
-	    }
-	}
-      bgp_process (bgp, rn, afi, SAFI_UNICAST);
-    }
+  bgp = bgp_get_default ();
+  if (bgp == NULL)
+    return 0;
 
-  bgp_nexthop_cache_reset (bnct_inactive (afi));
-  if (afi == AFI_IP)
-    {
-      for (dprn = route_top (desyncpfxs); dprn; dprn = route_next (dprn))
-        dprn->info = NULL;
-      route_table_finish (desyncpfxs);
-    }
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (rn = bgp_table_top (bgp->rib[afi][SAFI_UNICAST]); rn;
+	 rn = bgp_route_next (rn))
+      {
+	changed = 0;
+	for (bi = rn->info; bi; bi = bi->next)
+	  {
+	    /* Routes tracked by zebra are kept up to date that way. */
+	    if (bi->type != ZEBRA_ROUTE_BGP
+		|| bi->sub_type != BGP_ROUTE_NORMAL
+		|| bi->nexthop
+		|| CHECK_FLAG (bi->flags, BGP_INFO_REMOVED)
+		|| peer_sort (bi->peer) != BGP_PEER_EBGP
+		|| bi->peer->ttl != 1)
+	      continue;
+
+	    valid = bgp_nexthop_onlink (afi, bi->attr);
+	    current = CHECK_FLAG (bi->flags, BGP_INFO_VALID) ? 1 : 0;
+
+	    if (valid == current)
+	      continue;
+
+	    if (current)
+	      {
+		bgp_aggregate_decrement (bgp, &rn->p, bi, afi, SAFI_UNICAST);
+		bgp_info_unset_flag (rn, bi, BGP_INFO_VALID);
+	      }
+	    else
+	      {
+		bgp_info_set_flag (rn, bi, BGP_INFO_VALID);
+		bgp_aggregate_increment (bgp, &rn->p, bi, afi, SAFI_UNICAST);
+	      }
+	    changed = 1;
+	  }
+	if (changed)
+	  bgp_process (bgp, rn, afi, SAFI_UNICAST);
+      }
+
+  return 0;
+}
+
+static void
+bgp_connected_changed (void)
+{
+  if (! bgp_connected_thread)
+    bgp_connected_thread =
+      thread_add_event (master, bgp_connected_scan, NULL, 0);
 }
 
 /* BGP scan thread.  This thread check nexthop reachability. */
@@ -713,6 +874,7 @@ bgp_connected_add (struct connected *ifc)
 	  bc = XCALLOC (MTYPE_BGP_CONN, sizeof (struct bgp_connected_ref));
 	  bc->refcnt = 1;
 	  rn->info = bc;
+	  bgp_connected_changed ();
 	}
     }
 #ifdef HAVE_IPV6
@@ -738,6 +900,7 @@ bgp_connected_add (struct connected *ifc)
 	  bc = XCALLOC (MTYPE_BGP_CONN, sizeof (struct bgp_connected_ref));
 	  bc->refcnt = 1;
 	  rn->info = bc;
+	  bgp_connected_changed ();
 	}
     }
 #endif /* HAVE_IPV6 */
@@ -777,6 +940,7 @@ bgp_connected_delete (struct connected *ifc)
 	{
 	  XFREE (MTYPE_BGP_CONN, bc);
 	  rn->info = NULL;
+	  bgp_connected_changed ();
 	}
       bgp_unlock_node (rn);
       bgp_unlock_node (rn);
@@ -803,6 +967,7 @@ bgp_connected_delete (struct connected *ifc)
 	{
 	  XFREE (MTYPE_BGP_CONN, bc);
 	  rn->info = NULL;
+	  bgp_connected_changed ();
 	}
       bgp_unlock_node (rn);
       bgp_unlock_node (rn);
@@ -1313,7 +1478,7 @@ show_ip_bgp_scan_tables (struct vty *vty, const char detail)
   vty_out (vty, "BGP scan interval is %d%s", bgp_scan_interval, VTY_NEWLINE);
 
   vty_out (vty, "Current BGP nexthop cache:%s", VTY_NEWLINE);
-  for (rn = bgp_table_top (bnct_active (AFI_IP)); rn; rn = bgp_route_next (rn))
+  for (rn = bgp_table_top (bgp_nexthop_cache_table[AFI_IP]); rn; rn = bgp_route_next (rn))
     if ((bnc = rn->info) != NULL)
       {
 	if (bnc->valid)
@@ -1341,7 +1506,7 @@ show_ip_bgp_scan_tables (struct vty *vty, const char detail)
 
 #ifdef HAVE_IPV6
   {
-    for (rn = bgp_table_top (bnct_active (AFI_IP6));
+    for (rn = bgp_table_top (bgp_nexthop_cache_table[AFI_IP6]);
          rn; 
          rn = bgp_route_next (rn))
       if ((bnc = rn->info) != NULL)
@@ -1438,11 +1603,11 @@ bgp_scan_init (void)
   bgp_scan_interval = BGP_SCAN_INTERVAL_DEFAULT;
   bgp_import_interval = BGP_IMPORT_INTERVAL_DEFAULT;
 
-  bnct_init (AFI_IP);
+  bgp_nexthop_cache_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
   bgp_connected_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
 
 #ifdef HAVE_IPV6
-  bnct_init (AFI_IP6);
+  bgp_nexthop_cache_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
   bgp_connected_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
 #endif /* HAVE_IPV6 */
 
@@ -1465,16 +1630,16 @@ bgp_scan_init (void)
 void
 bgp_scan_finish (void)
 {
-  /* Only the current one needs to be reset. */
-  bgp_nexthop_cache_reset (bnct_active (AFI_IP));
-  bnct_finish (AFI_IP);
+  bgp_nexthop_cache_reset (bgp_nexthop_cache_table[AFI_IP]);
+  bgp_table_unlock (bgp_nexthop_cache_table[AFI_IP]);
+  bgp_nexthop_cache_table[AFI_IP] = NULL;
   bgp_table_unlock (bgp_connected_table[AFI_IP]);
   bgp_connected_table[AFI_IP] = NULL;
 
 #ifdef HAVE_IPV6
-  /* Only the current one needs to be reset. */
-  bgp_nexthop_cache_reset (bnct_active (AFI_IP6));
-  bnct_finish (AFI_IP6);
+  bgp_nexthop_cache_reset (bgp_nexthop_cache_table[AFI_IP6]);
+  bgp_table_unlock (bgp_nexthop_cache_table[AFI_IP6]);
+  bgp_nexthop_cache_table[AFI_IP6] = NULL;
   bgp_table_unlock (bgp_connected_table[AFI_IP6]);
   bgp_connected_table[AFI_IP6] = NULL;
 #endif /* HAVE_IPV6 */
@@ -22,34 +22,39 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define _QUAGGA_BGP_NEXTHOP_H
 
 #include "if.h"
+#include "zclient.h"
 
 #define BGP_SCAN_INTERVAL_DEFAULT   60
 #define BGP_IMPORT_INTERVAL_DEFAULT 15
 
-/* BGP nexthop cache value structure. */
+/* BGP nexthop cache value structure.  Entries are registered with
+   zebra, which sends ZEBRA_NEXTHOP_UPDATE whenever the IGP route they
+   resolve through changes.  */
 struct bgp_nexthop_cache
 {
   /* This nexthop exists in IGP. */
   u_char valid;
 
-  /* Nexthop is changed. */
-  u_char changed;
-
-  /* Nexthop is changed. */
-  u_char metricchanged;
-
   /* IGP route's metric. */
   u_int32_t metric;
 
   /* Nexthop number and nexthop linked list.*/
   u_char nexthop_num;
   struct nexthop *nexthop;
+
+  /* Node in the nexthop cache table.  */
+  struct bgp_node *node;
+
+  /* Routes resolving through this nexthop, linked by nh_next.  */
+  struct bgp_info *paths;
 };
 
 extern void bgp_scan_init (void);
 extern void bgp_scan_finish (void);
-extern int bgp_nexthop_lookup (afi_t, struct peer *peer, struct bgp_info *,
-			int *, int *);
+extern int bgp_nexthop_lookup (afi_t, struct peer *peer, struct bgp_info *);
+extern void bgp_nexthop_unlink (struct bgp_info *);
+extern int bgp_nexthop_update (int, struct zclient *, zebra_size_t);
+extern void bgp_nexthop_register_all (struct zclient *);
 extern void bgp_connected_add (struct connected *c);
 extern void bgp_connected_delete (struct connected *c);
 extern int bgp_multiaccess_check_v4 (struct in_addr, char *);
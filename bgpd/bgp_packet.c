@@ -48,6 +48,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
 
 int stream_put_prefix (struct stream *, struct prefix *);
 
@@ -189,10 +191,10 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 	  stream_putw (s, 0);		
 	  pos = stream_get_endp (s);
 	  stream_putw (s, 0);
-	  total_attr_len = bgp_packet_attribute (NULL, peer, s, 
-	                                         adv->baa->attr,
-	                                         &rn->p, afi, safi, 
-	                                         from, prd, tag);
+	  total_attr_len = update_group_packet_attribute (peer, s,
+	                                                  adv->baa->attr,
+	                                                  &rn->p, afi, safi,
+	                                                  from, prd, tag);
 	  stream_putw_at (s, pos, total_attr_len);
 	}
 
@@ -499,19 +501,16 @@ bgp_default_withdraw_send (struct peer *peer, afi_t afi, safi_t safi)
   BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 }
 
-/* Get next packet to be written.  */
+/* Build the next update, withdraw or End-of-RIB packet and add it to
+   the output queue.  */
 static struct stream *
-bgp_write_packet (struct peer *peer)
+bgp_write_packet_build (struct peer *peer)
 {
   afi_t afi;
   safi_t safi;
   struct stream *s = NULL;
   struct bgp_advertise *adv;
 
-  s = stream_fifo_head (peer->obuf);
-  if (s)
-    return s;
-
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       {
@@ -564,6 +563,19 @@ bgp_write_packet (struct peer *peer)
   return NULL;
 }
 
+/* Get next packet to be written.  */
+static struct stream *
+bgp_write_packet (struct peer *peer)
+{
+  struct stream *s;
+
+  s = stream_fifo_head (peer->obuf);
+  if (s)
+    return s;
+
+  return bgp_write_packet_build (peer);
+}
+
 /* Is there partially written packet or updates we can send right
    now.  */
 static int
@@ -590,15 +602,69 @@ bgp_write_proceed (struct peer *peer)
   return 0;
 }
 
-/* Write packet to the peer. */
+/* Count a packet of TYPE sent to the peer.  */
+static void
+bgp_packet_count_out (struct peer *peer, u_char type)
+{
+  switch (type)
+    {
+    case BGP_MSG_OPEN:
+      peer->open_out++;
+      break;
+    case BGP_MSG_UPDATE:
+      peer->update_out++;
+      break;
+    case BGP_MSG_NOTIFY:
+      peer->notify_out++;
+      break;
+    case BGP_MSG_KEEPALIVE:
+      peer->keepalive_out++;
+      break;
+    case BGP_MSG_ROUTE_REFRESH_NEW:
+    case BGP_MSG_ROUTE_REFRESH_OLD:
+      peer->refresh_out++;
+      break;
+    case BGP_MSG_CAPABILITY:
+      peer->dynamic_cap_out++;
+      break;
+    }
+}
+
+/* The I/O thread owns the socket, hand it whole packets until it has
+   enough queued.  */
+static int
+bgp_write_io (struct peer *peer)
+{
+  struct stream *s;
+  unsigned int count = 0;
+
+  while (count++ < BGP_WRITE_PACKET_MAX && bgp_io_writable (peer)
+	 && (s = bgp_write_packet (peer)) != NULL)
+    {
+      stream_fifo_pop (peer->obuf);
+      bgp_packet_count_out (peer, stream_getc_from (s, BGP_MARKER_SIZE + 2));
+      bgp_io_send (peer, s);
+    }
+
+  if (bgp_io_writable (peer) && bgp_write_proceed (peer))
+    BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+
+  return 0;
+}
+
+/* Write packet to the peer.  As many queued packets as fit the write
+   budget go out in one writev(), more are built while it lasts.  */
 int
 bgp_write (struct thread *thread)
 {
   struct peer *peer;
   u_char type;
   struct stream *s; 
-  int num;
-  unsigned int count = 0;
+  struct iovec iov[BGP_WRITE_IOV_MAX];
+  int iovcnt = 0;
+  size_t total = 0;
+  size_t len;
+  ssize_t num;
 
   /* Yes first of all get peer pointer. */
   peer = THREAD_ARG (thread);
@@ -611,53 +677,61 @@ bgp_write (struct thread *thread)
       return 0;
     }
 
+  if (peer->io)
+    return bgp_write_io (peer);
+
   s = bgp_write_packet (peer);
   if (!s)
     return 0;	/* nothing to send */
 
+  /* A notification goes last, the session stops after it.  */
+  while (s && iovcnt < BGP_WRITE_IOV_MAX && total < bm->write_budget)
+    {
+      iov[iovcnt].iov_base = STREAM_PNT (s);
+      iov[iovcnt].iov_len = STREAM_READABLE (s);
+      total += iov[iovcnt].iov_len;
+      iovcnt++;
+
+      if (stream_getc_from (s, BGP_MARKER_SIZE + 2) == BGP_MSG_NOTIFY)
+	break;
+      s = s->next ? s->next : bgp_write_packet_build (peer);
+    }
+
   setsockopt_tcp_cork (peer->fd, 1);
 
   /* Nonblocking write until TCP output buffer is full.  */
-  do
+  num = writev (peer->fd, iov, iovcnt);
+  if (num < 0)
     {
-      int writenum;
-
-      /* Number of bytes to be sent.  */
-      writenum = stream_get_endp (s) - stream_get_getp (s);
-
-      /* Call write() system call.  */
-      num = write (peer->fd, STREAM_PNT (s), writenum);
-      if (num < 0)
+      /* write failed either retry needed or error */
+      if (! ERRNO_IO_RETRY (errno))
 	{
-	  /* write failed either retry needed or error */
-	  if (ERRNO_IO_RETRY(errno))
-		break;
-
-          BGP_EVENT_ADD (peer, TCP_fatal_error);
+	  BGP_EVENT_ADD (peer, TCP_fatal_error);
 	  return 0;
 	}
+      num = 0;
+    }
+  else
+    peer->write_calls++;
 
-      if (num != writenum)
+  /* Drop what went out, a packet written in part stays at the head. */
+  while (num > 0 && (s = stream_fifo_head (peer->obuf)) != NULL)
+    {
+      len = STREAM_READABLE (s);
+      if ((size_t) num < len)
 	{
-	  /* Partial write */
 	  stream_forward_getp (s, num);
 	  break;
 	}
+      num -= len;
 
       /* Retrieve BGP packet type. */
-      stream_set_getp (s, BGP_MARKER_SIZE + 2);
-      type = stream_getc (s);
+      type = stream_getc_from (s, BGP_MARKER_SIZE + 2);
+      bgp_packet_count_out (peer, type);
+      peer->write_msgs++;
 
-      switch (type)
+      if (type == BGP_MSG_NOTIFY)
 	{
-	case BGP_MSG_OPEN:
-	  peer->open_out++;
-	  break;
-	case BGP_MSG_UPDATE:
-	  peer->update_out++;
-	  break;
-	case BGP_MSG_NOTIFY:
-	  peer->notify_out++;
 	  /* Double start timer. */
 	  peer->v_start *= 2;
 
@@ -668,23 +742,11 @@ bgp_write (struct thread *thread)
 	  /* Flush any existing events */
 	  BGP_EVENT_ADD (peer, BGP_Stop);
 	  return 0;
-	case BGP_MSG_KEEPALIVE:
-	  peer->keepalive_out++;
-	  break;
-	case BGP_MSG_ROUTE_REFRESH_NEW:
-	case BGP_MSG_ROUTE_REFRESH_OLD:
-	  peer->refresh_out++;
-	  break;
-	case BGP_MSG_CAPABILITY:
-	  peer->dynamic_cap_out++;
-	  break;
 	}
 
       /* OK we send packet so delete it. */
       bgp_packet_delete (peer);
     }
-  while (++count < BGP_WRITE_PACKET_MAX &&
-	 (s = bgp_write_packet (peer)) != NULL);
   
   if (bgp_write_proceed (peer))
     BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
@@ -832,6 +894,9 @@ bgp_notify_send_with_data (struct peer *peer, u_char code, u_char sub_code,
   struct stream *s;
   int length;
 
+  /* The notification is written synchronously, from here.  */
+  bgp_io_peer_stop (peer);
+
   /* Allocate new stream. */
   s = stream_new (BGP_MAX_PACKET_SIZE);
 
@@ -2240,6 +2305,35 @@ bgp_capability_receive (struct peer *peer, bgp_size_t size)
   return bgp_capability_msg_parse (peer, pnt, size);
 }
 
+/* Reading from the peer failed with ERRNUM, or the peer closed the
+   connection if ERRNUM is zero.  */
+void
+bgp_packet_read_error (struct peer *peer, int errnum)
+{
+  if (errnum)
+    plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
+	      peer->host, safe_strerror (errnum));
+  else if (BGP_DEBUG (events, EVENTS))
+    plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
+		peer->host, peer->fd);
+
+  if (peer->status == Established) 
+    {
+      if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
+	{
+	  peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
+	  SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
+	}
+      else
+	peer->last_reset = PEER_DOWN_CLOSE_SESSION;
+    }
+
+  if (errnum)
+    BGP_EVENT_ADD (peer, TCP_fatal_error);
+  else
+    BGP_EVENT_ADD (peer, TCP_connection_closed);
+}
+
 /* BGP read utility function. */
 static int
 bgp_read_packet (struct peer *peer)
@@ -2255,6 +2349,8 @@ bgp_read_packet (struct peer *peer)
 
   /* Read packet from fd. */
   nbytes = stream_read_try (peer->ibuf, peer->fd, readsize);
+  if (nbytes > 0)
+    peer->read_calls++;
 
   /* If read byte is smaller than zero then error occured. */
   if (nbytes < 0) 
@@ -2263,43 +2359,14 @@ bgp_read_packet (struct peer *peer)
       if (nbytes == -2)
 	return -1;
 
-      plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
-		 peer->host, safe_strerror (errno));
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_fatal_error);
+      bgp_packet_read_error (peer, errno);
       return -1;
     }  
 
   /* When read byte is zero : clear bgp peer and return */
   if (nbytes == 0) 
     {
-      if (BGP_DEBUG (events, EVENTS))
-	plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
-		   peer->host, peer->fd);
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_connection_closed);
+      bgp_packet_read_error (peer, 0);
       return -1;
     }
 
@@ -2312,129 +2379,176 @@ bgp_read_packet (struct peer *peer)
 
 /* Marker check. */
 static int
-bgp_marker_all_one (struct stream *s, int length)
+bgp_marker_all_one (const u_char *pnt, int length)
 {
   int i;
 
   for (i = 0; i < length; i++)
-    if (s->data[i] != 0xff)
+    if (pnt[i] != 0xff)
       return 0;
 
   return 1;
 }
 
-/* Starting point of packet process function. */
+/* Check the message header at HDR.  Returns zero and the message
+   length in SIZE, or the BGP_NOTIFY_HEADER_* subcode to send back.
+   The I/O thread calls this too, so it does nothing but look.  */
 int
-bgp_read (struct thread *thread)
+bgp_packet_check_header (const u_char *hdr, bgp_size_t *size)
 {
-  int ret;
-  u_char type = 0;
-  struct peer *peer;
+  u_char type;
+
+  *size = (hdr[BGP_MARKER_SIZE] << 8) | hdr[BGP_MARKER_SIZE + 1];
+  type = hdr[BGP_MARKER_SIZE + 2];
+
+  /* Marker check */
+  if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
+      && ! bgp_marker_all_one (hdr, BGP_MARKER_SIZE))
+    return BGP_NOTIFY_HEADER_NOT_SYNC;
+
+  /* BGP type check. */
+  if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
+      && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
+      && type != BGP_MSG_ROUTE_REFRESH_NEW
+      && type != BGP_MSG_ROUTE_REFRESH_OLD
+      && type != BGP_MSG_CAPABILITY)
+    return BGP_NOTIFY_HEADER_BAD_MESTYPE;
+
+  /* Mimimum packet length check. */
+  if ((*size < BGP_HEADER_SIZE)
+      || (*size > BGP_MAX_PACKET_SIZE)
+      || (type == BGP_MSG_OPEN && *size < BGP_MSG_OPEN_MIN_SIZE)
+      || (type == BGP_MSG_UPDATE && *size < BGP_MSG_UPDATE_MIN_SIZE)
+      || (type == BGP_MSG_NOTIFY && *size < BGP_MSG_NOTIFY_MIN_SIZE)
+      || (type == BGP_MSG_KEEPALIVE && *size != BGP_MSG_KEEPALIVE_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_NEW && *size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_OLD && *size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_CAPABILITY && *size < BGP_MSG_CAPABILITY_MIN_SIZE))
+    return BGP_NOTIFY_HEADER_BAD_MESLEN;
+
+  return 0;
+}
+
+/* Tell the peer what bgp_packet_check_header() found wrong with the
+   header at HDR.  */
+void
+bgp_packet_header_error (struct peer *peer, const u_char *hdr, int subcode)
+{
+  u_char data[2];
   bgp_size_t size;
-  char notify_data_length[2];
 
-  /* Yes first of all get peer pointer. */
-  peer = THREAD_ARG (thread);
-  peer->t_read = NULL;
+  size = (hdr[BGP_MARKER_SIZE] << 8) | hdr[BGP_MARKER_SIZE + 1];
+  data[0] = hdr[BGP_MARKER_SIZE + 2];
 
-  /* For non-blocking IO check. */
-  if (peer->status == Connect)
-    {
-      bgp_connect_check (peer);
-      goto done;
-    }
-  else
+  switch (subcode)
     {
-      if (peer->fd < 0)
-	{
-	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
-	  return -1;
-	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+    case BGP_NOTIFY_HEADER_BAD_MESTYPE:
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s unknown message type 0x%02x",
+		  peer->host, data[0]);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESTYPE,
+				 data, 1);
+      break;
+    case BGP_NOTIFY_HEADER_BAD_MESLEN:
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s bad message length - %d for %s",
+		  peer->host, size, 
+		  LOOKUP (bgp_type_str, data[0]));
+      memcpy (data, hdr + BGP_MARKER_SIZE, 2);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESLEN,
+				 data, 2);
+      break;
+    default:
+      bgp_notify_send (peer, BGP_NOTIFY_HEADER_ERR, subcode);
+      break;
     }
+}
 
-  /* Read packet header to determine type of the packet */
-  if (peer->packet_size == 0)
-    peer->packet_size = BGP_HEADER_SIZE;
+/* Handle every whole message in peer->rbuf.  The start of the next
+   message is kept for the next read.  */
+void
+bgp_read_buffered (struct peer *peer)
+{
+  struct stream *rbuf = peer->rbuf;
+  int fd = peer->fd;
+  size_t avail;
+  bgp_size_t size;
+  u_char type;
+  int ret;
 
-  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
+  while ((avail = STREAM_READABLE (rbuf)) >= BGP_HEADER_SIZE)
     {
-      ret = bgp_read_packet (peer);
-
-      /* Header read error or partial read packet. */
-      if (ret < 0) 
-	goto done;
-
-      /* Get size and type. */
-      stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
-      memcpy (notify_data_length, stream_pnt (peer->ibuf), 2);
-      size = stream_getw (peer->ibuf);
-      type = stream_getc (peer->ibuf);
+      ret = bgp_packet_check_header (STREAM_PNT (rbuf), &size);
+      if (ret)
+	{
+	  bgp_packet_header_error (peer, STREAM_PNT (rbuf), ret);
+	  return;
+	}
+      if (avail < size)
+	break;
 
+      type = stream_getc_from (rbuf, stream_get_getp (rbuf)
+			       + BGP_MARKER_SIZE + 2);
       if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
 	zlog_debug ("%s rcv message type %d, length (excl. header) %d",
 		   peer->host, type, size - BGP_HEADER_SIZE);
 
-      /* Marker check */
-      if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
-	  && ! bgp_marker_all_one (peer->ibuf, BGP_MARKER_SIZE))
-	{
-	  bgp_notify_send (peer,
-			   BGP_NOTIFY_HEADER_ERR, 
-			   BGP_NOTIFY_HEADER_NOT_SYNC);
-	  goto done;
-	}
+      stream_reset (peer->ibuf);
+      stream_put (peer->ibuf, STREAM_PNT (rbuf), size);
+      stream_set_getp (peer->ibuf, BGP_HEADER_SIZE);
+      stream_forward_getp (rbuf, size);
+      peer->packet_size = size;
+      peer->read_msgs++;
 
-      /* BGP type check. */
-      if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
-	  && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
-	  && type != BGP_MSG_ROUTE_REFRESH_NEW
-	  && type != BGP_MSG_ROUTE_REFRESH_OLD
-	  && type != BGP_MSG_CAPABILITY)
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s unknown message type 0x%02x",
-		      peer->host, type);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			 	     BGP_NOTIFY_HEADER_BAD_MESTYPE,
-				     &type, 1);
-	  goto done;
-	}
-      /* Mimimum packet length check. */
-      if ((size < BGP_HEADER_SIZE)
-	  || (size > BGP_MAX_PACKET_SIZE)
-	  || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
-	  || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
-	  || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
-	  || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s bad message length - %d for %s",
-		      peer->host, size, 
-		      LOOKUP (bgp_type_str, type));
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			  	     BGP_NOTIFY_HEADER_BAD_MESLEN,
-				     (u_char *) notify_data_length, 2);
-	  goto done;
-	}
+      bgp_packet_process (peer);
 
-      /* Adjust size to message length. */
-      peer->packet_size = size;
+      /* The session went down, the rest is of no use.  */
+      if (peer->status != Established || peer->fd != fd)
+	return;
     }
 
-  ret = bgp_read_packet (peer);
-  if (ret < 0) 
-    goto done;
+  /* Move the start of the next message to the front.  */
+  memmove (STREAM_DATA (rbuf), STREAM_PNT (rbuf), avail);
+  stream_reset (rbuf);
+  stream_forward_endp (rbuf, avail);
+}
+
+/* Read as much as fits into peer->rbuf and handle what came.  Only
+   once Established: before, the socket may still move to another
+   peer, so nothing past the current message may be read.  */
+static void
+bgp_read_chunk (struct peer *peer)
+{
+  int nbytes;
+
+  nbytes = stream_read_try (peer->rbuf, peer->fd,
+			    STREAM_WRITEABLE (peer->rbuf));
+  if (nbytes == -2)
+    return;
+  if (nbytes <= 0)
+    {
+      bgp_packet_read_error (peer, nbytes < 0 ? errno : 0);
+      return;
+    }
+  peer->read_calls++;
+
+  bgp_read_buffered (peer);
+}
+
+/* Handle the whole message in the peer's input buffer, its header
+   already checked.  */
+void
+bgp_packet_process (struct peer *peer)
+{
+  u_char type;
+  bgp_size_t size;
 
-  /* Get size and type again. */
-  size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
   type = stream_getc_from (peer->ibuf, BGP_MARKER_SIZE + 2);
 
   /* BGP packet dump function. */
@@ -2475,6 +2589,80 @@ bgp_read (struct thread *thread)
   peer->packet_size = 0;
   if (peer->ibuf)
     stream_reset (peer->ibuf);
+}
+
+/* Starting point of packet process function. */
+int
+bgp_read (struct thread *thread)
+{
+  int ret;
+  u_char type = 0;
+  struct peer *peer;
+  bgp_size_t size;
+
+  /* Yes first of all get peer pointer. */
+  peer = THREAD_ARG (thread);
+  peer->t_read = NULL;
+
+  /* For non-blocking IO check. */
+  if (peer->status == Connect)
+    {
+      bgp_connect_check (peer);
+      goto done;
+    }
+  else
+    {
+      if (peer->fd < 0)
+	{
+	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
+	  return -1;
+	}
+      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+    }
+
+  if (peer->status == Established)
+    {
+      bgp_read_chunk (peer);
+      return 0;
+    }
+
+  /* Read packet header to determine type of the packet */
+  if (peer->packet_size == 0)
+    peer->packet_size = BGP_HEADER_SIZE;
+
+  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
+    {
+      ret = bgp_read_packet (peer);
+
+      /* Header read error or partial read packet. */
+      if (ret < 0) 
+	goto done;
+
+      /* Get size and type. */
+      ret = bgp_packet_check_header (STREAM_DATA (peer->ibuf), &size);
+      type = stream_getc_from (peer->ibuf, BGP_MARKER_SIZE + 2);
+
+      if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
+	zlog_debug ("%s rcv message type %d, length (excl. header) %d",
+		   peer->host, type, size - BGP_HEADER_SIZE);
+
+      if (ret)
+	{
+	  bgp_packet_header_error (peer, STREAM_DATA (peer->ibuf), ret);
+	  goto done;
+	}
+
+      /* Adjust size to message length. */
+      stream_set_getp (peer->ibuf, BGP_HEADER_SIZE);
+      peer->packet_size = size;
+    }
+
+  ret = bgp_read_packet (peer);
+  if (ret < 0) 
+    goto done;
+
+  peer->read_msgs++;
+  bgp_packet_process (peer);
 
  done:
   if (CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
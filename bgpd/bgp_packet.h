@@ -25,6 +25,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_TOTAL_ATTR_LEN    2U
 #define BGP_UNFEASIBLE_LEN    2U
 #define BGP_WRITE_PACKET_MAX 10U
+#define BGP_WRITE_IOV_MAX    64
 
 /* When to refresh */
 #define REFRESH_IMMEDIATE 1
@@ -54,4 +55,10 @@ extern void bgp_default_withdraw_send (struct peer *, afi_t, safi_t);
 
 extern int bgp_capability_receive (struct peer *, bgp_size_t);
 
+extern int bgp_packet_check_header (const u_char *, bgp_size_t *);
+extern void bgp_packet_header_error (struct peer *, const u_char *, int);
+extern void bgp_packet_read_error (struct peer *, int);
+extern void bgp_packet_process (struct peer *);
+extern void bgp_read_buffered (struct peer *);
+
 #endif /* _QUAGGA_BGP_PACKET_H */
@@ -91,3 +91,122 @@ bgp_regex_free (regex_t *regex)
   regfree (regex);
   XFREE (MTYPE_BGP_REGEXP, regex);
 }
+
+/* The characters `_' stands for, bar the beginning and end of the
+   line. */
+static int
+bgp_regex_magic (char c)
+{
+  return c != '\0' && strchr (",{}() ", c) != NULL;
+}
+
+/* Compile STR if it is an ASN pattern: `^' or `_', one or more ASNs
+   separated by `_', then `$' or `_'; or "^$".  NULL otherwise, in
+   which case the regex has to be used. */
+struct bgp_regex_asns *
+bgp_regcomp_asns (const char *regstr)
+{
+  struct bgp_regex_asns *pat;
+  const char *p;
+  u_int64_t asn;
+  int count;
+  int digits;
+
+  if (regstr[0] != '^' && regstr[0] != '_')
+    return NULL;
+
+  for (count = 0, p = regstr; *p; p++)
+    if (*p == '_')
+      count++;
+
+  pat = XCALLOC (MTYPE_BGP_REGEXP,
+		 sizeof (struct bgp_regex_asns) + count * sizeof (as_t));
+  pat->begin = regstr[0];
+
+  if (strcmp (regstr, "^$") == 0)
+    {
+      pat->end = '$';
+      return pat;
+    }
+
+  for (p = regstr + 1; ; p++)
+    {
+      /* An ASN as the path string prints it, without leading zeros. */
+      for (asn = 0, digits = 0; isdigit ((int) *p); p++, digits++)
+	asn = asn * 10 + (*p - '0');
+      if (digits == 0 || digits > 10 || asn > UINT32_MAX
+	  || (digits > 1 && p[-digits] == '0'))
+	break;
+      pat->asn[pat->count++] = asn;
+
+      if (*p == '_' && isdigit ((int) p[1]))
+	continue;
+      if ((*p == '_' || *p == '$') && p[1] == '\0')
+	{
+	  pat->end = *p;
+	  return pat;
+	}
+      break;
+    }
+
+  bgp_regex_asns_free (pat);
+  return NULL;
+}
+
+/* Same result as bgp_regexec() with the regex PAT came from, but
+   comparing ASNs: a run of digits in the path string is an ASN, and
+   the pattern's ASNs have to be consecutive runs with exactly one
+   separator `_' matches between them. */
+int
+bgp_regexec_asns (struct bgp_regex_asns *pat, struct aspath *aspath)
+{
+  const char *str = aspath->str;
+  const char *p;
+  const char *q;
+  u_int64_t asn;
+  int i;
+
+  if (pat->count == 0)
+    return str[0] == '\0';
+
+  for (p = str; *p; )
+    {
+      if (! isdigit ((int) *p))
+	{
+	  if (pat->begin == '^')
+	    return 0;
+	  p++;
+	  continue;
+	}
+
+      if (pat->begin == '^' || p == str || bgp_regex_magic (p[-1]))
+	for (q = p, i = 0; ; q++)
+	  {
+	    for (asn = 0; isdigit ((int) *q) && asn <= UINT32_MAX; q++)
+	      asn = asn * 10 + (*q - '0');
+	    if (isdigit ((int) *q) || asn != pat->asn[i])
+	      break;
+	    if (++i == pat->count)
+	      {
+		if (*q == '\0'
+		    || (pat->end == '_' && bgp_regex_magic (*q)))
+		  return 1;
+		break;
+	      }
+	    if (! bgp_regex_magic (*q) || ! isdigit ((int) q[1]))
+	      break;
+	  }
+
+      if (pat->begin == '^')
+	return 0;
+      while (isdigit ((int) *p))
+	p++;
+    }
+  return 0;
+}
+
+void
+bgp_regex_asns_free (struct bgp_regex_asns *pat)
+{
+  XFREE (MTYPE_BGP_REGEXP, pat);
+}
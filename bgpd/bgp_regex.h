@@ -37,4 +37,19 @@ extern void bgp_regex_free (regex_t *regex);
 extern regex_t *bgp_regcomp (const char *str);
 extern int bgp_regexec (regex_t *regex, struct aspath *aspath);
 
+/* AS path regex that is no more than a run of ASNs between `_', `^'
+   and `$', such as "_65000_" or "^65001_65000$", matched without the
+   regex engine. */
+struct bgp_regex_asns
+{
+  char begin;
+  char end;
+  int count;
+  as_t asn[1];
+};
+
+extern struct bgp_regex_asns *bgp_regcomp_asns (const char *str);
+extern int bgp_regexec_asns (struct bgp_regex_asns *, struct aspath *);
+extern void bgp_regex_asns_free (struct bgp_regex_asns *);
+
 #endif /* _QUAGGA_BGP_REGEX_H */
@@ -34,6 +34,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "plist.h"
 #include "thread.h"
 #include "workqueue.h"
+#include "hash.h"
+#include "jhash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -54,6 +56,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_rsrib.h"
 
 /* Extern from bgp_dump.c */
 extern const char *bgp_origin_str[];
@@ -140,6 +144,7 @@ bgp_info_free (struct bgp_info *binfo)
     bgp_attr_unintern (binfo->attr);
   
   bgp_info_extra_free (&binfo->extra);
+  bgp_nexthop_unlink (binfo);
 
   peer_unlock (binfo->peer); /* bgp_info peer reference */
 
@@ -192,6 +197,8 @@ bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
   if (top)
     top->prev = ri;
   rn->info = ri;
+  ri->net = rn;
+  BGP_PEER_LIST_ADD (ri->peer->paths[rn->table->afi][rn->table->safi], ri);
   
   bgp_info_lock (ri);
   bgp_lock_node (rn);
@@ -209,7 +216,10 @@ bgp_info_reap (struct bgp_node *rn, struct bgp_info *ri)
     ri->prev->next = ri->next;
   else
     rn->info = ri->next;
+  BGP_PEER_LIST_DEL (ri->peer->paths[rn->table->afi][rn->table->safi], ri);
   
+  bgp_nexthop_unlink (ri);
+  ri->net = NULL;
   bgp_info_unlock (ri);
   bgp_unlock_node (rn);
 }
@@ -643,6 +653,27 @@ bgp_cluster_filter (struct peer *peer, struct attr *attr)
   return 0;
 }
 
+/* Apply route map MAP to INFO.  Maps that only match on attributes
+   remember their decision by the interned copy of INFO's attributes,
+   which can be had cheaply when the parts are all interned already,
+   as they are for attributes received from a peer. */
+static route_map_result_t
+bgp_route_map_apply (struct route_map *map, struct prefix *p,
+		     struct bgp_info *info)
+{
+  struct attr *key;
+  route_map_result_t ret;
+
+  if (! route_map_cacheable (map) || ! bgp_attr_parts_interned (info->attr))
+    return route_map_apply (map, p, RMAP_BGP, info);
+
+  key = bgp_attr_intern (info->attr);
+  ret = route_map_apply_cached (map, p, RMAP_BGP, info, key);
+  bgp_attr_unintern (key);
+
+  return ret;
+}
+
 static int
 bgp_input_modifier (struct peer *peer, struct prefix *p, struct attr *attr,
 		    afi_t afi, safi_t safi)
@@ -667,7 +698,7 @@ bgp_input_modifier (struct peer *peer, struct prefix *p, struct attr *attr,
       SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_IN); 
 
       /* Apply BGP route map to the attribute. */
-      ret = route_map_apply (ROUTE_MAP_IN (filter), p, RMAP_BGP, &info);
+      ret = bgp_route_map_apply (ROUTE_MAP_IN (filter), p, &info);
 
       peer->rmap_type = 0;
 
@@ -701,7 +732,7 @@ bgp_export_modifier (struct peer *rsclient, struct peer *peer,
       SET_FLAG (rsclient->rmap_type, PEER_RMAP_TYPE_EXPORT);
 
       /* Apply BGP route map to the attribute. */
-      ret = route_map_apply (ROUTE_MAP_EXPORT (filter), p, RMAP_BGP, &info);
+      ret = bgp_route_map_apply (ROUTE_MAP_EXPORT (filter), p, &info);
 
       rsclient->rmap_type = 0;
 
@@ -739,7 +770,7 @@ bgp_import_modifier (struct peer *rsclient, struct peer *peer,
       SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_IMPORT);
 
       /* Apply BGP route map to the attribute. */
-      ret = route_map_apply (ROUTE_MAP_IMPORT (filter), p, RMAP_BGP, &info);
+      ret = bgp_route_map_apply (ROUTE_MAP_IMPORT (filter), p, &info);
 
       peer->rmap_type = 0;
 
@@ -753,22 +784,17 @@ bgp_import_modifier (struct peer *rsclient, struct peer *peer,
   return RMAP_PERMIT;
 }
 
+/* The part of bgp_announce_check() that depends on the receiving peer
+   itself rather than on its outbound policy.  */
 static int
-bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
-		    struct attr *attr, afi_t afi, safi_t safi)
+bgp_announce_check_peer (struct bgp_info *ri, struct peer *peer,
+			 struct prefix *p, afi_t afi, safi_t safi)
 {
-  int ret;
   char buf[SU_ADDRSTRLEN];
-  struct bgp_filter *filter;
   struct peer *from;
-  struct bgp *bgp;
-  int transparent;
-  int reflect;
 
   from = ri->peer;
-  filter = &peer->filter[afi][safi];
-  bgp = peer->bgp;
-  
+
   if (DISABLE_BGP_ANNOUNCE)
     return 0;
 
@@ -785,11 +811,6 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
       && IPV4_ADDR_SAME(&peer->remote_id, &ri->attr->nexthop))
     return 0;
 
-  /* Aggregate-address suppress check. */
-  if (ri->extra && ri->extra->suppress)
-    if (! UNSUPPRESS_MAP_NAME (filter))
-      return 0;
-
   /* Default route check.  */
   if (CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_DEFAULT_ORIGINATE))
     {
@@ -801,17 +822,6 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 #endif /* HAVE_IPV6 */
     }
 
-  /* Transparency check. */
-  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
-      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-    transparent = 1;
-  else
-    transparent = 0;
-
-  /* If community is not disabled check the no-export and local. */
-  if (! transparent && bgp_community_filter (peer, ri->attr)) 
-    return 0;
-
   /* If the attribute has originator-id and it is same as remote
      peer's id. */
   if (ri->attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID))
@@ -838,18 +848,6 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
           return 0;
       }
 
-  /* Output filter check. */
-  if (bgp_output_filter (peer, p, ri->attr, afi, safi) == FILTER_DENY)
-    {
-      if (BGP_DEBUG (filter, FILTER))
-	zlog (peer->log, LOG_DEBUG,
-	      "%s [Update:SEND] %s/%d is filtered",
-	      peer->host,
-	      inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-	      p->prefixlen);
-      return 0;
-    }
-
 #ifdef BGP_SEND_ASPATH_CHECK
   /* AS path loop check. */
   if (aspath_loop_check (ri->attr->aspath, peer->as))
@@ -862,6 +860,56 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
     }
 #endif /* BGP_SEND_ASPATH_CHECK */
 
+  return 1;
+}
+
+/* The part of bgp_announce_check() that is the same for all the peers
+   of an update group.  */
+static int
+bgp_announce_check_policy (struct bgp_info *ri, struct peer *peer,
+			   struct prefix *p, struct attr *attr,
+			   afi_t afi, safi_t safi)
+{
+  int ret;
+  char buf[SU_ADDRSTRLEN];
+  struct bgp_filter *filter;
+  struct peer *from;
+  struct bgp *bgp;
+  int transparent;
+  int reflect;
+
+  from = ri->peer;
+  filter = &peer->filter[afi][safi];
+  bgp = peer->bgp;
+
+  /* Aggregate-address suppress check. */
+  if (ri->extra && ri->extra->suppress)
+    if (! UNSUPPRESS_MAP_NAME (filter))
+      return 0;
+
+  /* Transparency check. */
+  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    transparent = 1;
+  else
+    transparent = 0;
+
+  /* If community is not disabled check the no-export and local. */
+  if (! transparent && bgp_community_filter (peer, ri->attr)) 
+    return 0;
+
+  /* Output filter check. */
+  if (bgp_output_filter (peer, p, ri->attr, afi, safi) == FILTER_DENY)
+    {
+      if (BGP_DEBUG (filter, FILTER))
+	zlog (peer->log, LOG_DEBUG,
+	      "%s [Update:SEND] %s/%d is filtered",
+	      peer->host,
+	      inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
+	      p->prefixlen);
+      return 0;
+    }
+
   /* If we're a CONFED we need to loop check the CONFED ID too */
   if (CHECK_FLAG(bgp->config, BGP_CONFIG_CONFEDERATION))
     {
@@ -1037,9 +1085,9 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
       SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_OUT); 
 
       if (ri->extra && ri->extra->suppress)
-	ret = route_map_apply (UNSUPPRESS_MAP (filter), p, RMAP_BGP, &info);
+	ret = bgp_route_map_apply (UNSUPPRESS_MAP (filter), p, &info);
       else
-	ret = route_map_apply (ROUTE_MAP_OUT (filter), p, RMAP_BGP, &info);
+	ret = bgp_route_map_apply (ROUTE_MAP_OUT (filter), p, &info);
 
       peer->rmap_type = 0;
       
@@ -1055,6 +1103,44 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
   return 1;
 }
 
+static int
+bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
+		    struct attr *attr, afi_t afi, safi_t safi)
+{
+  return bgp_announce_check_peer (ri, peer, p, afi, safi)
+	 && bgp_announce_check_policy (ri, peer, p, attr, afi, safi);
+}
+
+/* bgp_announce_check() through the peer's update group, so that the
+   policy is applied once per group and node.  Returns the interned
+   attribute to announce, owned by the group, or NULL.  */
+static struct attr *
+bgp_announce_check_group (struct bgp_info *ri, struct peer *peer,
+			  struct prefix *p, afi_t afi, safi_t safi)
+{
+  struct update_group *group;
+  struct attr attr = { 0 };
+
+  if (! bgp_announce_check_peer (ri, peer, p, afi, safi))
+    return NULL;
+
+  group = update_group_get (peer, afi, safi);
+  if (group->round == update_group_round)
+    {
+      group->announce_reused++;
+      return group->attr;
+    }
+  group->announce_calc++;
+
+  if (bgp_announce_check_policy (ri, peer, p, &attr, afi, safi))
+    update_group_announce_set (group, bgp_attr_intern (&attr));
+  else
+    update_group_announce_set (group, NULL);
+
+  bgp_attr_extra_free (&attr);
+  return group->attr;
+}
+
 static int
 bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
         struct prefix *p, struct attr *attr, afi_t afi, safi_t safi)
@@ -1237,9 +1323,9 @@ bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
       SET_FLAG (rsclient->rmap_type, PEER_RMAP_TYPE_OUT);
 
       if (ri->extra && ri->extra->suppress)
-        ret = route_map_apply (UNSUPPRESS_MAP (filter), p, RMAP_BGP, &info);
+        ret = bgp_route_map_apply (UNSUPPRESS_MAP (filter), p, &info);
       else
-        ret = route_map_apply (ROUTE_MAP_OUT (filter), p, RMAP_BGP, &info);
+        ret = bgp_route_map_apply (ROUTE_MAP_OUT (filter), p, &info);
 
       rsclient->rmap_type = 0;
 
@@ -1344,12 +1430,52 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn, struct bgp_info_pair *
     return;
 }
 
+/* May RSCLIENT be sent RI from its RS-client table?  The table holds
+   the routes of all clients sharing it, the client's own included.  */
+static int
+bgp_rsclient_usable (struct bgp_info *ri, struct peer *rsclient)
+{
+  if (ri->peer == rsclient)
+    return 0;
+
+  /* Route reflector originator ID check.  */
+  if (ri->attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
+      && IPV4_ADDR_SAME (&rsclient->remote_id,
+			 &ri->attr->extra->originator_id))
+    return 0;
+
+  return 1;
+}
+
+/* The route of RN for RSCLIENT: SELECTED, unless the client may not
+   be sent that, then the best of the others.  */
+static struct bgp_info *
+bgp_rsclient_select (struct bgp *bgp, struct bgp_node *rn,
+		     struct bgp_info *selected, struct peer *rsclient)
+{
+  struct bgp_info *ri;
+  struct bgp_info *best = NULL;
+
+  if (! selected || bgp_rsclient_usable (selected, rsclient))
+    return selected;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      if (BGP_INFO_HOLDDOWN (ri) || ! bgp_rsclient_usable (ri, rsclient))
+	continue;
+      if (bgp_info_cmp (bgp, ri, best))
+	best = ri;
+    }
+  return best;
+}
+
 static int
 bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
                                struct bgp_node *rn, afi_t afi, safi_t safi)
 {
   struct prefix *p;
   struct attr attr = { 0 };
+  struct attr *announce;
 
   p = &rn->p;
 
@@ -1371,8 +1497,10 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
       case BGP_TABLE_MAIN:
       /* Announcement to peer->conf.  If the route is filtered,
          withdraw it. */
-        if (selected && bgp_announce_check (selected, peer, p, &attr, afi, safi))
-          bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
+        if (selected
+            && (announce = bgp_announce_check_group (selected, peer, p,
+                                                     afi, safi)) != NULL)
+          bgp_adj_out_set (rn, peer, p, announce, afi, safi, selected);
         else
           bgp_adj_out_unset (rn, peer, p, afi, safi);
         break;
@@ -1413,46 +1541,50 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
   struct bgp_info_pair old_and_new;
   struct listnode *node, *nnode;
   struct peer *rsclient = rn->table->owner;
+  struct list *clients = NULL;
+  int changed;
   
   /* Best path selection. */
   bgp_best_selection (bgp, rn, &old_and_new);
   new_select = old_and_new.new;
   old_select = old_and_new.old;
 
-  if (CHECK_FLAG (rsclient->sflags, PEER_STATUS_GROUP))
-    {
-      if (rsclient->group)
-        for (ALL_LIST_ELEMENTS (rsclient->group->peer, node, nnode, rsclient))
-          {
-            /* Nothing to do. */
-            if (old_select && old_select == new_select)
-              if (!CHECK_FLAG (old_select->flags, BGP_INFO_ATTR_CHANGED))
-                continue;
-
-            if (old_select)
-              bgp_info_unset_flag (rn, old_select, BGP_INFO_SELECTED);
-            if (new_select)
-              {
-                bgp_info_set_flag (rn, new_select, BGP_INFO_SELECTED);
-                bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
-              }
+  changed = (! old_select || old_select != new_select
+	     || CHECK_FLAG (old_select->flags, BGP_INFO_ATTR_CHANGED));
 
-            bgp_process_announce_selected (rsclient, new_select, rn,
-                                           afi, safi);
-          }
-    }
-  else
+  if (old_select)
+    bgp_info_unset_flag (rn, old_select, BGP_INFO_SELECTED);
+  if (new_select)
     {
-      if (old_select)
-	bgp_info_unset_flag (rn, old_select, BGP_INFO_SELECTED);
-      if (new_select)
-	{
-	  bgp_info_set_flag (rn, new_select, BGP_INFO_SELECTED);
-	  bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
-	}
-      bgp_process_announce_selected (rsclient, new_select, rn, afi, safi);
+      bgp_info_set_flag (rn, new_select, BGP_INFO_SELECTED);
+      bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
     }
 
+  /* Everyone the table is shared by, see bgp_rsrib.c.  */
+  if (rn->table->rsclients)
+    clients = rn->table->rsclients;
+  else if (CHECK_FLAG (rsclient->sflags, PEER_STATUS_GROUP))
+    clients = rsclient->group ? rsclient->group->peer : NULL;
+  else
+    bgp_process_announce_selected (rsclient,
+				   bgp_rsclient_select (bgp, rn, new_select,
+							rsclient),
+				   rn, afi, safi);
+
+  if (clients)
+    for (ALL_LIST_ELEMENTS (clients, node, nnode, rsclient))
+      {
+	/* Nothing to do, unless the client gets some other route. */
+	if (! changed && bgp_rsclient_usable (new_select, rsclient))
+	  continue;
+
+	bgp_process_announce_selected (rsclient,
+				       bgp_rsclient_select (bgp, rn,
+							    new_select,
+							    rsclient),
+				       rn, afi, safi);
+      }
+
   if (old_select && CHECK_FLAG (old_select->flags, BGP_INFO_REMOVED))
     bgp_info_reap (rn, old_select);
   
@@ -1486,7 +1618,10 @@ bgp_process_main (struct work_queue *wq, void *data)
       if (! CHECK_FLAG (old_select->flags, BGP_INFO_ATTR_CHANGED))
         {
           if (CHECK_FLAG (old_select->flags, BGP_INFO_IGP_CHANGED))
-            bgp_zebra_announce (p, old_select, bgp, safi);
+            {
+              bgp_zebra_announce (p, old_select, bgp, safi);
+              UNSET_FLAG (old_select->flags, BGP_INFO_IGP_CHANGED);
+            }
           
           UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
           return WQ_SUCCESS;
@@ -1502,7 +1637,9 @@ bgp_process_main (struct work_queue *wq, void *data)
     }
 
 
-  /* Check each BGP peer. */
+  /* Check each BGP peer, update groups work out the announcement
+     for this node afresh.  */
+  update_group_round++;
   for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
     {
       bgp_process_announce_selected (peer, new_select, rn, afi, safi);
@@ -1515,7 +1652,10 @@ bgp_process_main (struct work_queue *wq, void *data)
       if (new_select 
 	  && new_select->type == ZEBRA_ROUTE_BGP 
 	  && new_select->sub_type == BGP_ROUTE_NORMAL)
-	bgp_zebra_announce (p, new_select, bgp, safi);
+	{
+	  bgp_zebra_announce (p, new_select, bgp, safi);
+	  UNSET_FLAG (new_select->flags, BGP_INFO_IGP_CHANGED);
+	}
       else
 	{
 	  /* Withdraw the route from the kernel. */
@@ -1753,10 +1893,8 @@ bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
   const char *reason;
   char buf[SU_ADDRSTRLEN];
 
-  /* Do not insert announces from a rsclient into its own 'bgp_table'. */
-  if (peer == rsclient)
-    return;
-
+  /* Announces from the rsclient itself go into its table as well, for
+     the other clients sharing it, see bgp_rsclient_usable().  */
   bgp = peer->bgp;
   rn = bgp_afi_node_get (rsclient->rib[afi][safi], afi, safi, p, prd);
 
@@ -1772,14 +1910,6 @@ bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
       goto filtered;
     }
 
-  /* Route reflector originator ID check.  */
-  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
-      && IPV4_ADDR_SAME (&rsclient->remote_id, &attr->extra->originator_id))
-    {
-      reason = "originator is us;";
-      goto filtered;
-    }
-  
   bgp_attr_dup (&new_attr, attr);
 
   /* Apply export policy. */
@@ -1943,9 +2073,6 @@ bgp_withdraw_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
   struct bgp_info *ri;
   char buf[SU_ADDRSTRLEN];
 
-  if (rsclient == peer)
-    return;
-
   rn = bgp_afi_node_get (rsclient->rib[afi][safi], afi, safi, p, prd);
 
   /* Lookup withdrawn route. */
@@ -2197,7 +2324,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	      || (peer_sort (peer) == BGP_PEER_EBGP && peer->ttl != 1)
 	      || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
 	{
-	  if (bgp_nexthop_lookup (afi, peer, ri, NULL, NULL))
+	  if (bgp_nexthop_lookup (afi, peer, ri))
 	    bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
 	  else
 	    bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
@@ -2244,7 +2371,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	  || (peer_sort (peer) == BGP_PEER_EBGP && peer->ttl != 1)
 	  || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
     {
-      if (bgp_nexthop_lookup (afi, peer, new, NULL, NULL))
+      if (bgp_nexthop_lookup (afi, peer, new))
 	bgp_info_set_flag (rn, new, BGP_INFO_VALID);
       else
         bgp_info_unset_flag (rn, new, BGP_INFO_VALID);
@@ -2308,10 +2435,11 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
 
   bgp = peer->bgp;
 
-  /* Process the update for each RS-client. */
+  /* Process the update for each RS-client table. */
   for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
     {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+          && BGP_RSRIB_OWNER (rsclient, afi, safi))
         bgp_update_rsclient (rsclient, afi, safi, attr, peer, p, type,
                 sub_type, prd, tag);
     }
@@ -2333,10 +2461,11 @@ bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr,
 
   bgp = peer->bgp;
 
-  /* Process the withdraw for each RS-client. */
+  /* Process the withdraw for each RS-client table. */
   for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
     {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+          && BGP_RSRIB_OWNER (rsclient, afi, safi))
         bgp_withdraw_rsclient (rsclient, afi, safi, peer, p, type, sub_type, prd, tag);
     }
 
@@ -2479,8 +2608,15 @@ bgp_announce_table (struct peer *peer, afi_t afi, safi_t safi,
     bgp_default_originate (peer, afi, safi, 0);
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next(rn))
-    for (ri = rn->info; ri; ri = ri->next)
-      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED) && ri->peer != peer)
+    {
+      for (ri = rn->info; ri; ri = ri->next)
+	if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+	  break;
+
+      if (ri && rsclient)
+	ri = bgp_rsclient_select (peer->bgp, rn, ri, peer);
+
+      if (ri && ri->peer != peer)
 	{
          if ( (rsclient) ?
               (bgp_announce_check_rsclient (ri, peer, &rn->p, &attr, afi, safi))
@@ -2491,6 +2627,44 @@ bgp_announce_table (struct peer *peer, afi_t afi, safi_t safi,
           
           bgp_attr_extra_free (&attr);
 	}
+    }
+}
+
+/* Bring what RSCLIENT was sent in line with the RS-client table it
+   was just moved to.  A table that was only now filled in has its
+   routes processed and announced anyway; then only prefixes it does
+   not have are withdrawn.  */
+void
+bgp_announce_rsclient_table (struct peer *rsclient, afi_t afi, safi_t safi,
+			     int filled)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct bgp_adj_out *adj, *next;
+
+  if (filled)
+    {
+      for (adj = rsclient->adj_outs[afi][safi]; adj; adj = next)
+	{
+	  next = adj->peer_next;
+	  if (adj->rn->table == rsclient->rib[afi][safi] && ! adj->rn->info)
+	    bgp_adj_out_unset (adj->rn, rsclient, &adj->rn->p, afi, safi);
+	}
+      return;
+    }
+
+  for (rn = bgp_table_top (rsclient->rib[afi][safi]); rn;
+       rn = bgp_route_next (rn))
+    {
+      for (ri = rn->info; ri; ri = ri->next)
+	if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+	  break;
+
+      bgp_process_announce_selected (rsclient,
+				     bgp_rsclient_select (rsclient->bgp, rn,
+							  ri, rsclient),
+				     rn, afi, safi);
+    }
 }
 
 void
@@ -2566,57 +2740,34 @@ bgp_soft_reconfig_rsclient (struct peer *rsclient, afi_t afi, safi_t safi)
         bgp_soft_reconfig_table_rsclient (rsclient, afi, safi, table);
 }
 
-static void
-bgp_soft_reconfig_table (struct peer *peer, afi_t afi, safi_t safi,
-			 struct bgp_table *table)
-{
-  int ret;
-  struct bgp_node *rn;
-  struct bgp_adj_in *ain;
-
-  if (! table)
-    table = peer->bgp->rib[afi][safi];
-
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain; ain = ain->next)
-      {
-	if (ain->peer == peer)
-	  {
-	    ret = bgp_update (peer, &rn->p, ain->attr, afi, safi,
-			      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
-			      NULL, NULL, 1);
-	    if (ret < 0)
-	      {
-		bgp_unlock_node (rn);
-		return;
-	      }
-	    continue;
-	  }
-      }
-}
-
+/* Run the peer's stored updates through the inbound policy again.
+   The peer's adj-in list holds exactly these, VPN ones included.  */
 void
 bgp_soft_reconfig_in (struct peer *peer, afi_t afi, safi_t safi)
 {
-  struct bgp_node *rn;
-  struct bgp_table *table;
+  int ret;
+  struct bgp_adj_in *ain, *next;
 
   if (peer->status != Established)
     return;
 
-  if (safi != SAFI_MPLS_VPN)
-    bgp_soft_reconfig_table (peer, afi, safi, NULL);
-  else
-    for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-	 rn = bgp_route_next (rn))
-      if ((table = rn->info) != NULL)
-	bgp_soft_reconfig_table (peer, afi, safi, table);
+  for (ain = peer->adj_ins[afi][safi]; ain; ain = next)
+    {
+      next = ain->peer_next;
+      ret = bgp_update (peer, &ain->rn->p, ain->attr, afi, safi,
+			ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 1);
+      if (ret < 0)
+	return;
+    }
 }
 
 
+/* Clearing work item.  RI is the route to clear when the peer's own
+   routes are being cleared, otherwise the first route at RN is.  */
 struct bgp_clear_node_queue
 {
   struct bgp_node *rn;
+  struct bgp_info *ri;
   enum bgp_clear_route_type purpose;
 };
 
@@ -2632,19 +2783,24 @@ bgp_clear_route_node (struct work_queue *wq, void *data)
   
   assert (rn && peer);
   
-  for (ri = rn->info; ri; ri = ri->next)
-    if (ri->peer == peer || cnq->purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
-      {
-        /* graceful restart STALE flag set. */
-        if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT)
-            && peer->nsf[afi][safi]
-            && ! CHECK_FLAG (ri->flags, BGP_INFO_STALE)
-            && ! CHECK_FLAG (ri->flags, BGP_INFO_UNUSEABLE))
-          bgp_info_set_flag (rn, ri, BGP_INFO_STALE);
-        else
-          bgp_rib_remove (rn, ri, peer, afi, safi);
+  if (cnq->ri)
+    ri = (cnq->ri->net == rn) ? cnq->ri : NULL;
+  else
+    for (ri = rn->info; ri; ri = ri->next)
+      if (ri->peer == peer || cnq->purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
         break;
-      }
+
+  if (ri)
+    {
+      /* graceful restart STALE flag set. */
+      if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT)
+          && peer->nsf[afi][safi]
+          && ! CHECK_FLAG (ri->flags, BGP_INFO_STALE)
+          && ! CHECK_FLAG (ri->flags, BGP_INFO_UNUSEABLE))
+        bgp_info_set_flag (rn, ri, BGP_INFO_STALE);
+      else
+        bgp_rib_remove (rn, ri, peer, afi, safi);
+    }
   return WQ_SUCCESS;
 }
 
@@ -2655,11 +2811,32 @@ bgp_clear_node_queue_del (struct work_queue *wq, void *data)
   struct bgp_node *rn = cnq->rn;
   struct bgp_table *table = rn->table;
   
+  if (cnq->ri)
+    bgp_info_unlock (cnq->ri);
   bgp_unlock_node (rn); 
   bgp_table_unlock (table);
   XFREE (MTYPE_BGP_CLEAR_NODE_QUEUE, cnq);
 }
 
+static void
+bgp_clear_node_queue_add (struct peer *peer, struct bgp_node *rn,
+                          struct bgp_info *ri,
+                          enum bgp_clear_route_type purpose)
+{
+  struct bgp_clear_node_queue *cnq;
+
+  /* all unlocked in bgp_clear_node_queue_del */
+  bgp_table_lock (rn->table);
+  bgp_lock_node (rn);
+  cnq = XCALLOC (MTYPE_BGP_CLEAR_NODE_QUEUE,
+                 sizeof (struct bgp_clear_node_queue));
+  cnq->rn = rn;
+  if (ri)
+    cnq->ri = bgp_info_lock (ri);
+  cnq->purpose = purpose;
+  work_queue_add (peer->clear_node_queue, cnq);
+}
+
 static void
 bgp_clear_node_complete (struct work_queue *wq)
 {
@@ -2718,9 +2895,8 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
       if (rn->info == NULL)
         continue;
 
-      /* XXX:TODO: This is suboptimal, every non-empty route_node is
-       * queued for every clearing peer, regardless of whether it is
-       * relevant to the peer at hand.
+      /* Only used to clear a route server client's own table now,
+       * a peer's routes elsewhere are found by bgp_clear_route_peer.
        *
        * Overview: There are 3 different indices which need to be
        * scrubbed, potentially, when a peer is removed:
@@ -2752,16 +2928,7 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
       for (ri = rn->info; ri; ri = ri->next)
         if (ri->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
           {
-            struct bgp_clear_node_queue *cnq;
-
-            /* both unlocked in bgp_clear_node_queue_del */
-            bgp_table_lock (rn->table);
-            bgp_lock_node (rn);
-            cnq = XCALLOC (MTYPE_BGP_CLEAR_NODE_QUEUE,
-                           sizeof (struct bgp_clear_node_queue));
-            cnq->rn = rn;
-            cnq->purpose = purpose;
-            work_queue_add (peer->clear_node_queue, cnq);
+            bgp_clear_node_queue_add (peer, rn, NULL, purpose);
             break;
           }
 
@@ -2783,21 +2950,47 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
   return;
 }
 
-void
-bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
-                 enum bgp_clear_route_type purpose)
+/* Queue the peer's routes in AFI/SAFI for clearing, in the main RIB,
+   any VPN tables and route server client tables alike, and drop its
+   adjacencies there.  Only the peer's own entries are visited.  */
+static void
+bgp_clear_route_peer (struct peer *peer, afi_t afi, safi_t safi)
 {
+  struct bgp_info *ri;
+  struct bgp_adj_in *ain, *ain_next;
+  struct bgp_adj_out *aout, *aout_next;
   struct bgp_node *rn;
-  struct bgp_table *table;
-  struct peer *rsclient;
-  struct listnode *node, *nnode;
 
-  if (peer->clear_node_queue == NULL)
-    bgp_clear_node_queue_init (peer);
-  
-  /* bgp_fsm.c keeps sessions in state Clearing, not transitioning to
-   * Idle until it receives a Clearing_Completed event. This protects
-   * against peers which flap faster than we can we clear, which could
+  for (ri = peer->paths[afi][safi]; ri; ri = ri->peer_next)
+    bgp_clear_node_queue_add (peer, ri->net, ri, BGP_CLEAR_ROUTE_NORMAL);
+
+  for (ain = peer->adj_ins[afi][safi]; ain; ain = ain_next)
+    {
+      ain_next = ain->peer_next;
+      rn = ain->rn;
+      bgp_adj_in_remove (rn, ain);
+      bgp_unlock_node (rn);
+    }
+
+  for (aout = peer->adj_outs[afi][safi]; aout; aout = aout_next)
+    {
+      aout_next = aout->peer_next;
+      rn = aout->rn;
+      bgp_adj_out_remove (rn, aout, peer, afi, safi);
+      bgp_unlock_node (rn);
+    }
+}
+
+void
+bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
+                 enum bgp_clear_route_type purpose)
+{
+  if (peer->clear_node_queue == NULL)
+    bgp_clear_node_queue_init (peer);
+  
+  /* bgp_fsm.c keeps sessions in state Clearing, not transitioning to
+   * Idle until it receives a Clearing_Completed event. This protects
+   * against peers which flap faster than we can we clear, which could
    * lead to:
    *
    * a) race with routes from the new session being installed before
@@ -2813,18 +3006,7 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
   switch (purpose)
     {
     case BGP_CLEAR_ROUTE_NORMAL:
-      if (safi != SAFI_MPLS_VPN)
-        bgp_clear_route_table (peer, afi, safi, NULL, NULL, purpose);
-      else
-        for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-             rn = bgp_route_next (rn))
-          if ((table = rn->info) != NULL)
-            bgp_clear_route_table (peer, afi, safi, table, NULL, purpose);
-
-      for (ALL_LIST_ELEMENTS (peer->bgp->rsclient, node, nnode, rsclient))
-        if (CHECK_FLAG(rsclient->af_flags[afi][safi],
-                       PEER_FLAG_RSERVER_CLIENT))
-          bgp_clear_route_table (peer, afi, safi, NULL, rsclient, purpose);
+      bgp_clear_route_peer (peer, afi, safi);
       break;
 
     case BGP_CLEAR_ROUTE_MY_RSCLIENT:
@@ -2838,8 +3020,6 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
   
   /* If no routes were cleared, nothing was added to workqueue, the
    * completion function won't be run by workqueue code - call it here. 
-   * XXX: Actually, this assumption doesn't hold, see
-   * bgp_clear_route_table(), we queue all non-empty nodes.
    *
    * Additionally, there is a presumption in FSM that clearing is only
    * really needed if peer state is Established - peers in
@@ -2870,43 +3050,93 @@ bgp_clear_route_all (struct peer *peer)
       bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_NORMAL);
 }
 
+/* Empty an RS-client table no client uses any longer.  There is no
+   one left to tell, so routes are dropped without processing.  */
 void
-bgp_clear_adj_in (struct peer *peer, afi_t afi, safi_t safi)
+bgp_clear_rsclient_table (struct bgp_table *table)
 {
-  struct bgp_table *table;
   struct bgp_node *rn;
-  struct bgp_adj_in *ain;
-
-  table = peer->bgp->rib[afi][safi];
+  struct bgp_info *ri, *ri_next;
+  struct bgp_adj_out *aout, *aout_next;
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain ; ain = ain->next)
-      if (ain->peer == peer)
+    {
+      for (ri = rn->info; ri; ri = ri_next)
 	{
-          bgp_adj_in_remove (rn, ain);
-          bgp_unlock_node (rn);
-          break;
+	  ri_next = ri->next;
+	  bgp_info_reap (rn, ri);
 	}
+      for (aout = rn->adj_out; aout; aout = aout_next)
+	{
+	  aout_next = aout->next;
+	  bgp_adj_out_remove (rn, aout, aout->peer, table->afi, table->safi);
+	  bgp_unlock_node (rn);
+	}
+    }
 }
 
+/* Start the fresh RS-client table TO off with the routes of FROM, the
+   table its owner was in, as far as they pass the owner's AS check.
+   They stand until the announcing peers send them again, so that
+   nothing is withdrawn from the clients moving along meanwhile.  */
 void
-bgp_clear_stale_route (struct peer *peer, afi_t afi, safi_t safi)
+bgp_copy_rsclient_table (struct bgp_table *from, struct bgp_table *to)
+{
+  struct peer *rsclient = to->owner;
+  struct bgp_node *rn, *rm;
+  struct bgp_info *ri, *new;
+
+  for (rn = bgp_table_top (from); rn; rn = bgp_route_next (rn))
+    for (ri = rn->info; ri; ri = ri->next)
+      {
+	if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED)
+	    || ! CHECK_FLAG (ri->flags, BGP_INFO_VALID))
+	  continue;
+	if (aspath_loop_check (ri->attr->aspath, rsclient->as)
+	    > ri->peer->allowas_in[to->afi][to->safi])
+	  continue;
+
+	rm = bgp_node_get (to, &rn->p);
+
+	new = bgp_info_new ();
+	new->type = ri->type;
+	new->sub_type = ri->sub_type;
+	new->peer = ri->peer;
+	new->attr = bgp_attr_intern (ri->attr);
+	new->uptime = ri->uptime;
+	bgp_info_set_flag (rm, new, BGP_INFO_VALID);
+	bgp_info_add (rm, new);
+
+	bgp_unlock_node (rm);
+	bgp_process (rsclient->bgp, rm, to->afi, to->safi);
+      }
+}
+
+void
+bgp_clear_adj_in (struct peer *peer, afi_t afi, safi_t safi)
 {
+  struct bgp_adj_in *ain, *next;
   struct bgp_node *rn;
-  struct bgp_info *ri;
-  struct bgp_table *table;
 
-  table = peer->bgp->rib[afi][safi];
+  for (ain = peer->adj_ins[afi][safi]; ain; ain = next)
+    {
+      next = ain->peer_next;
+      rn = ain->rn;
+      bgp_adj_in_remove (rn, ain);
+      bgp_unlock_node (rn);
+    }
+}
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+void
+bgp_clear_stale_route (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_info *ri, *next;
+
+  for (ri = peer->paths[afi][safi]; ri; ri = next)
     {
-      for (ri = rn->info; ri; ri = ri->next)
-	if (ri->peer == peer)
-	  {
-	    if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
-	      bgp_rib_remove (rn, ri, peer, afi, safi);
-	    break;
-	  }
+      next = ri->peer_next;
+      if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
+	bgp_rib_remove (ri->net, ri, peer, afi, safi);
     }
 }
 
@@ -3443,7 +3673,8 @@ bgp_static_update (struct bgp *bgp, struct prefix *p,
 
   for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
     {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+          && BGP_RSRIB_OWNER (rsclient, afi, safi))
         bgp_static_update_rsclient (rsclient, p, bgp_static, afi, safi);
     }
 }
@@ -4359,13 +4590,134 @@ struct bgp_aggregate
   /* Route-map for aggregated route. */
   struct route_map *map;
 
-  /* Suppress-count. */
+  /* Number of routes aggregated. */
   unsigned long count;
 
+  /* With as-set, how many of those routes have each origin, and the
+     distinct AS paths and communities among them with the number of
+     routes having each.  The aggregate's attributes are made from
+     these, so a route coming or going only means working them out
+     again when it brings or takes the last of something. */
+  unsigned long origin_count[BGP_ORIGIN_INCOMPLETE + 1];
+  struct hash *aspath_hash;
+  struct hash *community_hash;
+
   /* SAFI configuration. */
   safi_t safi;
 };
 
+/* An AS path or community of the routes of an as-set aggregate. */
+struct bgp_aggregate_ref
+{
+  void *data;
+  unsigned long count;
+};
+
+static unsigned int
+bgp_aggregate_ref_hash_key (void *p)
+{
+  struct bgp_aggregate_ref *ref = p;
+
+  return jhash_1word ((u_int32_t) (uintptr_t) ref->data, 0);
+}
+
+static int
+bgp_aggregate_ref_hash_cmp (const void *p1, const void *p2)
+{
+  const struct bgp_aggregate_ref *ref1 = p1;
+  const struct bgp_aggregate_ref *ref2 = p2;
+
+  return ref1->data == ref2->data;
+}
+
+static void *
+bgp_aggregate_ref_alloc (void *p)
+{
+  struct bgp_aggregate_ref *val = p;
+  struct bgp_aggregate_ref *ref;
+
+  ref = XMALLOC (MTYPE_BGP_AGGREGATE, sizeof (struct bgp_aggregate_ref));
+  ref->data = val->data;
+  ref->count = 0;
+  return ref;
+}
+
+/* Count one more route having DATA, an interned AS path or
+   community.  Return 1 if no route had it before. */
+static int
+bgp_aggregate_ref_add (struct hash **hash, void *data)
+{
+  struct bgp_aggregate_ref lookup;
+  struct bgp_aggregate_ref *ref;
+
+  if (*hash == NULL)
+    *hash = hash_create (bgp_aggregate_ref_hash_key,
+			 bgp_aggregate_ref_hash_cmp);
+
+  lookup.data = data;
+  ref = hash_get (*hash, &lookup, bgp_aggregate_ref_alloc);
+  return ref->count++ == 0;
+}
+
+/* One route less has DATA.  Return 1 if that was the last one, the
+   caller then drops the reference the aggregate held on it. */
+static int
+bgp_aggregate_ref_delete (struct hash *hash, void *data)
+{
+  struct bgp_aggregate_ref lookup;
+  struct bgp_aggregate_ref *ref;
+
+  if (hash == NULL)
+    return 0;
+
+  lookup.data = data;
+  ref = hash_lookup (hash, &lookup);
+  if (ref == NULL || --ref->count > 0)
+    return 0;
+
+  hash_release (hash, ref);
+  XFREE (MTYPE_BGP_AGGREGATE, ref);
+  return 1;
+}
+
+static void
+bgp_aggregate_aspath_free (void *p)
+{
+  struct bgp_aggregate_ref *ref = p;
+
+  aspath_unintern (ref->data);
+  XFREE (MTYPE_BGP_AGGREGATE, ref);
+}
+
+static void
+bgp_aggregate_community_free (void *p)
+{
+  struct bgp_aggregate_ref *ref = p;
+
+  community_unintern (ref->data);
+  XFREE (MTYPE_BGP_AGGREGATE, ref);
+}
+
+/* Forget the routes counted in AGGREGATE. */
+static void
+bgp_aggregate_reset (struct bgp_aggregate *aggregate)
+{
+  aggregate->count = 0;
+  memset (aggregate->origin_count, 0, sizeof (aggregate->origin_count));
+  if (aggregate->aspath_hash)
+    {
+      hash_clean (aggregate->aspath_hash, bgp_aggregate_aspath_free);
+      hash_free (aggregate->aspath_hash);
+      aggregate->aspath_hash = NULL;
+    }
+  if (aggregate->community_hash)
+    {
+      hash_clean (aggregate->community_hash, bgp_aggregate_community_free);
+      hash_free (aggregate->community_hash);
+      aggregate->community_hash = NULL;
+    }
+}
+
 static struct bgp_aggregate *
 bgp_aggregate_new (void)
 {
@@ -4375,35 +4727,14 @@ bgp_aggregate_new (void)
 static void
 bgp_aggregate_free (struct bgp_aggregate *aggregate)
 {
+  bgp_aggregate_reset (aggregate);
   XFREE (MTYPE_BGP_AGGREGATE, aggregate);
 }     
 
-static void
-bgp_aggregate_route (struct bgp *bgp, struct prefix *p, struct bgp_info *rinew,
-		     afi_t afi, safi_t safi, struct bgp_info *del, 
-		     struct bgp_aggregate *aggregate)
+static u_char
+bgp_aggregate_origin (struct bgp_aggregate *aggregate)
 {
-  struct bgp_table *table;
-  struct bgp_node *top;
-  struct bgp_node *rn;
   u_char origin;
-  struct aspath *aspath = NULL;
-  struct aspath *asmerge = NULL;
-  struct community *community = NULL;
-  struct community *commerge = NULL;
-  struct in_addr nexthop;
-  u_int32_t med = 0;
-  struct bgp_info *ri;
-  struct bgp_info *new;
-  int first = 1;
-  unsigned long match = 0;
-
-  /* Record adding route's nexthop and med. */
-  if (rinew)
-    {
-      nexthop = rinew->attr->nexthop;
-      med = rinew->attr->med;
-    }
 
   /* ORIGIN attribute: If at least one route among routes that are
      aggregated has ORIGIN with the value INCOMPLETE, then the
@@ -4413,139 +4744,202 @@ bgp_aggregate_route (struct bgp *bgp, struct prefix *p, struct bgp_info *rinew,
      route must have the origin attribute with the value EGP. In all
      other case the value of the ORIGIN attribute of the aggregated
      route is INTERNAL. */
-  origin = BGP_ORIGIN_IGP;
+  for (origin = BGP_ORIGIN_INCOMPLETE; origin > BGP_ORIGIN_IGP; origin--)
+    if (aggregate->origin_count[origin])
+      break;
+  return origin;
+}
 
-  table = bgp->rib[afi][safi];
+/* Count route RI in AGGREGATE, or stop counting it if DEL.  Return 1
+   if the aggregate route's attributes change with it. */
+static int
+bgp_aggregate_count (struct bgp_aggregate *aggregate, struct bgp_info *ri,
+		     int del)
+{
+  struct attr *attr = ri->attr;
+  u_char origin;
+  int changed = 0;
 
-  top = bgp_node_get (table, p);
-  for (rn = bgp_node_get (table, p); rn; rn = bgp_route_next_until (rn, top))
-    if (rn->p.prefixlen > p->prefixlen)
-      {
-	match = 0;
+  if (! del)
+    {
+      aggregate->count++;
+      if (aggregate->summary_only)
+	(bgp_info_extra_get (ri))->suppress++;
+    }
+  else
+    {
+      aggregate->count--;
+      if (aggregate->summary_only && ri->extra)
+	ri->extra->suppress--;
+    }
 
-	for (ri = rn->info; ri; ri = ri->next)
-	  {
-	    if (BGP_INFO_HOLDDOWN (ri))
-	      continue;
+  if (! aggregate->as_set)
+    return 0;
 
-	    if (del && ri == del)
-	      continue;
+  origin = bgp_aggregate_origin (aggregate);
+  if (attr->origin <= BGP_ORIGIN_INCOMPLETE)
+    {
+      if (! del)
+	aggregate->origin_count[attr->origin]++;
+      else
+	aggregate->origin_count[attr->origin]--;
+    }
+  if (origin != bgp_aggregate_origin (aggregate))
+    changed = 1;
 
-	    if (! rinew && first)
-	      {
-		nexthop = ri->attr->nexthop;
-		med = ri->attr->med;
-		first = 0;
-	      }
+  if (! del)
+    {
+      if (attr->aspath
+	  && bgp_aggregate_ref_add (&aggregate->aspath_hash, attr->aspath))
+	{
+	  attr->aspath->refcnt++;
+	  changed = 1;
+	}
+      if (attr->community
+	  && bgp_aggregate_ref_add (&aggregate->community_hash,
+				    attr->community))
+	{
+	  attr->community->refcnt++;
+	  changed = 1;
+	}
+    }
+  else
+    {
+      if (attr->aspath
+	  && bgp_aggregate_ref_delete (aggregate->aspath_hash, attr->aspath))
+	{
+	  aspath_unintern (attr->aspath);
+	  changed = 1;
+	}
+      if (attr->community
+	  && bgp_aggregate_ref_delete (aggregate->community_hash,
+				       attr->community))
+	{
+	  community_unintern (attr->community);
+	  changed = 1;
+	}
+    }
 
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
-	      {
-		if (aggregate->summary_only)
-		  {
-		    (bgp_info_extra_get (ri))->suppress++;
-		    bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
-		    match++;
-		  }
+  return changed;
+}
 
-		aggregate->count++;
+static void
+bgp_aggregate_aspath_merge (struct hash_backet *backet, void *arg)
+{
+  struct bgp_aggregate_ref *ref = backet->data;
+  struct aspath **aspath = arg;
+  struct aspath *asmerge;
 
-		if (aggregate->as_set)
-		  {
-		    if (origin < ri->attr->origin)
-		      origin = ri->attr->origin;
-
-		    if (aspath)
-		      {
-			asmerge = aspath_aggregate (aspath, ri->attr->aspath);
-			aspath_free (aspath);
-			aspath = asmerge;
-		      }
-		    else
-		      aspath = aspath_dup (ri->attr->aspath);
-
-		    if (ri->attr->community)
-		      {
-			if (community)
-			  {
-			    commerge = community_merge (community,
-							ri->attr->community);
-			    community = community_uniq_sort (commerge);
-			    community_free (commerge);
-			  }
-			else
-			  community = community_dup (ri->attr->community);
-		      }
-		  }
-	      }
-	  }
-	if (match)
-	  bgp_process (bgp, rn, afi, safi);
-      }
-  bgp_unlock_node (top);
+  if (*aspath)
+    {
+      asmerge = aspath_aggregate (*aspath, ref->data);
+      aspath_free (*aspath);
+      *aspath = asmerge;
+    }
+  else
+    *aspath = aspath_dup (ref->data);
+}
 
-  if (rinew)
+static void
+bgp_aggregate_community_merge (struct hash_backet *backet, void *arg)
+{
+  struct bgp_aggregate_ref *ref = backet->data;
+  struct community **community = arg;
+  struct community *commerge;
+
+  if (*community)
     {
-      aggregate->count++;
-      
-      if (aggregate->summary_only)
-        (bgp_info_extra_get (rinew))->suppress++;
+      commerge = community_merge (*community, ref->data);
+      *community = community_uniq_sort (commerge);
+      community_free (commerge);
+    }
+  else
+    *community = community_dup (ref->data);
+}
 
-      if (aggregate->as_set)
-	{
-	  if (origin < rinew->attr->origin)
-	    origin = rinew->attr->origin;
+/* Interned attributes of the aggregate route. */
+static struct attr *
+bgp_aggregate_attr (struct bgp *bgp, struct bgp_aggregate *aggregate)
+{
+  struct aspath *aspath = NULL;
+  struct community *community = NULL;
 
-	  if (aspath)
-	    {
-	      asmerge = aspath_aggregate (aspath, rinew->attr->aspath);
-	      aspath_free (aspath);
-	      aspath = asmerge;
-	    }
-	  else
-	    aspath = aspath_dup (rinew->attr->aspath);
+  if (aggregate->aspath_hash)
+    hash_iterate (aggregate->aspath_hash, bgp_aggregate_aspath_merge,
+		  &aspath);
+  if (aggregate->community_hash)
+    hash_iterate (aggregate->community_hash, bgp_aggregate_community_merge,
+		  &community);
 
-	  if (rinew->attr->community)
-	    {
-	      if (community)
-		{
-		  commerge = community_merge (community,
-					      rinew->attr->community);
-		  community = community_uniq_sort (commerge);
-		  community_free (commerge);
-		}
-	      else
-		community = community_dup (rinew->attr->community);
-	    }
+  return bgp_attr_aggregate_intern (bgp, bgp_aggregate_origin (aggregate),
+				    aspath, community, aggregate->as_set);
+}
+
+/* Bring the aggregate route for P in line with what AGGREGATE has
+   counted: withdraw it if no route is left, otherwise announce it or
+   update its attributes. */
+static void
+bgp_aggregate_update (struct bgp *bgp, struct prefix *p, afi_t afi,
+		      safi_t safi, struct bgp_aggregate *aggregate)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct bgp_info *new;
+  struct attr *attr;
+
+  rn = bgp_node_get (bgp->rib[afi][safi], p);
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == bgp->peer_self
+	&& ri->type == ZEBRA_ROUTE_BGP
+	&& ri->sub_type == BGP_ROUTE_AGGREGATE
+	&& ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+      break;
+
+  if (aggregate->count == 0)
+    {
+      if (ri)
+	{
+	  bgp_info_delete (rn, ri);
+	  bgp_process (bgp, rn, afi, safi);
 	}
+      bgp_unlock_node (rn);
+      return;
     }
 
-  if (aggregate->count > 0)
+  attr = bgp_aggregate_attr (bgp, aggregate);
+
+  if (ri && ri->attr == attr)
+    bgp_attr_unintern (attr);
+  else if (ri)
+    {
+      bgp_attr_unintern (ri->attr);
+      ri->attr = attr;
+      ri->uptime = bgp_clock ();
+      bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+      bgp_process (bgp, rn, afi, safi);
+    }
+  else
     {
-      rn = bgp_node_get (table, p);
       new = bgp_info_new ();
       new->type = ZEBRA_ROUTE_BGP;
       new->sub_type = BGP_ROUTE_AGGREGATE;
       new->peer = bgp->peer_self;
       SET_FLAG (new->flags, BGP_INFO_VALID);
-      new->attr = bgp_attr_aggregate_intern (bgp, origin, aspath, community, aggregate->as_set);
+      new->attr = attr;
       new->uptime = bgp_clock ();
 
       bgp_info_add (rn, new);
-      bgp_unlock_node (rn);
       bgp_process (bgp, rn, afi, safi);
     }
-  else
-    {
-      if (aspath)
-	aspath_free (aspath);
-      if (community)
-	community_free (community);
-    }
-}
 
-void bgp_aggregate_delete (struct bgp *, struct prefix *, afi_t, safi_t,
-			   struct bgp_aggregate *);
+  bgp_unlock_node (rn);
+}
 
+/* A route for P became usable.  It is counted in each aggregate
+   covering it, and only aggregates whose route changes with it are
+   updated; the other routes under the aggregates are not looked
+   at. */
 void
 bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
 			 struct bgp_info *ri, afi_t afi, safi_t safi)
@@ -4561,8 +4955,12 @@ bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
   if (p->prefixlen == 0)
     return;
 
-  if (BGP_INFO_HOLDDOWN (ri))
+  if (BGP_INFO_HOLDDOWN (ri) || ri->sub_type == BGP_ROUTE_AGGREGATE)
+    return;
+
+  if (CHECK_FLAG (ri->flags, BGP_INFO_AGGREGATED))
     return;
+  SET_FLAG (ri->flags, BGP_INFO_AGGREGATED);
 
   child = bgp_node_get (bgp->aggregate[afi][safi], p);
 
@@ -4570,12 +4968,13 @@ bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
   for (rn = child; rn; rn = rn->parent)
     if ((aggregate = rn->info) != NULL && rn->p.prefixlen < p->prefixlen)
       {
-	bgp_aggregate_delete (bgp, &rn->p, afi, safi, aggregate);
-	bgp_aggregate_route (bgp, &rn->p, ri, afi, safi, NULL, aggregate);
+	if (bgp_aggregate_count (aggregate, ri, 0) || aggregate->count == 1)
+	  bgp_aggregate_update (bgp, &rn->p, afi, safi, aggregate);
       }
   bgp_unlock_node (child);
 }
 
+/* A route for P is going away or becoming unusable. */
 void
 bgp_aggregate_decrement (struct bgp *bgp, struct prefix *p, 
 			 struct bgp_info *del, afi_t afi, safi_t safi)
@@ -4583,13 +4982,11 @@ bgp_aggregate_decrement (struct bgp *bgp, struct prefix *p,
   struct bgp_node *child;
   struct bgp_node *rn;
   struct bgp_aggregate *aggregate;
+  int unsuppress = 0;
 
-  /* MPLS-VPN aggregation is not yet supported. */
-  if (safi == SAFI_MPLS_VPN)
-    return;
-
-  if (p->prefixlen == 0)
+  if (! CHECK_FLAG (del->flags, BGP_INFO_AGGREGATED))
     return;
+  UNSET_FLAG (del->flags, BGP_INFO_AGGREGATED);
 
   child = bgp_node_get (bgp->aggregate[afi][safi], p);
 
@@ -4597,12 +4994,19 @@ bgp_aggregate_decrement (struct bgp *bgp, struct prefix *p,
   for (rn = child; rn; rn = rn->parent)
     if ((aggregate = rn->info) != NULL && rn->p.prefixlen < p->prefixlen)
       {
-	bgp_aggregate_delete (bgp, &rn->p, afi, safi, aggregate);
-	bgp_aggregate_route (bgp, &rn->p, NULL, afi, safi, del, aggregate);
+	if (aggregate->summary_only)
+	  unsuppress = 1;
+	if (bgp_aggregate_count (aggregate, del, 1) || aggregate->count == 0)
+	  bgp_aggregate_update (bgp, &rn->p, afi, safi, aggregate);
       }
   bgp_unlock_node (child);
+
+  /* The route may be announced again. */
+  if (unsuppress && del->extra && del->extra->suppress == 0)
+    SET_FLAG (del->flags, BGP_INFO_ATTR_CHANGED);
 }
 
+/* An aggregate was configured: count the routes already under it. */
 static void
 bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
 		   struct bgp_aggregate *aggregate)
@@ -4610,14 +5014,8 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
   struct bgp_table *table;
   struct bgp_node *top;
   struct bgp_node *rn;
-  struct bgp_info *new;
   struct bgp_info *ri;
   unsigned long match;
-  u_char origin = BGP_ORIGIN_IGP;
-  struct aspath *aspath = NULL;
-  struct aspath *asmerge = NULL;
-  struct community *community = NULL;
-  struct community *commerge = NULL;
 
   table = bgp->rib[afi][safi];
 
@@ -4636,49 +5034,16 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
 
 	for (ri = rn->info; ri; ri = ri->next)
 	  {
-	    if (BGP_INFO_HOLDDOWN (ri))
+	    if (! CHECK_FLAG (ri->flags, BGP_INFO_AGGREGATED))
 	      continue;
 
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
+	    /* summary-only aggregate route suppress aggregated
+	       route announcement.  */
+	    bgp_aggregate_count (aggregate, ri, 0);
+	    if (aggregate->summary_only)
 	      {
-		/* summary-only aggregate route suppress aggregated
-		   route announcement.  */
-		if (aggregate->summary_only)
-		  {
-		    (bgp_info_extra_get (ri))->suppress++;
-		    bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
-		    match++;
-		  }
-		/* as-set aggregate route generate origin, as path,
-		   community aggregation.  */
-		if (aggregate->as_set)
-		  {
-		    if (origin < ri->attr->origin)
-		      origin = ri->attr->origin;
-
-		    if (aspath)
-		      {
-			asmerge = aspath_aggregate (aspath, ri->attr->aspath);
-			aspath_free (aspath);
-			aspath = asmerge;
-		      }
-		    else
-		      aspath = aspath_dup (ri->attr->aspath);
-
-		    if (ri->attr->community)
-		      {
-			if (community)
-			  {
-			    commerge = community_merge (community,
-							ri->attr->community);
-			    community = community_uniq_sort (commerge);
-			    community_free (commerge);
-			  }
-			else
-			  community = community_dup (ri->attr->community);
-		      }
-		  }
-		aggregate->count++;
+		bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+		match++;
 	      }
 	  }
 	
@@ -4690,26 +5055,12 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
 
   /* Add aggregate route to BGP table. */
   if (aggregate->count)
-    {
-      rn = bgp_node_get (table, p);
-
-      new = bgp_info_new ();
-      new->type = ZEBRA_ROUTE_BGP;
-      new->sub_type = BGP_ROUTE_AGGREGATE;
-      new->peer = bgp->peer_self;
-      SET_FLAG (new->flags, BGP_INFO_VALID);
-      new->attr = bgp_attr_aggregate_intern (bgp, origin, aspath, community, aggregate->as_set);
-      new->uptime = bgp_clock ();
-
-      bgp_info_add (rn, new);
-      bgp_unlock_node (rn);
-      
-      /* Process change. */
-      bgp_process (bgp, rn, afi, safi);
-    }
+    bgp_aggregate_update (bgp, p, afi, safi, aggregate);
 }
 
-void
+/* The aggregate is being unconfigured: release the routes under it
+   and withdraw its route. */
+static void
 bgp_aggregate_delete (struct bgp *bgp, struct prefix *p, afi_t afi, 
 		      safi_t safi, struct bgp_aggregate *aggregate)
 {
@@ -4735,22 +5086,15 @@ bgp_aggregate_delete (struct bgp *bgp, struct prefix *p, afi_t afi,
 
 	for (ri = rn->info; ri; ri = ri->next)
 	  {
-	    if (BGP_INFO_HOLDDOWN (ri))
+	    if (! CHECK_FLAG (ri->flags, BGP_INFO_AGGREGATED))
 	      continue;
 
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
+	    bgp_aggregate_count (aggregate, ri, 1);
+	    if (aggregate->summary_only && ri->extra
+		&& ri->extra->suppress == 0)
 	      {
-		if (aggregate->summary_only && ri->extra)
-		  {
-		    ri->extra->suppress--;
-
-		    if (ri->extra->suppress == 0)
-		      {
-			bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
-			match++;
-		      }
-		  }
-		aggregate->count--;
+		bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+		match++;
 	      }
 	  }
 
@@ -4760,24 +5104,9 @@ bgp_aggregate_delete (struct bgp *bgp, struct prefix *p, afi_t afi,
       }
   bgp_unlock_node (top);
 
-  /* Delete aggregate route from BGP table. */
-  rn = bgp_node_get (table, p);
-
-  for (ri = rn->info; ri; ri = ri->next)
-    if (ri->peer == bgp->peer_self 
-	&& ri->type == ZEBRA_ROUTE_BGP
-	&& ri->sub_type == BGP_ROUTE_AGGREGATE)
-      break;
-
-  /* Withdraw static BGP route from routing table. */
-  if (ri)
-    {
-      bgp_info_delete (rn, ri);
-      bgp_process (bgp, rn, afi, safi);
-    }
-
-  /* Unlock bgp_node_lookup. */
-  bgp_unlock_node (rn);
+  /* Withdraw the aggregate route. */
+  bgp_aggregate_reset (aggregate);
+  bgp_aggregate_update (bgp, p, afi, safi, aggregate);
 }
 
 /* Aggregate route attribute. */
@@ -56,6 +56,19 @@ struct bgp_info
   
   /* Extra information */
   struct bgp_info_extra *extra;
+
+  /* Node this route hangs off, set by bgp_info_add.  */
+  struct bgp_node *net;
+
+  /* Nexthop this route resolves through, and the other routes
+     depending on it.  See bgp_nexthop_lookup.  */
+  struct bgp_nexthop_cache *nexthop;
+  struct bgp_info *nh_next;
+  struct bgp_info *nh_prev;
+
+  /* The peer's other routes, see BGP_PEER_LIST_ADD.  */
+  struct bgp_info *peer_next;
+  struct bgp_info *peer_prev;
   
   /* Uptime.  */
   time_t uptime;
@@ -76,6 +89,7 @@ struct bgp_info
 #define BGP_INFO_STALE          (1 << 8)
 #define BGP_INFO_REMOVED        (1 << 9)
 #define BGP_INFO_COUNTED	(1 << 10)
+#define BGP_INFO_AGGREGATED	(1 << 11)
 
   /* BGP route type.  This can be static, RIP, OSPF, BGP etc.  */
   u_char type;
@@ -178,6 +192,9 @@ extern void bgp_clear_route (struct peer *, afi_t, safi_t,
 extern void bgp_clear_route_all (struct peer *);
 extern void bgp_clear_adj_in (struct peer *, afi_t, safi_t);
 extern void bgp_clear_stale_route (struct peer *, afi_t, safi_t);
+extern void bgp_clear_rsclient_table (struct bgp_table *);
+extern void bgp_copy_rsclient_table (struct bgp_table *, struct bgp_table *);
+extern void bgp_announce_rsclient_table (struct peer *, afi_t, safi_t, int);
 
 extern struct bgp_info *bgp_info_lock (struct bgp_info *);
 extern struct bgp_info *bgp_info_unlock (struct bgp_info *);
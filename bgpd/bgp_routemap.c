@@ -53,6 +53,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_ecommunity.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_zebra.h"
+#include "bgpd/bgp_rsrib.h"
+#include "bgpd/bgp_updgrp.h"
 
 /* Memo of route-map commands.
 
@@ -566,7 +568,8 @@ struct route_map_rule_cmd route_match_metric_cmd =
   "metric",
   route_match_metric,
   route_match_metric_compile,
-  route_match_metric_free
+  route_match_metric_free,
+  1
 };
 
 /* `match as-path ASPATH' */
@@ -615,7 +618,8 @@ struct route_map_rule_cmd route_match_aspath_cmd =
   "as-path",
   route_match_aspath,
   route_match_aspath_compile,
-  route_match_aspath_free
+  route_match_aspath_free,
+  1
 };
 
 /* `match community COMMUNIY' */
@@ -699,7 +703,8 @@ struct route_map_rule_cmd route_match_community_cmd =
   "community",
   route_match_community,
   route_match_community_compile,
-  route_match_community_free
+  route_match_community_free,
+  1
 };
 
 /* Match function for extcommunity match. */
@@ -748,7 +753,8 @@ struct route_map_rule_cmd route_match_ecommunity_cmd =
   "extcommunity",
   route_match_ecommunity,
   route_match_ecommunity_compile,
-  route_match_ecommunity_free
+  route_match_ecommunity_free,
+  1
 };
 
 /* `match nlri` and `set nlri` are replaced by `address-family ipv4`
@@ -804,7 +810,8 @@ struct route_map_rule_cmd route_match_origin_cmd =
   "origin",
   route_match_origin,
   route_match_origin_compile,
-  route_match_origin_free
+  route_match_origin_free,
+  1
 };
 
 /* match probability  { */
@@ -2306,6 +2313,8 @@ bgp_route_map_update (const char *unused)
   struct bgp_node *bn;
   struct bgp_static *bgp_static;
 
+  update_group_config_changed ();
+
   /* For neighbor route-map updates. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
@@ -2404,6 +2413,23 @@ bgp_route_map_update (const char *unused)
 #endif /* HAVE_IPV6 */
 	}
     }
+
+  /* Route server clients may share tables differently now. */
+  bgp_rsrib_regroup_all ();
+}
+
+/* Route map results are remembered by interned attribute, see
+   bgp_route_map_apply(); the cache holds a reference on it. */
+static void *
+bgp_route_map_cache_ref (void *key)
+{
+  return bgp_attr_intern (key);
+}
+
+static void
+bgp_route_map_cache_unref (void *key)
+{
+  bgp_attr_unintern (key);
 }
 
 /* Update redistributed routes when route-map changed and
@@ -2416,6 +2442,9 @@ void bgp_route_map_changed (route_map_event_t e, const char *rm)
   struct listnode *mnode, *mnnode;
   struct bgp *bgp;
 
+  /* Matches on the peer keep route server clients apart. */
+  bgp_rsrib_regroup_all ();
+
   if (!bgp_option_check (BGP_OPT_REDIST_RMAP_RESPONSIVE))
     return;
 
@@ -3891,6 +3920,8 @@ bgp_route_map_init (void)
   route_map_add_hook (bgp_route_map_update);
   route_map_delete_hook (bgp_route_map_update);
   route_map_event_hook (bgp_route_map_changed);
+  route_map_cache_key_hook (bgp_route_map_cache_ref,
+			    bgp_route_map_cache_unref);
 
   install_element (CONFIG_NODE, &responsive_rmap_cmd);
   install_element (CONFIG_NODE, &no_responsive_rmap_cmd);
@@ -0,0 +1,487 @@
+/* BGP shared route server client RIBs
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+/* What ends up in an RS-client table depends on the client's AS and
+   import route-map, and on the export route-maps of the announcing
+   peers.  Clients agreeing on the former share one table, which is
+   filled in and runs best path selection once for all of them, the
+   way members of a route server peer-group share the group's.  Routes
+   a client announced itself are in the table for the others, and
+   bgp_process_rsclient() sends it the best of the rest instead.
+
+   Export and network route-maps matching on the peer may tell clients
+   apart, so while there are any nothing is shared.  Configuration
+   changes regroup the clients: a client whose policy no longer
+   matches its table's is moved to a table of its own or to that of
+   the clients it now agrees with, taking along what it has been sent
+   so that only differences are announced.  A table of its own starts
+   off with the routes of the one it left, which stand until the
+   announcing peers have sent theirs again.  */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "memory.h"
+#include "command.h"
+#include "linklist.h"
+#include "routemap.h"
+#include "thread.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_advertise.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_rsrib.h"
+
+/* A client being regrouped.  */
+struct bgp_rsrib_member
+{
+  struct peer *peer;
+
+  /* First member with the same policy.  */
+  int class;
+
+  /* Table the member goes to, and whether it was made just now.  */
+  struct bgp_table *to;
+  int assigned;
+  int fresh;
+  int moved;
+};
+
+static struct thread *bgp_rsrib_thread;
+
+/* May PEER's table be shared?  Peer-groups share theirs among their
+   members already.  */
+static int
+bgp_rsrib_shareable (struct peer *peer, afi_t afi, safi_t safi)
+{
+  return (safi != SAFI_MPLS_VPN
+	  && CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+	  && ! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP)
+	  && ! peer->af_group[afi][safi]);
+}
+
+/* Do export and network route-maps treat all clients alike?  */
+static int
+bgp_rsrib_eligible (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct listnode *node, *nnode;
+  struct peer *peer;
+  struct bgp_node *rn;
+  struct bgp_static *bgp_static;
+
+  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+    if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+	&& update_group_rmap_peer (ROUTE_MAP_EXPORT (&peer->filter[afi][safi])))
+      return 0;
+
+  for (rn = bgp_table_top (bgp->route[afi][safi]); rn; rn = bgp_route_next (rn))
+    if ((bgp_static = rn->info) != NULL
+	&& update_group_rmap_peer (bgp_static->rmap.map))
+      {
+	bgp_unlock_node (rn);
+	return 0;
+      }
+
+  return 1;
+}
+
+/* Would A and B have the same routes in their tables?  */
+static int
+bgp_rsrib_same (struct peer *a, struct peer *b, afi_t afi, safi_t safi)
+{
+  const char *ma = a->filter[afi][safi].map[RMAP_IMPORT].name;
+  const char *mb = b->filter[afi][safi].map[RMAP_IMPORT].name;
+
+  if (a->as != b->as)
+    return 0;
+  if (ma == NULL || mb == NULL)
+    return ma == mb;
+  return strcmp (ma, mb) == 0;
+}
+
+static struct bgp_table *
+bgp_rsrib_new (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_table *table;
+
+  table = bgp_table_init (afi, safi);
+  table->type = BGP_TABLE_RSCLIENT;
+  /* RIB peer reference.  Released when table is free'd in bgp_table_free. */
+  table->owner = peer_lock (peer);
+  if (bgp_rsrib_shareable (peer, afi, safi))
+    table->rsclients = list_new ();
+  return table;
+}
+
+/* Give PEER, just made an RS-client, a table: that of a client with
+   the same policy, or a new one.  Returns 1 if the table is new and
+   needs filling in.  */
+int
+bgp_rsrib_join (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct listnode *node, *nnode;
+  struct peer *other;
+  struct bgp_table *table;
+
+  if (bgp_rsrib_shareable (peer, afi, safi)
+      && bgp_rsrib_eligible (peer->bgp, afi, safi))
+    for (ALL_LIST_ELEMENTS (peer->bgp->rsclient, node, nnode, other))
+      if (other != peer
+	  && bgp_rsrib_shareable (other, afi, safi)
+	  && other->rib[afi][safi] && other->rib[afi][safi]->rsclients
+	  && bgp_rsrib_same (peer, other, afi, safi))
+	{
+	  peer->rib[afi][safi] = other->rib[afi][safi];
+	  listnode_add (peer->rib[afi][safi]->rsclients, peer);
+	  return 0;
+	}
+
+  table = peer->rib[afi][safi] = bgp_rsrib_new (peer, afi, safi);
+  if (table->rsclients)
+    listnode_add (table->rsclients, peer);
+  return 1;
+}
+
+/* Take PEER out of its RS-client table, dropping the table along with
+   the last client.  */
+void
+bgp_rsrib_leave (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_table *table = peer->rib[afi][safi];
+  struct bgp_adj_out *adj, *next;
+  struct bgp_node *rn;
+
+  if (! table)
+    return;
+
+  if (table->rsclients)
+    listnode_delete (table->rsclients, peer);
+
+  if (! table->rsclients || list_isempty (table->rsclients))
+    {
+      bgp_clear_rsclient_table (table);
+      bgp_table_finish (&peer->rib[afi][safi]);
+      return;
+    }
+
+  for (adj = peer->adj_outs[afi][safi]; adj; adj = next)
+    {
+      next = adj->peer_next;
+      if (adj->rn->table == table)
+	{
+	  rn = adj->rn;
+	  bgp_adj_out_remove (rn, adj, peer, afi, safi);
+	  bgp_unlock_node (rn);
+	}
+    }
+
+  if (table->owner == peer)
+    {
+      table->owner = peer_lock (listgetdata (listhead (table->rsclients)));
+      peer_unlock (peer); /* RIB peer reference */
+    }
+  peer->rib[afi][safi] = NULL;
+}
+
+/* Move PEER to table TO, along with what it has been sent.  */
+static void
+bgp_rsrib_move (struct peer *peer, afi_t afi, safi_t safi,
+		struct bgp_table *to)
+{
+  struct bgp_table *from = peer->rib[afi][safi];
+  struct bgp_adj_out *adj, *next;
+
+  for (adj = peer->adj_outs[afi][safi]; adj; adj = next)
+    {
+      next = adj->peer_next;
+      if (adj->rn->table == from)
+	bgp_adj_out_move (adj, to);
+    }
+
+  bgp_rsrib_leave (peer, afi, safi);
+  peer->rib[afi][safi] = to;
+  listnode_add (to->rsclients, peer);
+}
+
+/* Put the RS-clients of BGP in AFI/SAFI with the same policy together,
+   and those with different policies apart.  */
+void
+bgp_rsrib_regroup (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct listnode *node, *nnode;
+  struct peer *peer;
+  struct bgp_rsrib_member *m;
+  struct bgp_table *table, *best;
+  int n, i, j, k, c, size, count, most, taken, eligible, fresh;
+
+  n = 0;
+  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, peer))
+    if (bgp_rsrib_shareable (peer, afi, safi) && peer->rib[afi][safi]
+	&& peer->rib[afi][safi]->rsclients)
+      n++;
+  if (n == 0)
+    return;
+
+  m = XCALLOC (MTYPE_TMP, n * sizeof (struct bgp_rsrib_member));
+  eligible = bgp_rsrib_eligible (bgp, afi, safi);
+
+  i = 0;
+  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, peer))
+    if (bgp_rsrib_shareable (peer, afi, safi) && peer->rib[afi][safi]
+	&& peer->rib[afi][safi]->rsclients)
+      {
+	m[i].peer = peer;
+	m[i].class = i;
+	if (eligible)
+	  for (j = 0; j < i; j++)
+	    if (bgp_rsrib_same (peer, m[j].peer, afi, safi))
+	      {
+		m[i].class = m[j].class;
+		break;
+	      }
+	i++;
+      }
+
+  /* Biggest class first, each class keeps the table most of its
+     members are in, unless a bigger class kept that one.  */
+  for (;;)
+    {
+      c = -1;
+      size = 0;
+      for (i = 0; i < n; i++)
+	if (m[i].class == i && ! m[i].assigned)
+	  {
+	    for (count = 0, j = i; j < n; j++)
+	      if (m[j].class == i)
+		count++;
+	    if (count > size)
+	      {
+		c = i;
+		size = count;
+	      }
+	  }
+      if (c < 0)
+	break;
+
+      best = NULL;
+      most = 0;
+      for (j = c; j < n; j++)
+	{
+	  if (m[j].class != c)
+	    continue;
+	  table = m[j].peer->rib[afi][safi];
+
+	  for (taken = 0, k = 0; k < n && ! taken; k++)
+	    taken = (m[k].assigned && m[k].to == table);
+	  if (taken)
+	    continue;
+
+	  for (count = 0, k = c; k < n; k++)
+	    if (m[k].class == c && m[k].peer->rib[afi][safi] == table)
+	      count++;
+	  if (count > most)
+	    {
+	      best = table;
+	      most = count;
+	    }
+	}
+
+      for (j = c; j < n; j++)
+	if (m[j].class == c)
+	  {
+	    m[j].to = best;
+	    m[j].assigned = 1;
+	  }
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      if (m[i].to == m[i].peer->rib[afi][safi])
+	continue;
+
+      /* The class lost its tables to bigger ones, start a new one
+	 with what the first member had until now.  */
+      if (m[i].to == NULL)
+	{
+	  table = bgp_rsrib_new (m[i].peer, afi, safi);
+	  bgp_copy_rsclient_table (m[i].peer->rib[afi][safi], table);
+	  for (j = i; j < n; j++)
+	    if (m[j].class == m[i].class)
+	      {
+		m[j].to = table;
+		m[j].fresh = 1;
+	      }
+	}
+
+      bgp_rsrib_move (m[i].peer, afi, safi, m[i].to);
+      m[i].moved = 1;
+    }
+
+  /* Fill in the new tables, through their owners, then settle what
+     the moved clients have been sent.  */
+  fresh = 0;
+  for (i = 0; i < n; i++)
+    if (m[i].fresh && m[i].to->owner == m[i].peer)
+      {
+	bgp_check_local_routes_rsclient (m[i].peer, afi, safi);
+	bgp_soft_reconfig_rsclient (m[i].peer, afi, safi);
+	fresh = 1;
+      }
+
+  /* Routes of peers without soft-reconfiguration came along as the old
+     policy let them in, have those peers send them again.  */
+  if (fresh)
+    for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+      if (peer->status == Established && peer->afc_nego[afi][safi]
+	  && ! CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_SOFT_RECONFIG)
+	  && (CHECK_FLAG (peer->cap, PEER_CAP_REFRESH_OLD_RCV)
+	      || CHECK_FLAG (peer->cap, PEER_CAP_REFRESH_NEW_RCV)))
+	bgp_route_refresh_send (peer, afi, safi, 0, 0, 0);
+
+  for (i = 0; i < n; i++)
+    if (m[i].moved)
+      bgp_announce_rsclient_table (m[i].peer, afi, safi, m[i].fresh);
+
+  XFREE (MTYPE_TMP, m);
+}
+
+static int
+bgp_rsrib_regroup_event (struct thread *thread)
+{
+  struct listnode *node, *nnode;
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  bgp_rsrib_thread = NULL;
+
+  for (ALL_LIST_ELEMENTS (bm->bgp, node, nnode, bgp))
+    for (afi = AFI_IP; afi < AFI_MAX; afi++)
+      for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+	bgp_rsrib_regroup (bgp, afi, safi);
+  return 0;
+}
+
+/* Route-maps changed, regroup the clients of all views once done with
+   the configuration at hand, rather than for every line of it.  */
+void
+bgp_rsrib_regroup_all (void)
+{
+  if (! bgp_rsrib_thread)
+    bgp_rsrib_thread = thread_add_event (bm->master, bgp_rsrib_regroup_event,
+					 NULL, 0);
+}
+
+/* Show one shared table, adding what sharing saves to *SAVED.  */
+static void
+bgp_rsrib_show_table (struct vty *vty, struct bgp_table *table,
+		      unsigned long *saved)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct listnode *node;
+  struct peer *peer;
+  const char *import;
+  unsigned long paths = 0;
+  unsigned long size;
+  int n = listcount (table->rsclients);
+
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    for (ri = rn->info; ri; ri = ri->next)
+      paths++;
+
+  size = table->count * sizeof (struct bgp_node)
+	 + paths * sizeof (struct bgp_info);
+  *saved += (n - 1) * size;
+
+  peer = table->owner;
+  import = peer->filter[table->afi][table->safi].map[RMAP_IMPORT].name;
+
+  vty_out (vty, "%s RS-client RIB, %lu prefixes, %lu paths%s",
+	   afi_safi_print (table->afi, table->safi), table->count, paths,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Clients of AS %u, import route-map %s%s",
+	   peer->as, import ? import : "(none)", VTY_NEWLINE);
+  if (n > 1)
+    vty_out (vty, "  Shared by %d clients, saving about %lu KiB%s",
+	     n, (n - 1) * size / 1024, VTY_NEWLINE);
+  for (ALL_LIST_ELEMENTS_RO (table->rsclients, node, peer))
+    vty_out (vty, "    %s%s%s", peer->host,
+	     peer->status == Established ? "" : " (not established)",
+	     VTY_NEWLINE);
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
+
+DEFUN (show_ip_bgp_rsclient_groups,
+       show_ip_bgp_rsclient_groups_cmd,
+       "show ip bgp rsclient groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Information about Route Server Client\n"
+       "RS-client RIBs and the clients sharing them\n")
+{
+  struct listnode *node, *nnode;
+  struct listnode *rnode, *rnnode;
+  struct bgp *bgp;
+  struct peer *peer;
+  unsigned long saved = 0;
+  afi_t afi;
+  safi_t safi;
+
+  for (ALL_LIST_ELEMENTS (bm->bgp, node, nnode, bgp))
+    {
+      if (bgp->name)
+	vty_out (vty, "BGP view %s%s%s", bgp->name, VTY_NEWLINE, VTY_NEWLINE);
+
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+	for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+	  for (ALL_LIST_ELEMENTS (bgp->rsclient, rnode, rnnode, peer))
+	    if (bgp_rsrib_shareable (peer, afi, safi)
+		&& BGP_RSRIB_OWNER (peer, afi, safi)
+		&& peer->rib[afi][safi]->rsclients)
+	      bgp_rsrib_show_table (vty, peer->rib[afi][safi], &saved);
+    }
+
+  vty_out (vty, "Memory saved by sharing: about %lu KiB%s",
+	   saved / 1024, VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
+
+ALIAS (show_ip_bgp_rsclient_groups,
+       show_bgp_rsclient_groups_cmd,
+       "show bgp rsclient groups",
+       SHOW_STR
+       BGP_STR
+       "Information about Route Server Client\n"
+       "RS-client RIBs and the clients sharing them\n")
+
+void
+bgp_rsrib_init (void)
+{
+  install_element (VIEW_NODE, &show_ip_bgp_rsclient_groups_cmd);
+  install_element (VIEW_NODE, &show_bgp_rsclient_groups_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_rsclient_groups_cmd);
+  install_element (ENABLE_NODE, &show_bgp_rsclient_groups_cmd);
+}
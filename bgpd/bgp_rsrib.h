@@ -0,0 +1,34 @@
+/* BGP shared route server client RIBs
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+#ifndef _QUAGGA_BGP_RSRIB_H
+#define _QUAGGA_BGP_RSRIB_H
+
+/* Is P the RS-client its table is filled in through?  Updates are
+   only run once per table, for its owner.  */
+#define BGP_RSRIB_OWNER(P,A,S) \
+  ((P)->rib[(A)][(S)] && (P)->rib[(A)][(S)]->owner == (P))
+
+extern int bgp_rsrib_join (struct peer *, afi_t, safi_t);
+extern void bgp_rsrib_leave (struct peer *, afi_t, safi_t);
+extern void bgp_rsrib_regroup (struct bgp *, afi_t, safi_t);
+extern void bgp_rsrib_regroup_all (void);
+extern void bgp_rsrib_init (void);
+
+#endif /* _QUAGGA_BGP_RSRIB_H */
@@ -24,6 +24,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "memory.h"
 #include "sockunion.h"
 #include "vty.h"
+#include "linklist.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -96,6 +97,8 @@ bgp_node_set (struct bgp_table *table, struct prefix *prefix)
 static void
 bgp_node_free (struct bgp_node *node)
 {
+  if (node->adj_out_slot)
+    XFREE (MTYPE_BGP_ADJ_OUT_SLOT, node->adj_out_slot);
   XFREE (MTYPE_BGP_NODE, node);
 }
 
@@ -156,6 +159,9 @@ bgp_table_free (struct bgp_table *rt)
       rt->owner = NULL;
     }
 
+  if (rt->rsclients)
+    list_delete (rt->rsclients);
+
   XFREE (MTYPE_BGP_TABLE, rt);
   return;
 }
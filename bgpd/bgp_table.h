@@ -40,6 +40,10 @@ struct bgp_table
   /* The owner of this 'bgp_table' structure. */
   struct peer *owner;
 
+  /* RS-clients sharing an RSCLIENT table, the owner first, see
+     bgp_rsrib.c.  NULL for tables of peer-groups.  */
+  struct list *rsclients;
+
   struct bgp_node *top;
   
   unsigned long count;
@@ -59,6 +63,10 @@ struct bgp_node
 
   struct bgp_adj_out *adj_out;
 
+  /* The same adj_out entries by peer adj_out_slot, see bgp_advertise.c. */
+  struct bgp_adj_out **adj_out_slot;
+  unsigned int adj_out_slots;
+
   struct bgp_adj_in *adj_in;
 
   struct bgp_node *prn;
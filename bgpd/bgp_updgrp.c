@@ -0,0 +1,424 @@
+/* BGP update groups
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+/* Peers sharing an outbound policy are put in one update group per
+   address family.  bgp_process_main() runs the policy part of
+   bgp_announce_check() once per group for the node it is processing
+   and hands the result to every member, and bgp_update_packet() reuses
+   the path attributes one member has encoded for the next ones.
+
+   A peer's key is only recomputed once something it is made of may have
+   changed.  The configuration functions in bgpd.c, the filter and
+   route-map update hooks and bgp_establish(), which sees the negotiated
+   capabilities and next hops, call update_group_config_changed(), and a
+   peer whose group was last checked before that moves to its new group
+   on its next announcement.  */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "memory.h"
+#include "command.h"
+#include "hash.h"
+#include "linklist.h"
+#include "stream.h"
+#include "sockunion.h"
+#include "jhash.h"
+#include "filter.h"
+#include "routemap.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+
+/* Outbound relevant peer flags.  */
+#define UPDATE_GROUP_FLAGS	PEER_FLAG_LOCAL_AS_NO_PREPEND
+#define UPDATE_GROUP_AF_FLAGS \
+  (PEER_FLAG_SEND_COMMUNITY | PEER_FLAG_SEND_EXT_COMMUNITY \
+   | PEER_FLAG_NEXTHOP_SELF | PEER_FLAG_REFLECTOR_CLIENT \
+   | PEER_FLAG_RSERVER_CLIENT | PEER_FLAG_AS_PATH_UNCHANGED \
+   | PEER_FLAG_NEXTHOP_UNCHANGED | PEER_FLAG_MED_UNCHANGED \
+   | PEER_FLAG_REMOVE_PRIVATE_AS | PEER_FLAG_NEXTHOP_LOCAL_UNCHANGED)
+
+static struct hash *update_groups;
+static unsigned int update_group_id;
+
+/* Bumped by bgp_process_main() for every node it announces.  */
+unsigned long update_group_round = 1;
+
+/* Bumped whenever a group key may have changed.  */
+static unsigned long update_group_config = 1;
+
+void
+update_group_config_changed (void)
+{
+  update_group_config++;
+}
+
+/* Can MAP give different results depending on the peer it is applied
+   for?  */
+int
+update_group_rmap_peer (struct route_map *map)
+{
+  return map && (route_map_match_used (map, "peer")
+		 || route_map_match_used (map, "ip route-source")
+		 || route_map_match_used (map, "ip route-source prefix-list"));
+}
+
+static void
+update_group_key_make (struct peer *peer, afi_t afi, safi_t safi,
+		       struct update_group_key *key)
+{
+  struct bgp *bgp = peer->bgp;
+  struct bgp_filter *filter = &peer->filter[afi][safi];
+
+  /* The key is hashed and compared as a whole, padding included. */
+  memset (key, 0, sizeof (struct update_group_key));
+
+  key->bgp = bgp;
+  key->afi = afi;
+  key->safi = safi;
+
+  key->router_id = bgp->router_id;
+  key->cluster_id = bgp->cluster_id;
+  key->confed_id = bgp->confed_id;
+  key->bgp_config = bgp->config;
+  key->bgp_flags = bgp->flags;
+  key->default_local_pref = bgp->default_local_pref;
+
+  key->sort = peer_sort (peer);
+  key->local_as = peer->local_as;
+  key->change_local_as = peer->change_local_as;
+  key->flags = peer->flags & UPDATE_GROUP_FLAGS;
+  key->af_flags = peer->af_flags[afi][safi] & UPDATE_GROUP_AF_FLAGS;
+  key->cap = peer->cap & PEER_CAP_AS4_RCV;
+
+  key->shared_network = peer->shared_network;
+  key->nexthop_v4 = peer->nexthop.v4;
+#ifdef HAVE_IPV6
+  key->nexthop_v6_global = peer->nexthop.v6_global;
+  key->nexthop_v6_local = peer->nexthop.v6_local;
+#endif /* HAVE_IPV6 */
+
+  /* The third party next hop check and these route-map matches look
+     at the address of the peer itself.  */
+  if ((key->sort == BGP_PEER_EBGP && peer->ttl > 1)
+      || update_group_rmap_peer (filter->map[RMAP_OUT].map)
+      || update_group_rmap_peer (filter->usmap.map))
+    key->su = peer->su;
+
+  key->dlist = filter->dlist[FILTER_OUT].alist;
+  key->plist = filter->plist[FILTER_OUT].plist;
+  key->aslist = filter->aslist[FILTER_OUT].aslist;
+  key->rmap = filter->map[RMAP_OUT].map;
+  key->usmap = filter->usmap.map;
+  key->names = (filter->dlist[FILTER_OUT].name ? 0x01 : 0)
+	       | (filter->plist[FILTER_OUT].name ? 0x02 : 0)
+	       | (filter->aslist[FILTER_OUT].name ? 0x04 : 0)
+	       | (filter->map[RMAP_OUT].name ? 0x08 : 0)
+	       | (filter->usmap.name ? 0x10 : 0);
+}
+
+static unsigned int
+update_group_hash_key (void *p)
+{
+  struct update_group *group = p;
+
+  return jhash (&group->key, sizeof (struct update_group_key), 0);
+}
+
+static int
+update_group_hash_cmp (const void *p1, const void *p2)
+{
+  const struct update_group *group1 = p1;
+  const struct update_group *group2 = p2;
+
+  return ! memcmp (&group1->key, &group2->key,
+		   sizeof (struct update_group_key));
+}
+
+static void *
+update_group_alloc (void *p)
+{
+  struct update_group *ref = p;
+  struct update_group *group;
+
+  group = XCALLOC (MTYPE_BGP_UPDGRP, sizeof (struct update_group));
+  group->key = ref->key;
+  group->id = ++update_group_id;
+  group->peer = list_new ();
+  group->uptime = bgp_clock ();
+  return group;
+}
+
+static void
+update_group_free (struct update_group *group)
+{
+  int i;
+
+  if (group->attr)
+    bgp_attr_unintern (group->attr);
+
+  for (i = 0; i < UPDATE_GROUP_ENCODINGS; i++)
+    if (group->enc[i].attr)
+      {
+	bgp_attr_unintern (group->enc[i].attr);
+	XFREE (MTYPE_BGP_UPDGRP_DATA, group->enc[i].data);
+      }
+
+  list_delete (group->peer);
+  XFREE (MTYPE_BGP_UPDGRP, group);
+}
+
+static void
+update_group_leave (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct update_group *group = peer->updgrp[afi][safi];
+
+  peer->updgrp[afi][safi] = NULL;
+  listnode_delete (group->peer, peer);
+
+  if (list_isempty (group->peer))
+    {
+      hash_release (update_groups, group);
+      update_group_free (group);
+    }
+}
+
+/* Update group PEER belongs to for AFI/SAFI under its current
+   configuration, moving it over if that has changed.  */
+struct update_group *
+update_group_get (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct update_group ref;
+  struct update_group *group;
+
+  group = peer->updgrp[afi][safi];
+  if (group && peer->updgrp_config[afi][safi] == update_group_config)
+    return group;
+
+  update_group_key_make (peer, afi, safi, &ref.key);
+  peer->updgrp_config[afi][safi] = update_group_config;
+
+  if (group && ! memcmp (&group->key, &ref.key, sizeof (ref.key)))
+    return group;
+
+  if (group)
+    update_group_leave (peer, afi, safi);
+
+  if (update_groups == NULL)
+    {
+      update_groups = hash_create (update_group_hash_key,
+				   update_group_hash_cmp);
+      hash_set_name (update_groups, "BGP update groups");
+    }
+
+  group = hash_get (update_groups, &ref, update_group_alloc);
+  listnode_add (group->peer, peer);
+  peer->updgrp[afi][safi] = group;
+
+  return group;
+}
+
+/* Remember the announcement worked out for the current round, ATTR is
+   an interned reference the group takes over, or NULL.  */
+void
+update_group_announce_set (struct update_group *group, struct attr *attr)
+{
+  if (group->attr)
+    bgp_attr_unintern (group->attr);
+
+  group->attr = attr;
+  group->round = update_group_round;
+}
+
+void
+update_group_peer_delete (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (peer->updgrp[afi][safi])
+	update_group_leave (peer, afi, safi);
+}
+
+/* bgp_packet_attribute() for PEER, copied from what another member of
+   its update group has encoded if possible.  Besides the attribute and
+   the group key, the encoding depends on the originator id and type of
+   the peer the route came from.  */
+bgp_size_t
+update_group_packet_attribute (struct peer *peer, struct stream *s,
+			       struct attr *attr, struct prefix *p,
+			       afi_t afi, safi_t safi, struct peer *from,
+			       struct prefix_rd *prd, u_char *tag)
+{
+  struct update_group *group;
+  struct update_group_encoding *enc;
+  struct in_addr from_id;
+  int from_sort;
+  size_t pos;
+  bgp_size_t len;
+  int i;
+
+  /* Other families carry the prefix in MP_REACH_NLRI. */
+  if (afi != AFI_IP || safi != SAFI_UNICAST)
+    return bgp_packet_attribute (NULL, peer, s, attr, p, afi, safi,
+				 from, prd, tag);
+
+  group = update_group_get (peer, afi, safi);
+
+  from_id.s_addr = from ? from->remote_id.s_addr : 0;
+  from_sort = from ? peer_sort (from) : 0;
+
+  for (i = 0; i < UPDATE_GROUP_ENCODINGS; i++)
+    {
+      enc = &group->enc[i];
+      if (enc->attr == attr && enc->from == from
+	  && enc->from_id.s_addr == from_id.s_addr
+	  && enc->from_sort == from_sort)
+	{
+	  stream_put (s, enc->data, enc->len);
+	  group->encode_reused++;
+	  return enc->len;
+	}
+    }
+
+  pos = stream_get_endp (s);
+  len = bgp_packet_attribute (NULL, peer, s, attr, p, afi, safi,
+			      from, prd, tag);
+  group->encode_calc++;
+
+  enc = &group->enc[group->enc_next++ % UPDATE_GROUP_ENCODINGS];
+  if (enc->attr)
+    bgp_attr_unintern (enc->attr);
+  enc->attr = bgp_attr_intern (attr);
+  enc->from = from;
+  enc->from_id = from_id;
+  enc->from_sort = from_sort;
+  enc->data = XREALLOC (MTYPE_BGP_UPDGRP_DATA, enc->data, len);
+  memcpy (enc->data, STREAM_DATA (s) + pos, len);
+  enc->len = len;
+
+  return len;
+}
+
+static const char *
+update_group_sort_str (int sort)
+{
+  switch (sort)
+    {
+    case BGP_PEER_IBGP:
+      return "iBGP";
+    case BGP_PEER_EBGP:
+      return "eBGP";
+    case BGP_PEER_CONFED:
+      return "confed-eBGP";
+    default:
+      return "internal";
+    }
+}
+
+static void
+update_group_show (struct hash_backet *backet, void *arg)
+{
+  struct vty *vty = arg;
+  struct update_group *group = backet->data;
+  struct bgp_filter *filter;
+  struct listnode *node;
+  struct peer *peer;
+  char timebuf[BGP_UPTIME_LEN];
+
+  peer = listgetdata (listhead (group->peer));
+  filter = &peer->filter[group->key.afi][group->key.safi];
+
+  vty_out (vty, "Update group %u, %s, up for %s%s", group->id,
+	   afi_safi_print (group->key.afi, group->key.safi),
+	   peer_uptime (group->uptime, timebuf, BGP_UPTIME_LEN),
+	   VTY_NEWLINE);
+
+  vty_out (vty, "  %s peers", update_group_sort_str (group->key.sort));
+  if (CHECK_FLAG (group->key.af_flags, PEER_FLAG_REFLECTOR_CLIENT))
+    vty_out (vty, ", route-reflector-client");
+  if (CHECK_FLAG (group->key.af_flags, PEER_FLAG_NEXTHOP_SELF))
+    vty_out (vty, ", next-hop-self");
+  if (CHECK_FLAG (group->key.cap, PEER_CAP_AS4_RCV))
+    vty_out (vty, ", 4-octet AS");
+  vty_out (vty, "%s", VTY_NEWLINE);
+
+  if (filter->map[RMAP_OUT].name)
+    vty_out (vty, "  Route map: %s%s", filter->map[RMAP_OUT].name,
+	     VTY_NEWLINE);
+  if (filter->plist[FILTER_OUT].name)
+    vty_out (vty, "  Prefix list: %s%s", filter->plist[FILTER_OUT].name,
+	     VTY_NEWLINE);
+  if (filter->dlist[FILTER_OUT].name)
+    vty_out (vty, "  Distribute list: %s%s", filter->dlist[FILTER_OUT].name,
+	     VTY_NEWLINE);
+  if (filter->aslist[FILTER_OUT].name)
+    vty_out (vty, "  Filter list: %s%s", filter->aslist[FILTER_OUT].name,
+	     VTY_NEWLINE);
+  if (filter->usmap.name)
+    vty_out (vty, "  Unsuppress map: %s%s", filter->usmap.name,
+	     VTY_NEWLINE);
+
+  vty_out (vty, "  Announcements computed %lu, reused %lu%s",
+	   group->announce_calc, group->announce_reused, VTY_NEWLINE);
+  vty_out (vty, "  Attribute encodings computed %lu, reused %lu%s",
+	   group->encode_calc, group->encode_reused, VTY_NEWLINE);
+
+  vty_out (vty, "  %d member%s:%s", listcount (group->peer),
+	   listcount (group->peer) == 1 ? "" : "s", VTY_NEWLINE);
+  for (ALL_LIST_ELEMENTS_RO (group->peer, node, peer))
+    vty_out (vty, "    %s%s%s", peer->host,
+	     peer->status == Established ? "" : " (not established)",
+	     VTY_NEWLINE);
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
+
+DEFUN (show_ip_bgp_update_groups,
+       show_ip_bgp_update_groups_cmd,
+       "show ip bgp update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Peers sharing outbound policy\n")
+{
+  if (update_groups)
+    hash_iterate (update_groups, update_group_show, vty);
+  return CMD_SUCCESS;
+}
+
+ALIAS (show_ip_bgp_update_groups,
+       show_bgp_update_groups_cmd,
+       "show bgp update-groups",
+       SHOW_STR
+       BGP_STR
+       "Peers sharing outbound policy\n")
+
+void
+bgp_update_group_init (void)
+{
+  install_element (VIEW_NODE, &show_ip_bgp_update_groups_cmd);
+  install_element (VIEW_NODE, &show_bgp_update_groups_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_update_groups_cmd);
+  install_element (ENABLE_NODE, &show_bgp_update_groups_cmd);
+}
@@ -0,0 +1,125 @@
+/* BGP update groups
+   
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+#ifndef _QUAGGA_BGP_UPDGRP_H
+#define _QUAGGA_BGP_UPDGRP_H
+
+/* Everything bgp_announce_check() and bgp_packet_attribute() look at
+   besides the identity of the receiving peer.  Peers with equal keys
+   are sent the same attributes for the same route.  */
+struct update_group_key
+{
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  /* Instance wide settings, so that changing them regroups.  */
+  struct in_addr router_id;
+  struct in_addr cluster_id;
+  as_t confed_id;
+  u_int16_t bgp_config;
+  u_int16_t bgp_flags;
+  u_int32_t default_local_pref;
+
+  int sort;
+  as_t local_as;
+  as_t change_local_as;
+  u_int32_t flags;
+  u_int32_t af_flags;
+  u_int16_t cap;
+
+  /* Next hop the peer is sent when it is rewritten.  */
+  int shared_network;
+  struct in_addr nexthop_v4;
+#ifdef HAVE_IPV6
+  struct in6_addr nexthop_v6_global;
+  struct in6_addr nexthop_v6_local;
+#endif /* HAVE_IPV6 */
+
+  /* Only set when the announcement depends on the peer address: for
+     EBGP peers that are not directly connected, and with route-maps
+     matching on the peer.  */
+  union sockunion su;
+
+  /* Outbound filters, by object and by whether a name is configured. */
+  void *dlist;
+  void *plist;
+  void *aslist;
+  void *rmap;
+  void *usmap;
+  u_char names;
+};
+
+/* Encoded path attributes of a recent UPDATE, for the other members. */
+struct update_group_encoding
+{
+  struct attr *attr;
+  struct peer *from;
+  struct in_addr from_id;
+  int from_sort;
+
+  u_char *data;
+  bgp_size_t len;
+};
+
+#define UPDATE_GROUP_ENCODINGS 8
+
+struct update_group
+{
+  unsigned int id;
+  struct update_group_key key;
+
+  /* Member peers.  */
+  struct list *peer;
+
+  time_t uptime;
+
+  /* Announcement for the node bgp_process_main() is working on, valid
+     while round equals update_group_round.  NULL if filtered.  */
+  unsigned long round;
+  struct attr *attr;
+
+  struct update_group_encoding enc[UPDATE_GROUP_ENCODINGS];
+  unsigned int enc_next;
+
+  /* Statistics.  */
+  unsigned long announce_calc;
+  unsigned long announce_reused;
+  unsigned long encode_calc;
+  unsigned long encode_reused;
+};
+
+extern unsigned long update_group_round;
+
+extern void bgp_update_group_init (void);
+extern struct update_group *update_group_get (struct peer *, afi_t, safi_t);
+extern void update_group_config_changed (void);
+extern void update_group_announce_set (struct update_group *, struct attr *);
+extern void update_group_peer_delete (struct peer *);
+extern int update_group_rmap_peer (struct route_map *);
+extern bgp_size_t update_group_packet_attribute (struct peer *,
+						  struct stream *,
+						  struct attr *,
+						  struct prefix *,
+						  afi_t, safi_t,
+						  struct peer *,
+						  struct prefix_rd *,
+						  u_char *);
+
+#endif /* _QUAGGA_BGP_UPDGRP_H */
@@ -30,6 +30,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "memory.h"
 #include "hash.h"
+#include "routemap.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_advertise.h"
@@ -48,6 +49,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_table.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_io.h"
+#include "bgpd/bgp_rsrib.h"
 
 extern struct in_addr router_id_zebra;
 
@@ -285,6 +288,39 @@ DEFUN (no_bgp_config_type,
   return CMD_SUCCESS;
 }
 
+DEFUN (bgp_write_budget,
+       bgp_write_budget_cmd,
+       "bgp write-budget <4096-1048576>",
+       BGP_STR
+       "Bytes written to a peer per run\n"
+       "Number of bytes\n")
+{
+  u_int32_t budget;
+
+  VTY_GET_INTEGER_RANGE ("write budget", budget, argv[0], 4096, 1048576);
+  bm->write_budget = budget;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_bgp_write_budget,
+       no_bgp_write_budget_cmd,
+       "no bgp write-budget",
+       NO_STR
+       BGP_STR
+       "Bytes written to a peer per run\n")
+{
+  bm->write_budget = BGP_WRITE_BUDGET_DEFAULT;
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_bgp_write_budget,
+       no_bgp_write_budget_val_cmd,
+       "no bgp write-budget <4096-1048576>",
+       NO_STR
+       BGP_STR
+       "Bytes written to a peer per run\n"
+       "Number of bytes\n")
+
 DEFUN (no_synchronization,
        no_synchronization_cmd,
        "no synchronization",
@@ -2111,16 +2147,15 @@ peer_rsclient_set_vty (struct vty *vty, const char *peer_str,
       return bgp_vty_return (vty, ret);
     }
 
-  peer->rib[afi][safi] = bgp_table_init (afi, safi);
-  peer->rib[afi][safi]->type = BGP_TABLE_RSCLIENT;
-  /* RIB peer reference.  Released when table is free'd in bgp_table_free. */
-  peer->rib[afi][safi]->owner = peer_lock (peer);
-
-  /* Check for existing 'network' and 'redistribute' routes. */
-  bgp_check_local_routes_rsclient (peer, afi, safi);
+  /* Share the table of a client with the same policy, if any. */
+  if (bgp_rsrib_join (peer, afi, safi))
+    {
+      /* Check for existing 'network' and 'redistribute' routes. */
+      bgp_check_local_routes_rsclient (peer, afi, safi);
 
-  /* Check for routes for peers configured with 'soft-reconfiguration'. */
-  bgp_soft_reconfig_rsclient (peer, afi, safi);
+      /* Check for routes for peers configured with 'soft-reconfiguration'. */
+      bgp_soft_reconfig_rsclient (peer, afi, safi);
+    }
 
   if (CHECK_FLAG(peer->sflags, PEER_STATUS_GROUP))
     {
@@ -2205,15 +2240,14 @@ peer_rsclient_unset_vty (struct vty *vty, const char *peer_str,
   if (ret < 0)
     return bgp_vty_return (vty, ret);
 
+  bgp_rsrib_leave (peer, afi, safi);
+
   if ( ! peer_rsclient_active (peer) )
     {
-      bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_MY_RSCLIENT);
       listnode_delete (bgp->rsclient, peer);
       peer_unlock (peer); /* peer bgp rsclient reference */
     }
 
-  bgp_table_finish (&peer->rib[bgp_node_afi(vty)][bgp_node_safi(vty)]);
-
   return CMD_SUCCESS;
 }
 
@@ -3569,6 +3603,10 @@ peer_route_map_set_vty (struct vty *vty, const char *ip_str,
 
   ret = peer_route_map_set (peer, afi, safi, direct, name_str);
 
+  /* Route server clients may share tables differently now. */
+  if (ret == 0 && (direct == RMAP_IMPORT || direct == RMAP_EXPORT))
+    bgp_rsrib_regroup (peer->bgp, afi, safi);
+
   return bgp_vty_return (vty, ret);
 }
 
@@ -3596,6 +3634,10 @@ peer_route_map_unset_vty (struct vty *vty, const char *ip_str, afi_t afi,
 
   ret = peer_route_map_unset (peer, afi, safi, direct);
 
+  /* Route server clients may share tables differently now. */
+  if (ret == 0 && (direct == RMAP_IMPORT || direct == RMAP_EXPORT))
+    bgp_rsrib_regroup (peer->bgp, afi, safi);
+
   return bgp_vty_return (vty, ret);
 }
 
@@ -6587,6 +6629,7 @@ DEFUN (show_bgp_memory,
 {
   char memstrbuf[MTYPE_MEMSTR_LEN];
   unsigned long count;
+  unsigned long hits, misses;
   
   /* RIB related usage stats */
   count = mtype_stats_alloc (MTYPE_BGP_NODE);
@@ -6650,6 +6693,11 @@ DEFUN (show_bgp_memory,
   
   if ((count = attr_unknown_count()))
     vty_out (vty, "%ld unknown attributes%s", count, VTY_NEWLINE);
+
+  bgp_attr_cache_stats (&count, &hits, &misses);
+  if (count || hits || misses)
+    vty_out (vty, "%ld raw attribute cache entries, %lu hits, %lu misses%s",
+	     count, hits, misses, VTY_NEWLINE);
   
   /* AS_PATH attributes */
   count = aspath_count ();
@@ -6785,6 +6833,7 @@ bgp_show_summary (struct vty *vty, struct bgp *bgp, int afi, int safi)
 
 	  vty_out (vty, "4 ");
 
+	  bgp_io_peer_stats (peer);
 	  vty_out (vty, "%5u %7d %7d %8d %4d %4lu ",
 		   peer->as,
 		   peer->open_in + peer->update_in + peer->keepalive_in
@@ -7338,11 +7387,23 @@ bgp_show_peer_afi (struct vty *vty, struct peer *p, afi_t afi, safi_t safi)
   vty_out (vty, "%s", VTY_NEWLINE);
 }
 
+/* Messages per socket call, with two decimals.  */
+static const char *
+bgp_per_call (u_int32_t msgs, u_int32_t calls, char *buf)
+{
+  unsigned long long x100;
+
+  x100 = calls ? (unsigned long long) msgs * 100 / calls : 0;
+  snprintf (buf, 16, "%llu.%02llu", x100 / 100, x100 % 100);
+  return buf;
+}
+
 static void
 bgp_show_peer (struct vty *vty, struct peer *p)
 {
   struct bgp *bgp;
   char buf1[BUFSIZ];
+  char buf2[16];
   char timebuf[BGP_UPTIME_LEN];
   afi_t afi;
   safi_t safi;
@@ -7570,6 +7631,7 @@ bgp_show_peer (struct vty *vty, struct peer *p)
     }
 
   /* Packet counts. */
+  bgp_io_peer_stats (p);
   vty_out (vty, "  Message statistics:%s", VTY_NEWLINE);
   vty_out (vty, "    Inq depth is 0%s", VTY_NEWLINE);
   vty_out (vty, "    Outq depth is %lu%s", (unsigned long) p->obuf->count, VTY_NEWLINE);
@@ -7584,6 +7646,13 @@ bgp_show_peer (struct vty *vty, struct peer *p)
 	   p->update_out + p->keepalive_out + p->refresh_out + p->dynamic_cap_out,
 	   p->open_in + p->notify_in + p->update_in + p->keepalive_in + p->refresh_in +
 	   p->dynamic_cap_in, VTY_NEWLINE);
+  vty_out (vty, "    Socket calls:  %10u %10u%s", p->write_calls, p->read_calls,
+	   VTY_NEWLINE);
+  vty_out (vty, "    Per call:      %10s %10s%s",
+	   bgp_per_call (p->write_msgs, p->write_calls, buf1),
+	   bgp_per_call (p->read_msgs, p->read_calls, buf2), VTY_NEWLINE);
+  vty_out (vty, "    Attribute cache: %u hits, %u misses%s",
+	   p->attr_cache_hit, p->attr_cache_miss, VTY_NEWLINE);
 
   /* advertisement-interval */
   vty_out (vty, "  Minimum time between advertisement runs is %d seconds%s",
@@ -8923,6 +8992,11 @@ bgp_vty_init (void)
   install_element (CONFIG_NODE, &bgp_config_type_cmd);
   install_element (CONFIG_NODE, &no_bgp_config_type_cmd);
 
+  /* "bgp write-budget" commands. */
+  install_element (CONFIG_NODE, &bgp_write_budget_cmd);
+  install_element (CONFIG_NODE, &no_bgp_write_budget_cmd);
+  install_element (CONFIG_NODE, &no_bgp_write_budget_val_cmd);
+
   /* Dummy commands (Currently not supported) */
   install_element (BGP_NODE, &no_synchronization_cmd);
   install_element (BGP_NODE, &no_auto_summary_cmd);
@@ -10100,6 +10174,7 @@ community_list_set_vty (struct vty *vty, int argc, const char **argv,
   /* When community_list_set() return nevetive value, it means
      malformed community string.  */
   ret = community_list_set (bgp_clist, argv[0], str, direct, style);
+  route_map_cache_flush ();
 
   /* Free temporary community list string allocated by
      argv_concat().  */
@@ -10145,6 +10220,7 @@ community_list_unset_vty (struct vty *vty, int argc, const char **argv,
 
   /* Unset community list.  */
   ret = community_list_unset (bgp_clist, argv[0], str, direct, style);
+  route_map_cache_flush ();
 
   /* Free temporary community list string allocated by
      argv_concat().  */
@@ -10453,6 +10529,7 @@ extcommunity_list_set_vty (struct vty *vty, int argc, const char **argv,
     str = NULL;
 
   ret = extcommunity_list_set (bgp_clist, argv[0], str, direct, style);
+  route_map_cache_flush ();
 
   /* Free temporary community list string allocated by
      argv_concat().  */
@@ -10495,6 +10572,7 @@ extcommunity_list_unset_vty (struct vty *vty, int argc, const char **argv,
 
   /* Unset community list.  */
   ret = extcommunity_list_unset (bgp_clist, argv[0], str, direct, style);
+  route_map_cache_flush ();
 
   /* Free temporary community list string allocated by
      argv_concat().  */
@@ -58,6 +58,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
+#include "bgpd/bgp_rsrib.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -121,6 +124,8 @@ bgp_option_check (int flag)
 int
 bgp_flag_set (struct bgp *bgp, int flag)
 {
+  update_group_config_changed ();
+
   SET_FLAG (bgp->flags, flag);
   return 0;
 }
@@ -128,6 +133,8 @@ bgp_flag_set (struct bgp *bgp, int flag)
 int
 bgp_flag_unset (struct bgp *bgp, int flag)
 {
+  update_group_config_changed ();
+
   UNSET_FLAG (bgp->flags, flag);
   return 0;
 }
@@ -142,12 +149,16 @@ bgp_flag_check (struct bgp *bgp, int flag)
 static void
 bgp_config_set (struct bgp *bgp, int config)
 {
+  update_group_config_changed ();
+
   SET_FLAG (bgp->config, config);
 }
 
 static void
 bgp_config_unset (struct bgp *bgp, int config)
 {
+  update_group_config_changed ();
+
   UNSET_FLAG (bgp->config, config);
 }
 
@@ -389,6 +400,8 @@ bgp_confederation_peers_add (struct bgp *bgp, as_t as)
   struct peer *peer;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! bgp)
     return BGP_ERR_INVALID_BGP;
 
@@ -439,6 +452,8 @@ bgp_confederation_peers_remove (struct bgp *bgp, as_t as)
   struct peer *peer;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! bgp)
     return -1;
 
@@ -491,6 +506,8 @@ bgp_confederation_peers_remove (struct bgp *bgp, as_t as)
 int
 bgp_default_local_preference_set (struct bgp *bgp, u_int32_t local_pref)
 {
+  update_group_config_changed ();
+
   if (! bgp)
     return -1;
 
@@ -502,6 +519,8 @@ bgp_default_local_preference_set (struct bgp *bgp, u_int32_t local_pref)
 int
 bgp_default_local_preference_unset (struct bgp *bgp)
 {
+  update_group_config_changed ();
+
   if (! bgp)
     return -1;
 
@@ -620,6 +639,8 @@ peer_af_flag_reset (struct peer *peer, afi_t afi, safi_t safi)
 static void
 peer_global_config_reset (struct peer *peer)
 {
+  update_group_config_changed ();
+
   peer->weight = 0;
   peer->change_local_as = 0;
   peer->ttl = (peer_sort (peer) == BGP_PEER_IBGP ? 255 : 1);
@@ -730,6 +751,7 @@ peer_free (struct peer *peer)
   if (peer->clear_node_queue)
     work_queue_free (peer->clear_node_queue);
   
+  update_group_peer_delete (peer);
   bgp_sync_delete (peer);
   memset (peer, 0, sizeof (struct peer));
   
@@ -823,6 +845,7 @@ peer_new (struct bgp *bgp)
 
   /* Create buffers.  */
   peer->ibuf = stream_new (BGP_MAX_PACKET_SIZE);
+  peer->rbuf = stream_new (BGP_READ_BUF_SIZE);
   peer->obuf = stream_fifo_new ();
   peer->work = stream_new (BGP_MAX_PACKET_SIZE);
 
@@ -900,6 +923,10 @@ static void
 peer_as_change (struct peer *peer, as_t as)
 {
   int type;
+  afi_t afi;
+  safi_t safi;
+
+  update_group_config_changed ();
 
   /* Stop peer. */
   if (! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP))
@@ -956,6 +983,12 @@ peer_as_change (struct peer *peer, as_t as)
       peer->change_local_as = 0;
       UNSET_FLAG (peer->flags, PEER_FLAG_LOCAL_AS_NO_PREPEND);
     }
+
+  /* Route server clients share tables with clients of the same AS. */
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+	bgp_rsrib_regroup (peer->bgp, afi, safi);
 }
 
 /* If peer does not exist, create new one.  If peer already exists,
@@ -1241,31 +1274,27 @@ peer_delete (struct peer *peer)
     {
       peer_unlock (peer); /* rsclient list reference */
       list_delete_node (bgp->rsclient, pn);
-
-      /* Clear our own rsclient ribs. */
-      for (afi = AFI_IP; afi < AFI_MAX; afi++)
-        for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
-          if (CHECK_FLAG(peer->af_flags[afi][safi],
-                         PEER_FLAG_RSERVER_CLIENT))
-            bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_MY_RSCLIENT);
     }
 
-  /* Free RIB for any family in which peer is RSERVER_CLIENT, and is not
-      member of a peer_group. */
+  /* Leave or free RIB for any family in which peer is RSERVER_CLIENT,
+      and is not member of a peer_group. */
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       if (peer->rib[afi][safi] && ! peer->af_group[afi][safi])
-        bgp_table_finish (&peer->rib[afi][safi]);
+        bgp_rsrib_leave (peer, afi, safi);
 
   /* Buffers.  */
   if (peer->ibuf)
     stream_free (peer->ibuf);
+  if (peer->rbuf)
+    stream_free (peer->rbuf);
   if (peer->obuf)
     stream_fifo_free (peer->obuf);
   if (peer->work)
     stream_free (peer->work);
   peer->obuf = NULL;
-  peer->work = peer->ibuf = NULL;
+  peer->work = peer->ibuf = peer->rbuf = NULL;
+  bgp_attr_cache_flush (peer);
 
   /* Local and remote addresses. */
   if (peer->su_local)
@@ -1405,6 +1434,8 @@ peer_group2peer_config_copy (struct peer_group *group, struct peer *peer,
   struct bgp_filter *pfilter;
   struct bgp_filter *gfilter;
 
+  update_group_config_changed ();
+
   conf = group->conf;
   pfilter = &peer->filter[afi][safi];
   gfilter = &conf->filter[afi][safi];
@@ -1838,12 +1869,9 @@ peer_group_bind (struct bgp *bgp, union sockunion *su,
         {
           peer_unlock (peer); /* peer rsclient reference */
           list_delete_node (bgp->rsclient, pn);
-
-          /* Clear our own rsclient rib for this afi/safi. */
-          bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_MY_RSCLIENT);
         }
 
-      bgp_table_finish (&peer->rib[afi][safi]);
+      bgp_rsrib_leave (peer, afi, safi);
 
       /* Import policy. */
       if (peer->filter[afi][safi].map[RMAP_IMPORT].name)
@@ -1881,6 +1909,8 @@ int
 peer_group_unbind (struct bgp *bgp, struct peer *peer,
 		   struct peer_group *group, afi_t afi, safi_t safi)
 {
+  update_group_config_changed ();
+
   if (! peer->af_group[afi][safi])
       return 0;
 
@@ -2437,6 +2467,8 @@ peer_flag_modify (struct peer *peer, u_int32_t flag, int set)
   struct listnode *node, *nnode;
   struct peer_flag_action action;
 
+  update_group_config_changed ();
+
   memset (&action, 0, sizeof (struct peer_flag_action));
   size = sizeof peer_flag_action_list / sizeof (struct peer_flag_action);
 
@@ -2540,6 +2572,8 @@ peer_af_flag_modify (struct peer *peer, afi_t afi, safi_t safi, u_int32_t flag,
   struct peer_group *group;
   struct peer_flag_action action;
 
+  update_group_config_changed ();
+
   memset (&action, 0, sizeof (struct peer_flag_action));
   size = sizeof peer_af_flag_action_list / sizeof (struct peer_flag_action);
   
@@ -2673,6 +2707,8 @@ peer_ebgp_multihop_set (struct peer *peer, int ttl)
   struct listnode *node, *nnode;
   struct peer *peer1;
 
+  update_group_config_changed ();
+
   if (peer_sort (peer) == BGP_PEER_IBGP)
     return 0;
 
@@ -2731,6 +2767,8 @@ peer_ebgp_multihop_unset (struct peer *peer)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (peer_sort (peer) == BGP_PEER_IBGP)
     return 0;
 
@@ -3401,6 +3439,8 @@ peer_local_as_set (struct peer *peer, as_t as, int no_prepend)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (peer_sort (peer) != BGP_PEER_EBGP
       && peer_sort (peer) != BGP_PEER_INTERNAL)
     return BGP_ERR_LOCAL_AS_ALLOWED_ONLY_FOR_EBGP;
@@ -3464,6 +3504,8 @@ peer_local_as_unset (struct peer *peer)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (peer_group_active (peer))
     return BGP_ERR_INVALID_FOR_PEER_GROUP_MEMBER;
 
@@ -3619,6 +3661,8 @@ peer_distribute_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3666,6 +3710,8 @@ peer_distribute_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3731,6 +3777,8 @@ peer_distribute_update (struct access_list *access)
   struct peer_group *group;
   struct bgp_filter *filter;
 
+  update_group_config_changed ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -3779,6 +3827,8 @@ peer_prefix_list_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3825,6 +3875,8 @@ peer_prefix_list_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3890,6 +3942,8 @@ peer_prefix_list_update (struct prefix_list *plist)
   safi_t safi;
   int direct;
 
+  update_group_config_changed ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -3937,6 +3991,8 @@ peer_aslist_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3980,6 +4036,8 @@ peer_aslist_unset (struct peer *peer,afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4044,6 +4102,8 @@ peer_aslist_update (void)
   struct peer_group *group;
   struct bgp_filter *filter;
 
+  update_group_config_changed ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -4092,6 +4152,8 @@ peer_route_map_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4139,6 +4201,8 @@ peer_route_map_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4200,6 +4264,8 @@ peer_unsuppress_map_set (struct peer *peer, afi_t afi, safi_t safi,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4241,6 +4307,8 @@ peer_unsuppress_map_unset (struct peer *peer, afi_t afi, safi_t safi)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  update_group_config_changed ();
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
   
@@ -4377,6 +4445,8 @@ peer_ttl_security_hops_set (struct peer *peer, int gtsm_hops)
   struct peer *peer1;
   int ret;
 
+  update_group_config_changed ();
+
   zlog_debug ("peer_ttl_security_hops_set: set gtsm_hops to %d for %s", gtsm_hops, peer->host);
 
   if (peer_sort (peer) == BGP_PEER_IBGP)
@@ -4464,6 +4534,8 @@ peer_ttl_security_hops_unset (struct peer *peer)
   struct listnode *node, *nnode;
   struct peer *opeer;
 
+  update_group_config_changed ();
+
   zlog_debug ("peer_ttl_security_hops_unset: set gtsm_hops to zero for %s", peer->host);
 
   if (peer_sort (peer) == BGP_PEER_IBGP)
@@ -5160,6 +5232,15 @@ bgp_config_write (struct vty *vty)
       write++;
     }
 
+  if (bm->write_budget != BGP_WRITE_BUDGET_DEFAULT)
+    {
+      vty_out (vty, "bgp write-budget %u%s", bm->write_budget, VTY_NEWLINE);
+      write++;
+    }
+
+  /* BGP I/O thread. */
+  write += bgp_io_config_write (vty);
+
   /* BGP configuration. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
@@ -5338,6 +5419,7 @@ bgp_master_init (void)
   bm->port = BGP_PORT_DEFAULT;
   bm->master = thread_master_create ();
   bm->start_time = bgp_clock ();
+  bm->write_budget = BGP_WRITE_BUDGET_DEFAULT;
 }
 
 
@@ -5355,6 +5437,9 @@ bgp_init (void)
   bgp_debug_init ();
   bgp_dump_init ();
   bgp_route_init ();
+  bgp_update_group_init ();
+  bgp_rsrib_init ();
+  bgp_io_init ();
   bgp_route_map_init ();
   bgp_scan_init ();
   bgp_mplsvpn_init ();
@@ -60,6 +60,9 @@ struct bgp_master
 #define BGP_OPT_MULTIPLE_INSTANCE        (1 << 1)
 #define BGP_OPT_CONFIG_CISCO             (1 << 2)
 #define BGP_OPT_REDIST_RMAP_RESPONSIVE   (1 << 3)
+
+  /* Bytes written to a peer per run of bgp_write().  */
+  u_int32_t write_budget;
 };
 
 /* BGP instance structure.  */
@@ -289,11 +292,16 @@ struct peer
   /* Peer specific RIB when configured as route-server-client. */
   struct bgp_table *rib[AFI_MAX][SAFI_MAX];
 
-  /* Packet receive and send buffer. */
+  /* Packet receive and send buffer.  Once Established, the socket is
+     read in chunks into rbuf and each message copied to ibuf. */
   struct stream *ibuf;
+  struct stream *rbuf;
   struct stream_fifo *obuf;
   struct stream *work;
 
+  /* Attribute blocks lately received, see bgp_attr_parse(). */
+  struct bgp_attr_cache *attr_cache;
+
   /* Status of the peer. */
   int status;
   int ostatus;
@@ -303,6 +311,7 @@ struct peer
 
   /* Peer information */
   int fd;			/* File descriptor */
+  struct bgp_io_peer *io;	/* Socket owned by the I/O thread */
   int ttl;			/* TTL of TCP connection to the peer. */
   int gtsm_hops;		/* minimum hopcount to peer */
   char *desc;			/* Description of the peer. */
@@ -469,6 +478,12 @@ struct peer
   u_int32_t refresh_out;	/* Route Refresh output count */
   u_int32_t dynamic_cap_in;	/* Dynamic Capability input count.  */
   u_int32_t dynamic_cap_out;	/* Dynamic Capability output count.  */
+  u_int32_t read_calls;		/* Socket reads */
+  u_int32_t read_msgs;		/* Messages they brought */
+  u_int32_t write_calls;	/* Socket writes */
+  u_int32_t write_msgs;		/* Messages they sent */
+  u_int32_t attr_cache_hit;	/* Attribute blocks found in cache */
+  u_int32_t attr_cache_miss;	/* Attribute blocks decoded and cached */
 
   /* BGP state count */
   u_int32_t established;	/* Established */
@@ -484,6 +499,20 @@ struct peer
   /* Announcement attribute hash.  */
   struct hash *hash[AFI_MAX][SAFI_MAX];
 
+  /* This peer's routes and adjacencies in every table, main and
+     route server, by AFI/SAFI of the table.  */
+  struct bgp_info *paths[AFI_MAX][SAFI_MAX];
+  struct bgp_adj_in *adj_ins[AFI_MAX][SAFI_MAX];
+  struct bgp_adj_out *adj_outs[AFI_MAX][SAFI_MAX];
+
+  /* Index of this peer's entries in bgp_node adj_out_slot arrays.  */
+  unsigned int adj_out_slot;
+
+  /* Update group per address family, see bgp_updgrp.c, and the
+     update_group_config value it was last checked against.  */
+  struct update_group *updgrp[AFI_MAX][SAFI_MAX];
+  unsigned long updgrp_config[AFI_MAX][SAFI_MAX];
+
   /* Notify data. */
   struct bgp_notify notify;
 
@@ -575,6 +604,11 @@ struct bgp_nlri
 #define BGP_HEADER_SIZE		                19
 #define BGP_MAX_PACKET_SIZE                   4096
 
+/* Socket reads of an Established session, and the default for the
+   bytes bgp_write() sends per run.  */
+#define BGP_READ_BUF_SIZE          (8 * BGP_MAX_PACKET_SIZE)
+#define BGP_WRITE_BUDGET_DEFAULT            (64 * 1024)
+
 /* BGP minimum message size.  */
 #define BGP_MSG_OPEN_MIN_SIZE                   (BGP_HEADER_SIZE + 10)
 #define BGP_MSG_UPDATE_MIN_SIZE                 (BGP_HEADER_SIZE + 4)
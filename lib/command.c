@@ -30,6 +30,7 @@ Boston, MA 02111-1307, USA.  */
 #include "vty.h"
 #include "command.h"
 #include "workqueue.h"
+#include "hash.h"
 
 /* Command vector which includes some level of command lists. Normally
    each daemon maintains each own cmdvec. */
@@ -3664,6 +3665,7 @@ cmd_init (int terminal)
 
       install_thread_cmds();
       install_work_queues_cmds();
+      install_hash_cmds();
     }
   srand(time(NULL));
 }
@@ -826,13 +826,38 @@ distribute_print (struct vty *vty, char *tab[], int is_prefix,
   return has_print;
 }
 
+/* Show the filters of one interface in the given direction. */
+static void
+distribute_show_if (struct hash_backet *mp, void *args[])
+{
+  struct vty *vty = args[0];
+  enum distribute_type v4 = *(enum distribute_type *) args[1];
+  enum distribute_type v6 = *(enum distribute_type *) args[2];
+  struct distribute *dist = mp->data;
+  int has_print;
+
+  if (! dist->ifname)
+    return;
+
+  vty_out (vty, "    %s filtered by", dist->ifname);
+  has_print = 0;
+  has_print = distribute_print(vty, dist->list,   0, v4, has_print);
+  has_print = distribute_print(vty, dist->prefix, 1, v4, has_print);
+  has_print = distribute_print(vty, dist->list,   0, v6, has_print);
+  has_print = distribute_print(vty, dist->prefix, 1, v6, has_print);
+  if (has_print)
+    vty_out (vty, "%s", VTY_NEWLINE);
+  else
+    vty_out(vty, " nothing%s", VTY_NEWLINE);
+}
+
 int
 config_show_distribute (struct vty *vty)
 {
-  unsigned int i;
   int has_print = 0;
-  struct hash_backet *mp;
   struct distribute *dist;
+  enum distribute_type v4, v6;
+  void *args[3];
 
   /* Output filter configuration. */
   dist = distribute_lookup (NULL);
@@ -854,28 +879,14 @@ config_show_distribute (struct vty *vty)
   else
     vty_out (vty, " not set%s", VTY_NEWLINE);
 
-  for (i = 0; i < disthash->size; i++)
-    for (mp = disthash->index[i]; mp; mp = mp->next)
-      {
-	dist = mp->data;
-	if (dist->ifname)
-          {
-            vty_out (vty, "    %s filtered by", dist->ifname);
-            has_print = 0;
-            has_print = distribute_print(vty, dist->list,   0,
-                                         DISTRIBUTE_V4_OUT, has_print);
-            has_print = distribute_print(vty, dist->prefix, 1,
-                                         DISTRIBUTE_V4_OUT, has_print);
-            has_print = distribute_print(vty, dist->list,   0,
-                                         DISTRIBUTE_V6_OUT, has_print);
-            has_print = distribute_print(vty, dist->prefix, 1,
-                                         DISTRIBUTE_V6_OUT, has_print);
-            if (has_print)
-              vty_out (vty, "%s", VTY_NEWLINE);
-            else
-              vty_out(vty, " nothing%s", VTY_NEWLINE);
-          }
-      }
+  args[0] = vty;
+  args[1] = &v4;
+  args[2] = &v6;
+  v4 = DISTRIBUTE_V4_OUT;
+  v6 = DISTRIBUTE_V6_OUT;
+  hash_iterate (disthash,
+                (void (*) (struct hash_backet *, void *)) distribute_show_if,
+                args);
 
 
   /* Input filter configuration. */
@@ -898,74 +909,62 @@ config_show_distribute (struct vty *vty)
   else
     vty_out (vty, " not set%s", VTY_NEWLINE);
 
-  for (i = 0; i < disthash->size; i++)
-    for (mp = disthash->index[i]; mp; mp = mp->next)
-      {
-	dist = mp->data;
-        if (dist->ifname)
-          {
-            vty_out (vty, "    %s filtered by", dist->ifname);
-            has_print = 0;
-            has_print = distribute_print(vty, dist->list,   0,
-                                         DISTRIBUTE_V4_IN, has_print);
-            has_print = distribute_print(vty, dist->prefix, 1,
-                                         DISTRIBUTE_V4_IN, has_print);
-            has_print = distribute_print(vty, dist->list,   0,
-                                         DISTRIBUTE_V6_IN, has_print);
-            has_print = distribute_print(vty, dist->prefix, 1,
-                                         DISTRIBUTE_V6_IN, has_print);
-            if (has_print)
-              vty_out (vty, "%s", VTY_NEWLINE);
-            else
-              vty_out(vty, " nothing%s", VTY_NEWLINE);
-          }
-      }
+  v4 = DISTRIBUTE_V4_IN;
+  v6 = DISTRIBUTE_V6_IN;
+  hash_iterate (disthash,
+                (void (*) (struct hash_backet *, void *)) distribute_show_if,
+                args);
   return 0;
 }
 
+/* Write the distribute-lists of one hash entry. */
+static void
+distribute_config_write_one (struct hash_backet *mp, void *args[])
+{
+  struct vty *vty = args[0];
+  int *write = args[1];
+  struct distribute *dist = mp->data;
+  int j;
+  int output, v6;
+
+  for (j=0; j < DISTRIBUTE_MAX; j++)
+    if (dist->list[j]) {
+      output = j == DISTRIBUTE_V4_OUT || j == DISTRIBUTE_V6_OUT;
+      v6 = j == DISTRIBUTE_V6_IN || j == DISTRIBUTE_V6_OUT;
+      vty_out (vty, " %sdistribute-list %s %s %s%s",
+               v6 ? "ipv6 " : "",
+               dist->list[j],
+               output ? "out" : "in",
+               dist->ifname ? dist->ifname : "",
+               VTY_NEWLINE);
+      (*write)++;
+    }
+
+  for (j=0; j < DISTRIBUTE_MAX; j++)
+    if (dist->prefix[j]) {
+      output = j == DISTRIBUTE_V4_OUT || j == DISTRIBUTE_V6_OUT;
+      v6 = j == DISTRIBUTE_V6_IN || j == DISTRIBUTE_V6_OUT;
+      vty_out (vty, " %sdistribute-list prefix %s %s %s%s",
+               v6 ? "ipv6 " : "",
+               dist->prefix[j],
+               output ? "out" : "in",
+               dist->ifname ? dist->ifname : "",
+               VTY_NEWLINE);
+      (*write)++;
+    }
+}
+
 /* Configuration write function. */
 int
 config_write_distribute (struct vty *vty)
 {
-  unsigned int i;
-  int j;
-  int output, v6;
-  struct hash_backet *mp;
   int write = 0;
+  void *args[2] = { vty, &write };
 
-  for (i = 0; i < disthash->size; i++)
-    for (mp = disthash->index[i]; mp; mp = mp->next)
-      {
-	struct distribute *dist;
-
-	dist = mp->data;
-
-	for (j=0; j < DISTRIBUTE_MAX; j++)
-	  if (dist->list[j]) {
-	    output = j == DISTRIBUTE_V4_OUT || j == DISTRIBUTE_V6_OUT;
-            v6 = j == DISTRIBUTE_V6_IN || j == DISTRIBUTE_V6_OUT;
-	    vty_out (vty, " %sdistribute-list %s %s %s%s",
-                     v6 ? "ipv6 " : "",
-		     dist->list[j],
-		     output ? "out" : "in",
-		     dist->ifname ? dist->ifname : "",
-		     VTY_NEWLINE);
-	    write++;
-	  }
-
-	for (j=0; j < DISTRIBUTE_MAX; j++)
-	  if (dist->prefix[j]) {
-	    output = j == DISTRIBUTE_V4_OUT || j == DISTRIBUTE_V6_OUT;
-            v6 = j == DISTRIBUTE_V6_IN || j == DISTRIBUTE_V6_OUT;
-	    vty_out (vty, " %sdistribute-list prefix %s %s %s%s",
-                     v6 ? "ipv6 " : "",
-		     dist->prefix[j],
-		     output ? "out" : "in",
-		     dist->ifname ? dist->ifname : "",
-		     VTY_NEWLINE);
-	    write++;
-	  }
-      }
+  hash_iterate (disthash,
+                (void (*) (struct hash_backet *, void *))
+                  distribute_config_write_one,
+                args);
   return write;
 }
 
@@ -28,6 +28,7 @@
 #include "sockunion.h"
 #include "buffer.h"
 #include "log.h"
+#include "table.h"
 
 struct filter_cisco
 {
@@ -66,6 +67,27 @@ struct filter
       struct filter_cisco cfilter;
       struct filter_zebra zfilter;
     } u;
+
+  /* Position in the access-list, and next filter in the same place
+     of the list's index.  Only valid while the list is indexed. */
+  int order;
+  struct filter *tnext;
+};
+
+/* Lists shorter than this are scanned, longer ones get an index. */
+#define ACCESS_LIST_INDEX_MIN 16
+
+/* Compiled access-list.  Zebra filters are kept in a radix tree per
+   family by their prefix, Cisco filters whose wildcard bits are
+   contiguous in one by the source address and its mask, which covers
+   both standard entries and the source half of extended ones.  Those
+   with odd wildcards are left on a list of their own.  Filters hanging
+   off the same node are chained in list order. */
+struct access_list_index
+{
+  struct route_table *zebra[2];
+  struct route_table *cisco;
+  struct filter *rest;
 };
 
 /* List of access_list. */
@@ -209,6 +231,192 @@ filter_match_zebra (struct filter *mfilter, struct prefix *p)
     return 0;
 }
 
+static int
+filter_match (struct filter *filter, struct prefix *p)
+{
+  if (filter->cisco)
+    return filter_match_cisco (filter, p);
+  else
+    return filter_match_zebra (filter, p);
+}
+
+/* Table of INDEX the filter belongs in, and its key there.  NULL if
+   the filter can only be scanned. */
+static struct route_table **
+access_list_index_table (struct access_list_index *index,
+			 struct filter *filter, struct prefix *key)
+{
+  struct filter_cisco *cfilter;
+  struct in_addr mask;
+  u_int32_t wild;
+
+  if (! filter->cisco)
+    {
+      prefix_copy (key, &filter->u.zfilter.prefix);
+      apply_mask (key);
+      if (key->family == AF_INET)
+	return &index->zebra[0];
+      if (key->family == AF_INET6)
+	return &index->zebra[1];
+      return NULL;
+    }
+
+  /* A Cisco filter matches on the address alone, under its wildcard,
+     which is a prefix if the wildcard bits are all at the end. */
+  cfilter = &filter->u.cfilter;
+  wild = ntohl (cfilter->addr_mask.s_addr);
+  if (wild & (wild + 1))
+    return NULL;
+
+  mask.s_addr = ~cfilter->addr_mask.s_addr;
+  memset (key, 0, sizeof (struct prefix));
+  key->family = AF_INET;
+  key->prefixlen = ip_masklen (mask);
+  key->u.prefix4 = cfilter->addr;
+  return &index->cisco;
+}
+
+/* Filters are added from the tail of the list to its head, so putting
+   each in front of its chain keeps the chains in list order. */
+static void
+access_list_index_add (struct access_list_index *index, struct filter *filter)
+{
+  struct route_table **table;
+  struct route_node *rn;
+  struct prefix key;
+
+  table = access_list_index_table (index, filter, &key);
+  if (table == NULL)
+    {
+      filter->tnext = index->rest;
+      index->rest = filter;
+      return;
+    }
+
+  if (*table == NULL)
+    *table = route_table_init ();
+
+  /* The first filter on a node keeps the lock taken here. */
+  rn = route_node_get (*table, &key);
+  if (rn->info)
+    route_unlock_node (rn);
+
+  filter->tnext = rn->info;
+  rn->info = filter;
+}
+
+/* Drop the compiled form of the list, it is built again when next
+   used. */
+static void
+access_list_index_free (struct access_list *access)
+{
+  struct access_list_index *index;
+  int i;
+
+  index = access->index;
+  if (index)
+    {
+      for (i = 0; i < 2; i++)
+	if (index->zebra[i])
+	  route_table_finish (index->zebra[i]);
+      if (index->cisco)
+	route_table_finish (index->cisco);
+      XFREE (MTYPE_ACCESS_INDEX, index);
+    }
+
+  access->index = NULL;
+  access->compiled = 0;
+}
+
+static void
+access_list_compile (struct access_list *access)
+{
+  struct filter *filter;
+  int order;
+
+  access->compiled = 1;
+
+  for (order = 0, filter = access->head; filter; filter = filter->next)
+    filter->order = order++;
+  if (order < ACCESS_LIST_INDEX_MIN)
+    return;
+
+  access->index = XCALLOC (MTYPE_ACCESS_INDEX,
+			   sizeof (struct access_list_index));
+  for (filter = access->tail; filter; filter = filter->prev)
+    access_list_index_add (access->index, filter);
+}
+
+/* First filter matching P on the chains from RN up to the root, if it
+   comes before BEST. */
+static struct filter *
+access_list_index_walk (struct route_node *rn, struct prefix *p,
+			struct filter *best)
+{
+  struct filter *filter;
+
+  for (; rn; rn = rn->parent)
+    for (filter = rn->info; filter; filter = filter->tnext)
+      {
+	if (best && filter->order > best->order)
+	  break;
+	if (filter_match (filter, p))
+	  {
+	    best = filter;
+	    break;
+	  }
+      }
+  return best;
+}
+
+/* First filter of an indexed list that matches P. */
+static struct filter *
+access_list_index_match (struct access_list_index *index, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct filter *filter;
+  struct filter *best = NULL;
+  struct prefix host;
+
+  table = NULL;
+  if (p->family == AF_INET)
+    table = index->zebra[0];
+  else if (p->family == AF_INET6)
+    table = index->zebra[1];
+
+  if (table && (rn = route_node_match (table, p)) != NULL)
+    {
+      best = access_list_index_walk (rn, p, best);
+      route_unlock_node (rn);
+    }
+
+  if (index->cisco)
+    {
+      memset (&host, 0, sizeof (struct prefix));
+      host.family = AF_INET;
+      host.prefixlen = IPV4_MAX_BITLEN;
+      host.u.prefix4 = p->u.prefix4;
+
+      rn = route_node_match (index->cisco, &host);
+      if (rn)
+	{
+	  best = access_list_index_walk (rn, p, best);
+	  route_unlock_node (rn);
+	}
+    }
+
+  for (filter = index->rest; filter; filter = filter->tnext)
+    {
+      if (best && filter->order > best->order)
+	break;
+      if (filter_match (filter, p))
+	return filter;
+    }
+
+  return best;
+}
+
 /* Allocate new access list structure. */
 static struct access_list *
 access_list_new (void)
@@ -233,6 +441,7 @@ access_list_delete (struct access_list *access)
   struct access_list_list *list;
   struct access_master *master;
 
+  access_list_index_free (access);
   for (filter = access->head; filter; filter = next)
     {
       next = filter->next;
@@ -407,6 +616,15 @@ access_list_apply (struct access_list *access, void *object)
   if (access == NULL)
     return FILTER_DENY;
 
+  if (! access->compiled)
+    access_list_compile (access);
+
+  if (access->index)
+    {
+      filter = access_list_index_match (access->index, p);
+      return filter ? filter->type : FILTER_DENY;
+    }
+
   for (filter = access->head; filter; filter = filter->next)
     {
       if (filter->cisco)
@@ -457,6 +675,8 @@ access_list_filter_add (struct access_list *access, struct filter *filter)
     access->head = filter;
   access->tail = filter;
 
+  access_list_index_free (access);
+
   /* Run hook function. */
   if (access->master->add_hook)
     (*access->master->add_hook) (access);
@@ -481,6 +701,8 @@ access_list_filter_delete (struct access_list *access, struct filter *filter)
 
   master = access->master;
 
+  access_list_index_free (access);
+
   if (filter->next)
     filter->next->prev = filter->prev;
   else
@@ -54,6 +54,10 @@ struct access_list
 
   struct filter *head;
   struct filter *tail;
+
+  /* Compiled form of a long list, built on first use after a change. */
+  int compiled;
+  struct access_list_index *index;
 };
 
 /* Prototypes for access-list. */
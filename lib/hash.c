@@ -23,6 +23,11 @@
 
 #include "hash.h"
 #include "memory.h"
+#include "linklist.h"
+#include "command.h"
+
+/* Hashes listed by "show hashtable". */
+static struct list hashtables;
 
 /* Allocate a new hash.  */
 struct hash *
@@ -31,10 +36,11 @@ hash_create_size (unsigned int size, unsigned int (*hash_key) (void *),
 {
   struct hash *hash;
 
-  hash = XMALLOC (MTYPE_HASH, sizeof (struct hash));
+  hash = XCALLOC (MTYPE_HASH, sizeof (struct hash));
   hash->index = XCALLOC (MTYPE_HASH_INDEX,
 			 sizeof (struct hash_backet *) * size);
   hash->size = size;
+  hash->min_size = size;
   hash->hash_key = hash_key;
   hash->hash_cmp = hash_cmp;
   hash->count = 0;
@@ -50,6 +56,16 @@ hash_create (unsigned int (*hash_key) (void *),
   return hash_create_size (HASHTABSIZE, hash_key, hash_cmp);
 }
 
+/* List the hash in "show hashtable" under the given name, which must
+   stay valid for the lifetime of the hash.  */
+void
+hash_set_name (struct hash *hash, const char *name)
+{
+  if (! hash->name)
+    listnode_add (&hashtables, hash);
+  hash->name = name;
+}
+
 /* Utility function for hash_get().  When this function is specified
    as alloc_func, return arugment as it is.  This function is used for
    intern already allocated value.  */
@@ -59,6 +75,67 @@ hash_alloc_intern (void *arg)
   return arg;
 }
 
+/* Move up to HASH_REHASH_STEP backets of the old index into the new
+   one, and drop the old index once it is empty.  The work of a resize
+   is spread over the following hash_get/hash_release calls, so that no
+   single insertion has to rehash the whole table.  */
+static void
+hash_rehash_step (struct hash *hash)
+{
+  struct hash_backet *hb;
+  struct hash_backet *next;
+  unsigned int index;
+  unsigned int n;
+
+  if (! hash->old_index || hash->iterating)
+    return;
+
+  for (n = 0; n < HASH_REHASH_STEP && hash->rehash_pos < hash->old_size; n++)
+    {
+      for (hb = hash->old_index[hash->rehash_pos]; hb; hb = next)
+	{
+	  next = hb->next;
+	  index = hb->key % hash->size;
+	  hb->next = hash->index[index];
+	  hash->index[index] = hb;
+	}
+      hash->old_index[hash->rehash_pos++] = NULL;
+    }
+
+  if (hash->rehash_pos == hash->old_size)
+    {
+      XFREE (MTYPE_HASH_INDEX, hash->old_index);
+      hash->old_size = 0;
+      hash->rehash_pos = 0;
+    }
+}
+
+/* Start resizing the table if the load factor is out of bounds. */
+static void
+hash_check_resize (struct hash *hash)
+{
+  unsigned int new_size;
+
+  if (hash->old_index || hash->iterating)
+    return;
+
+  if (hash->count > (unsigned long) hash->size * HASH_LOAD_MAX)
+    new_size = hash->size * 2;
+  else if (hash->size > hash->min_size
+	   && hash->count < hash->size / HASH_SHRINK_DIVISOR)
+    new_size = MAX (hash->size / 2, hash->min_size);
+  else
+    return;
+
+  hash->old_index = hash->index;
+  hash->old_size = hash->size;
+  hash->rehash_pos = 0;
+  hash->index = XCALLOC (MTYPE_HASH_INDEX,
+			 sizeof (struct hash_backet *) * new_size);
+  hash->size = new_size;
+  hash->resizes++;
+}
+
 /* Lookup and return hash backet in hash.  If there is no
    corresponding hash backet and alloc_func is specified, create new
    hash backet.  */
@@ -70,6 +147,8 @@ hash_get (struct hash *hash, void *data, void * (*alloc_func) (void *))
   void *newdata;
   struct hash_backet *backet;
 
+  hash_rehash_step (hash);
+
   key = (*hash->hash_key) (data);
   index = key % hash->size;
 
@@ -77,6 +156,12 @@ hash_get (struct hash *hash, void *data, void * (*alloc_func) (void *))
     if (backet->key == key && (*hash->hash_cmp) (backet->data, data))
       return backet->data;
 
+  if (hash->old_index)
+    for (backet = hash->old_index[key % hash->old_size]; backet != NULL;
+	 backet = backet->next)
+      if (backet->key == key && (*hash->hash_cmp) (backet->data, data))
+	return backet->data;
+
   if (alloc_func)
     {
       newdata = (*alloc_func) (data);
@@ -89,11 +174,12 @@ hash_get (struct hash *hash, void *data, void * (*alloc_func) (void *))
       backet->next = hash->index[index];
       hash->index[index] = backet;
       hash->count++;
+
+      hash_check_resize (hash);
       return backet->data;
     }
   return NULL;
 }
-
 /* Hash lookup.  */
 void *
 hash_lookup (struct hash *hash, void *data)
@@ -112,51 +198,70 @@ unsigned int string_hash_make (const char *str)
   return hash;
 }
 
-/* This function release registered value from specified hash.  When
-   release is successfully finished, return the data pointer in the
-   hash backet.  */
-void *
-hash_release (struct hash *hash, void *data)
+/* Unlink the backet holding data from one backet chain. */
+static struct hash_backet *
+hash_unlink (struct hash *hash, struct hash_backet **head,
+	     unsigned int key, void *data)
 {
-  void *ret;
-  unsigned int key;
-  unsigned int index;
   struct hash_backet *backet;
   struct hash_backet *pp;
 
-  key = (*hash->hash_key) (data);
-  index = key % hash->size;
-
-  for (backet = pp = hash->index[index]; backet; backet = backet->next)
+  for (backet = pp = *head; backet; backet = backet->next)
     {
       if (backet->key == key && (*hash->hash_cmp) (backet->data, data)) 
 	{
 	  if (backet == pp) 
-	    hash->index[index] = backet->next;
+	    *head = backet->next;
 	  else 
 	    pp->next = backet->next;
-
-	  ret = backet->data;
-	  XFREE (MTYPE_HASH_BACKET, backet);
-	  hash->count--;
-	  return ret;
+	  return backet;
 	}
       pp = backet;
     }
   return NULL;
 }
 
-/* Iterator function for hash.  */
-void
-hash_iterate (struct hash *hash, 
-	      void (*func) (struct hash_backet *, void *), void *arg)
+/* This function release registered value from specified hash.  When
+   release is successfully finished, return the data pointer in the
+   hash backet.  */
+void *
+hash_release (struct hash *hash, void *data)
+{
+  void *ret;
+  unsigned int key;
+  struct hash_backet *backet;
+
+  hash_rehash_step (hash);
+
+  key = (*hash->hash_key) (data);
+
+  backet = hash_unlink (hash, &hash->index[key % hash->size], key, data);
+  if (! backet && hash->old_index)
+    backet = hash_unlink (hash, &hash->old_index[key % hash->old_size],
+			  key, data);
+  if (! backet)
+    return NULL;
+
+  ret = backet->data;
+  XFREE (MTYPE_HASH_BACKET, backet);
+  hash->count--;
+
+  hash_check_resize (hash);
+  return ret;
+}
+
+/* Call func on every backet of one index. */
+static void
+hash_iterate_index (struct hash_backet **index, unsigned int from,
+		    unsigned int size,
+		    void (*func) (struct hash_backet *, void *), void *arg)
 {
   unsigned int i;
   struct hash_backet *hb;
   struct hash_backet *hbnext;
 
-  for (i = 0; i < hash->size; i++)
-    for (hb = hash->index[i]; hb; hb = hbnext)
+  for (i = from; i < size; i++)
+    for (hb = index[i]; hb; hb = hbnext)
       {
 	/* get pointer to next hash backet here, in case (*func)
 	 * decides to delete hb by calling hash_release
@@ -166,17 +271,34 @@ hash_iterate (struct hash *hash,
       }
 }
 
-/* Clean up hash.  */
+/* Iterator function for hash.  */
 void
-hash_clean (struct hash *hash, void (*free_func) (void *))
+hash_iterate (struct hash *hash, 
+	      void (*func) (struct hash_backet *, void *), void *arg)
+{
+  /* Backets must not move between the indexes under our feet. */
+  hash->iterating++;
+
+  hash_iterate_index (hash->index, 0, hash->size, func, arg);
+  if (hash->old_index)
+    hash_iterate_index (hash->old_index, hash->rehash_pos, hash->old_size,
+			func, arg);
+
+  hash->iterating--;
+}
+
+/* Free every backet of one index. */
+static void
+hash_clean_index (struct hash *hash, struct hash_backet **index,
+		  unsigned int size, void (*free_func) (void *))
 {
   unsigned int i;
   struct hash_backet *hb;
   struct hash_backet *next;
 
-  for (i = 0; i < hash->size; i++)
+  for (i = 0; i < size; i++)
     {
-      for (hb = hash->index[i]; hb; hb = next)
+      for (hb = index[i]; hb; hb = next)
 	{
 	  next = hb->next;
 	      
@@ -186,7 +308,22 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
 	  XFREE (MTYPE_HASH_BACKET, hb);
 	  hash->count--;
 	}
-      hash->index[i] = NULL;
+      index[i] = NULL;
+    }
+}
+
+/* Clean up hash.  */
+void
+hash_clean (struct hash *hash, void (*free_func) (void *))
+{
+  hash_clean_index (hash, hash->index, hash->size, free_func);
+
+  if (hash->old_index)
+    {
+      hash_clean_index (hash, hash->old_index, hash->old_size, free_func);
+      XFREE (MTYPE_HASH_INDEX, hash->old_index);
+      hash->old_size = 0;
+      hash->rehash_pos = 0;
     }
 }
 
@@ -195,6 +332,83 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
 void
 hash_free (struct hash *hash)
 {
+  if (hash->name)
+    listnode_delete (&hashtables, hash);
+  if (hash->old_index)
+    XFREE (MTYPE_HASH_INDEX, hash->old_index);
   XFREE (MTYPE_HASH_INDEX, hash->index);
   XFREE (MTYPE_HASH, hash);
 }
+
+/* Chain length statistics of one index. */
+struct hash_stats
+{
+  unsigned long backets;
+  unsigned long empty;
+  unsigned long max_chain;
+};
+
+static void
+hash_stats_index (struct hash_stats *stats, struct hash_backet **index,
+		  unsigned int from, unsigned int size)
+{
+  unsigned int i;
+  unsigned long len;
+  struct hash_backet *hb;
+
+  for (i = from; i < size; i++)
+    {
+      len = 0;
+      for (hb = index[i]; hb; hb = hb->next)
+	len++;
+
+      stats->backets++;
+      if (len == 0)
+	stats->empty++;
+      if (len > stats->max_chain)
+	stats->max_chain = len;
+    }
+}
+
+DEFUN (show_hashtable,
+       show_hashtable_cmd,
+       "show hashtable",
+       SHOW_STR
+       "Statistics of internal hash tables\n")
+{
+  struct listnode *node;
+  struct hash *hash;
+  struct hash_stats stats;
+  unsigned long used;
+
+  vty_out (vty, "%-20s %9s %9s %6s %9s %9s %7s%s",
+	   "Name", "Entries", "Backets", "Load", "Avg chain", "Max chain",
+	   "Resizes", VTY_NEWLINE);
+
+  for (ALL_LIST_ELEMENTS_RO (&hashtables, node, hash))
+    {
+      memset (&stats, 0, sizeof (stats));
+      hash_stats_index (&stats, hash->index, 0, hash->size);
+      if (hash->old_index)
+	hash_stats_index (&stats, hash->old_index, hash->rehash_pos,
+			  hash->old_size);
+
+      used = stats.backets - stats.empty;
+      vty_out (vty, "%-20s %9lu %9u %6.2f %9.2f %9lu %7lu%s%s",
+	       hash->name, hash->count, hash->size,
+	       (double) hash->count / hash->size,
+	       used ? (double) hash->count / used : 0.0,
+	       stats.max_chain, hash->resizes,
+	       hash->old_index ? " (resizing)" : "",
+	       VTY_NEWLINE);
+    }
+
+  return CMD_SUCCESS;
+}
+
+void
+install_hash_cmds (void)
+{
+  install_element (VIEW_NODE, &show_hashtable_cmd);
+  install_element (ENABLE_NODE, &show_hashtable_cmd);
+}
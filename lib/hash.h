@@ -24,6 +24,15 @@ Boston, MA 02111-1307, USA.  */
 /* Default hash table size.  */ 
 #define HASHTABSIZE     1024
 
+/* Tables grow once the average chain is longer than HASH_LOAD_MAX,
+   and shrink (never below their initial size) once it is shorter than
+   1/HASH_SHRINK_DIVISOR.  */
+#define HASH_LOAD_MAX		2
+#define HASH_SHRINK_DIVISOR	8
+
+/* Old backets moved to the resized table per hash_get/hash_release. */
+#define HASH_REHASH_STEP	16
+
 struct hash_backet
 {
   /* Linked list.  */
@@ -44,6 +53,24 @@ struct hash
   /* Hash table size. */
   unsigned int size;
 
+  /* Size given at creation, the table never shrinks below it. */
+  unsigned int min_size;
+
+  /* While resizing, backets not yet moved to index.  Backets below
+     rehash_pos have been moved already. */
+  struct hash_backet **old_index;
+  unsigned int old_size;
+  unsigned int rehash_pos;
+
+  /* No rehashing while hash_iterate is walking the table. */
+  unsigned int iterating;
+
+  /* Number of resizes, for "show hashtable". */
+  unsigned long resizes;
+
+  /* Name for "show hashtable", NULL if not listed. */
+  const char *name;
+
   /* Key make function. */
   unsigned int (*hash_key) (void *);
 
@@ -72,4 +99,7 @@ extern void hash_free (struct hash *);
 
 extern unsigned int string_hash_make (const char *);
 
+extern void hash_set_name (struct hash *, const char *);
+extern void install_hash_cmds (void);
+
 #endif /* _ZEBRA_HASH_H */
@@ -846,6 +846,14 @@ static const struct zebra_desc_table command_types[] = {
   DESC_ENTRY	(ZEBRA_ROUTER_ID_UPDATE),
   DESC_ENTRY	(ZEBRA_HELLO),
   DESC_ENTRY	(ZEBRA_BGP_IPV4_RGATE_VERIFY),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_REGISTER),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_UNREGISTER),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_UPDATE),
+  DESC_ENTRY	(ZEBRA_IPV4_ROUTE_BATCH_ADD),
+  DESC_ENTRY	(ZEBRA_IPV4_ROUTE_BATCH_DELETE),
+  DESC_ENTRY	(ZEBRA_IPV6_ROUTE_BATCH_ADD),
+  DESC_ENTRY	(ZEBRA_IPV6_ROUTE_BATCH_DELETE),
+  DESC_ENTRY	(ZEBRA_RING_START),
 };
 #undef DESC_ENTRY
 
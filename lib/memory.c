@@ -26,12 +26,18 @@
 #include <malloc.h>
 #endif /* !HAVE_STDLIB_H || HAVE_MALLINFO */
 
+#if defined(HAVE_PTHREAD) && !defined(NDEBUG)
+#include <pthread.h>
+#endif
+
 #include "log.h"
 #include "memory.h"
 
 static void alloc_inc (int);
 static void alloc_dec (int);
 static void log_memstats(int log_priority);
+static void zerror (const char *fname, int type, size_t size)
+  __attribute__ ((noreturn));
 
 static const struct message mstr [] =
 {
@@ -44,7 +50,7 @@ static const struct message mstr [] =
 };
 
 /* Fatal memory allocation error occured. */
-static void __attribute__ ((noreturn))
+static void
 zerror (const char *fname, int type, size_t size)
 {
   zlog_err ("%s : can't allocate memory for `%s' size %d: %s\n", 
@@ -58,6 +64,248 @@ zerror (const char *fname, int type, size_t size)
   abort();
 }
 
+#ifdef HAVE_POSIX_MEMALIGN
+/* Slab allocator for the types flagged MEMORY_SLAB in memtypes.c.
+ *
+ * Objects of a slab type are carved out of pages aligned to their own
+ * size, so the page header of any object is found by masking its
+ * address.  Each page keeps a freelist of released objects, and hands
+ * out never used space from 'fresh' so that untouched parts of a page
+ * cost no RSS.  Pages with room are on the slab's partial list; full
+ * pages are on no list.  One empty page is kept spare, further empty
+ * pages are given back.
+ *
+ * The object size is taken from the first allocation of a type.  A
+ * larger request for the same type gets a page of its own (large).
+ *
+ * Nothing here takes a lock: slab types may only be allocated and
+ * freed by the thread that first allocated one, the main thread of the
+ * daemon.  Helper threads (bgpd's I/O thread, zebra's dataplane) must
+ * leave allocating and freeing to it; builds with assertions check.
+ */
+#define SLAB_PAGE_SIZE		16384	/* minimum */
+#define SLAB_PAGE_OBJECTS	32	/* at least this many objects a page */
+#define SLAB_ALIGN		8
+#define SLAB_ROUNDUP(x)		(((x) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+struct slab_page
+{
+  struct slab_page *next;	/* on the partial list */
+  struct slab_page *prev;
+  void *free;			/* released objects */
+  char *fresh;			/* never used space starts here */
+  unsigned int used;		/* objects handed out */
+  size_t large;			/* size of the one oversized object, or 0 */
+};
+
+#define SLAB_HEADER_SIZE	SLAB_ROUNDUP (sizeof (struct slab_page))
+
+struct slab
+{
+  int enabled;
+  size_t size;			/* object size */
+  size_t page_size;
+  unsigned int per_page;
+  struct slab_page *partial;
+  struct slab_page *spare;
+  unsigned long pages;		/* including the spare */
+  unsigned long large;
+  unsigned long used;
+};
+
+static struct slab slabs[MTYPE_MAX];
+static int slabs_inited;
+#if defined(HAVE_PTHREAD) && !defined(NDEBUG)
+static pthread_t slabs_owner;
+#endif
+
+/* Pick up the MEMORY_SLAB flags from memtypes.c. */
+static void
+slab_init (void)
+{
+  struct mlist *ml;
+  struct memory_list *m;
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      if (m->index && (m->flags & MEMORY_SLAB))
+        slabs[m->index].enabled = 1;
+
+#if defined(HAVE_PTHREAD) && !defined(NDEBUG)
+  slabs_owner = pthread_self ();
+#endif
+  slabs_inited = 1;
+}
+
+static inline struct slab *
+slab_lookup (int type)
+{
+  if (!slabs_inited)
+    slab_init ();
+  if (!slabs[type].enabled)
+    return NULL;
+#if defined(HAVE_PTHREAD) && !defined(NDEBUG)
+  assert (pthread_equal (pthread_self (), slabs_owner));
+#endif
+  return &slabs[type];
+}
+
+static inline struct slab_page *
+slab_page_of (struct slab *slab, void *ptr)
+{
+  return (struct slab_page *) ((uintptr_t) ptr & ~(slab->page_size - 1));
+}
+
+static void
+slab_partial_add (struct slab *slab, struct slab_page *page)
+{
+  page->prev = NULL;
+  page->next = slab->partial;
+  if (slab->partial)
+    slab->partial->prev = page;
+  slab->partial = page;
+}
+
+static void
+slab_partial_del (struct slab *slab, struct slab_page *page)
+{
+  if (page->next)
+    page->next->prev = page->prev;
+  if (page->prev)
+    page->prev->next = page->next;
+  else
+    slab->partial = page->next;
+  page->next = page->prev = NULL;
+}
+
+static struct slab_page *
+slab_page_new (int type, struct slab *slab, size_t large)
+{
+  void *memory;
+  struct slab_page *page;
+
+  if (posix_memalign (&memory, slab->page_size,
+                      large ? SLAB_HEADER_SIZE + large : slab->page_size))
+    zerror ("posix_memalign", type, slab->page_size);
+
+  page = memory;
+  page->next = page->prev = NULL;
+  page->free = NULL;
+  page->fresh = (char *) page + SLAB_HEADER_SIZE;
+  page->used = 0;
+  page->large = large;
+  return page;
+}
+
+static void *
+slab_alloc (int type, struct slab *slab, size_t size)
+{
+  struct slab_page *page;
+  void *obj;
+
+  /* First allocation of this type decides the object size. */
+  if (!slab->size)
+    {
+      slab->size = SLAB_ROUNDUP (MAX (size, sizeof (void *)));
+      slab->page_size = SLAB_PAGE_SIZE;
+      while ((slab->page_size - SLAB_HEADER_SIZE) / slab->size
+             < SLAB_PAGE_OBJECTS)
+        slab->page_size *= 2;
+      slab->per_page = (slab->page_size - SLAB_HEADER_SIZE) / slab->size;
+    }
+
+  if (size > slab->size)
+    {
+      page = slab_page_new (type, slab, size);
+      page->used = 1;
+      slab->large++;
+      return page->fresh;
+    }
+
+  if ((page = slab->partial) == NULL)
+    {
+      if ((page = slab->spare) != NULL)
+        slab->spare = NULL;
+      else
+        {
+          page = slab_page_new (type, slab, 0);
+          slab->pages++;
+        }
+      slab_partial_add (slab, page);
+    }
+
+  if (page->free)
+    {
+      obj = page->free;
+      page->free = *(void **) obj;
+    }
+  else
+    {
+      obj = page->fresh;
+      page->fresh += slab->size;
+    }
+
+  page->used++;
+  slab->used++;
+  if (page->used == slab->per_page)
+    slab_partial_del (slab, page);
+
+  return obj;
+}
+
+static void
+slab_free (struct slab *slab, void *ptr)
+{
+  struct slab_page *page = slab_page_of (slab, ptr);
+
+  if (page->large)
+    {
+      slab->large--;
+      free (page);
+      return;
+    }
+
+  if (page->used == slab->per_page)
+    slab_partial_add (slab, page);
+
+  *(void **) ptr = page->free;
+  page->free = ptr;
+  page->used--;
+  slab->used--;
+
+  if (page->used)
+    return;
+
+  slab_partial_del (slab, page);
+  if (slab->spare)
+    {
+      free (page);
+      slab->pages--;
+    }
+  else
+    {
+      page->free = NULL;
+      page->fresh = (char *) page + SLAB_HEADER_SIZE;
+      slab->spare = page;
+    }
+}
+
+/* Usable size of a slab object. */
+static size_t
+slab_size (struct slab *slab, void *ptr)
+{
+  struct slab_page *page = slab_page_of (slab, ptr);
+
+  return page->large ? page->large : slab->size;
+}
+#else
+struct slab;
+#define slab_lookup(T)		(NULL)
+#define slab_alloc(T,S,Z)	(NULL)
+#define slab_free(S,P)
+#define slab_size(S,P)		(0)
+#endif /* HAVE_POSIX_MEMALIGN */
+
 /*
  * Allocate memory of a given size, to be tracked by a given type.
  * Effects: Returns a pointer to usable memory.  If memory cannot
@@ -67,8 +315,12 @@ void *
 zmalloc (int type, size_t size)
 {
   void *memory;
+  struct slab *slab;
 
-  memory = malloc (size);
+  if ((slab = slab_lookup (type)) != NULL)
+    memory = slab_alloc (type, slab, size);
+  else
+    memory = malloc (size);
 
   if (memory == NULL)
     zerror ("malloc", type, size);
@@ -85,8 +337,15 @@ void *
 zcalloc (int type, size_t size)
 {
   void *memory;
+  struct slab *slab;
 
-  memory = calloc (1, size);
+  if ((slab = slab_lookup (type)) != NULL)
+    {
+      memory = slab_alloc (type, slab, size);
+      memset (memory, 0, size);
+    }
+  else
+    memory = calloc (1, size);
 
   if (memory == NULL)
     zerror ("calloc", type, size);
@@ -107,6 +366,19 @@ void *
 zrealloc (int type, void *ptr, size_t size)
 {
   void *memory;
+  struct slab *slab;
+
+  if ((slab = slab_lookup (type)) != NULL)
+    {
+      if (ptr == NULL)
+        return zmalloc (type, size);
+      if (size <= slab_size (slab, ptr))
+        return ptr;
+      memory = slab_alloc (type, slab, size);
+      memcpy (memory, ptr, slab_size (slab, ptr));
+      slab_free (slab, ptr);
+      return memory;
+    }
 
   memory = realloc (ptr, size);
   if (memory == NULL)
@@ -126,10 +398,15 @@ zrealloc (int type, void *ptr, size_t size)
 void
 zfree (int type, void *ptr)
 {
+  struct slab *slab;
+
   if (ptr != NULL)
     {
       alloc_dec (type);
-      free (ptr);
+      if ((slab = slab_lookup (type)) != NULL)
+        slab_free (slab, ptr);
+      else
+        free (ptr);
     }
 }
 
@@ -144,6 +421,9 @@ zstrdup (int type, const char *str)
 {
   void *dup;
 
+  if (slab_lookup (type) != NULL)
+    return memcpy (zmalloc (type, strlen (str) + 1), str, strlen (str) + 1);
+
   dup = strdup (str);
   if (dup == NULL)
     zerror ("strdup", type, strlen (str));
@@ -392,6 +672,46 @@ show_memory_mallinfo (struct vty *vty)
 }
 #endif /* HAVE_MALLINFO */
 
+#ifdef HAVE_POSIX_MEMALIGN
+static int
+show_memory_slabs (struct vty *vty)
+{
+  struct mlist *ml;
+  struct memory_list *m;
+  struct slab *slab;
+  unsigned long capacity;
+  char buf[MTYPE_MEMSTR_LEN];
+  int header = 0;
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      {
+        slab = &slabs[m->index];
+        if (!m->index || !slab->enabled || !(slab->pages || slab->large))
+          continue;
+
+        if (!header)
+          {
+            vty_out (vty, "Slab allocator statistics:%s", VTY_NEWLINE);
+            vty_out (vty, "  %-26s %5s %9s %9s %6s %5s %8s %5s%s",
+                     "Type", "Size", "In use", "Capacity", "Pages", "Util",
+                     "Unused", "Large", VTY_NEWLINE);
+            header = 1;
+          }
+
+        capacity = slab->pages * slab->per_page;
+        vty_out (vty, "  %-26s %5lu %9lu %9lu %6lu %4lu%% %8s %5lu%s",
+                 m->format, (unsigned long) slab->size, slab->used, capacity,
+                 slab->pages,
+                 capacity ? (slab->used * 100) / capacity : 0,
+                 mtype_memstr (buf, MTYPE_MEMSTR_LEN,
+                               (capacity - slab->used) * slab->size),
+                 slab->large, VTY_NEWLINE);
+      }
+  return header;
+}
+#endif /* HAVE_POSIX_MEMALIGN */
+
 DEFUN (show_memory_all,
        show_memory_all_cmd,
        "show memory all",
@@ -405,6 +725,12 @@ DEFUN (show_memory_all,
 #ifdef HAVE_MALLINFO
   needsep = show_memory_mallinfo (vty);
 #endif /* HAVE_MALLINFO */
+
+#ifdef HAVE_POSIX_MEMALIGN
+  if (needsep)
+    show_separator (vty);
+  needsep = show_memory_slabs (vty);
+#endif /* HAVE_POSIX_MEMALIGN */
   
   for (ml = mlists; ml->list; ml++)
     {
@@ -26,8 +26,12 @@ struct memory_list
 {
   int index;
   const char *format;
+  int flags;
 };
 
+/* memory_list flags. */
+#define MEMORY_SLAB	(1 << 0)	/* fixed size, allocate from slab pages */
+
 struct mlist {
   struct memory_list *list;
   const char *name;
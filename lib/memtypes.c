@@ -5,6 +5,10 @@
  *
  * The script is sensitive to the format (though not whitespace), see
  * the top of memtypes.awk for more details.
+ *
+ * Types flagged MEMORY_SLAB are served from slab pages by lib/memory.c
+ * rather than by malloc.  They should always be allocated with the same
+ * size, larger requests still work but take a page of their own.
  */
 
 #include "zebra.h"
@@ -18,10 +22,11 @@ struct memory_list memory_list_lib[] =
   { MTYPE_VECTOR_INDEX,		"Vector index"			},
   { MTYPE_LINK_LIST,		"Link List"			},
   { MTYPE_LINK_NODE,		"Link Node"			},
-  { MTYPE_THREAD,		"Thread"			},
+  { MTYPE_THREAD,		"Thread",	MEMORY_SLAB	},
   { MTYPE_THREAD_MASTER,	"Thread master"			},
   { MTYPE_THREAD_STATS,		"Thread stats"			},
   { MTYPE_THREAD_FUNCNAME,	"Thread function name" 		},
+  { MTYPE_THREAD_FDS,		"Thread fd index"		},
   { MTYPE_VTY,			"VTY"				},
   { MTYPE_VTY_OUT_BUF,		"VTY output buffer"		},
   { MTYPE_VTY_HIST,		"VTY history"			},
@@ -37,15 +42,17 @@ struct memory_list memory_list_lib[] =
   { MTYPE_PREFIX_IPV4,		"Prefix IPv4"			},
   { MTYPE_PREFIX_IPV6,		"Prefix IPv6"			},
   { MTYPE_HASH,			"Hash"				},
-  { MTYPE_HASH_BACKET,		"Hash Bucket"			},
+  { MTYPE_HASH_BACKET,		"Hash Bucket",	MEMORY_SLAB	},
   { MTYPE_HASH_INDEX,		"Hash Index"			},
   { MTYPE_ROUTE_TABLE,		"Route table"			},
-  { MTYPE_ROUTE_NODE,		"Route node"			},
+  { MTYPE_ROUTE_NODE,		"Route node",	MEMORY_SLAB	},
+  { MTYPE_ROUTE_LPM,		"Route table LPM index"		},
   { MTYPE_DISTRIBUTE,		"Distribute list"		},
   { MTYPE_DISTRIBUTE_IFNAME,	"Dist-list ifname"		},
   { MTYPE_ACCESS_LIST,		"Access List"			},
   { MTYPE_ACCESS_LIST_STR,	"Access List Str"		},
   { MTYPE_ACCESS_FILTER,	"Access Filter"			},
+  { MTYPE_ACCESS_INDEX,		"Access List index"		},
   { MTYPE_PREFIX_LIST,		"Prefix List"			},
   { MTYPE_PREFIX_LIST_ENTRY,	"Prefix List Entry"		},
   { MTYPE_PREFIX_LIST_STR,	"Prefix List Str"		},
@@ -55,6 +62,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_ROUTE_MAP_RULE,	"Route map rule"		},
   { MTYPE_ROUTE_MAP_RULE_STR,	"Route map rule str"		},
   { MTYPE_ROUTE_MAP_COMPILED,	"Route map compiled"		},
+  { MTYPE_ROUTE_MAP_CACHE,	"Route map result cache"	},
   { MTYPE_DESC,			"Command desc"			},
   { MTYPE_KEY,			"Key"				},
   { MTYPE_KEYCHAIN,		"Key chain"			},
@@ -64,6 +72,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_PRIVS,		"Privilege information"		},
   { MTYPE_ZLOG,			"Logging"			},
   { MTYPE_ZCLIENT,		"Zclient"			},
+  { MTYPE_ZRING,		"Zebra shared memory ring"	},
   { MTYPE_WORK_QUEUE,		"Work queue"			},
   { MTYPE_WORK_QUEUE_ITEM,	"Work queue item"		},
   { MTYPE_WORK_QUEUE_NAME,	"Work queue name string"	},
@@ -79,9 +88,16 @@ struct memory_list memory_list_zebra[] =
   { MTYPE_RTADV_PREFIX,		"Router Advertisement Prefix"	},
   { MTYPE_VRF,			"VRF"				},
   { MTYPE_VRF_NAME,		"VRF name"			},
-  { MTYPE_NEXTHOP,		"Nexthop"			},
-  { MTYPE_RIB,			"RIB"				},
+  { MTYPE_NEXTHOP,		"Nexthop",	MEMORY_SLAB	},
+  { MTYPE_RIB,			"RIB",	MEMORY_SLAB	},
   { MTYPE_RIB_QUEUE,		"RIB process work queue"	},
+  { MTYPE_NETLINK_BATCH,	"Netlink batched routes"	},
+  { MTYPE_DPLANE_CTX,		"Dataplane route context"	},
+  { MTYPE_ZEBRA_NHT,		"Tracked nexthop"		},
+  { MTYPE_ZEBRA_NHT_STATE,	"Tracked nexthop state"		},
+  { MTYPE_NHG,			"Nexthop group"			},
+  { MTYPE_NHG_GATE,		"Nexthop gateway lookup"	},
+  { MTYPE_REDIST_PENDING,	"Queued redistribution"		},
   { MTYPE_STATIC_IPV4,		"Static IPv4 route"		},
   { MTYPE_STATIC_IPV6,		"Static IPv6 route"		},
   { -1, NULL },
@@ -98,26 +114,33 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_PEER_PASSWORD,	"Peer password string"		},
   { MTYPE_ATTR,			"BGP attribute"			},
   { MTYPE_ATTR_EXTRA,		"BGP extra attributes"		},
+  { MTYPE_BGP_ATTR_CACHE,	"BGP raw attribute cache"	},
   { MTYPE_AS_PATH,		"BGP aspath"			},
   { MTYPE_AS_SEG,		"BGP aspath seg"		},
   { MTYPE_AS_SEG_DATA,		"BGP aspath segment data"	},
   { MTYPE_AS_STR,		"BGP aspath str"		},
   { 0, NULL },
   { MTYPE_BGP_TABLE,		"BGP table"			},
-  { MTYPE_BGP_NODE,		"BGP node"			},
-  { MTYPE_BGP_ROUTE,		"BGP route"			},
+  { MTYPE_BGP_NODE,		"BGP node",	MEMORY_SLAB	},
+  { MTYPE_BGP_ROUTE,		"BGP route",	MEMORY_SLAB	},
   { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info"	},
   { MTYPE_BGP_CONN,		"BGP connected"			},
   { MTYPE_BGP_STATIC,		"BGP static"			},
   { MTYPE_BGP_ADVERTISE_ATTR,	"BGP adv attr"			},
-  { MTYPE_BGP_ADVERTISE,	"BGP adv"			},
+  { MTYPE_BGP_ADVERTISE,	"BGP adv",	MEMORY_SLAB	},
   { MTYPE_BGP_SYNCHRONISE,	"BGP synchronise"		},
-  { MTYPE_BGP_ADJ_IN,		"BGP adj in"			},
-  { MTYPE_BGP_ADJ_OUT,		"BGP adj out"			},
+  { MTYPE_BGP_ADJ_IN,		"BGP adj in",	MEMORY_SLAB	},
+  { MTYPE_BGP_ADJ_OUT,		"BGP adj out",	MEMORY_SLAB	},
+  { MTYPE_BGP_ADJ_OUT_SLOT,	"BGP adj out slots"		},
+  { MTYPE_BGP_UPDGRP,		"BGP update group"		},
+  { MTYPE_BGP_UPDGRP_DATA,	"BGP update group encoding"	},
+  { MTYPE_BGP_IO_PEER,		"BGP I/O thread peer"		},
+  { MTYPE_BGP_IO_ITEM,		"BGP I/O thread packet"		},
   { 0, NULL },
   { MTYPE_AS_LIST,		"BGP AS list"			},
   { MTYPE_AS_FILTER,		"BGP AS filter"			},
   { MTYPE_AS_FILTER_STR,	"BGP AS filter str"		},
+  { MTYPE_AS_LIST_CACHE,	"BGP AS list result cache"	},
   { 0, NULL },
   { MTYPE_COMMUNITY,		"community"			},
   { MTYPE_COMMUNITY_VAL,	"community val"			},
@@ -194,7 +217,7 @@ struct memory_list memory_list_ospf[] =
   { MTYPE_OSPF_NEIGHBOR,      "OSPF neighbor"			},
   { MTYPE_OSPF_ROUTE,         "OSPF route"			},
   { MTYPE_OSPF_TMP,           "OSPF tmp mem"			},
-  { MTYPE_OSPF_LSA,           "OSPF LSA"			},
+  { MTYPE_OSPF_LSA,           "OSPF LSA",	MEMORY_SLAB	},
   { MTYPE_OSPF_LSA_DATA,      "OSPF LSA data"			},
   { MTYPE_OSPF_LSDB,          "OSPF LSDB"			},
   { MTYPE_OSPF_PACKET,        "OSPF packet"			},
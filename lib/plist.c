@@ -29,6 +29,7 @@
 #include "buffer.h"
 #include "stream.h"
 #include "log.h"
+#include "table.h"
 
 /* Each prefix-list's entry. */
 struct prefix_list_entry
@@ -48,8 +49,14 @@ struct prefix_list_entry
 
   struct prefix_list_entry *next;
   struct prefix_list_entry *prev;
+
+  /* Next entry with the same prefix in the list's trie, by seq. */
+  struct prefix_list_entry *tnext;
 };
 
+/* Lists shorter than this are scanned, longer ones get a trie. */
+#define PREFIX_LIST_TRIE_MIN 32
+
 /* List of struct prefix_list. */
 struct prefix_list_list
 {
@@ -180,6 +187,134 @@ prefix_list_entry_free (struct prefix_list_entry *pentry)
   XFREE (MTYPE_PREFIX_LIST_ENTRY, pentry);
 }
 
+/* Prefix-list trie.  A long list is matched by walking a radix tree
+   of its entries' prefixes from the longest one covering the prefix
+   up to the root, instead of scanning every entry.  The entries
+   hanging off a node are kept in seq order, and the matching entry
+   with the lowest seq found on the way wins, as it would have in a
+   scan of the list.  The trie is built the first time a list of
+   PREFIX_LIST_TRIE_MIN entries or more is used and is kept up to
+   date from then on. */
+static struct route_table **
+prefix_list_trie_get (struct prefix_list *plist, u_char family)
+{
+  if (family == AF_INET)
+    return &plist->trie[0];
+  if (family == AF_INET6)
+    return &plist->trie[1];
+  return NULL;
+}
+
+/* Trie node of exactly PREFIX, locked, if there is one. */
+static struct route_node *
+prefix_list_trie_node (struct prefix_list *plist, struct prefix *prefix)
+{
+  struct route_table **trie;
+  struct prefix p;
+
+  trie = prefix_list_trie_get (plist, prefix->family);
+  if (trie == NULL || *trie == NULL)
+    return NULL;
+
+  prefix_copy (&p, prefix);
+  apply_mask (&p);
+  return route_node_lookup (*trie, &p);
+}
+
+static void
+prefix_list_trie_add (struct prefix_list *plist,
+		      struct prefix_list_entry *pentry)
+{
+  struct route_table **trie;
+  struct route_node *rn;
+  struct prefix_list_entry *point;
+  struct prefix p;
+
+  trie = prefix_list_trie_get (plist, pentry->prefix.family);
+  if (trie == NULL)
+    return;
+  if (*trie == NULL)
+    *trie = route_table_init ();
+
+  /* The entry keeps the lock taken here. */
+  prefix_copy (&p, &pentry->prefix);
+  apply_mask (&p);
+  rn = route_node_get (*trie, &p);
+
+  point = rn->info;
+  if (point == NULL || point->seq > pentry->seq)
+    {
+      pentry->tnext = point;
+      rn->info = pentry;
+      return;
+    }
+  while (point->tnext && point->tnext->seq < pentry->seq)
+    point = point->tnext;
+  pentry->tnext = point->tnext;
+  point->tnext = pentry;
+}
+
+static void
+prefix_list_trie_delete (struct prefix_list *plist,
+			 struct prefix_list_entry *pentry)
+{
+  struct route_node *rn;
+  struct prefix_list_entry *point;
+
+  rn = prefix_list_trie_node (plist, &pentry->prefix);
+  if (rn == NULL)
+    return;
+
+  if (rn->info == pentry)
+    rn->info = pentry->tnext;
+  else
+    {
+      for (point = rn->info; point; point = point->tnext)
+	if (point->tnext == pentry)
+	  break;
+      if (point == NULL)
+	{
+	  route_unlock_node (rn);
+	  return;
+	}
+      point->tnext = pentry->tnext;
+    }
+  pentry->tnext = NULL;
+
+  route_unlock_node (rn);	/* route_node_lookup () */
+  route_unlock_node (rn);	/* the entry's */
+}
+
+static void
+prefix_list_trie_free (struct prefix_list *plist)
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    if (plist->trie[i])
+      {
+	route_table_finish (plist->trie[i]);
+	plist->trie[i] = NULL;
+      }
+  plist->indexed = 0;
+}
+
+/* Build the trie if the list has grown long enough to want one, and
+   tell whether it has one. */
+static int
+prefix_list_trie_check (struct prefix_list *plist)
+{
+  struct prefix_list_entry *pentry;
+
+  if (! plist->indexed && plist->count >= PREFIX_LIST_TRIE_MIN)
+    {
+      for (pentry = plist->head; pentry; pentry = pentry->next)
+	prefix_list_trie_add (plist, pentry);
+      plist->indexed = 1;
+    }
+  return plist->indexed;
+}
+
 /* Insert new prefix list to list of prefix_list.  Each prefix_list
    is sorted by the name. */
 static struct prefix_list *
@@ -294,6 +429,7 @@ prefix_list_delete (struct prefix_list *plist)
   struct prefix_list_entry *next;
 
   /* If prefix-list contain prefix_list_entry free all of it. */
+  prefix_list_trie_free (plist);
   for (pentry = plist->head; pentry; pentry = next)
     {
       next = pentry->next;
@@ -380,15 +516,9 @@ prefix_new_seq_get (struct prefix_list *plist)
 {
   int maxseq;
   int newseq;
-  struct prefix_list_entry *pentry;
 
-  maxseq = newseq = 0;
-
-  for (pentry = plist->head; pentry; pentry = pentry->next)
-    {
-      if (maxseq < pentry->seq)
-	maxseq = pentry->seq;
-    }
+  /* The list is in seq order. */
+  maxseq = plist->tail ? plist->tail->seq : 0;
 
   newseq = ((maxseq / 5) * 5) + 5;
   
@@ -401,9 +531,14 @@ prefix_seq_check (struct prefix_list *plist, int seq)
 {
   struct prefix_list_entry *pentry;
 
+  /* Appending, as when configuration is read. */
+  if (plist->tail == NULL || plist->tail->seq < seq)
+    return NULL;
+
+  /* The list is kept sorted by seq. */
   for (pentry = plist->head; pentry; pentry = pentry->next)
-    if (pentry->seq == seq)
-      return pentry;
+    if (pentry->seq >= seq)
+      return pentry->seq == seq ? pentry : NULL;
   return NULL;
 }
 
@@ -412,8 +547,20 @@ prefix_list_entry_lookup (struct prefix_list *plist, struct prefix *prefix,
 			  enum prefix_list_type type, int seq, int le, int ge)
 {
   struct prefix_list_entry *pentry;
+  struct route_node *rn;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
+  if (prefix_list_trie_check (plist))
+    {
+      rn = prefix_list_trie_node (plist, prefix);
+      if (rn == NULL)
+	return NULL;
+      route_unlock_node (rn);
+      pentry = rn->info;
+    }
+  else
+    pentry = plist->head;
+
+  for (; pentry; pentry = plist->indexed ? pentry->tnext : pentry->next)
     if (prefix_same (&pentry->prefix, prefix) && pentry->type == type)
       {
 	if (seq >= 0 && pentry->seq != seq)
@@ -446,6 +593,9 @@ prefix_list_entry_delete (struct prefix_list *plist,
   else
     plist->tail = pentry->prev;
 
+  if (plist->indexed)
+    prefix_list_trie_delete (plist, pentry);
+
   prefix_list_entry_free (pentry);
 
   plist->count--;
@@ -479,9 +629,12 @@ prefix_list_entry_add (struct prefix_list *plist,
     prefix_list_entry_delete (plist, replace, 0);
 
   /* Check insert point. */
-  for (point = plist->head; point; point = point->next)
-    if (point->seq >= pentry->seq)
-      break;
+  if (plist->tail && plist->tail->seq < pentry->seq)
+    point = NULL;
+  else
+    for (point = plist->head; point; point = point->next)
+      if (point->seq >= pentry->seq)
+	break;
 
   /* In case of this is the first element of the list. */
   pentry->next = point;
@@ -510,6 +663,9 @@ prefix_list_entry_add (struct prefix_list *plist,
   /* Increment count. */
   plist->count++;
 
+  if (plist->indexed)
+    prefix_list_trie_add (plist, pentry);
+
   /* Run hook function. */
   if (plist->master->add_hook)
     (*plist->master->add_hook) (plist);
@@ -560,6 +716,42 @@ prefix_list_entry_match (struct prefix_list_entry *pentry, struct prefix *p)
   return 1;
 }
 
+/* Lowest seq entry of an indexed list that matches P.  Entries looked
+   at on the way have their refcnt bumped, as in a scan. */
+static struct prefix_list_entry *
+prefix_list_trie_match (struct prefix_list *plist, struct prefix *p)
+{
+  struct route_table **trie;
+  struct route_node *rn;
+  struct route_node *node;
+  struct prefix_list_entry *pentry;
+  struct prefix_list_entry *best = NULL;
+
+  trie = prefix_list_trie_get (plist, p->family);
+  if (trie == NULL || *trie == NULL)
+    return NULL;
+
+  rn = route_node_match (*trie, p);
+  if (rn == NULL)
+    return NULL;
+
+  for (node = rn; node; node = node->parent)
+    for (pentry = node->info; pentry; pentry = pentry->tnext)
+      {
+	if (best && pentry->seq > best->seq)
+	  break;
+	pentry->refcnt++;
+	if (prefix_list_entry_match (pentry, p))
+	  {
+	    best = pentry;
+	    break;
+	  }
+      }
+
+  route_unlock_node (rn);
+  return best;
+}
+
 enum prefix_list_type
 prefix_list_apply (struct prefix_list *plist, void *object)
 {
@@ -574,6 +766,16 @@ prefix_list_apply (struct prefix_list *plist, void *object)
   if (plist->count == 0)
     return PREFIX_PERMIT;
 
+  if (prefix_list_trie_check (plist)
+      && prefix_list_trie_get (plist, p->family))
+    {
+      pentry = prefix_list_trie_match (plist, p);
+      if (pentry == NULL)
+	return PREFIX_DENY;
+      pentry->hitcnt++;
+      return pentry->type;
+    }
+
   for (pentry = plist->head; pentry; pentry = pentry->next)
     {
       pentry->refcnt++;
@@ -628,6 +830,7 @@ prefix_entry_dup_check (struct prefix_list *plist,
 			struct prefix_list_entry *new)
 {
   struct prefix_list_entry *pentry;
+  struct route_node *rn;
   int seq = 0;
 
   if (new->seq == -1)
@@ -635,7 +838,18 @@ prefix_entry_dup_check (struct prefix_list *plist,
   else
     seq = new->seq;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
+  if (prefix_list_trie_check (plist))
+    {
+      rn = prefix_list_trie_node (plist, &new->prefix);
+      if (rn == NULL)
+	return NULL;
+      route_unlock_node (rn);
+      pentry = rn->info;
+    }
+  else
+    pentry = plist->head;
+
+  for (; pentry; pentry = plist->indexed ? pentry->tnext : pentry->next)
     {
       if (prefix_same (&pentry->prefix, &new->prefix)
 	  && pentry->type == new->type
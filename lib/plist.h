@@ -52,6 +52,10 @@ struct prefix_list
   struct prefix_list_entry *head;
   struct prefix_list_entry *tail;
 
+  /* Entries by prefix, IPv4 and IPv6, once the list is long enough. */
+  int indexed;
+  struct route_table *trie[2];
+
   struct prefix_list *next;
   struct prefix_list *prev;
 };
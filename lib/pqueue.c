@@ -168,3 +168,21 @@ pqueue_dequeue (struct pqueue *queue)
   trickle_down (0, queue);
   return data;
 }
+
+/* Remove the node at an arbitrary position, as tracked by the update
+   callback.  */
+void
+pqueue_remove_at (int index, struct pqueue *queue)
+{
+  queue->size--;
+  if (index == queue->size)
+    return;
+
+  queue->array[index] = queue->array[queue->size];
+  if (index > 0
+      && (*queue->cmp) (queue->array[index],
+                        queue->array[PARENT_OF (index)]) < 0)
+    trickle_up (index, queue);
+  else
+    trickle_down (index, queue);
+}
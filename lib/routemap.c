@@ -28,6 +28,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "command.h"
 #include "vty.h"
 #include "log.h"
+#include "hash.h"
+#include "jhash.h"
 
 /* Vector for route match rules. */
 static vector route_match_vec;
@@ -61,17 +63,39 @@ struct route_map_list
   void (*add_hook) (const char *);
   void (*delete_hook) (const char *);
   void (*event_hook) (route_map_event_t, const char *); 
+
+  void *(*cache_ref) (void *);
+  void (*cache_unref) (void *);
 };
 
 /* Master list of route map. */
 static struct route_map_list route_map_master = { NULL, NULL, NULL, NULL };
 
+/* Remembered first match of a route map, see route_map_apply_cached().
+   INDEX is NULL when no index matched. */
+struct route_map_cache_entry
+{
+  void *key;
+  struct route_map_index *index;
+};
+
+/* Entries kept per route map before it starts over. */
+#define ROUTE_MAP_CACHE_MAX	65536
+
+/* Values of route_map->cacheable. */
+#define ROUTE_MAP_CACHE_UNKNOWN	0
+#define ROUTE_MAP_CACHE_NO	1
+#define ROUTE_MAP_CACHE_YES	2
+
 static void
 route_map_rule_delete (struct route_map_rule_list *,
 		       struct route_map_rule *);
 
 static void
 route_map_index_delete (struct route_map_index *, int);
+
+static void
+route_map_cache_reset (struct route_map *);
 
 /* New route map allocation. Please note route map's name must be
    specified. */
@@ -121,6 +145,10 @@ route_map_delete (struct route_map *map)
   while ((index = map->head) != NULL)
     route_map_index_delete (index, 0);
 
+  route_map_cache_reset (map);
+  if (map->cache)
+    hash_free (map->cache);
+
   name = map->name;
 
   list = &route_map_master;
@@ -158,6 +186,41 @@ route_map_lookup_by_name (const char *name)
   return NULL;
 }
 
+/* Does MAP, or a route map it calls, have a match rule named NAME? */
+static int
+route_map_match_used_depth (struct route_map *map, const char *name,
+                            int depth)
+{
+  struct route_map_index *index;
+  struct route_map_rule *rule;
+
+  if (map == NULL)
+    return 0;
+
+  /* Assume the worst rather than chase call loops. */
+  if (depth > RMAP_RECURSION_LIMIT)
+    return 1;
+
+  for (index = map->head; index; index = index->next)
+    {
+      for (rule = index->match_list.head; rule; rule = rule->next)
+        if (strcmp (rule->cmd->str, name) == 0)
+          return 1;
+
+      if (index->nextrm
+          && route_map_match_used_depth (route_map_lookup_by_name (index->nextrm),
+                                         name, depth + 1))
+        return 1;
+    }
+  return 0;
+}
+
+int
+route_map_match_used (struct route_map *map, const char *name)
+{
+  return route_map_match_used_depth (map, name, 0);
+}
+
 /* Lookup route map.  If there isn't route map create one and return
    it. */
 static struct route_map *
@@ -198,6 +261,108 @@ route_map_empty (struct route_map *map)
     return 0;
 }
 
+/* Route map cache.  For a map whose match rules only look at the
+   attributes of the object, which index the object first matches
+   is a function of those attributes.  The caller of
+   route_map_apply_cached() names them with a key, typically an
+   interned attribute set, and the first match is remembered per key
+   until the map changes.  Set rules, call and on-match still run
+   every time, only the match rules up to the first match are
+   skipped. */
+static unsigned int
+route_map_cache_hash_key (void *p)
+{
+  struct route_map_cache_entry *entry = p;
+
+  return jhash_1word ((u_int32_t) (uintptr_t) entry->key, 0);
+}
+
+static int
+route_map_cache_hash_cmp (const void *p1, const void *p2)
+{
+  const struct route_map_cache_entry *e1 = p1;
+  const struct route_map_cache_entry *e2 = p2;
+
+  return e1->key == e2->key;
+}
+
+static void *
+route_map_cache_entry_alloc (void *p)
+{
+  struct route_map_cache_entry *val = p;
+  struct route_map_cache_entry *entry;
+
+  entry = XMALLOC (MTYPE_ROUTE_MAP_CACHE, sizeof (struct route_map_cache_entry));
+  entry->key = (*route_map_master.cache_ref) (val->key);
+  entry->index = val->index;
+  return entry;
+}
+
+static void
+route_map_cache_entry_free (void *p)
+{
+  struct route_map_cache_entry *entry = p;
+
+  (*route_map_master.cache_unref) (entry->key);
+  XFREE (MTYPE_ROUTE_MAP_CACHE, entry);
+}
+
+static void
+route_map_cache_reset (struct route_map *map)
+{
+  if (map->cache)
+    hash_clean (map->cache, route_map_cache_entry_free);
+  map->cacheable = ROUTE_MAP_CACHE_UNKNOWN;
+}
+
+/* Are all match rules of the route map attr_only? */
+int
+route_map_cacheable (struct route_map *map)
+{
+  struct route_map_index *index;
+  struct route_map_rule *rule;
+
+  if (map == NULL || ! route_map_master.cache_ref)
+    return 0;
+
+  if (map->cacheable == ROUTE_MAP_CACHE_UNKNOWN)
+    {
+      map->cacheable = ROUTE_MAP_CACHE_YES;
+      for (index = map->head; index; index = index->next)
+	for (rule = index->match_list.head; rule; rule = rule->next)
+	  if (! rule->cmd->attr_only)
+	    map->cacheable = ROUTE_MAP_CACHE_NO;
+    }
+  return map->cacheable == ROUTE_MAP_CACHE_YES;
+}
+
+void
+route_map_cache_flush (void)
+{
+  struct route_map *map;
+
+  for (map = route_map_master.head; map; map = map->next)
+    route_map_cache_reset (map);
+}
+
+void
+route_map_cache_key_hook (void *(*ref) (void *), void (*unref) (void *))
+{
+  route_map_master.cache_ref = ref;
+  route_map_master.cache_unref = unref;
+}
+
+/* The route map changed: forget what its cache knows and tell the
+   daemon. */
+static void
+route_map_changed (struct route_map *map, route_map_event_t event)
+{
+  route_map_cache_reset (map);
+
+  if (route_map_master.event_hook)
+    (*route_map_master.event_hook) (event, map->name);
+}
+
 /* show route-map */
 static void
 vty_show_route_map_entry (struct vty *vty, struct route_map *map)
@@ -246,6 +411,11 @@ vty_show_route_map_entry (struct vty *vty, struct route_map *map)
       else if (index->exitpolicy == RMAP_EXIT)
         vty_out (vty, "    Exit routemap%s", VTY_NEWLINE);
     }
+
+  if (route_map_cacheable (map) || map->cache_hit || map->cache_miss)
+    vty_out (vty, "route-map %s result cache: %lu entries, %lu hits, %lu misses%s",
+	     map->name, map->cache ? map->cache->count : 0,
+	     map->cache_hit, map->cache_miss, VTY_NEWLINE);
 }
 
 static int
@@ -318,10 +488,9 @@ route_map_index_delete (struct route_map_index *index, int notify)
   if (index->nextrm)
     XFREE (MTYPE_ROUTE_MAP_NAME, index->nextrm);
 
-    /* Execute event hook. */
-  if (route_map_master.event_hook && notify)
-    (*route_map_master.event_hook) (RMAP_EVENT_INDEX_DELETED,
-				    index->map->name);
+  /* Execute event hook. */
+  if (notify)
+    route_map_changed (index->map, RMAP_EVENT_INDEX_DELETED);
 
   XFREE (MTYPE_ROUTE_MAP_INDEX, index);
 }
@@ -385,9 +554,7 @@ route_map_index_add (struct route_map *map, enum route_map_type type,
     }
 
   /* Execute event hook. */
-  if (route_map_master.event_hook)
-    (*route_map_master.event_hook) (RMAP_EVENT_INDEX_ADDED,
-				    map->name);
+  route_map_changed (map, RMAP_EVENT_INDEX_ADDED);
 
   return index;
 }
@@ -571,11 +738,8 @@ route_map_add_match (struct route_map_index *index, const char *match_name,
   route_map_rule_add (&index->match_list, rule);
 
   /* Execute event hook. */
-  if (route_map_master.event_hook)
-    (*route_map_master.event_hook) (replaced ?
-				    RMAP_EVENT_MATCH_REPLACED:
-				    RMAP_EVENT_MATCH_ADDED,
-				    index->map->name);
+  route_map_changed (index->map, replaced ?
+		     RMAP_EVENT_MATCH_REPLACED : RMAP_EVENT_MATCH_ADDED);
 
   return 0;
 }
@@ -598,9 +762,7 @@ route_map_delete_match (struct route_map_index *index, const char *match_name,
       {
 	route_map_rule_delete (&index->match_list, rule);
 	/* Execute event hook. */
-	if (route_map_master.event_hook)
-	  (*route_map_master.event_hook) (RMAP_EVENT_MATCH_DELETED,
-					  index->map->name);
+	route_map_changed (index->map, RMAP_EVENT_MATCH_DELETED);
 	return 0;
       }
   /* Can't find matched rule. */
@@ -658,11 +820,8 @@ route_map_add_set (struct route_map_index *index, const char *set_name,
   route_map_rule_add (&index->set_list, rule);
 
   /* Execute event hook. */
-  if (route_map_master.event_hook)
-    (*route_map_master.event_hook) (replaced ?
-				    RMAP_EVENT_SET_REPLACED:
-				    RMAP_EVENT_SET_ADDED,
-				    index->map->name);
+  route_map_changed (index->map, replaced ?
+		     RMAP_EVENT_SET_REPLACED : RMAP_EVENT_SET_ADDED);
   return 0;
 }
 
@@ -684,9 +843,7 @@ route_map_delete_set (struct route_map_index *index, const char *set_name,
       {
         route_map_rule_delete (&index->set_list, rule);
 	/* Execute event hook. */
-	if (route_map_master.event_hook)
-	  (*route_map_master.event_hook) (RMAP_EVENT_SET_DELETED,
-					  index->map->name);
+	route_map_changed (index->map, RMAP_EVENT_SET_DELETED);
         return 0;
       }
   /* Can't find matched rule. */
@@ -769,32 +926,40 @@ route_map_apply_match (struct route_map_rule_list *match_list,
   return ret;
 }
 
-/* Apply route map to the object. */
-route_map_result_t
-route_map_apply (struct route_map *map, struct prefix *prefix,
-                 route_map_object_t type, void *object)
+/* First index of the route map whose match rules all match. */
+static struct route_map_index *
+route_map_first_match (struct route_map *map, struct prefix *prefix,
+                       route_map_object_t type, void *object)
 {
-  static int recursion = 0;
-  int ret = 0;
   struct route_map_index *index;
-  struct route_map_rule *set;
 
-  if (recursion > RMAP_RECURSION_LIMIT)
-    {
-      zlog (NULL, LOG_WARNING,
-            "route-map recursion limit (%d) reached, discarding route",
-            RMAP_RECURSION_LIMIT);
-      recursion = 0;
-      return RMAP_DENYMATCH;
-    }
+  for (index = map->head; index; index = index->next)
+    if (route_map_apply_match (&index->match_list, prefix,
+                               type, object) == RMAP_MATCH)
+      return index;
+  return NULL;
+}
 
-  if (map == NULL)
-    return RMAP_DENYMATCH;
+static int route_map_recursion = 0;
 
-  for (index = map->head; index; index = index->next)
+/* Apply the route map to the object, FIRST being the index it first
+   matches. */
+static route_map_result_t
+route_map_apply_from (struct route_map *map, struct route_map_index *first,
+                      struct prefix *prefix, route_map_object_t type,
+                      void *object)
+{
+  int ret = 0;
+  struct route_map_index *index;
+  struct route_map_rule *set;
+
+  for (index = first; index; index = index->next)
     {
       /* Apply this index. */
-      ret = route_map_apply_match (&index->match_list, prefix, type, object);
+      if (index == first)
+        ret = RMAP_MATCH;
+      else
+        ret = route_map_apply_match (&index->match_list, prefix, type, object);
 
       /* Now we apply the matrix from above */
       if (ret == RMAP_NOMATCH)
@@ -818,9 +983,9 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
 
                   if (nextrm) /* Target route-map found, jump to it */
                     {
-                      recursion++;
+                      route_map_recursion++;
                       ret = route_map_apply (nextrm, prefix, type, object);
-                      recursion--;
+                      route_map_recursion--;
                     }
 
                   /* If nextrm returned 'deny', finish. */
@@ -864,6 +1029,60 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   return RMAP_DENYMATCH;
 }
 
+/* Apply route map to the object. */
+route_map_result_t
+route_map_apply (struct route_map *map, struct prefix *prefix,
+                 route_map_object_t type, void *object)
+{
+  if (route_map_recursion > RMAP_RECURSION_LIMIT)
+    {
+      zlog (NULL, LOG_WARNING,
+            "route-map recursion limit (%d) reached, discarding route",
+            RMAP_RECURSION_LIMIT);
+      route_map_recursion = 0;
+      return RMAP_DENYMATCH;
+    }
+
+  if (map == NULL)
+    return RMAP_DENYMATCH;
+
+  return route_map_apply_from (map,
+                               route_map_first_match (map, prefix,
+                                                      type, object),
+                               prefix, type, object);
+}
+
+route_map_result_t
+route_map_apply_cached (struct route_map *map, struct prefix *prefix,
+                        route_map_object_t type, void *object, void *key)
+{
+  struct route_map_cache_entry lookup;
+  struct route_map_cache_entry *entry;
+
+  if (key == NULL || ! route_map_cacheable (map))
+    return route_map_apply (map, prefix, type, object);
+
+  if (! map->cache)
+    map->cache = hash_create (route_map_cache_hash_key,
+                              route_map_cache_hash_cmp);
+
+  lookup.key = key;
+  entry = hash_lookup (map->cache, &lookup);
+  if (entry)
+    map->cache_hit++;
+  else
+    {
+      if (map->cache->count >= ROUTE_MAP_CACHE_MAX)
+        hash_clean (map->cache, route_map_cache_entry_free);
+
+      lookup.index = route_map_first_match (map, prefix, type, object);
+      entry = hash_get (map->cache, &lookup, route_map_cache_entry_alloc);
+      map->cache_miss++;
+    }
+
+  return route_map_apply_from (map, entry->index, prefix, type, object);
+}
+
 void
 route_map_add_hook (void (*func) (const char *))
 {
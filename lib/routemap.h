@@ -87,6 +87,10 @@ struct route_map_rule_cmd
 
   /* Free allocated value by func_compile (). */
   void (*func_free)(void *);
+
+  /* Match rule whose result depends on nothing but the attributes
+     the caller of route_map_apply_cached() keys on. */
+  int attr_only;
 };
 
 /* Route map apply error. */
@@ -149,6 +153,12 @@ struct route_map
   /* Make linked list. */
   struct route_map *next;
   struct route_map *prev;
+
+  /* First matching index by key, see route_map_apply_cached(). */
+  struct hash *cache;
+  int cacheable;
+  unsigned long cache_hit;
+  unsigned long cache_miss;
 };
 
 /* Prototypes. */
@@ -185,12 +195,33 @@ extern void route_map_install_set (struct route_map_rule_cmd *cmd);
 /* Lookup route map by name. */
 extern struct route_map * route_map_lookup_by_name (const char *name);
 
+/* Is a match rule used by the route map or one it calls? */
+extern int route_map_match_used (struct route_map *, const char *);
+
 /* Apply route map to the object. */
 extern route_map_result_t route_map_apply (struct route_map *map,
                                            struct prefix *,
                                            route_map_object_t object_type,
                                            void *object);
 
+/* Same as route_map_apply(), but when every match rule of MAP is
+   attr_only the index the object first matches is remembered under
+   KEY, and the match rules are skipped when KEY is seen again.  KEY
+   must stand for the object's attributes for as long as it is held;
+   the hooks given to route_map_cache_key_hook() take and drop a
+   reference on it. */
+extern route_map_result_t route_map_apply_cached (struct route_map *map,
+                                                  struct prefix *,
+                                                  route_map_object_t object_type,
+                                                  void *object, void *key);
+extern int route_map_cacheable (struct route_map *map);
+extern void route_map_cache_key_hook (void *(*ref) (void *),
+                                      void (*unref) (void *));
+
+/* Forget all remembered results, for when something attr_only rules
+   refer to, such as a filter list, has changed. */
+extern void route_map_cache_flush (void);
+
 extern void route_map_add_hook (void (*func) (const char *));
 extern void route_map_delete_hook (void (*func) (const char *));
 extern void route_map_event_hook (void (*func) (route_map_event_t, const char *));
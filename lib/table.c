@@ -75,6 +75,329 @@ route_node_free (struct route_node *node)
   XFREE (MTYPE_ROUTE_NODE, node);
 }
 
+/* Longest prefix match index.
+
+   Walking the radix tree touches one pointer-linked route_node, each
+   carrying a whole struct prefix, per branching bit of the address, which
+   is slow for the host lookups zebra and the nexthop code do in bulk.  A
+   table may keep a multibit trie beside the tree to answer those: every
+   trie node covers one octet of the address, and for each of its 256
+   slots records the deepest tree node whose prefix length ends within
+   that octet, plus the trie node for the next octet.  Both vectors are
+   stored compressed the way poptrie does it: one bitmap marks the slots
+   that have a child, another the slots where a run of equal leaves
+   starts, and a slot's position in the packed array is the population
+   count of the bitmap up to it.
+
+   Every node route_node_get() has handed out is in the index, so the
+   lookup yields the deepest of them covering the address.  Since info is
+   only ever hung off such nodes, the answer of route_node_match() is that
+   node or its nearest ancestor with info: all covering nodes lie on the
+   path from the root.  Glue nodes stay out, otherwise most misses would
+   end in a walk up a chain of them. */
+
+#define LPM_STRIDE 8
+#define LPM_SLOTS  (1 << LPM_STRIDE)
+#define LPM_WORDS  (LPM_SLOTS / 64)
+
+#define LPM_TEST(V,S) ((V)[(S) / 64] & ((u_int64_t) 1 << ((S) % 64)))
+#define LPM_SET(V,S)  ((V)[(S) / 64] |= ((u_int64_t) 1 << ((S) % 64)))
+
+struct route_lpm_node
+{
+  u_int64_t childvec[LPM_WORDS];
+  u_int64_t leafvec[LPM_WORDS];
+
+  /* Packed arrays, allocated together with the node. */
+  struct route_lpm_node **child;
+  struct route_node **leaf;
+};
+
+struct route_lpm
+{
+  /* Indexed by route_lpm_family(). */
+  struct route_node *def[2];
+  struct route_lpm_node *root[2];
+};
+
+static int
+route_lpm_family (u_char family)
+{
+  if (family == AF_INET)
+    return 0;
+#ifdef HAVE_IPV6
+  if (family == AF_INET6)
+    return 1;
+#endif /* HAVE_IPV6 */
+  return -1;
+}
+
+static inline int
+lpm_popcount (u_int64_t v)
+{
+#ifdef __GNUC__
+  return __builtin_popcountll (v);
+#else
+  int n;
+
+  for (n = 0; v; n++)
+    v &= v - 1;
+  return n;
+#endif /* __GNUC__ */
+}
+
+/* Number of bits set in VEC from slot 0 up to and including SLOT. */
+static inline int
+lpm_rank (const u_int64_t *vec, unsigned int slot)
+{
+  unsigned int i;
+  int n = 0;
+
+  for (i = 0; i < slot / 64; i++)
+    n += lpm_popcount (vec[i]);
+  return n + lpm_popcount (vec[i] << (63 - slot % 64));
+}
+
+/* Unpack a trie node into one entry per slot. */
+static void
+route_lpm_expand (const struct route_lpm_node *ln,
+		  struct route_lpm_node **child, struct route_node **leaf)
+{
+  int s, c, l;
+
+  if (ln == NULL)
+    {
+      memset (child, 0, LPM_SLOTS * sizeof (struct route_lpm_node *));
+      memset (leaf, 0, LPM_SLOTS * sizeof (struct route_node *));
+      return;
+    }
+
+  for (s = 0, c = 0, l = -1; s < LPM_SLOTS; s++)
+    {
+      if (LPM_TEST (ln->leafvec, s))
+	l++;
+      leaf[s] = ln->leaf[l];
+      child[s] = LPM_TEST (ln->childvec, s) ? ln->child[c++] : NULL;
+    }
+}
+
+/* Pack per slot entries into a new trie node.  Returns NULL when there
+   is nothing left to point to. */
+static struct route_lpm_node *
+route_lpm_compress (struct route_lpm_node **child, struct route_node **leaf)
+{
+  struct route_lpm_node *ln;
+  int s, nchild, nleaf, used;
+
+  for (s = 0, nchild = 0, nleaf = 0, used = 0; s < LPM_SLOTS; s++)
+    {
+      if (child[s])
+	nchild++;
+      if (s == 0 || leaf[s] != leaf[s - 1])
+	nleaf++;
+      if (leaf[s])
+	used = 1;
+    }
+
+  if (nchild == 0 && ! used)
+    return NULL;
+
+  ln = XCALLOC (MTYPE_ROUTE_LPM, sizeof (struct route_lpm_node)
+		+ nchild * sizeof (struct route_lpm_node *)
+		+ nleaf * sizeof (struct route_node *));
+  ln->child = (struct route_lpm_node **) (ln + 1);
+  ln->leaf = (struct route_node **) (ln->child + nchild);
+
+  for (s = 0, nchild = 0, nleaf = 0; s < LPM_SLOTS; s++)
+    {
+      if (child[s])
+	{
+	  LPM_SET (ln->childvec, s);
+	  ln->child[nchild++] = child[s];
+	}
+      if (s == 0 || leaf[s] != leaf[s - 1])
+	{
+	  LPM_SET (ln->leafvec, s);
+	  ln->leaf[nleaf++] = leaf[s];
+	}
+    }
+  return ln;
+}
+
+static void
+route_lpm_node_free (struct route_lpm_node *ln)
+{
+  int i, n;
+
+  for (i = 0, n = 0; i < LPM_WORDS; i++)
+    n += lpm_popcount (ln->childvec[i]);
+  for (i = 0; i < n; i++)
+    route_lpm_node_free (ln->child[i]);
+  XFREE (MTYPE_ROUTE_LPM, ln);
+}
+
+/* Make NODE the leaf of the slots its prefix covers where nothing longer
+   is, or when deleting, hand the slots NODE holds over to REPLACE.  LN is
+   the trie node at DEPTH on the way to NODE's octet; the return value
+   takes its place. */
+static struct route_lpm_node *
+route_lpm_update (struct route_lpm_node *ln, int depth,
+		  struct route_node *node, struct route_node *replace,
+		  int add)
+{
+  struct route_lpm_node *child[LPM_SLOTS];
+  struct route_node *leaf[LPM_SLOTS];
+  struct route_lpm_node *next;
+  struct route_lpm_node *new;
+  const u_char *addr = &node->p.u.prefix;
+  int s, first, last;
+
+  if (depth < (node->p.prefixlen - 1) / LPM_STRIDE)
+    {
+      s = addr[depth];
+      next = NULL;
+      if (ln && LPM_TEST (ln->childvec, s))
+	next = ln->child[lpm_rank (ln->childvec, s) - 1];
+
+      new = route_lpm_update (next, depth + 1, node, replace, add);
+      if (new == next)
+	return ln;
+      if (next && new)
+	{
+	  ln->child[lpm_rank (ln->childvec, s) - 1] = new;
+	  return ln;
+	}
+
+      route_lpm_expand (ln, child, leaf);
+      child[s] = new;
+    }
+  else
+    {
+      route_lpm_expand (ln, child, leaf);
+
+      first = addr[depth];
+      last = first + (1 << ((depth + 1) * LPM_STRIDE - node->p.prefixlen));
+      for (s = first; s < last; s++)
+	if (add)
+	  {
+	    if (leaf[s] == NULL || leaf[s]->p.prefixlen < node->p.prefixlen)
+	      leaf[s] = node;
+	  }
+	else if (leaf[s] == node)
+	  leaf[s] = replace;
+    }
+
+  new = route_lpm_compress (child, leaf);
+  if (ln)
+    XFREE (MTYPE_ROUTE_LPM, ln);
+  return new;
+}
+
+static void
+route_lpm_add (struct route_node *node)
+{
+  struct route_lpm *lpm = node->table->lpm;
+  int afi;
+
+  if (lpm == NULL || CHECK_FLAG (node->flags, ROUTE_NODE_LPM)
+      || (afi = route_lpm_family (node->p.family)) < 0)
+    return;
+
+  SET_FLAG (node->flags, ROUTE_NODE_LPM);
+  if (node->p.prefixlen == 0)
+    lpm->def[afi] = node;
+  else
+    lpm->root[afi] = route_lpm_update (lpm->root[afi], 0, node, NULL, 1);
+}
+
+static void
+route_lpm_delete (struct route_node *node)
+{
+  struct route_lpm *lpm = node->table->lpm;
+  struct route_node *replace;
+  int afi, floor;
+
+  if (! CHECK_FLAG (node->flags, ROUTE_NODE_LPM))
+    return;
+
+  UNSET_FLAG (node->flags, ROUTE_NODE_LPM);
+  afi = route_lpm_family (node->p.family);
+  if (node->p.prefixlen == 0)
+    {
+      if (lpm->def[afi] == node)
+	lpm->def[afi] = NULL;
+      return;
+    }
+
+  /* Whatever covers the slots NODE held is now its deepest ancestor
+     ending in the same octet, if there is one. */
+  floor = (node->p.prefixlen - 1) / LPM_STRIDE * LPM_STRIDE;
+  for (replace = node->parent; replace; replace = replace->parent)
+    if (CHECK_FLAG (replace->flags, ROUTE_NODE_LPM))
+      break;
+  if (replace && replace->p.prefixlen <= floor)
+    replace = NULL;
+
+  lpm->root[afi] = route_lpm_update (lpm->root[afi], 0, node, replace, 0);
+}
+
+static struct route_node *
+route_lpm_match (const struct route_lpm *lpm, int afi, const u_char *addr)
+{
+  const struct route_lpm_node *ln;
+  struct route_node *match;
+  struct route_node *leaf;
+  int depth;
+
+  match = lpm->def[afi];
+  for (ln = lpm->root[afi], depth = 0; ln; depth++)
+    {
+      leaf = ln->leaf[lpm_rank (ln->leafvec, addr[depth]) - 1];
+      if (leaf)
+	match = leaf;
+      if (! LPM_TEST (ln->childvec, addr[depth]))
+	break;
+      ln = ln->child[lpm_rank (ln->childvec, addr[depth]) - 1];
+    }
+
+  while (match && match->info == NULL)
+    match = match->parent;
+
+  if (match)
+    return route_lock_node (match);
+
+  return NULL;
+}
+
+static void
+route_lpm_free (struct route_lpm *lpm)
+{
+  int afi;
+
+  for (afi = 0; afi < 2; afi++)
+    if (lpm->root[afi])
+      route_lpm_node_free (lpm->root[afi]);
+  XFREE (MTYPE_ROUTE_LPM, lpm);
+}
+
+/* Keep a longest prefix match index for TABLE from now on.  It speeds
+   up route_node_match() for host addresses at the cost of memory and
+   of slower route_node_get() and route_node_delete().  Nodes already
+   in the table are indexed if they carry info or someone holds them. */
+void
+route_table_lpm_enable (struct route_table *table)
+{
+  struct route_node *node;
+
+  if (table->lpm)
+    return;
+
+  table->lpm = XCALLOC (MTYPE_ROUTE_LPM, sizeof (struct route_lpm));
+  for (node = route_top (table); node; node = route_next (node))
+    if (node->info || node->lock > 1)
+      route_lpm_add (node);
+}
+
 /* Free route table. */
 void
 route_table_free (struct route_table *rt)
@@ -85,6 +408,9 @@ route_table_free (struct route_table *rt)
   if (rt == NULL)
     return;
 
+  if (rt->lpm)
+    route_lpm_free (rt->lpm);
+
   node = rt->top;
 
   while (node)
@@ -198,6 +524,11 @@ route_node_match (const struct route_table *table, const struct prefix *p)
 {
   struct route_node *node;
   struct route_node *matched;
+  int afi;
+
+  if (table->lpm && (afi = route_lpm_family (p->family)) >= 0
+      && p->prefixlen == (afi ? IPV6_MAX_PREFIXLEN : IPV4_MAX_PREFIXLEN))
+    return route_lpm_match (table->lpm, afi, &p->u.prefix);
 
   matched = NULL;
   node = table->top;
@@ -229,6 +560,9 @@ route_node_match_ipv4 (const struct route_table *table,
 {
   struct prefix_ipv4 p;
 
+  if (table->lpm)
+    return route_lpm_match (table->lpm, 0, (const u_char *) addr);
+
   memset (&p, 0, sizeof (struct prefix_ipv4));
   p.family = AF_INET;
   p.prefixlen = IPV4_MAX_PREFIXLEN;
@@ -244,6 +578,9 @@ route_node_match_ipv6 (const struct route_table *table,
 {
   struct prefix_ipv6 p;
 
+  if (table->lpm)
+    return route_lpm_match (table->lpm, 1, (const u_char *) addr);
+
   memset (&p, 0, sizeof (struct prefix_ipv6));
   p.family = AF_INET6;
   p.prefixlen = IPV6_MAX_PREFIXLEN;
@@ -287,7 +624,10 @@ route_node_get (struct route_table *table, struct prefix *p)
 	 prefix_match (&node->p, p))
     {
       if (node->p.prefixlen == p->prefixlen)
-        return route_lock_node (node);
+        {
+          route_lpm_add (node);
+          return route_lock_node (node);
+        }
       
       match = node;
       node = node->link[prefix_bit(&p->u.prefix, node->p.prefixlen)];
@@ -300,6 +640,7 @@ route_node_get (struct route_table *table, struct prefix *p)
 	set_link (match, new);
       else
 	table->top = new;
+      route_lpm_add (new);
     }
   else
     {
@@ -320,6 +661,7 @@ route_node_get (struct route_table *table, struct prefix *p)
 	  new = route_node_set (table, p);
 	  set_link (match, new);
 	}
+      route_lpm_add (new);
     }
   route_lock_node (new);
   
@@ -336,6 +678,9 @@ route_node_delete (struct route_node *node)
   assert (node->lock == 0);
   assert (node->info == NULL);
 
+  /* Whether it stays as glue or goes, it is no longer a route. */
+  route_lpm_delete (node);
+
   if (node->l_left && node->l_right)
     return;
 
@@ -26,10 +26,15 @@
 /* for struct prefix */
 #include "prefix.h"
 
+struct route_lpm;
+
 /* Routing table top structure. */
 struct route_table
 {
   struct route_node *top;
+
+  /* Optional longest prefix match index, see route_table_lpm_enable(). */
+  struct route_lpm *lpm;
 };
 
 /* Each routing entry. */
@@ -48,6 +53,9 @@ struct route_node
   /* Lock of this radix */
   unsigned int lock;
 
+  u_char flags;
+#define ROUTE_NODE_LPM		(1 << 0) /* In the table's LPM index. */
+
   /* Each node of route. */
   void *info;
 
@@ -58,6 +66,7 @@ struct route_node
 /* Prototypes. */
 extern struct route_table *route_table_init (void);
 extern void route_table_finish (struct route_table *);
+extern void route_table_lpm_enable (struct route_table *);
 extern void route_unlock_node (struct route_node *node);
 extern void route_node_delete (struct route_node *node);
 extern struct route_node *route_top (struct route_table *);
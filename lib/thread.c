@@ -29,6 +29,11 @@
 #include "hash.h"
 #include "command.h"
 #include "sigevent.h"
+#include "pqueue.h"
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
 
 /* Recent absolute time of day */
 struct timeval recent_time;
@@ -483,14 +488,12 @@ thread_master_debug (struct thread_master *m)
   thread_list_debug (&m->read);
   printf ("writelist : ");
   thread_list_debug (&m->write);
-  printf ("timerlist : ");
-  thread_list_debug (&m->timer);
+  printf ("timerlist : count [%d]\n", m->timer->size);
   printf ("eventlist : ");
   thread_list_debug (&m->event);
   printf ("unuselist : ");
   thread_list_debug (&m->unuse);
-  printf ("bgndlist : ");
-  thread_list_debug (&m->background);
+  printf ("bgndlist : count [%d]\n", m->background->size);
   printf ("total alloc: [%ld]\n", m->alloc);
   printf ("-----------\n");
 }
@@ -505,17 +508,36 @@ install_thread_cmds(void)
   install_element (ENABLE_NODE, &clear_thread_cpu_cmd);
 }
 
+static void thread_io_init (struct thread_master *);
+static int thread_timer_cmp (void *, void *);
+static void thread_timer_update (void *, int);
+
 /* Allocate new thread master.  */
 struct thread_master *
 thread_master_create ()
 {
+  struct thread_master *m;
+
   if (cpu_record == NULL) 
-    cpu_record 
-      = hash_create_size (1011, (unsigned int (*) (void *))cpu_record_hash_key, 
-                          (int (*) (const void *, const void *))cpu_record_hash_cmp);
-    
-  return (struct thread_master *) XCALLOC (MTYPE_THREAD_MASTER,
-					   sizeof (struct thread_master));
+    {
+      cpu_record 
+        = hash_create_size (1011, (unsigned int (*) (void *))cpu_record_hash_key, 
+                            (int (*) (const void *, const void *))cpu_record_hash_cmp);
+      hash_set_name (cpu_record, "Thread CPU history");
+    }
+
+  m = XCALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_master));
+
+  m->timer = pqueue_create ();
+  m->timer->cmp = thread_timer_cmp;
+  m->timer->update = thread_timer_update;
+  m->background = pqueue_create ();
+  m->background->cmp = thread_timer_cmp;
+  m->background->update = thread_timer_update;
+
+  thread_io_init (m);
+
+  return m;
 }
 
 /* Add a new thread to the list.  */
@@ -532,22 +554,6 @@ thread_list_add (struct thread_list *list, struct thread *thread)
   list->count++;
 }
 
-/* Add a new thread just before the point.  */
-static void
-thread_list_add_before (struct thread_list *list, 
-			struct thread *point, 
-			struct thread *thread)
-{
-  thread->next = point;
-  thread->prev = point->prev;
-  if (point->prev)
-    point->prev->next = thread;
-  else
-    list->head = thread;
-  point->prev = thread;
-  list->count++;
-}
-
 /* Delete a thread from the list. */
 static struct thread *
 thread_list_delete (struct thread_list *list, struct thread *thread)
@@ -565,6 +571,389 @@ thread_list_delete (struct thread_list *list, struct thread *thread)
   return thread;
 }
 
+/* I/O readiness backend.  thread_fetch() asks the backend to wait for
+ * I/O or the next timer with poll(), and then to move the read/write
+ * threads whose fds became ready onto the ready list with process().
+ * The owning thread of each fd is kept in m->fds[], so backends which
+ * report readiness per fd can find it without walking m->read/m->write.
+ */
+struct thread_io_backend
+{
+  const char *name;
+  int (*init) (struct thread_master *);
+  void (*finish) (struct thread_master *);
+  /* Register/unregister interest, type is THREAD_READ or THREAD_WRITE */
+  int (*add) (struct thread_master *, int fd, thread_type type);
+  void (*del) (struct thread_master *, int fd, thread_type type);
+  int (*poll) (struct thread_master *, struct timeval *);
+  void (*process) (struct thread_master *, int num);
+};
+
+#define THREAD_FDS_MIN	64
+
+/* Make sure m->fds[] can be indexed by fd. */
+static void
+thread_fds_grow (struct thread_master *m, int fd)
+{
+  int size;
+
+  if (fd < m->fd_size)
+    return;
+
+  size = m->fd_size ? m->fd_size : THREAD_FDS_MIN;
+  while (size <= fd)
+    size *= 2;
+
+  m->fds = XREALLOC (MTYPE_THREAD_FDS, m->fds, size * sizeof (struct thread_fd));
+  memset (&m->fds[m->fd_size], 0,
+          (size - m->fd_size) * sizeof (struct thread_fd));
+  m->fd_size = size;
+}
+
+/* Move a read or write thread whose fd became ready to the ready list. */
+static void
+thread_fd_ready (struct thread_master *m, struct thread *thread)
+{
+  if (thread->type == THREAD_READ)
+    {
+      m->fds[thread->u.fd].read = NULL;
+      thread_list_delete (&m->read, thread);
+    }
+  else
+    {
+      m->fds[thread->u.fd].write = NULL;
+      thread_list_delete (&m->write, thread);
+    }
+  thread->type = THREAD_READY;
+  thread_list_add (&m->ready, thread);
+}
+
+/* select() backend, portable fallback. */
+struct thread_select
+{
+  fd_set readfd;
+  fd_set writefd;
+  fd_set exceptfd;
+  /* Result of the last select(). */
+  fd_set readfd_ready;
+  fd_set writefd_ready;
+  fd_set exceptfd_ready;
+};
+
+static int
+thread_select_init (struct thread_master *m)
+{
+  m->io_data = XCALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_select));
+  return 0;
+}
+
+static void
+thread_select_finish (struct thread_master *m)
+{
+  XFREE (MTYPE_THREAD_MASTER, m->io_data);
+}
+
+static int
+thread_select_add (struct thread_master *m, int fd, thread_type type)
+{
+  struct thread_select *sel = m->io_data;
+
+  if (fd >= FD_SETSIZE)
+    {
+      zlog_err ("fd %d exceeds FD_SETSIZE (%d)", fd, FD_SETSIZE);
+      return -1;
+    }
+
+  if (type == THREAD_READ)
+    FD_SET (fd, &sel->readfd);
+  else
+    FD_SET (fd, &sel->writefd);
+  return 0;
+}
+
+static void
+thread_select_del (struct thread_master *m, int fd, thread_type type)
+{
+  struct thread_select *sel = m->io_data;
+
+  if (type == THREAD_READ)
+    {
+      assert (FD_ISSET (fd, &sel->readfd));
+      FD_CLR (fd, &sel->readfd);
+    }
+  else
+    {
+      assert (FD_ISSET (fd, &sel->writefd));
+      FD_CLR (fd, &sel->writefd);
+    }
+}
+
+static int
+thread_select_poll (struct thread_master *m, struct timeval *timer_wait)
+{
+  struct thread_select *sel = m->io_data;
+
+  /* Structure copy.  */
+  sel->readfd_ready = sel->readfd;
+  sel->writefd_ready = sel->writefd;
+  sel->exceptfd_ready = sel->exceptfd;
+
+  return select (FD_SETSIZE, &sel->readfd_ready, &sel->writefd_ready,
+                 &sel->exceptfd_ready, timer_wait);
+}
+
+static void
+thread_select_process_fd (struct thread_master *m, struct thread_list *list,
+                          fd_set *fdset, fd_set *mfdset)
+{
+  struct thread *thread;
+  struct thread *next;
+
+  for (thread = list->head; thread; thread = next)
+    {
+      next = thread->next;
+
+      if (FD_ISSET (THREAD_FD (thread), fdset))
+        {
+          assert (FD_ISSET (THREAD_FD (thread), mfdset));
+          FD_CLR(THREAD_FD (thread), mfdset);
+          thread_fd_ready (m, thread);
+        }
+    }
+}
+
+static void
+thread_select_process (struct thread_master *m, int num)
+{
+  struct thread_select *sel = m->io_data;
+
+  /* Normal priority read thead. */
+  thread_select_process_fd (m, &m->read, &sel->readfd_ready, &sel->readfd);
+  /* Write thead. */
+  thread_select_process_fd (m, &m->write, &sel->writefd_ready, &sel->writefd);
+}
+
+static const struct thread_io_backend thread_io_select =
+{
+  "select",
+  thread_select_init,
+  thread_select_finish,
+  thread_select_add,
+  thread_select_del,
+  thread_select_poll,
+  thread_select_process,
+};
+
+#ifdef HAVE_EPOLL
+/* epoll() backend.
+ *
+ * Interest is registered when a read/write thread is added and is left
+ * armed when the thread fires, as most users immediately add the same
+ * thread again.  Interest is only dropped when a thread is cancelled, or
+ * when the fd reports readiness while nobody owns it any more.
+ *
+ * An fd can be closed and its number reused while still armed, in which
+ * case the kernel has already forgotten it, so adding interest always
+ * goes through epoll_ctl() to resync.
+ */
+#define THREAD_EPOLL_EVENTS	256
+
+struct thread_epoll
+{
+  int fd;
+  struct epoll_event events[THREAD_EPOLL_EVENTS];
+};
+
+static int
+thread_epoll_init (struct thread_master *m)
+{
+  struct thread_epoll *ep;
+  int fd;
+
+  if ((fd = epoll_create (THREAD_EPOLL_EVENTS)) < 0)
+    return -1;
+
+  /* Don't leak into children started with fork/exec */
+  fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+  ep = XCALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_epoll));
+  ep->fd = fd;
+  m->io_data = ep;
+  return 0;
+}
+
+static void
+thread_epoll_finish (struct thread_master *m)
+{
+  struct thread_epoll *ep = m->io_data;
+
+  close (ep->fd);
+  XFREE (MTYPE_THREAD_MASTER, m->io_data);
+}
+
+/* Register the interest set 'armed' for fd, returns epoll_ctl result. */
+static int
+thread_epoll_ctl (struct thread_epoll *ep, int fd, u_char old, u_char armed)
+{
+  struct epoll_event ev;
+  int op;
+  int ret;
+
+  memset (&ev, 0, sizeof (ev));
+  if (armed & (1 << THREAD_READ))
+    ev.events |= EPOLLIN;
+  if (armed & (1 << THREAD_WRITE))
+    ev.events |= EPOLLOUT;
+  ev.data.fd = fd;
+
+  if (! armed)
+    op = EPOLL_CTL_DEL;
+  else if (old)
+    op = EPOLL_CTL_MOD;
+  else
+    op = EPOLL_CTL_ADD;
+
+  ret = epoll_ctl (ep->fd, op, fd, &ev);
+
+  /* Our idea of what is registered went stale. */
+  if (ret < 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+    ret = epoll_ctl (ep->fd, EPOLL_CTL_ADD, fd, &ev);
+  else if (ret < 0 && op == EPOLL_CTL_ADD && errno == EEXIST)
+    ret = epoll_ctl (ep->fd, EPOLL_CTL_MOD, fd, &ev);
+
+  return ret;
+}
+
+static int
+thread_epoll_add (struct thread_master *m, int fd, thread_type type)
+{
+  struct thread_fd *tfd = &m->fds[fd];
+  u_char armed = tfd->armed | (1 << type);
+
+  if (thread_epoll_ctl (m->io_data, fd, tfd->armed, armed) < 0)
+    {
+      zlog_err ("epoll_ctl() on fd %d failed: %s", fd, safe_strerror (errno));
+      return -1;
+    }
+  tfd->armed = armed;
+  return 0;
+}
+
+static void
+thread_epoll_del (struct thread_master *m, int fd, thread_type type)
+{
+  struct thread_fd *tfd = &m->fds[fd];
+  u_char armed = tfd->armed & ~(1 << type);
+
+  if (armed == tfd->armed)
+    return;
+
+  /* The fd may well be closed already, nothing to complain about. */
+  thread_epoll_ctl (m->io_data, fd, tfd->armed, armed);
+  tfd->armed = armed;
+}
+
+static int
+thread_epoll_poll (struct thread_master *m, struct timeval *timer_wait)
+{
+  struct thread_epoll *ep = m->io_data;
+  int timeout = -1;
+
+  /* Round up, so we don't wake up just before the timer is due. */
+  if (timer_wait)
+    timeout = timer_wait->tv_sec * 1000 + (timer_wait->tv_usec + 999) / 1000;
+
+  return epoll_wait (ep->fd, ep->events, THREAD_EPOLL_EVENTS, timeout);
+}
+
+/* Move the owners of ready fds of the given type onto the ready list. */
+static void
+thread_epoll_process_type (struct thread_master *m, int num, thread_type type)
+{
+  struct thread_epoll *ep = m->io_data;
+  struct thread *thread;
+  u_int32_t mask;
+  int i, fd;
+
+  mask = (type == THREAD_READ ? EPOLLIN : EPOLLOUT) | EPOLLHUP | EPOLLERR;
+
+  for (i = 0; i < num; i++)
+    {
+      if (! (ep->events[i].events & mask))
+        continue;
+
+      fd = ep->events[i].data.fd;
+      thread = (type == THREAD_READ ? m->fds[fd].read : m->fds[fd].write);
+
+      if (thread)
+        thread_fd_ready (m, thread);
+      else
+        /* Left armed after the owner ran, and not re-added since. */
+        thread_epoll_del (m, fd, type);
+    }
+}
+
+static void
+thread_epoll_process (struct thread_master *m, int num)
+{
+  /* Readers first, then writers, as select() always did. */
+  thread_epoll_process_type (m, num, THREAD_READ);
+  thread_epoll_process_type (m, num, THREAD_WRITE);
+}
+
+static const struct thread_io_backend thread_io_epoll =
+{
+  "epoll",
+  thread_epoll_init,
+  thread_epoll_finish,
+  thread_epoll_add,
+  thread_epoll_del,
+  thread_epoll_poll,
+  thread_epoll_process,
+};
+#endif /* HAVE_EPOLL */
+
+/* Pick the I/O backend of a new thread master.  */
+static void
+thread_io_init (struct thread_master *m)
+{
+#ifdef HAVE_EPOLL
+  m->io = &thread_io_epoll;
+  if (m->io->init (m) < 0)
+    {
+      zlog_warn ("epoll_create() failed: %s, falling back to select()",
+                 safe_strerror (errno));
+      m->io = &thread_io_select;
+      m->io->init (m);
+    }
+#else
+  m->io = &thread_io_select;
+  m->io->init (m);
+#endif /* HAVE_EPOLL */
+}
+
+/* Timer heap ordering and position tracking, for pqueue. */
+static int
+thread_timer_cmp (void *a, void *b)
+{
+  struct thread *ta = a;
+  struct thread *tb = b;
+
+  if (ta->u.sands.tv_sec != tb->u.sands.tv_sec)
+    return ta->u.sands.tv_sec < tb->u.sands.tv_sec ? -1 : 1;
+  if (ta->u.sands.tv_usec != tb->u.sands.tv_usec)
+    return ta->u.sands.tv_usec < tb->u.sands.tv_usec ? -1 : 1;
+  return 0;
+}
+
+static void
+thread_timer_update (void *node, int actual_position)
+{
+  struct thread *thread = node;
+
+  thread->index = actual_position;
+}
+
 /* Move thread to unuse list. */
 static void
 thread_add_unuse (struct thread_master *m, struct thread *thread)
@@ -595,17 +984,39 @@ thread_list_free (struct thread_master *m, struct thread_list *list)
     }
 }
 
+/* Free all threads in a timer queue, and the queue. */
+static void
+thread_queue_free (struct thread_master *m, struct pqueue *queue)
+{
+  struct thread *t;
+  int i;
+
+  for (i = 0; i < queue->size; i++)
+    {
+      t = queue->array[i];
+      if (t->funcname)
+        XFREE (MTYPE_THREAD_FUNCNAME, t->funcname);
+      XFREE (MTYPE_THREAD, t);
+      m->alloc--;
+    }
+  pqueue_delete (queue);
+}
+
 /* Stop thread scheduler. */
 void
 thread_master_free (struct thread_master *m)
 {
   thread_list_free (m, &m->read);
   thread_list_free (m, &m->write);
-  thread_list_free (m, &m->timer);
+  thread_queue_free (m, m->timer);
   thread_list_free (m, &m->event);
   thread_list_free (m, &m->ready);
   thread_list_free (m, &m->unuse);
-  thread_list_free (m, &m->background);
+  thread_queue_free (m, m->background);
+
+  m->io->finish (m);
+  if (m->fds)
+    XFREE (MTYPE_THREAD_FDS, m->fds);
   
   XFREE (MTYPE_THREAD_MASTER, m);
 
@@ -693,6 +1104,7 @@ thread_get (struct thread_master *m, u_char type,
   thread->type = type;
   thread->add_type = type;
   thread->master = m;
+  thread->index = -1;
   thread->func = func;
   thread->arg = arg;
   
@@ -710,15 +1122,21 @@ funcname_thread_add_read (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->readfd))
+  assert (fd >= 0);
+
+  thread_fds_grow (m, fd);
+  if (m->fds[fd].read)
     {
       zlog (NULL, LOG_WARNING, "There is already read fd [%d]", fd);
       return NULL;
     }
 
+  if (m->io->add (m, fd, THREAD_READ) < 0)
+    return NULL;
+
   thread = thread_get (m, THREAD_READ, func, arg, funcname);
-  FD_SET (fd, &m->readfd);
   thread->u.fd = fd;
+  m->fds[fd].read = thread;
   thread_list_add (&m->read, thread);
 
   return thread;
@@ -733,15 +1151,21 @@ funcname_thread_add_write (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->writefd))
+  assert (fd >= 0);
+
+  thread_fds_grow (m, fd);
+  if (m->fds[fd].write)
     {
       zlog (NULL, LOG_WARNING, "There is already write fd [%d]", fd);
       return NULL;
     }
 
+  if (m->io->add (m, fd, THREAD_WRITE) < 0)
+    return NULL;
+
   thread = thread_get (m, THREAD_WRITE, func, arg, funcname);
-  FD_SET (fd, &m->writefd);
   thread->u.fd = fd;
+  m->fds[fd].write = thread;
   thread_list_add (&m->write, thread);
 
   return thread;
@@ -756,16 +1180,15 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
                                   const char* funcname)
 {
   struct thread *thread;
-  struct thread_list *list;
+  struct pqueue *queue;
   struct timeval alarm_time;
-  struct thread *tt;
 
   assert (m != NULL);
 
   assert (type == THREAD_TIMER || type == THREAD_BACKGROUND);
   assert (time_relative);
   
-  list = ((type == THREAD_TIMER) ? &m->timer : &m->background);
+  queue = ((type == THREAD_TIMER) ? m->timer : m->background);
   thread = thread_get (m, type, func, arg, funcname);
 
   /* Do we need jitter here? */
@@ -774,15 +1197,7 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
   alarm_time.tv_usec = relative_time.tv_usec + time_relative->tv_usec;
   thread->u.sands = timeval_adjust(alarm_time);
 
-  /* Sort by timeval. */
-  for (tt = list->head; tt; tt = tt->next)
-    if (timeval_cmp (thread->u.sands, tt->u.sands) <= 0)
-      break;
-
-  if (tt)
-    thread_list_add_before (list, tt, thread);
-  else
-    thread_list_add (list, thread);
+  pqueue_enqueue (thread, queue);
 
   return thread;
 }
@@ -868,22 +1283,23 @@ funcname_thread_add_event (struct thread_master *m,
 void
 thread_cancel (struct thread *thread)
 {
-  struct thread_list *list;
+  struct thread_list *list = NULL;
+  struct pqueue *queue = NULL;
   
   switch (thread->type)
     {
     case THREAD_READ:
-      assert (FD_ISSET (thread->u.fd, &thread->master->readfd));
-      FD_CLR (thread->u.fd, &thread->master->readfd);
+      thread->master->io->del (thread->master, thread->u.fd, THREAD_READ);
+      thread->master->fds[thread->u.fd].read = NULL;
       list = &thread->master->read;
       break;
     case THREAD_WRITE:
-      assert (FD_ISSET (thread->u.fd, &thread->master->writefd));
-      FD_CLR (thread->u.fd, &thread->master->writefd);
+      thread->master->io->del (thread->master, thread->u.fd, THREAD_WRITE);
+      thread->master->fds[thread->u.fd].write = NULL;
       list = &thread->master->write;
       break;
     case THREAD_TIMER:
-      list = &thread->master->timer;
+      queue = thread->master->timer;
       break;
     case THREAD_EVENT:
       list = &thread->master->event;
@@ -892,13 +1308,22 @@ thread_cancel (struct thread *thread)
       list = &thread->master->ready;
       break;
     case THREAD_BACKGROUND:
-      list = &thread->master->background;
+      queue = thread->master->background;
       break;
     default:
       return;
       break;
     }
-  thread_list_delete (list, thread);
+
+  if (queue)
+    {
+      assert (thread->index >= 0 && thread->index < queue->size);
+      assert (queue->array[thread->index] == thread);
+      pqueue_remove_at (thread->index, queue);
+      thread->index = -1;
+    }
+  else
+    thread_list_delete (list, thread);
   thread->type = THREAD_UNUSED;
   thread_add_unuse (thread->master, thread);
 }
@@ -930,11 +1355,14 @@ thread_cancel_event (struct thread_master *m, void *arg)
 }
 
 static struct timeval *
-thread_timer_wait (struct thread_list *tlist, struct timeval *timer_val)
+thread_timer_wait (struct pqueue *queue, struct timeval *timer_val)
 {
-  if (!thread_empty (tlist))
+  struct thread *next_timer;
+
+  if (queue->size)
     {
-      *timer_val = timeval_subtract (tlist->head->u.sands, relative_time);
+      next_timer = queue->array[0];
+      *timer_val = timeval_subtract (next_timer->u.sands, relative_time);
       return timer_val;
     }
   return NULL;
@@ -951,44 +1379,20 @@ thread_run (struct thread_master *m, struct thread *thread,
   return fetch;
 }
 
-static int
-thread_process_fd (struct thread_list *list, fd_set *fdset, fd_set *mfdset)
-{
-  struct thread *thread;
-  struct thread *next;
-  int ready = 0;
-  
-  assert (list);
-  
-  for (thread = list->head; thread; thread = next)
-    {
-      next = thread->next;
-
-      if (FD_ISSET (THREAD_FD (thread), fdset))
-        {
-          assert (FD_ISSET (THREAD_FD (thread), mfdset));
-          FD_CLR(THREAD_FD (thread), mfdset);
-          thread_list_delete (list, thread);
-          thread_list_add (&thread->master->ready, thread);
-          thread->type = THREAD_READY;
-          ready++;
-        }
-    }
-  return ready;
-}
-
 /* Add all timers that have popped to the ready list. */
 static unsigned int
-thread_timer_process (struct thread_list *list, struct timeval *timenow)
+thread_timer_process (struct pqueue *queue, struct timeval *timenow)
 {
   struct thread *thread;
   unsigned int ready = 0;
   
-  for (thread = list->head; thread; thread = thread->next)
+  while (queue->size)
     {
+      thread = queue->array[0];
       if (timeval_cmp (*timenow, thread->u.sands) < 0)
         return ready;
-      thread_list_delete (list, thread);
+      pqueue_dequeue (queue);
+      thread->index = -1;
       thread->type = THREAD_READY;
       thread_list_add (&thread->master->ready, thread);
       ready++;
@@ -1001,9 +1405,6 @@ struct thread *
 thread_fetch (struct thread_master *m, struct thread *fetch)
 {
   struct thread *thread;
-  fd_set readfd;
-  fd_set writefd;
-  fd_set exceptfd;
   struct timeval timer_val;
   struct timeval timer_val_bg;
   struct timeval *timer_wait;
@@ -1026,28 +1427,23 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
       if ((thread = thread_trim_head (&m->ready)) != NULL)
         return thread_run (m, thread, fetch);
       
-      /* Structure copy.  */
-      readfd = m->readfd;
-      writefd = m->writefd;
-      exceptfd = m->exceptfd;
-      
       /* Calculate select wait timer if nothing else to do */
       quagga_get_relative (NULL);
-      timer_wait = thread_timer_wait (&m->timer, &timer_val);
-      timer_wait_bg = thread_timer_wait (&m->background, &timer_val_bg);
+      timer_wait = thread_timer_wait (m->timer, &timer_val);
+      timer_wait_bg = thread_timer_wait (m->background, &timer_val_bg);
       
       if (timer_wait_bg &&
 	  (!timer_wait || (timeval_cmp (*timer_wait, *timer_wait_bg) > 0)))
 	timer_wait = timer_wait_bg;
       
-      num = select (FD_SETSIZE, &readfd, &writefd, &exceptfd, timer_wait);
+      num = m->io->poll (m, timer_wait);
       
       /* Signals should get quick treatment */
       if (num < 0)
         {
           if (errno == EINTR)
             continue; /* signal received - process it */
-          zlog_warn ("select() error: %s", safe_strerror (errno));
+          zlog_warn ("%s() error: %s", m->io->name, safe_strerror (errno));
             return NULL;
         }
 
@@ -1055,16 +1451,11 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
          priority than I/O threads, so let's push them onto the ready
 	 list in front of the I/O threads. */
       quagga_get_relative (NULL);
-      thread_timer_process (&m->timer, &relative_time);
+      thread_timer_process (m->timer, &relative_time);
       
       /* Got IO, process it */
       if (num > 0)
-        {
-          /* Normal priority read thead. */
-          thread_process_fd (&m->read, &readfd, &m->readfd);
-          /* Write thead. */
-          thread_process_fd (&m->write, &writefd, &m->writefd);
-        }
+        m->io->process (m, num);
 
 #if 0
       /* If any threads were made ready above (I/O or foreground timer),
@@ -1076,7 +1467,7 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
 #endif
 
       /* Background timer/events, lowest priority */
-      thread_timer_process (&m->background, &relative_time);
+      thread_timer_process (m->background, &relative_time);
       
       if ((thread = thread_trim_head (&m->ready)) != NULL)
         return thread_run (m, thread, fetch);
@@ -43,19 +43,32 @@ struct thread_list
   int count;
 };
 
+/* Owners of a file descriptor's read and write interest. */
+struct thread_fd
+{
+  struct thread *read;
+  struct thread *write;
+  u_char armed;			/* interest registered with the backend */
+};
+
+/* I/O readiness backend, see thread.c. */
+struct thread_io_backend;
+struct pqueue;
+
 /* Master of the theads. */
 struct thread_master
 {
   struct thread_list read;
   struct thread_list write;
-  struct thread_list timer;
+  struct pqueue *timer;		/* min-heap on u.sands */
   struct thread_list event;
   struct thread_list ready;
   struct thread_list unuse;
-  struct thread_list background;
-  fd_set readfd;
-  fd_set writefd;
-  fd_set exceptfd;
+  struct pqueue *background;	/* min-heap on u.sands */
+  struct thread_fd *fds;	/* indexed by fd */
+  int fd_size;
+  const struct thread_io_backend *io;
+  void *io_data;		/* backend private state */
   unsigned long alloc;
 };
 
@@ -69,6 +82,7 @@ struct thread
   struct thread *next;		/* next pointer of the thread */   
   struct thread *prev;		/* previous pointer of the thread */
   struct thread_master *master;	/* pointer to the struct thread_master. */
+  int index;			/* position in the timer heap, or -1 */
   int (*func) (struct thread *); /* event function */
   void *arg;			/* event argument */
   union {
@@ -32,12 +32,19 @@
 #include "zclient.h"
 #include "memory.h"
 #include "table.h"
+#include "zring.h"
 
 /* Zebra client events. */
 enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_CONNECT};
 
 /* Prototype for event manager. */
 static void zclient_event (enum event, struct zclient *);
+static int zclient_batch_event (struct thread *);
+static int zclient_failed (struct zclient *);
+static void zapi_ipv4_nexthops (struct stream *, struct zapi_ipv4 *);
+#ifdef HAVE_IPV6
+static void zapi_ipv6_nexthops (struct stream *, struct zapi_ipv6 *);
+#endif /* HAVE_IPV6 */
 
 extern struct thread_master *master;
 
@@ -55,6 +62,7 @@ zclient_new ()
 
   zclient->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->bbuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->wb = buffer_new(0);
 
   return zclient;
@@ -72,6 +80,8 @@ zclient_free (struct zclient *zclient)
     stream_free(zclient->ibuf);
   if (zclient->obuf)
     stream_free(zclient->obuf);
+  if (zclient->bbuf)
+    stream_free(zclient->bbuf);
   if (zclient->wb)
     buffer_free(zclient->wb);
 
@@ -121,14 +131,30 @@ zclient_stop (struct zclient *zclient)
   THREAD_OFF(zclient->t_read);
   THREAD_OFF(zclient->t_connect);
   THREAD_OFF(zclient->t_write);
+  THREAD_OFF(zclient->t_batch);
+  THREAD_OFF(zclient->t_ring);
 
   /* Reset streams. */
   stream_reset(zclient->ibuf);
   stream_reset(zclient->obuf);
 
+  /* Drop batched routes, and what the next zebra can do is yet to be
+     seen. */
+  zclient->batch_count = 0;
+  zclient->caps = 0;
+
   /* Empty the write buffer. */
   buffer_reset(zclient->wb);
 
+#ifdef HAVE_ZSERV_RING
+  if (zclient->ring)
+    {
+      zring_free (zclient->ring);
+      zclient->ring = NULL;
+    }
+  zclient->ring_started = 0;
+#endif /* HAVE_ZSERV_RING */
+
   /* Close socket. */
   if (zclient->sock >= 0)
     {
@@ -268,13 +294,24 @@ zclient_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zclient_send_message(struct zclient *zclient)
+static int
+zclient_write (struct zclient *zclient, struct stream *s)
 {
   if (zclient->sock < 0)
     return -1;
-  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(zclient->obuf),
-		       stream_get_endp(zclient->obuf)))
+#ifdef HAVE_ZSERV_RING
+  if (zclient->ring_started)
+    {
+      if (zring_send (zclient->ring, s) < 0)
+	{
+	  zlog_warn("%s: ring to zebra broken, closing", __func__);
+	  return zclient_failed(zclient);
+	}
+      return 0;
+    }
+#endif /* HAVE_ZSERV_RING */
+  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(s),
+		       stream_get_endp(s)))
     {
     case BUFFER_ERROR:
       zlog_warn("%s: buffer_write failed to zclient fd %d, closing",
@@ -292,6 +329,15 @@ zclient_send_message(struct zclient *zclient)
   return 0;
 }
 
+int
+zclient_send_message(struct zclient *zclient)
+{
+  /* Batched routes go before anything sent after them. */
+  if (zclient->batch_count && zclient_batch_flush (zclient) < 0)
+    return -1;
+  return zclient_write (zclient, zclient->obuf);
+}
+
 void
 zclient_create_header (struct stream *s, uint16_t command)
 {
@@ -318,23 +364,94 @@ zebra_message_send (struct zclient *zclient, int command)
   return zclient_send_message(zclient);
 }
 
+#ifdef HAVE_ZSERV_RING
+/* Send the message with descriptors attached.  Nothing may be waiting
+   in the write buffer, the descriptors would arrive ahead of it. */
+static int
+zclient_send_fds (struct zclient *zclient, struct stream *s, int *fds, int n)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int) * ZRING_NFDS)];
+    struct cmsghdr align;
+  } control;
+  ssize_t nbytes;
+
+  assert (n <= ZRING_NFDS && buffer_empty (zclient->wb));
+
+  iov.iov_base = STREAM_DATA (s);
+  iov.iov_len = stream_get_endp (s);
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE (sizeof (int) * n);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int) * n);
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * n);
+
+  while ((nbytes = sendmsg (zclient->sock, &msg, 0)) < 0 && errno == EINTR)
+    ;
+  if (nbytes < 0)
+    {
+      zlog_warn("%s: sendmsg failed to zclient fd %d: %s, closing",
+		__func__, zclient->sock, safe_strerror (errno));
+      return zclient_failed(zclient);
+    }
+
+  /* The rest goes without them. */
+  if ((size_t) nbytes < stream_get_endp (s))
+    {
+      buffer_put (zclient->wb, STREAM_DATA (s) + nbytes,
+		  stream_get_endp (s) - nbytes);
+      THREAD_WRITE_ON(master, zclient->t_write,
+		      zclient_flush_data, zclient, zclient->sock);
+    }
+  return 0;
+}
+#endif /* HAVE_ZSERV_RING */
+
+/* Tell zebra the route type we announce, if any, and the capabilities
+   we would use.  Zebra answers with those it has, a zebra that knows of
+   none does not answer at all. */
 static int
 zebra_hello_send (struct zclient *zclient)
 {
   struct stream *s;
+  u_char caps = ZEBRA_CAP_ALL & ~ZEBRA_CAP_RING;
+
+  s = zclient->obuf;
+  stream_reset (s);
 
-  if (zclient->redist_default)
+#ifdef HAVE_ZSERV_RING
+  /* Rings are offered with the hello, the first thing sent. */
+  if (zclient->ring_size && ! zclient->ring && buffer_empty (zclient->wb)
+      && (zclient->ring = zring_new (zclient->ring_size)) != NULL)
     {
-      s = zclient->obuf;
-      stream_reset (s);
+      int fds[ZRING_NFDS];
 
       zclient_create_header (s, ZEBRA_HELLO);
       stream_putc (s, zclient->redist_default);
+      stream_putc (s, caps | ZEBRA_CAP_RING);
+      stream_putl (s, zclient->ring_size);
       stream_putw_at (s, 0, stream_get_endp (s));
-      return zclient_send_message(zclient);
+
+      zring_fds (zclient->ring, fds);
+      return zclient_send_fds (zclient, s, fds, ZRING_NFDS);
     }
+#endif /* HAVE_ZSERV_RING */
 
-  return 0;
+  zclient_create_header (s, ZEBRA_HELLO);
+  stream_putc (s, zclient->redist_default);
+  stream_putc (s, caps);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  return zclient_send_message(zclient);
 }
 
 /* Make connection to zebra daemon. */
@@ -395,6 +512,9 @@ zclient_start (struct zclient *zclient)
   if (zclient->default_information)
     zebra_message_send (zclient, ZEBRA_REDISTRIBUTE_DEFAULT_ADD);
 
+  if (zclient->zebra_connected)
+    (*zclient->zebra_connected) (zclient);
+
   return 0;
 }
 
@@ -477,7 +597,6 @@ int
 zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
                  struct zapi_ipv4 *api)
 {
-  int i;
   int psize;
   struct stream *s;
 
@@ -498,7 +617,20 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
   stream_putc (s, p->prefixlen);
   stream_write (s, (u_char *) & p->prefix, psize);
 
-  /* Nexthop, ifindex, distance and metric information. */
+  zapi_ipv4_nexthops (s, api);
+
+  /* Put length at the first point of the stream. */
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zclient_send_message(zclient);
+}
+
+/* Nexthop, ifindex, distance and metric information. */
+static void
+zapi_ipv4_nexthops (struct stream *s, struct zapi_ipv4 *api)
+{
+  int i;
+
   /* ZAPI_MESSAGE_ONLINK implies interleaving */
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_ONLINK))
     {
@@ -544,11 +676,131 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
     stream_putc (s, api->distance);
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
     stream_putl (s, api->metric);
+}
 
-  /* Put length at the first point of the stream. */
+/*
+ * Route add/delete messages for many prefixes at once.  Routes given to
+ * zapi_ipv4_route_batch() or zapi_ipv6_route_batch() one after another
+ * with the same command and the same type, flags, nexthops, distance
+ * and metric go to zebra in one ZEBRA_IPV4_ROUTE_BATCH_ADD etc.,
+ * encoded as:
+ *
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | Route Type    | ZEBRA Flags   | Message Flags |     SAFI      |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |     SAFI      |        Prefix count           |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * followed by nexthops, distance and metric as in the single route
+ * messages, and then the prefixes, each a prefix length and as many
+ * bytes of the prefix as that takes.
+ *
+ * The message is sent when a route that does not fit in comes along,
+ * before any other message is sent, or once the current thread is done.
+ * Without ZEBRA_CAP_ROUTE_BATCH from zebra the routes are sent one by
+ * one as before.
+ */
+static void
+zclient_batch_put (struct zclient *zclient, u_char cmd, struct prefix *p,
+		   size_t attr_len)
+{
+  struct stream *s = zclient->bbuf;
+
+  if (zclient->batch_count == 0)
+    {
+      stream_reset (s);
+      zclient_create_header (s, cmd);
+      stream_write (s, STREAM_DATA (zclient->obuf), attr_len);
+      zclient->batch_attr_len = attr_len;
+      if (! zclient->t_batch)
+	zclient->t_batch = thread_add_event (master, zclient_batch_event,
+					     zclient, 0);
+    }
+
+  stream_putc (s, p->prefixlen);
+  stream_write (s, (u_char *) &p->u.prefix, PSIZE (p->prefixlen));
+  zclient->batch_count++;
+}
+
+/* Add P to the batch being put together, the shared part of the route
+   having been encoded in zclient->obuf. */
+static int
+zclient_batch_add (struct zclient *zclient, u_char cmd, struct prefix *p)
+{
+  struct stream *s = zclient->bbuf;
+  size_t attr_len = stream_get_endp (zclient->obuf);
+
+  if (zclient->sock < 0)
+    return -1;
+
+  if (zclient->batch_count
+      && (stream_getw_from (s, ZEBRA_HEADER_SIZE - 2) != cmd
+	  || zclient->batch_attr_len != attr_len
+	  || memcmp (STREAM_DATA (s) + ZEBRA_HEADER_SIZE,
+		     STREAM_DATA (zclient->obuf), ZAPI_BATCH_COUNT_OFFSET)
+	  || memcmp (STREAM_DATA (s) + ZEBRA_HEADER_SIZE
+		     + ZAPI_BATCH_COUNT_OFFSET + 2,
+		     STREAM_DATA (zclient->obuf) + ZAPI_BATCH_COUNT_OFFSET + 2,
+		     attr_len - ZAPI_BATCH_COUNT_OFFSET - 2)
+	  || STREAM_WRITEABLE (s) < 1 + (size_t) PSIZE (p->prefixlen)
+	  || zclient->batch_count == UINT16_MAX))
+    if (zclient_batch_flush (zclient) < 0)
+      return -1;
+
+  zclient_batch_put (zclient, cmd, p, attr_len);
+  return 0;
+}
+
+/* Send the routes batched so far. */
+int
+zclient_batch_flush (struct zclient *zclient)
+{
+  struct stream *s = zclient->bbuf;
+
+  if (zclient->batch_count == 0)
+    return 0;
+
+  stream_putw_at (s, ZEBRA_HEADER_SIZE + ZAPI_BATCH_COUNT_OFFSET,
+		  zclient->batch_count);
   stream_putw_at (s, 0, stream_get_endp (s));
+  zclient->batch_count = 0;
+  return zclient_write (zclient, s);
+}
 
-  return zclient_send_message(zclient);
+static int
+zclient_batch_event (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_batch = NULL;
+  return zclient_batch_flush (zclient);
+}
+
+int
+zapi_ipv4_route_batch (u_char cmd, struct zclient *zclient,
+		       struct prefix_ipv4 *p, struct zapi_ipv4 *api)
+{
+  struct stream *s;
+
+  if (! CHECK_FLAG (zclient->caps, ZEBRA_CAP_ROUTE_BATCH))
+    return zapi_ipv4_route (cmd, zclient, p, api);
+
+  s = zclient->obuf;
+  stream_reset (s);
+
+  stream_putc (s, api->type);
+  stream_putc (s, api->flags);
+  stream_putc (s, api->message);
+  stream_putw (s, api->safi);
+  stream_putw (s, 0);
+  zapi_ipv4_nexthops (s, api);
+
+  return zclient_batch_add (zclient, cmd == ZEBRA_IPV4_ROUTE_ADD
+			    ? ZEBRA_IPV4_ROUTE_BATCH_ADD
+			    : ZEBRA_IPV4_ROUTE_BATCH_DELETE,
+			    (struct prefix *) p);
 }
 
 #ifdef HAVE_IPV6
@@ -567,7 +819,6 @@ int
 zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
 	       struct zapi_ipv6 *api)
 {
-  int i;
   int psize;
   struct stream *s;
 
@@ -588,7 +839,20 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
   stream_putc (s, p->prefixlen);
   stream_write (s, (u_char *)&p->prefix, psize);
 
-  /* Nexthop, ifindex, distance and metric information. */
+  zapi_ipv6_nexthops (s, api);
+
+  /* Put length at the first point of the stream. */
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zclient_send_message(zclient);
+}
+
+/* Nexthop, ifindex, distance and metric information. */
+static void
+zapi_ipv6_nexthops (struct stream *s, struct zapi_ipv6 *api)
+{
+  int i;
+
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
     {
       stream_putc (s, api->nexthop_num + api->ifindex_num);
@@ -609,11 +873,31 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
     stream_putc (s, api->distance);
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
     stream_putl (s, api->metric);
+}
 
-  /* Put length at the first point of the stream. */
-  stream_putw_at (s, 0, stream_get_endp (s));
+int
+zapi_ipv6_route_batch (u_char cmd, struct zclient *zclient,
+		       struct prefix_ipv6 *p, struct zapi_ipv6 *api)
+{
+  struct stream *s;
 
-  return zclient_send_message(zclient);
+  if (! CHECK_FLAG (zclient->caps, ZEBRA_CAP_ROUTE_BATCH))
+    return zapi_ipv6_route (cmd, zclient, p, api);
+
+  s = zclient->obuf;
+  stream_reset (s);
+
+  stream_putc (s, api->type);
+  stream_putc (s, api->flags);
+  stream_putc (s, api->message);
+  stream_putw (s, api->safi);
+  stream_putw (s, 0);
+  zapi_ipv6_nexthops (s, api);
+
+  return zclient_batch_add (zclient, cmd == ZEBRA_IPV6_ROUTE_ADD
+			    ? ZEBRA_IPV6_ROUTE_BATCH_ADD
+			    : ZEBRA_IPV6_ROUTE_BATCH_DELETE,
+			    (struct prefix *) p);
 }
 #endif /* HAVE_IPV6 */
 
@@ -639,6 +923,45 @@ zebra_redistribute_send (int command, struct zclient *zclient, int type)
   return zclient_send_message(zclient);
 }
 
+/*
+ * Register or unregister interest in the reachability of a nexthop.
+ *
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |    Family     |  Address (4 or 16 bytes) ...                  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * ZEBRA_NEXTHOP_UPDATE carries the same family and address, followed by
+ * the IGP metric, the number of nexthops and the nexthops, encoded as in
+ * the answer to ZEBRA_IPV4_NEXTHOP_LOOKUP.  No nexthops means the address
+ * is unreachable.
+ */
+int
+zebra_nexthop_register_send (int command, struct zclient *zclient,
+			     struct prefix *p)
+{
+  struct stream *s;
+
+  s = zclient->obuf;
+  stream_reset (s);
+
+  zclient_create_header (s, command);
+  stream_putc (s, p->family);
+  if (p->family == AF_INET)
+    stream_put_in_addr (s, &p->u.prefix4);
+#ifdef HAVE_IPV6
+  else if (p->family == AF_INET6)
+    stream_put (s, &p->u.prefix6, 16);
+#endif /* HAVE_IPV6 */
+  else
+    return -1;
+
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zclient_send_message(zclient);
+}
+
 /* Router-id update from zebra daemon. */
 void
 zebra_router_id_update_read (struct stream *s, struct prefix *rid)
@@ -878,95 +1201,121 @@ zebra_interface_address_read (int type, struct stream *s)
 }
 
 
-/* Zebra client message read function. */
+/* Check the header of the message in the input buffer, and get the
+   length of the message and its command. */
 static int
-zclient_read (struct thread *thread)
+zclient_header_get (struct zclient *zclient, uint16_t *length,
+		    uint16_t *command)
 {
-  size_t already;
-  uint16_t length, command;
   uint8_t marker, version;
-  struct zclient *zclient;
-
-  /* Get socket to zebra. */
-  zclient = THREAD_ARG (thread);
-  zclient->t_read = NULL;
-
-  /* Read zebra header (if we don't have it already). */
-  if ((already = stream_get_endp(zclient->ibuf)) < ZEBRA_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
-				     ZEBRA_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (zclient_debug)
-	   zlog_debug ("zclient connection closed socket [%d].", zclient->sock);
-	  return zclient_failed(zclient);
-	}
-      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  zclient_event (ZCLIENT_READ, zclient);
-	  return 0;
-	}
-      already = ZEBRA_HEADER_SIZE;
-    }
 
   /* Reset to read from the beginning of the incoming packet. */
   stream_set_getp(zclient->ibuf, 0);
 
   /* Fetch header values. */
-  length = stream_getw (zclient->ibuf);
+  *length = stream_getw (zclient->ibuf);
   marker = stream_getc (zclient->ibuf);
   version = stream_getc (zclient->ibuf);
-  command = stream_getw (zclient->ibuf);
+  *command = stream_getw (zclient->ibuf);
   
   if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
     {
       zlog_err("%s: socket %d version mismatch, marker %d, version %d",
                __func__, zclient->sock, marker, version);
-      return zclient_failed(zclient);
+      return -1;
     }
   
-  if (length < ZEBRA_HEADER_SIZE) 
+  if (*length < ZEBRA_HEADER_SIZE) 
     {
       zlog_err("%s: socket %d message length %u is less than %d ",
-	       __func__, zclient->sock, length, ZEBRA_HEADER_SIZE);
-      return zclient_failed(zclient);
+	       __func__, zclient->sock, *length, ZEBRA_HEADER_SIZE);
+      return -1;
     }
+  return 0;
+}
 
-  /* Length check. */
-  if (length > STREAM_SIZE(zclient->ibuf))
+#ifdef HAVE_ZSERV_RING
+static void zclient_dispatch (struct zclient *, uint16_t, uint16_t);
+
+/* Messages taken from the ring before others get a turn. */
+#define ZCLIENT_RING_BURST 100
+
+/* Messages from zebra on the ring, and room for those waiting to go
+   to it. */
+static int
+zclient_ring_read (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+  struct zring *ring = zclient->ring;
+  uint16_t length, command;
+  int i, ret;
+
+  zclient->t_ring = NULL;
+
+  zring_clear (ring);
+  if (zring_backlog (ring) && zring_flush (ring) < 0)
+    goto broken;
+
+  for (i = 0; i < ZCLIENT_RING_BURST; i++)
     {
-      struct stream *ns;
-      zlog_warn("%s: message size %u exceeds buffer size %lu, expanding...",
-	        __func__, length, (u_long)STREAM_SIZE(zclient->ibuf));
-      ns = stream_new(length);
-      stream_copy(ns, zclient->ibuf);
-      stream_free (zclient->ibuf);
-      zclient->ibuf = ns;
+      stream_reset (zclient->ibuf);
+      if ((ret = zring_recv (ring, zclient->ibuf)) == 0)
+	break;
+      if (ret < ZEBRA_HEADER_SIZE
+	  || zclient_header_get (zclient, &length, &command) < 0)
+	goto broken;
+
+      zclient_dispatch (zclient, command, length);
+      if (zclient->sock < 0)
+	/* Connection was closed during packet processing. */
+	return -1;
     }
+  stream_reset (zclient->ibuf);
 
-  /* Read rest of zebra packet. */
-  if (already < length)
+  if (i == ZCLIENT_RING_BURST || ! zring_sleep (ring))
+    zclient->t_ring = thread_add_event (master, zclient_ring_read, zclient, 0);
+  else
+    zclient->t_ring = thread_add_read (master, zclient_ring_read, zclient,
+				       zring_fd (ring));
+  return 0;
+
+ broken:
+  zlog_warn ("%s: ring from zebra broken, closing", __func__);
+  return zclient_failed (zclient);
+}
+
+/* Zebra answered our hello, through the socket.  If it took the rings,
+   what it sends from now on comes through them, and what we send
+   goes through them after we told it so. */
+static void
+zclient_ring_start (struct zclient *zclient)
+{
+  if (! zclient->ring || zclient->ring_started)
+    return;
+
+  if (! CHECK_FLAG (zclient->caps, ZEBRA_CAP_RING))
     {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (zclient_debug)
-	    zlog_debug("zclient connection closed socket [%d].", zclient->sock);
-	  return zclient_failed(zclient);
-	}
-      if (nbyte != (ssize_t)(length-already))
-	{
-	  /* Try again later. */
-	  zclient_event (ZCLIENT_READ, zclient);
-	  return 0;
-	}
+      zring_free (zclient->ring);
+      zclient->ring = NULL;
+      return;
     }
 
+  if (zebra_message_send (zclient, ZEBRA_RING_START) < 0)
+    return;
+  zclient->ring_started = 1;
+  zclient->t_ring = thread_add_event (master, zclient_ring_read, zclient, 0);
+
+  if (zclient_debug)
+    zlog_debug ("zclient talks to zebra through %lu byte rings",
+		(u_long) zclient->ring_size);
+}
+#endif /* HAVE_ZSERV_RING */
+
+/* Hand the message in the input buffer, LENGTH as in its header, to
+   the callback for it. */
+static void
+zclient_dispatch (struct zclient *zclient, uint16_t command, uint16_t length)
+{
   length -= ZEBRA_HEADER_SIZE;
 
   if (zclient_debug)
@@ -1018,10 +1367,94 @@ zclient_read (struct thread *thread)
       if (zclient->ipv6_route_delete)
 	(*zclient->ipv6_route_delete) (command, zclient, length);
       break;
+    case ZEBRA_NEXTHOP_UPDATE:
+      if (zclient->nexthop_update)
+	(*zclient->nexthop_update) (command, zclient, length);
+      break;
+    case ZEBRA_HELLO:
+      zclient->caps = stream_getc (zclient->ibuf) & ZEBRA_CAP_ALL;
+      if (zclient_debug)
+	zlog_debug ("zebra capabilities 0x%02x", zclient->caps);
+#ifdef HAVE_ZSERV_RING
+      zclient_ring_start (zclient);
+#endif /* HAVE_ZSERV_RING */
+      break;
     default:
       break;
     }
 
+}
+
+/* Zebra client message read function. */
+static int
+zclient_read (struct thread *thread)
+{
+  size_t already;
+  uint16_t length, command;
+  struct zclient *zclient;
+
+  /* Get socket to zebra. */
+  zclient = THREAD_ARG (thread);
+  zclient->t_read = NULL;
+
+  /* Read zebra header (if we don't have it already). */
+  if ((already = stream_get_endp(zclient->ibuf)) < ZEBRA_HEADER_SIZE)
+    {
+      ssize_t nbyte;
+      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
+				     ZEBRA_HEADER_SIZE-already)) == 0) ||
+	  (nbyte == -1))
+	{
+	  if (zclient_debug)
+	   zlog_debug ("zclient connection closed socket [%d].", zclient->sock);
+	  return zclient_failed(zclient);
+	}
+      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
+	{
+	  /* Try again later. */
+	  zclient_event (ZCLIENT_READ, zclient);
+	  return 0;
+	}
+      already = ZEBRA_HEADER_SIZE;
+    }
+
+  if (zclient_header_get (zclient, &length, &command) < 0)
+    return zclient_failed(zclient);
+
+  /* Length check. */
+  if (length > STREAM_SIZE(zclient->ibuf))
+    {
+      struct stream *ns;
+      zlog_warn("%s: message size %u exceeds buffer size %lu, expanding...",
+	        __func__, length, (u_long)STREAM_SIZE(zclient->ibuf));
+      ns = stream_new(length);
+      stream_copy(ns, zclient->ibuf);
+      stream_free (zclient->ibuf);
+      zclient->ibuf = ns;
+    }
+
+  /* Read rest of zebra packet. */
+  if (already < length)
+    {
+      ssize_t nbyte;
+      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
+				     length-already)) == 0) ||
+	  (nbyte == -1))
+	{
+	  if (zclient_debug)
+	    zlog_debug("zclient connection closed socket [%d].", zclient->sock);
+	  return zclient_failed(zclient);
+	}
+      if (nbyte != (ssize_t)(length-already))
+	{
+	  /* Try again later. */
+	  zclient_event (ZCLIENT_READ, zclient);
+	  return 0;
+	}
+    }
+
+  zclient_dispatch (zclient, command, length);
+
   if (zclient->sock < 0)
     /* Connection was closed during packet processing. */
     return -1;
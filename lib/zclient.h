@@ -63,6 +63,24 @@ struct zclient
   /* Thread to write buffered data to zebra. */
   struct thread *t_write;
 
+  /* Capabilities zebra answered our hello with, ZEBRA_CAP_*. */
+  u_char caps;
+
+  /* Route message being batched, the number of prefixes in it and
+     the length of the part they share, see zapi_ipv4_route_batch(). */
+  struct stream *bbuf;
+  u_int16_t batch_count;
+  size_t batch_attr_len;
+  struct thread *t_batch;
+
+  /* Size of the shared memory rings to offer zebra, 0 for none, see
+     lib/zring.h.  Zebra's messages come through them once it took
+     them, ours go once ZEBRA_RING_START is sent.  */
+  size_t ring_size;
+  struct zring *ring;
+  int ring_started;
+  struct thread *t_ring;
+
   /* Redistribute information. */
   u_char redist_default;
   u_char redist[ZEBRA_ROUTE_MAX];
@@ -82,6 +100,11 @@ struct zclient
   int (*ipv4_route_delete) (int, struct zclient *, uint16_t);
   int (*ipv6_route_add) (int, struct zclient *, uint16_t);
   int (*ipv6_route_delete) (int, struct zclient *, uint16_t);
+  int (*nexthop_update) (int, struct zclient *, uint16_t);
+
+  /* Called once the connection to zebra is up, to resend state that
+     zebra keeps per client. */
+  void (*zebra_connected) (struct zclient *);
 };
 
 /* Zebra API message flag. */
@@ -91,6 +114,10 @@ struct zclient
 #define ZAPI_MESSAGE_METRIC   0x08
 #define ZAPI_MESSAGE_ONLINK   0x10
 
+/* Where the prefix count is in batched route messages, after the
+   header. */
+#define ZAPI_BATCH_COUNT_OFFSET 5
+
 /* Zserv protocol message header */
 struct zserv_header
 {
@@ -139,6 +166,12 @@ extern void zclient_serv_path_set  (char *path);
 /* Send redistribute command to zebra daemon. Do not update zclient state. */
 extern int zebra_redistribute_send (int command, struct zclient *, int type);
 
+/* Send ZEBRA_NEXTHOP_REGISTER or ZEBRA_NEXTHOP_UNREGISTER for the host
+   address in the prefix.  Zebra answers a registration, and follows up
+   on any change, with ZEBRA_NEXTHOP_UPDATE.  */
+extern int zebra_nexthop_register_send (int command, struct zclient *,
+					struct prefix *);
+
 /* If state has changed, update state and call zebra_redistribute_send. */
 extern void zclient_redistribute (int command, struct zclient *, int type);
 
@@ -149,6 +182,10 @@ extern void zclient_redistribute_default (int command, struct zclient *);
    Returns 0 for success or -1 on an I/O error. */
 extern int zclient_send_message(struct zclient *);
 
+/* Send the routes batched by zapi_ipv4_route_batch() and
+   zapi_ipv6_route_batch() now, rather than once the thread is done. */
+extern int zclient_batch_flush (struct zclient *);
+
 /* create header for command, length to be filled in by user later */
 extern void zclient_create_header (struct stream *, uint16_t);
 
@@ -159,6 +196,10 @@ extern void zebra_interface_if_set_value (struct stream *, struct interface *);
 extern void zebra_router_id_update_read (struct stream *s, struct prefix *rid);
 extern int zapi_ipv4_route (u_char, struct zclient *, struct prefix_ipv4 *, 
                             struct zapi_ipv4 *);
+/* Same as zapi_ipv4_route(), but let routes sharing all but the prefix
+   go to zebra in one message. */
+extern int zapi_ipv4_route_batch (u_char, struct zclient *,
+				  struct prefix_ipv4 *, struct zapi_ipv4 *);
 
 #ifdef HAVE_IPV6
 /* IPv6 prefix add and delete function prototype. */
@@ -186,6 +227,8 @@ struct zapi_ipv6
 
 extern int zapi_ipv6_route (u_char cmd, struct zclient *zclient, 
                      struct prefix_ipv6 *p, struct zapi_ipv6 *api);
+extern int zapi_ipv6_route_batch (u_char cmd, struct zclient *zclient,
+				  struct prefix_ipv6 *p, struct zapi_ipv6 *api);
 #endif /* HAVE_IPV6 */
 
 #endif /* _ZEBRA_ZCLIENT_H */
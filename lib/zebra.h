@@ -419,7 +419,15 @@ struct in_pktinfo
 #define ZEBRA_ROUTER_ID_UPDATE            22
 #define ZEBRA_HELLO                       23
 #define ZEBRA_BGP_IPV4_RGATE_VERIFY       24
-#define ZEBRA_MESSAGE_MAX                 25
+#define ZEBRA_NEXTHOP_REGISTER            25
+#define ZEBRA_NEXTHOP_UNREGISTER          26
+#define ZEBRA_NEXTHOP_UPDATE              27
+#define ZEBRA_IPV4_ROUTE_BATCH_ADD        28
+#define ZEBRA_IPV4_ROUTE_BATCH_DELETE     29
+#define ZEBRA_IPV6_ROUTE_BATCH_ADD        30
+#define ZEBRA_IPV6_ROUTE_BATCH_DELETE     31
+#define ZEBRA_RING_START                  32
+#define ZEBRA_MESSAGE_MAX                 33
 
 /* Marker value used in new Zserv, in the byte location corresponding
  * the command value in the old zserv header. To allow old and new
@@ -434,6 +442,13 @@ struct in_pktinfo
  * corresponding {command,route}_types[] table in lib/log.c MUST be
  * updated! */
 
+/* Capabilities a client asks for in ZEBRA_HELLO, and zebra confirms.
+   A client asking for a ring sends its size after the capabilities,
+   and the descriptors along with the message, see lib/zring.h.  */
+#define ZEBRA_CAP_ROUTE_BATCH            0x01
+#define ZEBRA_CAP_RING                   0x02
+#define ZEBRA_CAP_ALL                    (ZEBRA_CAP_ROUTE_BATCH | ZEBRA_CAP_RING)
+
 /* Zebra's family types. */
 #define ZEBRA_FAMILY_IPV4                1
 #define ZEBRA_FAMILY_IPV6                2
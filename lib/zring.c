@@ -0,0 +1,421 @@
+/*
+ * Shared memory rings between zebra and its clients.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* A client and zebra share a memfd holding two byte rings, one per
+   direction, each with a single sender and a single receiver.  The
+   sender copies a whole message in and then moves the head, the
+   receiver copies it out and then moves the tail, so neither takes a
+   lock or makes a system call while the other keeps up.
+
+   An end that runs dry sets "sleeping" and waits on its eventfd, an
+   end that runs out of room sets "blocked" and waits on the same.  The
+   other end clears the flag when it sees it and posts the eventfd, so
+   there is one wakeup per wait however many messages follow.
+
+   Zebra cannot trust the client with the memory: it keeps its own
+   head and tail, checks what it reads from the client's, and wants the
+   memfd sealed so it cannot be shrunk under it.  */
+
+#include <zebra.h>
+
+#ifdef HAVE_ZRING
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "memory.h"
+#include "log.h"
+#include "network.h"
+#include "stream.h"
+#include "zring.h"
+
+/* At the start of each ring, a cache line for each end.  */
+struct zring_shm
+{
+  /* Moved by the sender.  */
+  volatile u_int32_t head;
+  volatile u_int32_t blocked;
+  char pad1[56];
+
+  /* Moved by the receiver.  */
+  volatile u_int32_t tail;
+  volatile u_int32_t sleeping;
+  char pad2[56];
+};
+
+struct zring_dir
+{
+  struct zring_shm *shm;
+  u_char *data;
+  u_int32_t size;
+
+  /* Our own head when sending, tail when receiving.  */
+  u_int32_t pos;
+};
+
+struct zring
+{
+  void *map;
+  size_t maplen;
+  int mfd;
+
+  struct zring_dir tx;
+  struct zring_dir rx;
+
+  /* Our eventfd and the other end's.  */
+  int wake_fd;
+  int peer_fd;
+
+  /* Messages waiting for room in tx.  */
+  struct stream_fifo *backlog;
+  size_t backlog_bytes;
+};
+
+static int
+zring_size_ok (size_t size)
+{
+  return size >= ZRING_SIZE_MIN && size <= ZRING_SIZE_MAX
+	 && (size & (size - 1)) == 0;
+}
+
+/* Ring 0 carries messages from the client to zebra, ring 1 the other
+   way.  */
+static void
+zring_setup (struct zring *r, size_t size, int server)
+{
+  struct zring_dir *dir[2];
+  u_char *p = r->map;
+  int i;
+
+  dir[0] = server ? &r->rx : &r->tx;
+  dir[1] = server ? &r->tx : &r->rx;
+  for (i = 0; i < 2; i++)
+    {
+      dir[i]->shm = (struct zring_shm *) p;
+      dir[i]->data = p + sizeof (struct zring_shm);
+      dir[i]->size = size;
+      dir[i]->pos = 0;
+      p += sizeof (struct zring_shm) + size;
+    }
+  r->backlog = stream_fifo_new ();
+}
+
+static int
+zring_map (struct zring *r, size_t size)
+{
+  r->maplen = 2 * (sizeof (struct zring_shm) + size);
+  r->map = mmap (NULL, r->maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 r->mfd, 0);
+  if (r->map == MAP_FAILED)
+    {
+      r->map = NULL;
+      return -1;
+    }
+  return 0;
+}
+
+static struct zring *
+zring_alloc (void)
+{
+  struct zring *r;
+
+  r = XCALLOC (MTYPE_ZRING, sizeof (struct zring));
+  r->mfd = r->wake_fd = r->peer_fd = -1;
+  return r;
+}
+
+struct zring *
+zring_new (size_t size)
+{
+  struct zring *r;
+  unsigned int flags = MFD_CLOEXEC;
+
+  if (! zring_size_ok (size))
+    return NULL;
+
+  r = zring_alloc ();
+#ifdef F_SEAL_SHRINK
+  flags |= MFD_ALLOW_SEALING;
+#endif /* F_SEAL_SHRINK */
+  if ((r->mfd = memfd_create ("zring", flags)) < 0
+      || ftruncate (r->mfd, 2 * (sizeof (struct zring_shm) + size)) < 0)
+    goto fail;
+#ifdef F_SEAL_SHRINK
+  if (fcntl (r->mfd, F_ADD_SEALS,
+	     F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    goto fail;
+#endif /* F_SEAL_SHRINK */
+  if (zring_map (r, size) < 0)
+    goto fail;
+
+  if ((r->wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+      || (r->peer_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    goto fail;
+
+  zring_setup (r, size, 0);
+  return r;
+
+ fail:
+  zlog_warn ("%s: can't make rings: %s", __func__, safe_strerror (errno));
+  zring_free (r);
+  return NULL;
+}
+
+/* The memory, then the eventfd of the other end, then ours.  */
+void
+zring_fds (struct zring *r, int *fds)
+{
+  fds[0] = r->mfd;
+  fds[1] = r->peer_fd;
+  fds[2] = r->wake_fd;
+}
+
+/* Takes over the descriptors, whatever comes of it.  */
+struct zring *
+zring_attach (size_t size, int *fds)
+{
+  struct zring *r;
+  struct stat st;
+#ifdef F_SEAL_SHRINK
+  int seals;
+#endif /* F_SEAL_SHRINK */
+
+  r = zring_alloc ();
+  r->mfd = fds[0];
+  r->wake_fd = fds[1];
+  r->peer_fd = fds[2];
+
+  if (! zring_size_ok (size))
+    {
+      zlog_warn ("%s: bad ring size %lu", __func__, (u_long) size);
+      goto fail;
+    }
+  if (fstat (r->mfd, &st) < 0
+      || (size_t) st.st_size < 2 * (sizeof (struct zring_shm) + size))
+    {
+      zlog_warn ("%s: ring memory missing or too small", __func__);
+      goto fail;
+    }
+#ifdef F_SEAL_SHRINK
+  seals = fcntl (r->mfd, F_GET_SEALS);
+  if (seals < 0 || ! (seals & F_SEAL_SHRINK))
+#endif /* F_SEAL_SHRINK */
+    {
+      zlog_warn ("%s: ring memory could shrink", __func__);
+      goto fail;
+    }
+  if (zring_map (r, size) < 0)
+    {
+      zlog_warn ("%s: can't map rings: %s", __func__, safe_strerror (errno));
+      goto fail;
+    }
+
+  /* Never mind what the other end made them, we do not block.  */
+  set_nonblocking (r->wake_fd);
+  set_nonblocking (r->peer_fd);
+
+  zring_setup (r, size, 1);
+  return r;
+
+ fail:
+  zring_free (r);
+  return NULL;
+}
+
+void
+zring_free (struct zring *r)
+{
+  if (r->map)
+    munmap (r->map, r->maplen);
+  if (r->mfd >= 0)
+    close (r->mfd);
+  if (r->wake_fd >= 0)
+    close (r->wake_fd);
+  if (r->peer_fd >= 0)
+    close (r->peer_fd);
+  if (r->backlog)
+    stream_fifo_free (r->backlog);
+  XFREE (MTYPE_ZRING, r);
+}
+
+int
+zring_fd (struct zring *r)
+{
+  return r->wake_fd;
+}
+
+void
+zring_clear (struct zring *r)
+{
+  u_int64_t count;
+
+  while (read (r->wake_fd, &count, sizeof count) < 0 && errno == EINTR)
+    ;
+}
+
+/* The flag was set by the other end going to wait, wake it up once.  */
+static void
+zring_wake (struct zring *r, volatile u_int32_t *flag)
+{
+  u_int64_t one = 1;
+
+  if (*flag && __sync_bool_compare_and_swap (flag, 1, 0))
+    while (write (r->peer_fd, &one, sizeof one) < 0 && errno == EINTR)
+      ;
+}
+
+/* Returns 1 if the message went in, 0 if there was no room and -1 if
+   the other end broke the ring.  */
+static int
+zring_put (struct zring_dir *d, const u_char *buf, size_t len)
+{
+  u_int32_t used = d->pos - d->shm->tail;
+  u_int32_t off, n;
+
+  if (used > d->size)
+    return -1;
+  if (d->size - used < len)
+    return 0;
+
+  off = d->pos & (d->size - 1);
+  n = MIN (len, d->size - off);
+  memcpy (d->data + off, buf, n);
+  memcpy (d->data, buf + n, len - n);
+  d->pos += len;
+
+  __sync_synchronize ();
+  d->shm->head = d->pos;
+  return 1;
+}
+
+static void
+zring_copy_out (struct zring_dir *d, u_char *buf, size_t len)
+{
+  u_int32_t off, n;
+
+  off = d->pos & (d->size - 1);
+  n = MIN (len, d->size - off);
+  memcpy (buf, d->data + off, n);
+  memcpy (buf + n, d->data, len - n);
+}
+
+int
+zring_send (struct zring *r, struct stream *s)
+{
+  size_t len = stream_get_endp (s);
+  int ret = 0;
+
+  if (len > r->tx.size)
+    return -1;
+
+  if (! r->backlog_bytes
+      && (ret = zring_put (&r->tx, STREAM_DATA (s), len)) > 0)
+    {
+      zring_wake (r, &r->tx.shm->sleeping);
+      return 0;
+    }
+  if (ret < 0)
+    return -1;
+
+  stream_fifo_push (r->backlog, stream_dup (s));
+  r->backlog_bytes += len;
+
+  /* Have the other end tell us when it made room, then look again in
+     case it did just now.  */
+  r->tx.shm->blocked = 1;
+  __sync_synchronize ();
+  return zring_flush (r) < 0 ? -1 : 0;
+}
+
+int
+zring_flush (struct zring *r)
+{
+  struct stream *s;
+  int ret;
+
+  while ((s = stream_fifo_head (r->backlog)) != NULL)
+    {
+      ret = zring_put (&r->tx, STREAM_DATA (s), stream_get_endp (s));
+      if (ret < 0)
+	return -1;
+      if (ret == 0)
+	break;
+      r->backlog_bytes -= stream_get_endp (s);
+      stream_free (stream_fifo_pop (r->backlog));
+    }
+  zring_wake (r, &r->tx.shm->sleeping);
+
+  return r->backlog_bytes ? 1 : 0;
+}
+
+size_t
+zring_backlog (struct zring *r)
+{
+  return r->backlog_bytes;
+}
+
+int
+zring_recv (struct zring *r, struct stream *s)
+{
+  struct zring_dir *d = &r->rx;
+  u_int32_t avail;
+  u_char lenbuf[2];
+  size_t len;
+
+  avail = d->shm->head - d->pos;
+  if (avail == 0)
+    return 0;
+  __sync_synchronize ();
+
+  if (avail < sizeof lenbuf || avail > d->size)
+    return -1;
+  zring_copy_out (d, lenbuf, sizeof lenbuf);
+  len = (lenbuf[0] << 8) | lenbuf[1];
+  if (len < sizeof lenbuf || len > avail || len > STREAM_WRITEABLE (s))
+    return -1;
+
+  zring_copy_out (d, STREAM_DATA (s) + stream_get_endp (s), len);
+  stream_forward_endp (s, len);
+  d->pos += len;
+
+  __sync_synchronize ();
+  d->shm->tail = d->pos;
+  zring_wake (r, &d->shm->blocked);
+  return len;
+}
+
+int
+zring_sleep (struct zring *r)
+{
+  struct zring_dir *d = &r->rx;
+
+  d->shm->sleeping = 1;
+  __sync_synchronize ();
+  if (d->shm->head == d->pos)
+    return 1;
+
+  /* A wakeup the other end may have posted meanwhile is cleared with
+     the next one.  */
+  __sync_bool_compare_and_swap (&d->shm->sleeping, 1, 0);
+  return 0;
+}
+
+#endif /* HAVE_ZRING */
@@ -0,0 +1,73 @@
+/*
+ * Shared memory rings between zebra and its clients.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_ZRING_H
+#define _QUAGGA_ZRING_H
+
+#include "stream.h"
+
+/* The descriptors are passed over the unix socket to zebra, so there
+   are no rings with TCP.  */
+#if defined(HAVE_ZRING) && !defined(HAVE_TCP_ZEBRA)
+#define HAVE_ZSERV_RING
+#endif
+
+/* Bytes per direction, a power of 2.  */
+#define ZRING_SIZE_MIN          (64 * 1024)
+#define ZRING_SIZE_MAX          (64 * 1024 * 1024)
+#define ZRING_SIZE_DEFAULT      (1024 * 1024)
+
+/* Descriptors one end hands the other: the memory, the eventfd waking
+   up the receiving end, and the one waking up the sending end.  */
+#define ZRING_NFDS              3
+
+struct zring;
+
+/* Messages start with their length in two bytes, as ZAPI ones do.
+   zring_new() makes the rings and is for the client, zring_attach()
+   is for zebra, taking the descriptors from zring_fds().  */
+extern struct zring *zring_new (size_t);
+extern void zring_fds (struct zring *, int *);
+extern struct zring *zring_attach (size_t, int *);
+extern void zring_free (struct zring *);
+
+/* The descriptor to wait on for reading.  It is readable when the
+   other end sent messages after zring_sleep(), or made room for the
+   backlog.  zring_clear() then resets it.  */
+extern int zring_fd (struct zring *);
+extern void zring_clear (struct zring *);
+
+/* Send a message, -1 if the ring is corrupt.  What does not fit waits
+   in a backlog, which zring_flush() moves on when there is room; it
+   returns 1 while some is still waiting, 0 once it is all sent.  */
+extern int zring_send (struct zring *, struct stream *);
+extern int zring_flush (struct zring *);
+extern size_t zring_backlog (struct zring *);
+
+/* Take the next message into the stream, returns its length, 0 if
+   there is none and -1 if the ring is corrupt.  */
+extern int zring_recv (struct zring *, struct stream *);
+
+/* Ask to be woken up for the next message, returns 0 if one arrived
+   meanwhile and the caller should rather go on reading.  */
+extern int zring_sleep (struct zring *);
+
+#endif /* _QUAGGA_ZRING_H */
@@ -326,63 +326,44 @@ ospf_interface_address_delete (int command, struct zclient *zclient,
 void
 ospf_zebra_add (struct prefix_ipv4 *p, struct ospf_route *or)
 {
-  u_char message;
-  u_char distance;
-  u_char flags;
-  int psize;
-  struct stream *s;
+  struct zapi_ipv4 api;
   struct ospf_path *path;
   struct listnode *node;
+  struct in_addr **nexthops;
+  unsigned int *ifindexes;
 
   if (zclient->redist[ZEBRA_ROUTE_OSPF])
     {
-      message = 0;
-      flags = 0;
+      api.type = ZEBRA_ROUTE_OSPF;
+      api.flags = 0;
+      api.message = 0;
+      api.safi = SAFI_UNICAST;
 
       /* OSPF pass nexthop and metric */
-      SET_FLAG (message, ZAPI_MESSAGE_NEXTHOP);
-      SET_FLAG (message, ZAPI_MESSAGE_METRIC);
+      SET_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP);
+      SET_FLAG (api.message, ZAPI_MESSAGE_METRIC);
 
       /* Distance value. */
-      distance = ospf_distance_apply (p, or);
-      if (distance)
-        SET_FLAG (message, ZAPI_MESSAGE_DISTANCE);
-
-      /* Make packet. */
-      s = zclient->obuf;
-      stream_reset (s);
-
-      /* Put command, type, flags, message. */
-      zclient_create_header (s, ZEBRA_IPV4_ROUTE_ADD);
-      stream_putc (s, ZEBRA_ROUTE_OSPF);
-      stream_putc (s, flags);
-      stream_putc (s, message);
-      stream_putw (s, SAFI_UNICAST);
-
-      /* Put prefix information. */
-      psize = PSIZE (p->prefixlen);
-      stream_putc (s, p->prefixlen);
-      stream_write (s, (u_char *) & p->prefix, psize);
-
-      /* Nexthop count. */
-      stream_putc (s, or->paths->count);
-
-      /* Nexthop, ifindex, distance and metric information. */
+      api.distance = ospf_distance_apply (p, or);
+      if (api.distance)
+        SET_FLAG (api.message, ZAPI_MESSAGE_DISTANCE);
+
+      /* Nexthop and ifindex information. */
+      nexthops = XCALLOC (MTYPE_TMP,
+                          or->paths->count * sizeof (struct in_addr *));
+      ifindexes = XCALLOC (MTYPE_TMP,
+                           or->paths->count * sizeof (unsigned int));
+      api.nexthop = nexthops;
+      api.ifindex = ifindexes;
+      api.nexthop_num = 0;
+      api.ifindex_num = 0;
+
       for (ALL_LIST_ELEMENTS_RO (or->paths, node, path))
         {
           if (path->nexthop.s_addr != INADDR_ANY)
-            {
-              stream_putc (s, ZEBRA_NEXTHOP_IPV4);
-              stream_put_in_addr (s, &path->nexthop);
-            }
+            nexthops[api.nexthop_num++] = &path->nexthop;
           else
-            {
-              stream_putc (s, ZEBRA_NEXTHOP_IFINDEX);
-              if (path->ifindex)
-                stream_putl (s, path->ifindex);
-              else
-                stream_putl (s, 0);
-            }
+            ifindexes[api.ifindex_num++] = path->ifindex;
 
           if (IS_DEBUG_OSPF (zebra, ZEBRA_REDISTRIBUTE))
             {
@@ -396,21 +377,18 @@ ospf_zebra_add (struct prefix_ipv4 *p, struct ospf_route *or)
             }
         }
 
-      if (CHECK_FLAG (message, ZAPI_MESSAGE_DISTANCE))
-        stream_putc (s, distance);
-      if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
-        {
-          if (or->path_type == OSPF_PATH_TYPE1_EXTERNAL)
-            stream_putl (s, or->cost + or->u.ext.type2_cost);
-          else if (or->path_type == OSPF_PATH_TYPE2_EXTERNAL)
-            stream_putl (s, or->u.ext.type2_cost);
-          else
-            stream_putl (s, or->cost);
-        }
+      if (or->path_type == OSPF_PATH_TYPE1_EXTERNAL)
+        api.metric = or->cost + or->u.ext.type2_cost;
+      else if (or->path_type == OSPF_PATH_TYPE2_EXTERNAL)
+        api.metric = or->u.ext.type2_cost;
+      else
+        api.metric = or->cost;
 
-      stream_putw_at (s, 0, stream_get_endp (s));
+      /* Routes of the same paths and cost go to zebra together. */
+      zapi_ipv4_route_batch (ZEBRA_IPV4_ROUTE_ADD, zclient, p, &api);
 
-      zclient_send_message(zclient);
+      XFREE (MTYPE_TMP, nexthops);
+      XFREE (MTYPE_TMP, ifindexes);
     }
 }
 
@@ -453,7 +431,7 @@ ospf_zebra_delete (struct prefix_ipv4 *p, struct ospf_route *or)
                          p->prefixlen);
             }
 
-          zapi_ipv4_route (ZEBRA_IPV4_ROUTE_DELETE, zclient, p, &api);
+          zapi_ipv4_route_batch (ZEBRA_IPV4_ROUTE_DELETE, zclient, p, &api);
 
           if (IS_DEBUG_OSPF (zebra, ZEBRA_REDISTRIBUTE) && api.nexthop_num)
             {
@@ -489,7 +467,7 @@ ospf_zebra_add_discard (struct prefix_ipv4 *p)
       api.nexthop_num = 0;
       api.ifindex_num = 0;
 
-      zapi_ipv4_route (ZEBRA_IPV4_ROUTE_ADD, zclient, p, &api);
+      zapi_ipv4_route_batch (ZEBRA_IPV4_ROUTE_ADD, zclient, p, &api);
 
       if (IS_DEBUG_OSPF (zebra, ZEBRA_REDISTRIBUTE))
         zlog_debug ("Zebra: Route add discard %s/%d",
@@ -512,7 +490,7 @@ ospf_zebra_delete_discard (struct prefix_ipv4 *p)
       api.nexthop_num = 0;
       api.ifindex_num = 0;
 
-      zapi_ipv4_route (ZEBRA_IPV4_ROUTE_DELETE, zclient, p, &api);
+      zapi_ipv4_route_batch (ZEBRA_IPV4_ROUTE_DELETE, zclient, p, &api);
 
       if (IS_DEBUG_OSPF (zebra, ZEBRA_REDISTRIBUTE))
         zlog_debug ("Zebra: Route delete discard %s/%d",
@@ -0,0 +1,142 @@
+/*
+ * BGP adjacency out benchmark.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "memory.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_advertise.h"
+
+/* Announces a table of /24s to a number of peers, re-announces it as
+   after a best path change, and withdraws it again, timing each round.
+   Usage: testbgpadjout [prefixes [peers]]  */
+
+static int
+privs_change (zebra_privs_ops_t op)
+{
+  return 0;
+}
+
+/* need these to link in libbgp, bgp_get() opens a listen socket */
+struct zebra_privs_t bgpd_privs = { .change = privs_change };
+struct thread_master *master = NULL;
+
+static as_t asn = 100;
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct bgp *bgp;
+  struct bgp_table *table;
+  struct bgp_node *rn;
+  struct bgp_info *binfo;
+  struct peer **peers;
+  struct prefix_ipv4 p;
+  struct attr attr;
+  struct timeval start;
+  int nprefix = 10000, npeer = 200;
+  int i, errors = 0;
+
+  if (argc > 1)
+    nprefix = atoi (argv[1]);
+  if (argc > 2)
+    npeer = atoi (argv[2]);
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_attr_init ();
+  bm->port = 0;
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  peers = XCALLOC (MTYPE_TMP, npeer * sizeof (struct peer *));
+  for (i = 0; i < npeer; i++)
+    {
+      peers[i] = peer_create_accept (bgp);
+      peers[i]->host = "peer";
+    }
+
+  table = bgp_table_init (AFI_IP, SAFI_UNICAST);
+  for (i = 0; i < nprefix; i++)
+    {
+      p.family = AF_INET;
+      p.prefixlen = 24;
+      p.prefix.s_addr = htonl (0x0a000000 | (i << 8));
+      bgp_node_get (table, (struct prefix *) &p);
+    }
+
+  bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
+  binfo = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+  bgp_info_lock (binfo);
+
+  gettimeofday (&start, NULL);
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    for (i = 0; i < npeer; i++)
+      bgp_adj_out_set (rn, peers[i], &rn->p, &attr, AFI_IP, SAFI_UNICAST,
+		       binfo);
+  printf ("announce    %d prefixes to %d peers: %.3fs\n",
+	  nprefix, npeer, elapsed (&start));
+
+  gettimeofday (&start, NULL);
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    for (i = 0; i < npeer; i++)
+      bgp_adj_out_set (rn, peers[i], &rn->p, &attr, AFI_IP, SAFI_UNICAST,
+		       binfo);
+  printf ("re-announce %d prefixes to %d peers: %.3fs\n",
+	  nprefix, npeer, elapsed (&start));
+
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    for (i = 0; i < npeer; i++)
+      if (! bgp_adj_out_lookup (peers[i], &rn->p, AFI_IP, SAFI_UNICAST, rn))
+	errors++;
+
+  gettimeofday (&start, NULL);
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    for (i = 0; i < npeer; i++)
+      bgp_adj_out_unset (rn, peers[i], &rn->p, AFI_IP, SAFI_UNICAST);
+  printf ("withdraw    %d prefixes to %d peers: %.3fs\n",
+	  nprefix, npeer, elapsed (&start));
+
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    if (rn->adj_out)
+      errors++;
+
+  printf ("%d errors\n", errors);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * BGP aggregate counting test.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "command.h"
+#include "stream.h"
+#include "privs.h"
+#include "memory.h"
+#include "prefix.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+
+/* Routes come and go under an as-set aggregate, which is counted
+   incrementally.  After every step the attributes of the aggregate
+   route must be what they were when the same routes were there
+   before.  */
+
+static int
+privs_change (zebra_privs_ops_t op)
+{
+  return 0;
+}
+
+/* need these to link in libbgp, bgp_get() opens a listen socket */
+struct zebra_privs_t bgpd_privs = { .change = privs_change };
+struct thread_master *master = NULL;
+
+extern struct cmd_element aggregate_address_as_set_cmd;
+
+static as_t asn = 100;
+static int failed = 0;
+
+static struct bgp_info *
+route_new (u_char origin, const char *aspath, const char *community)
+{
+  struct bgp_info *ri;
+  struct attr attr;
+
+  memset (&attr, 0, sizeof (struct attr));
+  attr.origin = origin;
+  if (aspath)
+    attr.aspath = aspath_str2aspath (aspath);
+  if (community)
+    attr.community = community_str2com (community);
+
+  ri = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+  ri->type = ZEBRA_ROUTE_BGP;
+  ri->sub_type = BGP_ROUTE_NORMAL;
+  SET_FLAG (ri->flags, BGP_INFO_VALID);
+  ri->attr = bgp_attr_intern (&attr);
+  return ri;
+}
+
+/* Describe the aggregate route for P in BUF, empty if there is none. */
+static void
+aggregate_str (struct bgp *bgp, struct prefix *p, char *buf, size_t len)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+
+  buf[0] = '\0';
+  rn = bgp_node_lookup (bgp->rib[AFI_IP][SAFI_UNICAST], p);
+  if (! rn)
+    return;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->sub_type == BGP_ROUTE_AGGREGATE
+	&& ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+      snprintf (buf, len, "origin %d, as-path {%s}, community {%s}",
+		ri->attr->origin, aspath_print (ri->attr->aspath),
+		ri->attr->community
+		? community_str (ri->attr->community) : "");
+  bgp_unlock_node (rn);
+}
+
+static void
+check (const char *step, const char *got, const char *expect)
+{
+  int ok = ! strcmp (got, expect);
+
+  printf ("%-40s %s\n", step, ok ? "OK" : "failed!");
+  if (! ok)
+    {
+      printf ("  got:    %s\n  expect: %s\n", got, expect);
+      failed++;
+    }
+}
+
+int
+main (void)
+{
+  struct bgp *bgp;
+  struct vty *vty;
+  struct prefix agg;
+  struct prefix p[3];
+  struct bgp_info *ri[3];
+  const char *argv[] = { "10.0.0.0/16" };
+  char none[256], one[256], two[256], buf[256];
+  int i;
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_attr_init ();
+  bm->port = 0;
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  vty = vty_new ();
+  vty->node = BGP_NODE;
+  vty->index = bgp;
+  if (aggregate_address_as_set_cmd.func (&aggregate_address_as_set_cmd, vty,
+					 1, argv) != CMD_SUCCESS)
+    return -1;
+  str2prefix ("10.0.0.0/16", &agg);
+
+  str2prefix ("10.0.1.0/24", &p[0]);
+  str2prefix ("10.0.2.0/24", &p[1]);
+  str2prefix ("10.0.3.0/24", &p[2]);
+  ri[0] = route_new (BGP_ORIGIN_IGP, "1 2", "65000:1");
+  ri[1] = route_new (BGP_ORIGIN_INCOMPLETE, "3 4", "65000:2");
+  ri[2] = route_new (BGP_ORIGIN_EGP, NULL, NULL);
+
+  aggregate_str (bgp, &agg, none, sizeof none);
+  check ("no route", none, "");
+
+  bgp_aggregate_increment (bgp, &p[0], ri[0], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, one, sizeof one);
+  check ("first route", one,
+	 "origin 0, as-path {1 2}, community {65000:1}");
+
+  bgp_aggregate_increment (bgp, &p[1], ri[1], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, two, sizeof two);
+  check ("second route", two,
+	 "origin 2, as-path {{1,2,3,4}}, community {65000:1 65000:2}");
+
+  /* Counted once only.  */
+  bgp_aggregate_increment (bgp, &p[1], ri[1], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, buf, sizeof buf);
+  check ("second route again", buf, two);
+
+  /* No AS path to merge.  */
+  bgp_aggregate_increment (bgp, &p[2], ri[2], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, buf, sizeof buf);
+  check ("route without AS path", buf, two);
+  bgp_aggregate_decrement (bgp, &p[2], ri[2], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, buf, sizeof buf);
+  check ("route without AS path gone", buf, two);
+
+  bgp_aggregate_decrement (bgp, &p[1], ri[1], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, buf, sizeof buf);
+  check ("second route gone", buf, one);
+
+  bgp_aggregate_increment (bgp, &p[1], ri[1], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, buf, sizeof buf);
+  check ("second route back", buf, two);
+
+  bgp_aggregate_decrement (bgp, &p[0], ri[0], AFI_IP, SAFI_UNICAST);
+  bgp_aggregate_decrement (bgp, &p[1], ri[1], AFI_IP, SAFI_UNICAST);
+  aggregate_str (bgp, &agg, buf, sizeof buf);
+  check ("all routes gone", buf, none);
+
+  for (i = 0; i < 3; i++)
+    bgp_attr_unintern (ri[i]->attr);
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
@@ -27,6 +27,10 @@
  * (it defaults to port 4000) and enter the 'clear foo string' command.
  * then type whatever and observe that, unlike heavy.c, the vty interface
  * remains responsive.
+ *
+ * 'benchmark timers NUMBER' arms, re-arms and cancels that many timers,
+ * the way bgpd treats keepalive/holdtime timers of many peers, and reports
+ * how long the timer queue operations took.
  */
 #include <zebra.h>
 #include <math.h>
@@ -138,8 +142,77 @@ DEFUN (clear_foo,
   return CMD_SUCCESS;
 }
 
+static int
+timer_dummy (struct thread *thread)
+{
+  return 0;
+}
+
+/* Random expiry between 1 and 180 seconds, in msecs. */
+static long
+timer_random_msec (void)
+{
+  return 1000 + random () % 179000;
+}
+
+static unsigned long
+timer_bench_elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000L
+         + (now.tv_usec - start->tv_usec);
+}
+
+DEFUN (benchmark_timers,
+       benchmark_timers_cmd,
+       "benchmark timers <1-10000000>",
+       "Benchmark\n"
+       "Timer queue arm, re-arm and cancel\n"
+       "Number of timers\n")
+{
+  struct thread **timers;
+  struct timeval start;
+  unsigned long count, i;
+  unsigned long arm, rearm, cancel;
+
+  count = strtoul (argv[0], NULL, 10);
+  timers = XCALLOC (MTYPE_TMP, count * sizeof (struct thread *));
+
+  srandom (1);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < count; i++)
+    timers[i] = thread_add_timer_msec (master, timer_dummy, NULL,
+                                       timer_random_msec ());
+  arm = timer_bench_elapsed (&start);
+
+  /* Like a keepalive being received: cancel and arm again. */
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < count; i++)
+    {
+      THREAD_TIMER_OFF (timers[i]);
+      timers[i] = thread_add_timer_msec (master, timer_dummy, NULL,
+                                         timer_random_msec ());
+    }
+  rearm = timer_bench_elapsed (&start);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < count; i++)
+    THREAD_TIMER_OFF (timers[i]);
+  cancel = timer_bench_elapsed (&start);
+
+  XFREE (MTYPE_TMP, timers);
+
+  vty_out (vty, "%lu timers: arm %lu usec, re-arm %lu usec, cancel %lu usec%s",
+           count, arm, rearm, cancel, VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
+
 void
 test_init()
 {
   install_element (VIEW_NODE, &clear_foo_cmd);
+  install_element (VIEW_NODE, &benchmark_timers_cmd);
 }
@@ -0,0 +1,379 @@
+/*
+ * Access-list index test and benchmark.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Loads standard, extended and zebra access-lists long enough to be
+   indexed through the commands, checks access_list_apply() against a
+   plain scan of the same entries while entries come and go, and
+   times matching. */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "command.h"
+#include "vty.h"
+#include "filter.h"
+#include "memory.h"
+
+struct thread_master *master;
+
+#define ENTRIES  3000
+#define CHECKS   20000
+#define LOOKUPS  1000000
+
+extern struct cmd_element access_list_standard_cmd;
+extern struct cmd_element no_access_list_standard_cmd;
+extern struct cmd_element access_list_extended_cmd;
+extern struct cmd_element no_access_list_extended_cmd;
+extern struct cmd_element access_list_cmd;
+extern struct cmd_element no_access_list_cmd;
+extern struct cmd_element access_list_exact_cmd;
+extern struct cmd_element no_access_list_exact_cmd;
+
+enum kind
+{
+  STANDARD,
+  EXTENDED,
+  ZEBRA,
+  KINDS
+};
+
+static const char *names[KINDS] = { "10", "110", "bench" };
+
+struct entry
+{
+  enum kind kind;
+  int permit;
+
+  /* Cisco entries, addresses already under their wildcards. */
+  struct in_addr addr;
+  struct in_addr addr_mask;
+  struct in_addr mask;
+  struct in_addr mask_mask;
+
+  /* Zebra entries. */
+  struct prefix p;
+  int exact;
+
+  /* Whether the entry is in its list, and when it was put there. */
+  int present;
+  unsigned int order;
+};
+
+static struct vty *vty;
+static unsigned int clock_order;
+static u_int32_t seed = 1;
+
+static u_int32_t
+rnd (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) | ((seed & 0xffff) << 16);
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Wildcard bits, mostly contiguous, which the index can take, and a
+   few odd ones which it has to scan. */
+static u_int32_t
+rnd_wild (void)
+{
+  if (rnd () % 10 == 0)
+    return (rnd () & 0x000f0f00) | 0x100;
+  return (1 << (rnd () % 13)) - 1;
+}
+
+/* Everything within 10.0.0.0/8, so that lookups hit now and then. */
+static void
+rnd_entry (struct entry *e, enum kind kind)
+{
+  struct in_addr mask;
+  u_int32_t wild;
+
+  memset (e, 0, sizeof (struct entry));
+  e->kind = kind;
+  e->permit = (rnd () % 10) != 0;
+
+  if (kind == ZEBRA)
+    {
+      e->p.family = AF_INET;
+      e->p.prefixlen = 16 + rnd () % 17;
+      e->p.u.prefix4.s_addr = htonl (0x0a000000 | (rnd () & 0x00ffffff));
+      apply_mask (&e->p);
+      e->exact = (rnd () % 4) == 0;
+      return;
+    }
+
+  wild = rnd_wild ();
+  e->addr_mask.s_addr = htonl (wild);
+  e->addr.s_addr = htonl ((0x0a000000 | (rnd () & 0x00ffffff)) & ~wild);
+  if (kind == EXTENDED)
+    {
+      masklen2ip (16 + rnd () % 17, &mask);
+      e->mask_mask.s_addr = htonl ((rnd () % 2) ? 0xff : 0);
+      e->mask.s_addr = mask.s_addr & ~e->mask_mask.s_addr;
+    }
+}
+
+/* The lists take each filter once only, keep the entries apart. */
+static int
+same (struct entry *a, struct entry *b)
+{
+  if (a->kind != b->kind)
+    return 0;
+  if (a->kind == ZEBRA)
+    return a->exact == b->exact && prefix_same (&a->p, &b->p);
+  return a->addr.s_addr == b->addr.s_addr
+	 && a->addr_mask.s_addr == b->addr_mask.s_addr
+	 && a->mask.s_addr == b->mask.s_addr
+	 && a->mask_mask.s_addr == b->mask_mask.s_addr;
+}
+
+static void
+set (struct entry *e, int on)
+{
+  struct cmd_element *cmd;
+  char addr[INET_ADDRSTRLEN], addr_mask[INET_ADDRSTRLEN];
+  char mask[INET_ADDRSTRLEN], mask_mask[INET_ADDRSTRLEN];
+  char prefix[INET_ADDRSTRLEN + 3];
+  const char *argv[6];
+  int argc;
+
+  if (e->present == on)
+    return;
+
+  argv[0] = names[e->kind];
+  argv[1] = e->permit ? "permit" : "deny";
+
+  if (e->kind == ZEBRA)
+    {
+      inet_ntop (AF_INET, &e->p.u.prefix4, addr, sizeof (addr));
+      snprintf (prefix, sizeof (prefix), "%s/%d", addr, e->p.prefixlen);
+      argv[2] = prefix;
+      argc = 3;
+      if (e->exact)
+	cmd = on ? &access_list_exact_cmd : &no_access_list_exact_cmd;
+      else
+	cmd = on ? &access_list_cmd : &no_access_list_cmd;
+    }
+  else
+    {
+      argv[2] = inet_ntop (AF_INET, &e->addr, addr, sizeof (addr));
+      argv[3] = inet_ntop (AF_INET, &e->addr_mask, addr_mask,
+			   sizeof (addr_mask));
+      argc = 4;
+      if (e->kind == EXTENDED)
+	{
+	  argv[4] = inet_ntop (AF_INET, &e->mask, mask, sizeof (mask));
+	  argv[5] = inet_ntop (AF_INET, &e->mask_mask, mask_mask,
+			       sizeof (mask_mask));
+	  argc = 6;
+	  cmd = on ? &access_list_extended_cmd : &no_access_list_extended_cmd;
+	}
+      else
+	cmd = on ? &access_list_standard_cmd : &no_access_list_standard_cmd;
+    }
+
+  if (cmd->func (cmd, vty, argc, argv) == CMD_SUCCESS)
+    {
+      e->present = on;
+      e->order = clock_order++;
+    }
+}
+
+static int
+ref_match (struct entry *e, struct prefix *p)
+{
+  struct in_addr mask;
+
+  if (e->kind == ZEBRA)
+    {
+      if (e->exact && e->p.prefixlen != p->prefixlen)
+	return 0;
+      return prefix_match (&e->p, p);
+    }
+
+  if ((p->u.prefix4.s_addr & ~e->addr_mask.s_addr) != e->addr.s_addr)
+    return 0;
+  if (e->kind == EXTENDED)
+    {
+      masklen2ip (p->prefixlen, &mask);
+      if ((mask.s_addr & ~e->mask_mask.s_addr) != e->mask.s_addr)
+	return 0;
+    }
+  return 1;
+}
+
+/* What a scan of KIND's entries in list order says. */
+static enum filter_type
+ref_apply (struct entry *entries, int n, enum kind kind, struct prefix *p)
+{
+  struct entry *best = NULL;
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (entries[i].kind == kind && entries[i].present
+	&& (! best || entries[i].order < best->order)
+	&& ref_match (&entries[i], p))
+      best = &entries[i];
+  if (best)
+    return best->permit ? FILTER_PERMIT : FILTER_DENY;
+  return FILTER_DENY;
+}
+
+/* A prefix near one of the entries, or now and then anywhere in
+   10.0.0.0/8. */
+static void
+rnd_lookup (struct entry *entries, int n, struct prefix *p)
+{
+  struct entry *e = &entries[rnd () % n];
+
+  memset (p, 0, sizeof (struct prefix));
+  p->family = AF_INET;
+  p->prefixlen = 16 + rnd () % 17;
+  if (e->kind == ZEBRA)
+    {
+      p->u.prefix4 = e->p.u.prefix4;
+      if (rnd () % 2 && p->prefixlen < e->p.prefixlen)
+	p->prefixlen = e->p.prefixlen;
+    }
+  else
+    p->u.prefix4 = e->addr;
+  if (rnd () % 10 == 0)
+    p->u.prefix4.s_addr = htonl (0x0a000000 | (rnd () & 0x00ffffff));
+  p->u.prefix4.s_addr |= htonl (rnd () & 0xff);
+  apply_mask (p);
+}
+
+static int
+compare (struct entry *entries, int n, int count)
+{
+  struct access_list *access;
+  struct prefix p;
+  char buf[INET_ADDRSTRLEN];
+  enum kind kind;
+  int i, errors = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      kind = i % KINDS;
+      access = access_list_lookup (AFI_IP, names[kind]);
+      rnd_lookup (entries, n, &p);
+      if (access_list_apply (access, &p) != ref_apply (entries, n, kind, &p))
+	{
+	  printf ("mismatch in %s for %s/%d\n", names[kind],
+		  inet_ntop (AF_INET, &p.u.prefix4, buf, sizeof (buf)),
+		  p.prefixlen);
+	  errors++;
+	}
+    }
+  return errors;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct entry *entries;
+  struct access_list *access;
+  struct prefix *lookups;
+  struct timeval start;
+  double secs;
+  int n = ENTRIES;
+  int i, j, permitted, errors = 0;
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+
+  vty = vty_new ();
+
+  entries = XCALLOC (MTYPE_TMP, n * sizeof (struct entry));
+  lookups = XCALLOC (MTYPE_TMP, LOOKUPS * sizeof (struct prefix));
+  for (i = 0; i < n; i++)
+    do
+      {
+	rnd_entry (&entries[i], i % KINDS);
+	for (j = 0; j < i; j++)
+	  if (same (&entries[i], &entries[j]))
+	    break;
+      }
+    while (j < i);
+
+  for (i = 0; i < n; i++)
+    set (&entries[i], 1);
+  errors += compare (entries, n, CHECKS);
+
+  /* Take some away, put some back at the end of the lists, and empty
+     the lists down to where they are scanned again. */
+  for (i = 0; i < n; i += 4)
+    set (&entries[i], 0);
+  errors += compare (entries, n, CHECKS);
+  for (i = 0; i < n; i += 8)
+    set (&entries[i], 1);
+  errors += compare (entries, n, CHECKS);
+  for (i = KINDS * 8; i < n; i++)
+    set (&entries[i], 0);
+  errors += compare (entries, n, CHECKS);
+  for (i = 0; i < n; i++)
+    set (&entries[i], 1);
+  errors += compare (entries, n, CHECKS);
+
+  for (i = 0; i < LOOKUPS; i++)
+    rnd_lookup (entries, n, &lookups[i]);
+
+  access = access_list_lookup (AFI_IP, names[ZEBRA]);
+  gettimeofday (&start, NULL);
+  for (i = permitted = 0; i < LOOKUPS; i++)
+    if (access_list_apply (access, &lookups[i]) == FILTER_PERMIT)
+      permitted++;
+  secs = elapsed (&start);
+  printf ("index    %d lookups, %d permitted, %.3fs, %.2f Mlookups/s\n",
+	  LOOKUPS, permitted, secs, LOOKUPS / secs / 1000000);
+
+  gettimeofday (&start, NULL);
+  for (i = permitted = 0; i < CHECKS; i++)
+    if (ref_apply (entries, n, ZEBRA, &lookups[i]) == FILTER_PERMIT)
+      permitted++;
+  secs = elapsed (&start);
+  printf ("scan     %d lookups, %d permitted, %.3fs, %.2f Mlookups/s\n",
+	  CHECKS, permitted, secs, CHECKS / secs / 1000000);
+
+  for (i = 0; i < n; i++)
+    set (&entries[i], 0);
+  for (i = 0; i < KINDS; i++)
+    if (access_list_lookup (AFI_IP, names[i]) != NULL)
+      {
+	printf ("access-list %s left after removing its entries\n", names[i]);
+	errors++;
+      }
+
+  XFREE (MTYPE_TMP, entries);
+  XFREE (MTYPE_TMP, lookups);
+
+  printf ("%d errors\n", errors);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Prefix-list trie test and benchmark.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Loads a synthetic IRR style prefix-list through the ORF interface,
+   checks prefix_list_apply() against a plain scan of the same entries
+   while entries come and go, and times loading and matching. */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "command.h"
+#include "plist.h"
+#include "memory.h"
+
+struct thread_master *master;
+
+#define ENTRIES  200000
+#define CHECKS   1000
+#define REINSERT 2000
+#define LOOKUPS  2000000
+
+#define NAME "bench"
+
+struct entry
+{
+  struct orf_prefix orf;
+  int permit;
+  int present;
+};
+
+static u_int32_t seed = 1;
+
+static u_int32_t
+rnd (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) | ((seed & 0xffff) << 16);
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Mostly exact /19 to /24 routes, some with "le", a few short
+   aggregates with "ge". */
+static void
+rnd_entry (struct entry *e, int seq)
+{
+  struct prefix *p = &e->orf.p;
+  u_int32_t r = rnd () % 100;
+
+  memset (e, 0, sizeof (struct entry));
+  p->family = AF_INET;
+  p->prefixlen = 19 + rnd () % 6;
+  if (r >= 95)
+    p->prefixlen = 8 + rnd () % 8;
+  p->u.prefix4.s_addr = htonl (rnd ());
+  apply_mask (p);
+
+  if (r >= 95)
+    e->orf.ge = p->prefixlen + 1 + rnd () % 8;
+  else if (r >= 75)
+    e->orf.le = p->prefixlen + 1 + rnd () % (IPV4_MAX_BITLEN - p->prefixlen);
+
+  e->orf.seq = seq;
+  e->permit = (rnd () % 10) != 0;
+}
+
+static void
+set (struct entry *e, int on)
+{
+  if (prefix_bgp_orf_set (NAME, AFI_IP, &e->orf, e->permit, on) == CMD_SUCCESS)
+    e->present = on;
+}
+
+static int
+ref_match (struct orf_prefix *orf, struct prefix *p)
+{
+  if (! prefix_match (&orf->p, p))
+    return 0;
+  if (! orf->le && ! orf->ge)
+    return orf->p.prefixlen == p->prefixlen;
+  if (orf->le && p->prefixlen > orf->le)
+    return 0;
+  if (orf->ge && p->prefixlen < orf->ge)
+    return 0;
+  return 1;
+}
+
+/* What a scan of the entries in seq order says. */
+static enum prefix_list_type
+ref_apply (struct entry *entries, int n, struct prefix *p)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (entries[i].present && ref_match (&entries[i].orf, p))
+      return entries[i].permit ? PREFIX_PERMIT : PREFIX_DENY;
+  return PREFIX_DENY;
+}
+
+/* A prefix at or under one of the entries, or now and then anywhere. */
+static void
+rnd_lookup (struct entry *entries, int n, struct prefix *p)
+{
+  struct prefix *base = &entries[rnd () % n].orf.p;
+
+  prefix_copy (p, base);
+  if (rnd () % 10 == 0)
+    p->u.prefix4.s_addr = htonl (rnd ());
+  if (rnd () % 2)
+    p->prefixlen += rnd () % (IPV4_MAX_BITLEN - p->prefixlen + 1);
+  p->u.prefix4.s_addr |= htonl (rnd ());
+  apply_mask (p);
+}
+
+static int
+compare (struct entry *entries, int n, int count)
+{
+  struct prefix_list *plist;
+  struct prefix p;
+  char buf[INET_ADDRSTRLEN];
+  int i, errors = 0;
+
+  plist = prefix_list_lookup (AFI_ORF_PREFIX, NAME);
+  for (i = 0; i < count; i++)
+    {
+      rnd_lookup (entries, n, &p);
+      if (prefix_list_apply (plist, &p) != ref_apply (entries, n, &p))
+	{
+	  printf ("mismatch for %s/%d\n",
+		  inet_ntop (AF_INET, &p.u.prefix4, buf, sizeof (buf)),
+		  p.prefixlen);
+	  errors++;
+	}
+    }
+  return errors;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct entry *entries;
+  struct prefix_list *plist;
+  struct prefix *lookups;
+  struct timeval start;
+  double secs;
+  int n = ENTRIES;
+  int i, permitted, errors = 0;
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+
+  entries = XCALLOC (MTYPE_TMP, n * sizeof (struct entry));
+  lookups = XCALLOC (MTYPE_TMP, LOOKUPS * sizeof (struct prefix));
+  for (i = 0; i < n; i++)
+    rnd_entry (&entries[i], (i + 1) * 5);
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < n; i++)
+    set (&entries[i], 1);
+  plist = prefix_list_lookup (AFI_ORF_PREFIX, NAME);
+  printf ("loaded %d entries in %.3fs\n", plist->count, elapsed (&start));
+
+  errors += compare (entries, n, CHECKS);
+
+  /* Take a third away and put some back, now out of seq order. */
+  for (i = 0; i < n; i += 3)
+    set (&entries[i], 0);
+  errors += compare (entries, n, CHECKS);
+  for (i = 3 * (REINSERT - 1); i >= 0; i -= 3)
+    if (i < n)
+      set (&entries[i], 1);
+  errors += compare (entries, n, CHECKS);
+
+  for (i = 0; i < LOOKUPS; i++)
+    rnd_lookup (entries, n, &lookups[i]);
+
+  gettimeofday (&start, NULL);
+  for (i = permitted = 0; i < LOOKUPS; i++)
+    if (prefix_list_apply (plist, &lookups[i]) == PREFIX_PERMIT)
+      permitted++;
+  secs = elapsed (&start);
+  printf ("trie     %d lookups, %d permitted, %.3fs, %.2f Mlookups/s\n",
+	  LOOKUPS, permitted, secs, LOOKUPS / secs / 1000000);
+
+  gettimeofday (&start, NULL);
+  for (i = permitted = 0; i < CHECKS; i++)
+    if (ref_apply (entries, n, &lookups[i]) == PREFIX_PERMIT)
+      permitted++;
+  secs = elapsed (&start);
+  printf ("scan     %d lookups, %d permitted, %.3fs, %.2f Mlookups/s\n",
+	  CHECKS, permitted, secs, CHECKS / secs / 1000000);
+
+  prefix_bgp_orf_remove_all (NAME);
+  if (prefix_list_lookup (AFI_ORF_PREFIX, NAME) != NULL)
+    {
+      printf ("prefix-list left after removing it\n");
+      errors++;
+    }
+
+  XFREE (MTYPE_TMP, entries);
+  XFREE (MTYPE_TMP, lookups);
+
+  printf ("%d errors\n", errors);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Route table longest prefix match index test and benchmark.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Fills two route tables with the same synthetic full table, only one
+   of them with route_table_lpm_enable(), checks that both give the
+   same answers while routes come and go, and times host lookups. */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+
+struct thread_master *master;
+
+#define PREFIXES 900000
+#define LOOKUPS  4000000
+
+static u_int32_t seed = 1;
+
+static u_int32_t
+rnd (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) | ((seed & 0xffff) << 16);
+}
+
+/* Roughly the length distribution of the Internet table. */
+static int
+rnd_len (void)
+{
+  u_int32_t r = rnd () % 100;
+
+  if (r < 58)
+    return 24;
+  if (r < 70)
+    return 22 + rnd () % 2;
+  if (r < 88)
+    return 16 + rnd () % 6;
+  if (r < 92)
+    return 8 + rnd () % 8;
+  if (r < 99)
+    return 25 + rnd () % 8;
+  return rnd () % 8;
+}
+
+static void
+rnd_prefix (struct prefix_ipv4 *p)
+{
+  p->family = AF_INET;
+  p->prefixlen = rnd_len ();
+  p->prefix.s_addr = htonl (rnd ());
+  apply_mask_ipv4 (p);
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void
+add (struct route_table *table, struct prefix_ipv4 *p)
+{
+  struct route_node *rn;
+
+  rn = route_node_get (table, (struct prefix *) p);
+  if (rn->info)
+    route_unlock_node (rn);
+  else
+    rn->info = rn;
+}
+
+static void
+del (struct route_table *table, struct prefix_ipv4 *p)
+{
+  struct route_node *rn;
+
+  rn = route_node_lookup (table, (struct prefix *) p);
+  if (rn == NULL)
+    return;
+  route_unlock_node (rn);
+  rn->info = NULL;
+  route_unlock_node (rn);
+}
+
+static int
+compare (struct route_table *plain, struct route_table *indexed, int count)
+{
+  struct route_node *a, *b;
+  struct in_addr addr;
+  int i, errors = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      addr.s_addr = htonl (rnd ());
+      a = route_node_match_ipv4 (plain, &addr);
+      b = route_node_match_ipv4 (indexed, &addr);
+      if ((a == NULL) != (b == NULL)
+	  || (a && ! prefix_same (&a->p, &b->p)))
+	{
+	  printf ("mismatch for %s\n", inet_ntoa (addr));
+	  errors++;
+	}
+      if (a)
+	route_unlock_node (a);
+      if (b)
+	route_unlock_node (b);
+    }
+  return errors;
+}
+
+static void
+bench (const char *name, struct route_table *table,
+       const struct in_addr *addrs, int count)
+{
+  struct route_node *rn;
+  struct timeval start;
+  double secs;
+  int i, found = 0;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < count; i++)
+    if ((rn = route_node_match_ipv4 (table, &addrs[i])) != NULL)
+      {
+	found++;
+	route_unlock_node (rn);
+      }
+  secs = elapsed (&start);
+  printf ("%-8s %d lookups, %d matched, %.3fs, %.2f Mlookups/s\n",
+	  name, count, found, secs, count / secs / 1000000);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct route_table *plain, *indexed;
+  struct prefix_ipv4 *prefixes;
+  struct in_addr *addrs;
+  struct timeval start;
+  int n = PREFIXES;
+  int i, errors = 0;
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+
+  prefixes = XCALLOC (MTYPE_TMP, n * sizeof (struct prefix_ipv4));
+  addrs = XCALLOC (MTYPE_TMP, LOOKUPS * sizeof (struct in_addr));
+  for (i = 0; i < n; i++)
+    rnd_prefix (&prefixes[i]);
+
+  plain = route_table_init ();
+  indexed = route_table_init ();
+
+  /* Index half of the table in bulk, the rest as it is added. */
+  gettimeofday (&start, NULL);
+  for (i = 0; i < n / 2; i++)
+    add (plain, &prefixes[i]);
+  for (i = 0; i < n; i++)
+    add (indexed, &prefixes[i]);
+  printf ("loaded %d prefixes in %.3fs\n", n, elapsed (&start));
+  route_table_lpm_enable (indexed);
+  for (i = n / 2; i < n; i++)
+    add (plain, &prefixes[i]);
+
+  errors += compare (plain, indexed, 200000);
+
+  /* Take a third away and put some back. */
+  for (i = 0; i < n; i += 3)
+    {
+      del (plain, &prefixes[i]);
+      del (indexed, &prefixes[i]);
+    }
+  errors += compare (plain, indexed, 200000);
+  for (i = 0; i < n; i += 6)
+    {
+      add (plain, &prefixes[i]);
+      add (indexed, &prefixes[i]);
+    }
+  errors += compare (plain, indexed, 200000);
+
+  /* Mostly addresses that hit, the way nexthops do. */
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      struct prefix_ipv4 *p = &prefixes[rnd () % n];
+
+      addrs[i].s_addr = p->prefix.s_addr;
+      if (i % 10 && p->prefixlen < IPV4_MAX_PREFIXLEN)
+	addrs[i].s_addr |= htonl (rnd () >> p->prefixlen);
+      else if (i % 10 == 0)
+	addrs[i].s_addr = htonl (rnd ());
+    }
+  bench ("radix", plain, addrs, LOOKUPS);
+  bench ("lpm", indexed, addrs, LOOKUPS);
+
+  for (i = 0; i < n; i++)
+    {
+      del (plain, &prefixes[i]);
+      del (indexed, &prefixes[i]);
+    }
+  if (indexed->top != NULL)
+    {
+      printf ("table not empty after deleting everything\n");
+      errors++;
+    }
+
+  route_table_finish (plain);
+  route_table_finish (indexed);
+  XFREE (MTYPE_TMP, prefixes);
+  XFREE (MTYPE_TMP, addrs);
+
+  printf ("%d errors\n", errors);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * ZAPI route message benchmark.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Adds and deletes a full table worth of routes in a running zebra, one
+   message per route and then batched, and times how long zebra takes to
+   read them, a nexthop lookup answered telling when it is done.  Point
+   it at a zebra linked with kernel_null.c in place of the kernel methods
+   to leave the kernel out of it:
+
+     testzapi [-s zserv-socket] [routes]
+
+   The routes are sent as BGP routes, so do not run a bgpd on the same
+   zebra, zebra drops them when the benchmark disconnects. */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "stream.h"
+#include "thread.h"
+#include "zclient.h"
+
+struct thread_master *master;
+
+#define ROUTES 900000
+
+static struct zclient *zclient;
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Wait for zebra's answer of type COMMAND, skipping anything else. */
+static int
+wait_for (uint16_t command)
+{
+  struct stream *s = zclient->ibuf;
+  uint16_t length;
+
+  for (;;)
+    {
+      stream_reset (s);
+      if (stream_read (s, zclient->sock, ZEBRA_HEADER_SIZE)
+	  != ZEBRA_HEADER_SIZE)
+	return -1;
+      length = stream_getw (s);
+      stream_forward_getp (s, 2);
+      if (length < ZEBRA_HEADER_SIZE || length > STREAM_SIZE (s))
+	return -1;
+      if (length > ZEBRA_HEADER_SIZE
+	  && stream_read (s, zclient->sock, length - ZEBRA_HEADER_SIZE)
+	     != length - ZEBRA_HEADER_SIZE)
+	return -1;
+      if (stream_getw (s) == command)
+	return 0;
+    }
+}
+
+/* Zebra answers in order, so once it has looked up an address it has
+   read all the routes sent before. */
+static int
+sync_zebra (void)
+{
+  struct stream *s = zclient->obuf;
+  struct in_addr addr;
+
+  addr.s_addr = htonl (0x10000001);
+  stream_reset (s);
+  zclient_create_header (s, ZEBRA_IPV4_NEXTHOP_LOOKUP);
+  stream_put_in_addr (s, &addr);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  if (zclient_send_message (zclient) < 0)
+    return -1;
+  return wait_for (ZEBRA_IPV4_NEXTHOP_LOOKUP);
+}
+
+static int
+hello (void)
+{
+  struct stream *s = zclient->obuf;
+
+  stream_reset (s);
+  zclient_create_header (s, ZEBRA_HELLO);
+  stream_putc (s, ZEBRA_ROUTE_BGP);
+  stream_putc (s, ZEBRA_CAP_ALL);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  if (zclient_send_message (zclient) < 0
+      || wait_for (ZEBRA_HELLO) < 0)
+    return -1;
+  zclient->caps = stream_getc (zclient->ibuf);
+  return 0;
+}
+
+/* Send N /24s from 16.0.0.0 on, all with the same nexthop. */
+static double
+push (u_char cmd, int n, int batch)
+{
+  struct zapi_ipv4 api;
+  struct prefix_ipv4 p;
+  struct in_addr gate, *nexthop = &gate;
+  struct timeval start;
+  int i;
+
+  memset (&api, 0, sizeof (api));
+  api.type = ZEBRA_ROUTE_BGP;
+  api.safi = SAFI_UNICAST;
+  SET_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP);
+  api.nexthop_num = 1;
+  api.nexthop = &nexthop;
+  SET_FLAG (api.message, ZAPI_MESSAGE_METRIC);
+  gate.s_addr = htonl (0xc0000201);
+
+  memset (&p, 0, sizeof (p));
+  p.family = AF_INET;
+  p.prefixlen = 24;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < n; i++)
+    {
+      p.prefix.s_addr = htonl (0x10000000 + (i << 8));
+      if ((batch ? zapi_ipv4_route_batch (cmd, zclient, &p, &api)
+	   : zapi_ipv4_route (cmd, zclient, &p, &api)) < 0)
+	return -1;
+    }
+  if (zclient_batch_flush (zclient) < 0 || sync_zebra () < 0)
+    return -1;
+  return elapsed (&start);
+}
+
+static int
+run (const char *name, int n, int batch)
+{
+  double add, del;
+
+  if ((add = push (ZEBRA_IPV4_ROUTE_ADD, n, batch)) < 0
+      || (del = push (ZEBRA_IPV4_ROUTE_DELETE, n, batch)) < 0)
+    {
+      printf ("lost zebra\n");
+      return -1;
+    }
+  printf ("%-8s %d routes, added in %.3fs (%.0f/s), deleted in %.3fs (%.0f/s)\n",
+	  name, n, add, n / add, del, n / del);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int n = ROUTES;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "s:")) != -1)
+    if (opt == 's')
+      zclient_serv_path_set (optarg);
+  if (optind < argc)
+    n = atoi (argv[optind]);
+
+  master = thread_master_create ();
+  zclient = zclient_new ();
+  zclient->sock = -1;
+  if (zclient_socket_connect (zclient) < 0)
+    {
+      printf ("can't connect to zebra\n");
+      return 1;
+    }
+
+  if (hello () < 0)
+    {
+      printf ("no answer to hello, zebra too old?\n");
+      return 1;
+    }
+
+  if (run ("single", n, 0) < 0)
+    return 1;
+  if (! CHECK_FLAG (zclient->caps, ZEBRA_CAP_ROUTE_BATCH))
+    {
+      printf ("zebra does not batch routes\n");
+      return 1;
+    }
+  if (run ("batched", n, 1) < 0)
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * Shared memory ring test and benchmark.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* A child process sends route sized ZAPI messages to its parent, first
+   over a socket pair, written one at a time and read header and then
+   body as zebra does, and then through a pair of rings.  Checks they
+   all arrive in order and prints how many a second get through:
+
+     testzring [messages]  */
+
+#include <zebra.h>
+
+#include <sys/wait.h>
+#include <poll.h>
+
+#include "stream.h"
+#include "zclient.h"
+#include "zring.h"
+
+struct thread_master *master;
+
+#define MESSAGES 2000000
+
+/* About an IPv4 route with one nexthop.  */
+#define MSGSIZE  32
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void
+fill (struct stream *s, u_int32_t seq)
+{
+  stream_reset (s);
+  stream_putw (s, MSGSIZE);
+  stream_putc (s, ZEBRA_HEADER_MARKER);
+  stream_putc (s, ZSERV_VERSION);
+  stream_putw (s, ZEBRA_IPV4_ROUTE_ADD);
+  stream_putl (s, seq);
+  while (stream_get_endp (s) < MSGSIZE)
+    stream_putc (s, 0);
+}
+
+/* Is this message number SEQ?  */
+static int
+check (struct stream *s, u_int32_t seq)
+{
+  stream_set_getp (s, 0);
+  if (stream_getw (s) != MSGSIZE)
+    return -1;
+  stream_forward_getp (s, 4);
+  return stream_getl (s) == seq ? 0 : -1;
+}
+
+static int
+full_write (int fd, u_char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len)
+    {
+      if ((n = write (fd, buf, len)) < 0)
+	return -1;
+      buf += n;
+      len -= n;
+    }
+  return 0;
+}
+
+static int
+full_read (int fd, struct stream *s, size_t len)
+{
+  ssize_t n;
+
+  while (len)
+    {
+      if ((n = stream_read_try (s, fd, len)) <= 0)
+	return -1;
+      len -= n;
+    }
+  return 0;
+}
+
+static int
+finish (pid_t pid, int errors)
+{
+  int status;
+
+  if (waitpid (pid, &status, 0) < 0
+      || ! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    errors++;
+  return errors;
+}
+
+static int
+bench_socket (u_int32_t n)
+{
+  struct stream *s = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  struct timeval start;
+  u_int32_t seq;
+  int sv[2];
+  pid_t pid;
+  double secs;
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    return 1;
+
+  gettimeofday (&start, NULL);
+  if ((pid = fork ()) == 0)
+    {
+      close (sv[0]);
+      for (seq = 0; seq < n; seq++)
+	{
+	  fill (s, seq);
+	  if (full_write (sv[1], STREAM_DATA (s), stream_get_endp (s)) < 0)
+	    _exit (1);
+	}
+      _exit (0);
+    }
+  close (sv[1]);
+
+  for (seq = 0; seq < n; seq++)
+    {
+      stream_reset (s);
+      if (full_read (sv[0], s, ZEBRA_HEADER_SIZE) < 0
+	  || full_read (sv[0], s, MSGSIZE - ZEBRA_HEADER_SIZE) < 0
+	  || check (s, seq) < 0)
+	break;
+    }
+  secs = elapsed (&start);
+  close (sv[0]);
+  stream_free (s);
+
+  printf ("socket   %u of %u messages in %.3fs, %.2f Mmsgs/s\n",
+	  seq, n, secs, seq / secs / 1000000);
+  return finish (pid, seq != n);
+}
+
+#ifdef HAVE_ZRING
+static void
+wait_for (struct zring *r)
+{
+  struct pollfd pfd;
+
+  pfd.fd = zring_fd (r);
+  pfd.events = POLLIN;
+  poll (&pfd, 1, -1);
+  zring_clear (r);
+}
+
+static int
+bench_ring (u_int32_t n)
+{
+  struct stream *s = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  struct zring *client, *server;
+  struct timeval start;
+  unsigned long sleeps = 0;
+  int fds[ZRING_NFDS];
+  u_int32_t seq;
+  pid_t pid;
+  double secs;
+  int i, ret;
+
+  if ((client = zring_new (ZRING_SIZE_DEFAULT)) == NULL)
+    return 1;
+  zring_fds (client, fds);
+  for (i = 0; i < ZRING_NFDS; i++)
+    fds[i] = dup (fds[i]);
+  if ((server = zring_attach (ZRING_SIZE_DEFAULT, fds)) == NULL)
+    return 1;
+
+  gettimeofday (&start, NULL);
+  if ((pid = fork ()) == 0)
+    {
+      zring_free (server);
+      for (seq = 0; seq < n; seq++)
+	{
+	  fill (s, seq);
+	  if (zring_send (client, s) < 0)
+	    _exit (1);
+	  while (zring_backlog (client))
+	    {
+	      wait_for (client);
+	      if (zring_flush (client) < 0)
+		_exit (1);
+	    }
+	}
+      _exit (0);
+    }
+  zring_free (client);
+
+  for (seq = 0; seq < n; )
+    {
+      stream_reset (s);
+      if ((ret = zring_recv (server, s)) < 0)
+	break;
+      if (ret == 0)
+	{
+	  if (zring_sleep (server))
+	    {
+	      wait_for (server);
+	      sleeps++;
+	    }
+	  continue;
+	}
+      if (check (s, seq) < 0)
+	break;
+      seq++;
+    }
+  secs = elapsed (&start);
+  zring_free (server);
+  stream_free (s);
+
+  printf ("ring     %u of %u messages in %.3fs, %.2f Mmsgs/s, %lu wakeups\n",
+	  seq, n, secs, seq / secs / 1000000, sleeps);
+  return finish (pid, seq != n);
+}
+#endif /* HAVE_ZRING */
+
+int
+main (int argc, char **argv)
+{
+  u_int32_t n = MESSAGES;
+  int errors = 0;
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+
+  errors += bench_socket (n);
+#ifdef HAVE_ZRING
+  errors += bench_ring (n);
+#else
+  printf ("no shared memory rings here\n");
+#endif /* HAVE_ZRING */
+
+  printf ("%d errors\n", errors);
+  return errors ? 1 : 0;
+}
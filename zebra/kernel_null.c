@@ -39,3 +39,8 @@ int kernel_address_delete_ipv4 (struct interface *a, struct connected *b)
 
 void kernel_init (void) { return; }
 #pragma weak route_read = kernel_init
+#ifdef HAVE_NETLINK
+#pragma weak netlink_route_flush = kernel_init
+int kernel_nhg_update (struct nhg *a) { return 1; }
+void kernel_nhg_delete (struct nhg *a) { return; }
+#endif /* HAVE_NETLINK */
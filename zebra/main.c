@@ -36,9 +36,12 @@
 #include "zebra/rib.h"
 #include "zebra/zserv.h"
 #include "zebra/debug.h"
+#include "zebra/rt.h"
 #include "zebra/router-id.h"
 #include "zebra/irdp.h"
 #include "zebra/rtadv.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_nhg.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -169,6 +172,10 @@ sigint (void)
 
   if (!retain_mode)
     rib_close ();
+  zebra_dplane_finish ();
+#ifdef HAVE_NETLINK
+  netlink_route_flush ();
+#endif /* HAVE_NETLINK */
 #ifdef HAVE_IRDP
   irdp_finish();
 #endif
@@ -321,6 +328,8 @@ main (int argc, char **argv)
   /* Zebra related initialize. */
   zebra_init ();
   rib_init ();
+  zebra_dplane_init ();
+  zebra_nhg_init ();
   zebra_if_init ();
   zebra_debug_init ();
   router_id_init();
@@ -30,6 +30,8 @@
 #include "zclient.h"
 #include "linklist.h"
 #include "log.h"
+#include "memory.h"
+#include "thread.h"
 
 #include "zebra/rib.h"
 #include "zebra/zserv.h"
@@ -84,56 +86,263 @@ is_default (struct prefix *p)
   return 0;
 }
 
+/* Routes are not sent to clients as they change, but queued per client
+   and prefix, so that a route changing several times in a row is sent
+   once, and sent along with the others in a few large writes rather
+   than one write each.  The queue is worked off a little after the
+   first route is queued, and only as far as the client keeps up
+   reading: no more than ZEBRA_REDIST_WB_MAX bytes are left in its
+   write buffer, or waiting for room in its ring, the rest waits until
+   those have been written out.
+
+   What is queued for a prefix is only that it is to be looked at again,
+   and what to withdraw if nothing is to be sent for it any more.  A
+   route that comes and goes again before the client is sent it leaves
+   nothing queued.  */
+#define ZEBRA_REDIST_DELAY_MSEC		10
+#define ZEBRA_REDIST_WB_MAX		(1024 * 1024)
+
+struct redist_pending
+{
+  /* The route to withdraw, the client having been sent it.  */
+  int withdraw;
+  int type;
+  u_char flags;
+  int has_nexthop;
+  struct nexthop nexthop;
+
+  /* Queued by redistribute_add() with nothing in the client to replace. */
+  int fresh;
+};
+
+static int zebra_redistribute_run (struct thread *);
+
+/* Does the client want routes of TYPE for P?  */
+static int
+redistribute_wanted (struct zserv *client, struct prefix *p, int type)
+{
+  if (is_default (p) && client->redist_default)
+    return 1;
+  return client->redist[type];
+}
+
 static void
-zebra_redistribute_default (struct zserv *client)
+redistribute_schedule (struct zserv *client, long msec)
+{
+  if (client->t_redist)
+    return;
+  if (msec)
+    client->t_redist = thread_add_timer_msec (zebrad.master,
+					      zebra_redistribute_run,
+					      client, msec);
+  else
+    client->t_redist = thread_add_event (zebrad.master,
+					 zebra_redistribute_run, client, 0);
+}
+
+/* Queue P to be sent to CLIENT.  FRESH only counts for a prefix not
+   queued yet.  */
+static struct redist_pending *
+redistribute_queue (struct zserv *client, struct prefix *p, int fresh)
+{
+  struct redist_pending *pending;
+  struct route_table **table;
+  struct route_node *rn;
+
+  table = &client->redist_queue[p->family == AF_INET ? 0 : 1];
+  if (! *table)
+    *table = route_table_init ();
+
+  rn = route_node_get (*table, p);
+  if (rn->info)
+    {
+      route_unlock_node (rn);
+      return rn->info;
+    }
+
+  pending = XCALLOC (MTYPE_REDIST_PENDING, sizeof (struct redist_pending));
+  pending->fresh = fresh;
+  rn->info = pending;
+  client->redist_queued++;
+  redistribute_schedule (client, ZEBRA_REDIST_DELAY_MSEC);
+  return pending;
+}
+
+/* Forget what is queued for P.  */
+static void
+redistribute_unqueue (struct zserv *client, struct prefix *p)
 {
-  struct prefix_ipv4 p;
   struct route_table *table;
   struct route_node *rn;
-  struct rib *newrib;
-#ifdef HAVE_IPV6
-  struct prefix_ipv6 p6;
-#endif /* HAVE_IPV6 */
 
+  table = client->redist_queue[p->family == AF_INET ? 0 : 1];
+  rn = route_node_lookup (table, p);
 
-  /* Lookup default route. */
-  memset (&p, 0, sizeof (struct prefix_ipv4));
-  p.family = AF_INET;
+  XFREE (MTYPE_REDIST_PENDING, rn->info);
+  rn->info = NULL;
+  route_unlock_node (rn);
+  route_unlock_node (rn);
+  client->redist_queued--;
+}
 
-  /* Lookup table.  */
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (table)
+/* The route at P the client is to have now, if any.  */
+static struct rib *
+redistribute_current (struct zserv *client, struct route_table *table,
+		      struct prefix *p)
+{
+  struct route_node *rn;
+  struct rib *rib;
+
+  if (! table || ! (rn = route_node_lookup (table, p)))
+    return NULL;
+
+  for (rib = rn->info; rib; rib = rib->next)
+    if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
+	&& rib->distance != DISTANCE_INFINITY
+	&& redistribute_wanted (client, p, rib->type))
+      break;
+
+  route_unlock_node (rn);
+  return rib;
+}
+
+/* Send what is queued for P, returns the number of bytes sent.  */
+static size_t
+redistribute_send (struct zserv *client, struct route_table *table,
+		   struct prefix *p, struct redist_pending *pending)
+{
+  struct rib *rib;
+  struct rib old;
+  int ipv4 = (p->family == AF_INET);
+  size_t sent = 0;
+
+  rib = redistribute_current (client, table, p);
+
+  /* Routes of the same type replace each other in the client.  */
+  if (pending->withdraw
+      && (! rib || rib->type != pending->type)
+      && redistribute_wanted (client, p, pending->type))
     {
-      rn = route_node_lookup (table, (struct prefix *)&p);
-      if (rn)
-	{
-	  for (newrib = rn->info; newrib; newrib = newrib->next)
-	    if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
-		&& newrib->distance != DISTANCE_INFINITY)
-	      zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
-	  route_unlock_node (rn);
-	}
+      memset (&old, 0, sizeof (struct rib));
+      old.type = pending->type;
+      old.flags = pending->flags;
+      if (pending->has_nexthop)
+	old.nexthop = &pending->nexthop;
+      zsend_route_multipath (ipv4 ? ZEBRA_IPV4_ROUTE_DELETE
+			     : ZEBRA_IPV6_ROUTE_DELETE, client, p, &old);
+      sent += stream_get_endp (client->obuf);
     }
 
-#ifdef HAVE_IPV6
-  /* Lookup default route. */
-  memset (&p6, 0, sizeof (struct prefix_ipv6));
-  p6.family = AF_INET6;
+  if (rib)
+    {
+      zsend_route_multipath (ipv4 ? ZEBRA_IPV4_ROUTE_ADD
+			     : ZEBRA_IPV6_ROUTE_ADD, client, p, rib);
+      sent += stream_get_endp (client->obuf);
+    }
+  return sent;
+}
 
-  /* Lookup table.  */
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (table)
+/* Work off the queue of a client, as far as its write buffer allows.  */
+static int
+zebra_redistribute_run (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+  struct route_table *table;
+  struct route_node *rn;
+  struct redist_pending *pending;
+  size_t buffered;
+  int i;
+
+  client->t_redist = NULL;
+
+  buffered = zebra_server_pending (client);
+  if (buffered >= ZEBRA_REDIST_WB_MAX)
+    return 0;
+
+  client->corked = 1;
+  for (i = 0; i < 2 && buffered < ZEBRA_REDIST_WB_MAX; i++)
     {
-      rn = route_node_lookup (table, (struct prefix *)&p6);
-      if (rn)
+      if (! client->redist_queue[i])
+	continue;
+
+      table = vrf_table (i == 0 ? AFI_IP : AFI_IP6, SAFI_UNICAST, 0);
+      for (rn = route_top (client->redist_queue[i]); rn; rn = route_next (rn))
 	{
-	  for (newrib = rn->info; newrib; newrib = newrib->next)
-	    if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
-		&& newrib->distance != DISTANCE_INFINITY)
-	      zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
+	  if ((pending = rn->info) == NULL)
+	    continue;
+
+	  if (buffered >= ZEBRA_REDIST_WB_MAX)
+	    {
+	      route_unlock_node (rn);
+	      break;
+	    }
+
+	  buffered += redistribute_send (client, table, &rn->p, pending);
+
+	  XFREE (MTYPE_REDIST_PENDING, pending);
+	  rn->info = NULL;
 	  route_unlock_node (rn);
+	  client->redist_queued--;
 	}
     }
+  zebra_server_uncork (client);
+
+  /* Go on if the client took it all, or once it did.  */
+  if (client->redist_queued && zebra_server_pending (client) == 0)
+    redistribute_schedule (client, 0);
+  return 0;
+}
+
+/* The client's write buffer has been written out.  */
+void
+zebra_redistribute_resume (struct zserv *client)
+{
+  if (client->redist_queued)
+    redistribute_schedule (client, 0);
+}
+
+/* Drop what is queued for a client going away.  */
+void
+zebra_redistribute_client_close (struct zserv *client)
+{
+  struct route_node *rn;
+  int i;
+
+  THREAD_OFF (client->t_redist);
+
+  for (i = 0; i < 2; i++)
+    if (client->redist_queue[i])
+      {
+	for (rn = route_top (client->redist_queue[i]); rn; rn = route_next (rn))
+	  if (rn->info)
+	    {
+	      XFREE (MTYPE_REDIST_PENDING, rn->info);
+	      rn->info = NULL;
+	      route_unlock_node (rn);
+	    }
+	route_table_finish (client->redist_queue[i]);
+	client->redist_queue[i] = NULL;
+      }
+  client->redist_queued = 0;
+}
+
+static void
+zebra_redistribute_default (struct zserv *client)
+{
+  struct prefix_ipv4 p;
+#ifdef HAVE_IPV6
+  struct prefix_ipv6 p6;
+#endif /* HAVE_IPV6 */
+
+  /* Look at the default routes again.  */
+  memset (&p, 0, sizeof (struct prefix_ipv4));
+  p.family = AF_INET;
+  redistribute_queue (client, (struct prefix *) &p, 0);
+
+#ifdef HAVE_IPV6
+  memset (&p6, 0, sizeof (struct prefix_ipv6));
+  p6.family = AF_INET6;
+  redistribute_queue (client, (struct prefix *) &p6, 0);
 #endif /* HAVE_IPV6 */
 }
 
@@ -153,7 +362,7 @@ zebra_redistribute (struct zserv *client, int type)
 	    && newrib->type == type 
 	    && newrib->distance != DISTANCE_INFINITY
 	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
+	  redistribute_queue (client, &rn->p, 0);
   
 #ifdef HAVE_IPV6
   table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
@@ -164,7 +373,7 @@ zebra_redistribute (struct zserv *client, int type)
 	    && newrib->type == type 
 	    && newrib->distance != DISTANCE_INFINITY
 	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
+	  redistribute_queue (client, &rn->p, 0);
 #endif /* HAVE_IPV6 */
 }
 
@@ -175,29 +384,8 @@ redistribute_add (struct prefix *p, struct rib *rib)
   struct zserv *client;
 
   for (ALL_LIST_ELEMENTS (zebrad.client_list, node, nnode, client))
-    {
-      if (is_default (p))
-        {
-          if (client->redist_default || client->redist[rib->type])
-            {
-              if (p->family == AF_INET)
-                zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, p, rib);
-#ifdef HAVE_IPV6
-              if (p->family == AF_INET6)
-                zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, p, rib);
-#endif /* HAVE_IPV6 */	  
-	    }
-        }
-      else if (client->redist[rib->type])
-        {
-          if (p->family == AF_INET)
-            zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, p, rib);
-#ifdef HAVE_IPV6
-          if (p->family == AF_INET6)
-            zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, p, rib);
-#endif /* HAVE_IPV6 */	  
-        }
-    }
+    if (redistribute_wanted (client, p, rib->type))
+      redistribute_queue (client, p, 1);
 }
 
 void
@@ -205,37 +393,42 @@ redistribute_delete (struct prefix *p, struct rib *rib)
 {
   struct listnode *node, *nnode;
   struct zserv *client;
+  struct redist_pending *pending;
+  struct nexthop *nexthop;
 
   /* Add DISTANCE_INFINITY check. */
   if (rib->distance == DISTANCE_INFINITY)
     return;
 
   for (ALL_LIST_ELEMENTS (zebrad.client_list, node, nnode, client))
-    {
-      if (is_default (p))
-	{
-	  if (client->redist_default || client->redist[rib->type])
+    if (redistribute_wanted (client, p, rib->type))
+      {
+	pending = redistribute_queue (client, p, 0);
+
+	/* Added and gone again before the client was sent it.  */
+	if (pending->fresh)
+	  {
+	    redistribute_unqueue (client, p);
+	    continue;
+	  }
+
+	/* Of several routes in a row, the client knows the first.  */
+	if (pending->withdraw)
+	  continue;
+
+	pending->withdraw = 1;
+	pending->type = rib->type;
+	pending->flags = rib->flags;
+	for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
 	    {
-	      if (p->family == AF_INET)
-		zsend_route_multipath (ZEBRA_IPV4_ROUTE_DELETE, client, p,
-				       rib);
-#ifdef HAVE_IPV6
-	      if (p->family == AF_INET6)
-		zsend_route_multipath (ZEBRA_IPV6_ROUTE_DELETE, client, p,
-				       rib);
-#endif /* HAVE_IPV6 */
+	      pending->nexthop = *nexthop;
+	      pending->nexthop.next = pending->nexthop.prev = NULL;
+	      pending->nexthop.ifname = NULL;
+	      pending->has_nexthop = 1;
+	      break;
 	    }
-	}
-      else if (client->redist[rib->type])
-	{
-	  if (p->family == AF_INET)
-	    zsend_route_multipath (ZEBRA_IPV4_ROUTE_DELETE, client, p, rib);
-#ifdef HAVE_IPV6
-	  if (p->family == AF_INET6)
-	    zsend_route_multipath (ZEBRA_IPV6_ROUTE_DELETE, client, p, rib);
-#endif /* HAVE_IPV6 */
-	}
-    }
+      }
 }
 
 void
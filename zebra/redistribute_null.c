@@ -3,6 +3,7 @@
 #include "zebra/zserv.h"
 
 #include "zebra/redistribute.h"
+#include "zebra/zebra_nht.h"
 
 void zebra_redistribute_add (int a, struct zserv *b, int c)
 { return; }
@@ -14,6 +15,9 @@ void redistribute_add (struct prefix *a, struct rib *b)
 { return; }
 #pragma weak redistribute_delete = redistribute_add
 
+void zebra_nht_changed (struct route_node *a)
+{ return; }
+
 void zebra_interface_up_update (struct interface *a)
 { return; }
 #pragma weak zebra_interface_down_update = zebra_interface_up_update
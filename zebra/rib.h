@@ -28,6 +28,9 @@
 
 #define DISTANCE_INFINITY  255
 
+struct route_node;
+struct nhg;
+
 /* Routing information base. */
 
 union g_addr {
@@ -77,6 +80,20 @@ struct rib
   /* RIB internal status */
   u_char status;
 #define RIB_ENTRY_REMOVED	(1 << 0)
+#define RIB_ENTRY_UNLINKED	(1 << 1)
+#define RIB_ENTRY_NHG		(1 << 2) /* nexthops resolved as the group's */
+
+  /* Kernel changes queued to the dataplane thread. */
+  unsigned int dplane_ops;
+
+  /* Set when the entry is linked into its node, so that it can be told
+     apart from a later entry allocated at the same address. */
+  u_int32_t gen;
+
+  /* Group of the nexthops, and the one whose kernel nexthop object the
+     route was installed with. */
+  struct nhg *nhg;
+  struct nhg *fib_nhg;
 
   /* Nexthop information. */
   u_char nexthop_num;
@@ -236,6 +253,13 @@ extern struct nexthop *nexthop_ipv4_add (struct rib *, struct in_addr *,
 					 struct in_addr *);
 extern struct nexthop * nexthop_ipv4_ifindex_ol_add (struct rib *, const struct in_addr *,
 						     const struct in_addr *, const unsigned);
+extern void nexthop_free (struct nexthop *);
+extern void nexthop_resolve (struct nexthop *, int, int, struct route_node *);
+
+/* FIB and SELECT, the routes in RN that were and are now installed,
+   changed; nexthops resolving through them are looked up again.  */
+extern void rib_nexthops_changed (struct route_node *, struct rib *,
+				  struct rib *);
 extern void rib_lookup_and_dump (struct prefix_ipv4 *);
 extern void rib_lookup_and_pushup (struct prefix_ipv4 *);
 extern void rib_dump (const char *, const struct prefix_ipv4 *, const struct rib *);
@@ -276,6 +300,7 @@ extern void rib_update (void);
 extern void rib_weed_tables (void);
 extern void rib_sweep_route (void);
 extern void rib_close (void);
+extern void rib_free (struct rib *);
 extern void rib_init (void);
 extern unsigned long rib_score_proto (u_char proto);
 
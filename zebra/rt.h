@@ -43,6 +43,17 @@ extern int kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *ga
 
 #ifdef HAVE_NETLINK
 extern int netlink_route_read (void);
+extern void netlink_route_flush (void);
+
+/* Default for "netlink batch ... delay", in milliseconds.  */
+#define NETLINK_BATCH_DELAY_DEFAULT 10
+
+/* Kernel nexthop objects.  Update returns 0 once routes can point at
+   the group's, 1 if the kernel has none or can't express the nexthops
+   and -1 if it refused them.  */
+struct nhg;
+extern int kernel_nhg_update (struct nhg *);
+extern void kernel_nhg_delete (struct nhg *);
 #endif
 
 #endif /* _ZEBRA_RT_H */
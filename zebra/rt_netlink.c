@@ -36,12 +36,20 @@
 #include "thread.h"
 #include "privs.h"
 #include "sockopt.h"
+#include "memory.h"
 
 #include "zebra/zserv.h"
 #include "zebra/rt.h"
 #include "zebra/redistribute.h"
 #include "zebra/interface.h"
 #include "zebra/debug.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_nhg.h"
+#include "zebra/zebra_nht.h"
+
+#ifdef RTM_NEWNEXTHOP
+#include <linux/nexthop.h>
+#endif /* RTM_NEWNEXTHOP */
 
 /* Socket interface to kernel */
 struct nlsock
@@ -51,7 +59,8 @@ struct nlsock
   struct sockaddr_nl snl;
   const char *name;
 } netlink      = { -1, 0, {0}, "netlink-listen"},     /* kernel messages */
-  netlink_cmd  = { -1, 0, {0}, "netlink-cmd"};        /* command channel */
+  netlink_cmd  = { -1, 0, {0}, "netlink-cmd"},        /* command channel */
+  netlink_batch = { -1, 0, {0}, "netlink-batch"};     /* batched routes */
 
 static const struct message nlmsg_str[] = {
   {RTM_NEWROUTE, "RTM_NEWROUTE"},
@@ -63,6 +72,11 @@ static const struct message nlmsg_str[] = {
   {RTM_NEWADDR,  "RTM_NEWADDR"},
   {RTM_DELADDR,  "RTM_DELADDR"},
   {RTM_GETADDR,  "RTM_GETADDR"},
+#ifdef RTM_NEWNEXTHOP
+  {RTM_NEWNEXTHOP, "RTM_NEWNEXTHOP"},
+  {RTM_DELNEXTHOP, "RTM_DELNEXTHOP"},
+  {RTM_GETNEXTHOP, "RTM_GETNEXTHOP"},
+#endif /* RTM_NEWNEXTHOP */
   {0, NULL}
 };
 
@@ -71,6 +85,7 @@ extern struct zebra_t zebrad;
 extern struct zebra_privs_t zserv_privs;
 
 extern u_int32_t nl_rcvbufsize;
+extern int keep_kernel_mode;
 
 /* Note: on netlink systems, there should be a 1-to-1 mapping between interface
    names and ifindex values. */
@@ -177,21 +192,14 @@ netlink_socket (struct nlsock *nl, unsigned long groups)
   return ret;
 }
 
-/* Get type specified information from netlink. */
+/* Send dump request N, the answers are read with netlink_parse_info(). */
 static int
-netlink_request (int family, int type, struct nlsock *nl)
+netlink_request_send (struct nlmsghdr *n, struct nlsock *nl)
 {
   int ret;
   struct sockaddr_nl snl;
   int save_errno;
 
-  struct
-  {
-    struct nlmsghdr nlh;
-    struct rtgenmsg g;
-  } req;
-
-
   /* Check netlink socket. */
   if (nl->sock < 0)
     {
@@ -202,13 +210,8 @@ netlink_request (int family, int type, struct nlsock *nl)
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
-  memset (&req, 0, sizeof req);
-  req.nlh.nlmsg_len = sizeof req;
-  req.nlh.nlmsg_type = type;
-  req.nlh.nlmsg_flags = NLM_F_ROOT | NLM_F_MATCH | NLM_F_REQUEST;
-  req.nlh.nlmsg_pid = nl->snl.nl_pid;
-  req.nlh.nlmsg_seq = ++nl->seq;
-  req.g.rtgen_family = family;
+  n->nlmsg_pid = nl->snl.nl_pid;
+  n->nlmsg_seq = ++nl->seq;
 
   /* linux appears to check capabilities on every message 
    * have to raise caps for every message sent
@@ -219,7 +222,7 @@ netlink_request (int family, int type, struct nlsock *nl)
       return -1;
     }
 
-  ret = sendto (nl->sock, (void *) &req, sizeof req, 0,
+  ret = sendto (nl->sock, (void *) n, n->nlmsg_len, 0,
                 (struct sockaddr *) &snl, sizeof snl);
   save_errno = errno;
 
@@ -236,6 +239,25 @@ netlink_request (int family, int type, struct nlsock *nl)
   return 0;
 }
 
+/* Get type specified information from netlink. */
+static int
+netlink_request (int family, int type, struct nlsock *nl)
+{
+  struct
+  {
+    struct nlmsghdr nlh;
+    struct rtgenmsg g;
+  } req;
+
+  memset (&req, 0, sizeof req);
+  req.nlh.nlmsg_len = sizeof req;
+  req.nlh.nlmsg_type = type;
+  req.nlh.nlmsg_flags = NLM_F_ROOT | NLM_F_MATCH | NLM_F_REQUEST;
+  req.g.rtgen_family = family;
+
+  return netlink_request_send (&req.nlh, nl);
+}
+
 /* Receive message from netlink interface and pass those information
    to the given function. */
 static int
@@ -334,6 +356,19 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *),
 		  return 0;
 		}
 
+#ifdef RTM_NEWNEXTHOP
+	      /* Kernels without nexthop objects refuse the dump.  */
+	      if (msg_type == RTM_GETNEXTHOP)
+		{
+		  if (IS_ZEBRA_DEBUG_KERNEL)
+		    zlog_debug ("%s: error: %s type=%s(%u), seq=%u, pid=%u",
+				nl->name, safe_strerror (-errnum),
+				lookup (nlmsg_str, msg_type),
+				msg_type, err->msg.nlmsg_seq, err->msg.nlmsg_pid);
+		  return -1;
+		}
+#endif /* RTM_NEWNEXTHOP */
+
 	      zlog_err ("%s error: %s, type=%s(%u), seq=%u, pid=%u",
 			nl->name, safe_strerror (-errnum),
 			lookup (nlmsg_str, msg_type),
@@ -356,6 +391,14 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *),
                             netlink_cmd.name, nl->name);
               continue;
             }
+          if (netlink_batch.sock >= 0
+              && h->nlmsg_pid == netlink_batch.snl.nl_pid)
+            {
+              if (IS_ZEBRA_DEBUG_KERNEL)
+                zlog_debug ("netlink_parse_info: %s packet comes from %s",
+                            netlink_batch.name, nl->name);
+              continue;
+            }
 
           error = (*filter) (&snl, h);
           if (error < 0)
@@ -1144,6 +1187,8 @@ netlink_talk_filter (struct sockaddr_nl *snl, struct nlmsghdr *h)
   return 0;
 }
 
+static void netlink_batch_send (void);
+
 /* sendmsg() to netlink socket then recvmsg(). */
 static int
 netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
@@ -1154,6 +1199,10 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
   int save_errno;
 
+  /* Keep the order of changes made by batched routes.  */
+  if (nl == &netlink_cmd)
+    netlink_batch_send ();
+
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
@@ -1190,6 +1239,453 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   return netlink_parse_info (netlink_talk_filter, nl);
 }
 
+/* netlink_talk() for the dataplane thread, on the batch socket.  It
+   neither logs nor changes privileges, see zebra_dplane.c: failures
+   are returned as -1 with errno set, for the main thread to report. */
+static int
+netlink_dplane_talk (struct nlmsghdr *n)
+{
+  char buf[4096];
+  struct sockaddr_nl snl;
+  struct iovec iov = { (void *) n, n->nlmsg_len };
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  struct nlmsghdr *h;
+  struct nlmsgerr *err;
+  int status;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  n->nlmsg_seq = ++netlink_batch.seq;
+  n->nlmsg_flags |= NLM_F_ACK;
+
+  while ((status = sendmsg (netlink_batch.sock, &msg, 0)) < 0)
+    if (errno != EINTR)
+      return -1;
+
+  iov.iov_base = buf;
+  iov.iov_len = sizeof buf;
+  while (1)
+    {
+      msg.msg_namelen = sizeof snl;
+      status = recvmsg (netlink_batch.sock, &msg, 0);
+      if (status < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      if (status == 0)
+	{
+	  errno = ECONNRESET;
+	  return -1;
+	}
+
+      for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) status);
+	   h = NLMSG_NEXT (h, status))
+	{
+	  if (h->nlmsg_type != NLMSG_ERROR || h->nlmsg_seq != n->nlmsg_seq)
+	    continue;
+	  if (h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+	    {
+	      errno = EBADMSG;
+	      return -1;
+	    }
+
+	  err = (struct nlmsgerr *) NLMSG_DATA (h);
+
+	  /* Same races in link handling as netlink_parse_info().  */
+	  if (err->error == 0
+	      || (n->nlmsg_type == RTM_DELROUTE
+		  && (-err->error == ENODEV || -err->error == ESRCH))
+	      || (n->nlmsg_type == RTM_NEWROUTE && -err->error == EEXIST))
+	    return 0;
+
+	  errno = -err->error;
+	  return -1;
+	}
+    }
+}
+
+/* Batched route programming, enabled by "netlink batch".  Route
+   messages are collected and sent on their own socket several at a
+   time, without waiting for the kernel in between.  Only the last
+   message of a batch asks for an ACK: the kernel reports failures of
+   the others anyway, and as it works through a batch in order, the ACK
+   also says everything before it is done.  As with netlink_talk(),
+   NEXTHOP_FLAG_FIB is set when the message is built; it is cleared
+   again when the kernel refuses the route.  */
+
+/* Batches sent but not acknowledged before the next one waits.  */
+#define NL_BATCH_INFLIGHT	4
+#define NL_BATCH_BUFSIZE	65536
+
+struct nl_batch_route
+{
+  u_int32_t seq;
+  int cmd;
+  int last;
+  struct prefix p;
+  struct rib *rib;
+  u_int32_t gen;
+};
+
+static struct
+{
+  /* Messages queued and not sent yet.  */
+  char buf[NL_BATCH_BUFSIZE];
+  size_t len;
+  size_t last;
+  unsigned int queued;
+
+  /* Ring of routes queued or sent, oldest first, until answered.  */
+  struct nl_batch_route *route;
+  unsigned int head;
+  unsigned int count;
+  unsigned int size;
+
+  /* Number of batches sent and not acknowledged.  */
+  unsigned int inflight;
+
+  struct thread *t_flush;
+  struct thread *t_read;
+} nl_batch;
+
+static struct nl_batch_route *
+netlink_batch_route (unsigned int i)
+{
+  return &nl_batch.route[(nl_batch.head + i) % nl_batch.size];
+}
+
+/* Forget the first N routes of the ring.  */
+static void
+netlink_batch_release (unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; i++)
+    if (netlink_batch_route (i)->last)
+      nl_batch.inflight--;
+
+  nl_batch.head = (nl_batch.head + n) % nl_batch.size;
+  nl_batch.count -= n;
+}
+
+/* The RIB entry a route was sent for, if it still exists, and its
+   node.  The entry may have been freed and its memory reused for
+   another one meanwhile, hence the generation check.  */
+static struct rib *
+netlink_batch_rib (struct nl_batch_route *r, struct route_node **rnp)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *rib = NULL;
+  afi_t afi;
+  safi_t safi;
+
+  afi = (r->p.family == AF_INET ? AFI_IP : AFI_IP6);
+
+  for (safi = SAFI_UNICAST; safi <= SAFI_MULTICAST; safi++)
+    {
+      table = vrf_table (afi, safi, 0);
+      if (! table)
+	continue;
+
+      rn = route_node_lookup (table, &r->p);
+      if (! rn)
+	continue;
+
+      for (rib = rn->info; rib; rib = rib->next)
+	if (rib == r->rib && rib->gen == r->gen)
+	  break;
+      route_unlock_node (rn);
+
+      if (rib)
+	{
+	  *rnp = rn;
+	  return rib;
+	}
+    }
+  return NULL;
+}
+
+static void
+netlink_batch_error (struct nl_batch_route *r, int errnum)
+{
+  char buf[INET6_ADDRSTRLEN + 4];
+  struct nexthop *nexthop;
+  struct route_node *rn;
+  struct rib *rib;
+
+  prefix2str (&r->p, buf, sizeof buf);
+
+  /* Deal with errors that occur because of races in link handling */
+  if ((r->cmd == RTM_DELROUTE && (errnum == ENODEV || errnum == ESRCH))
+      || (r->cmd == RTM_NEWROUTE && errnum == EEXIST))
+    {
+      if (IS_ZEBRA_DEBUG_KERNEL)
+	zlog_debug ("%s: error: %s type=%s(%u), seq=%u, %s",
+		    netlink_batch.name, safe_strerror (errnum),
+		    lookup (nlmsg_str, r->cmd), r->cmd, r->seq, buf);
+      return;
+    }
+
+  zlog_err ("%s error: %s, type=%s(%u), seq=%u, %s",
+	    netlink_batch.name, safe_strerror (errnum),
+	    lookup (nlmsg_str, r->cmd), r->cmd, r->seq, buf);
+
+  if (r->cmd == RTM_NEWROUTE && (rib = netlink_batch_rib (r, &rn)) != NULL
+      && CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED))
+    {
+      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      zebra_nht_changed (rn);
+      rib_nexthops_changed (rn, rib, NULL);
+    }
+}
+
+/* The kernel answered message SEQ with ERRNUM, 0 for an ACK.  */
+static void
+netlink_batch_answer (u_int32_t seq, int errnum)
+{
+  struct nl_batch_route *r;
+  unsigned int i;
+
+  if (nl_batch.count == 0)
+    return;
+
+  i = seq - netlink_batch_route (0)->seq;
+  if (i >= nl_batch.count - nl_batch.queued)
+    {
+      zlog_warn ("%s: unexpected answer seq=%u", netlink_batch.name, seq);
+      return;
+    }
+
+  r = netlink_batch_route (i);
+  if (errnum)
+    netlink_batch_error (r, errnum);
+
+  if (r->last)
+    netlink_batch_release (i + 1);
+}
+
+/* Read answers from the kernel.  Returns the number of bytes read, 0
+   if there was nothing to read and -1 on error.  */
+static int
+netlink_batch_recv (int flags)
+{
+  char buf[4096];
+  struct iovec iov = { buf, sizeof buf };
+  struct sockaddr_nl snl;
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  struct nlmsghdr *h;
+  struct nlmsgerr *err;
+  int status;
+  int len;
+
+  do
+    status = recvmsg (netlink_batch.sock, &msg, flags);
+  while (status < 0 && errno == EINTR);
+
+  if (status < 0)
+    {
+      if (errno == EWOULDBLOCK || errno == EAGAIN)
+	return 0;
+
+      zlog_err ("%s recvmsg overrun: %s", netlink_batch.name,
+		safe_strerror (errno));
+
+      /* Answers got lost, don't wait for them.  */
+      if (errno == ENOBUFS)
+	netlink_batch_release (nl_batch.count - nl_batch.queued);
+      return -1;
+    }
+
+  if (status == 0)
+    {
+      zlog (NULL, LOG_ERR, "%s EOF", netlink_batch.name);
+      return -1;
+    }
+
+  len = status;
+  for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) len);
+       h = NLMSG_NEXT (h, len))
+    {
+      if (h->nlmsg_type != NLMSG_ERROR)
+	continue;
+
+      if (h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+	{
+	  zlog (NULL, LOG_ERR, "%s error: message truncated",
+		netlink_batch.name);
+	  continue;
+	}
+
+      err = (struct nlmsgerr *) NLMSG_DATA (h);
+      netlink_batch_answer (err->msg.nlmsg_seq, -err->error);
+    }
+
+  return status;
+}
+
+static int
+netlink_batch_read (struct thread *thread)
+{
+  nl_batch.t_read = NULL;
+
+  while (nl_batch.inflight && netlink_batch_recv (MSG_DONTWAIT) > 0)
+    ;
+
+  if (nl_batch.inflight)
+    nl_batch.t_read = thread_add_read (zebrad.master, netlink_batch_read,
+				       NULL, netlink_batch.sock);
+  return 0;
+}
+
+/* None of the queued routes made it, for ERRNUM.  */
+static void
+netlink_batch_drop (int errnum)
+{
+  unsigned int i;
+
+  for (i = nl_batch.count - nl_batch.queued; i < nl_batch.count; i++)
+    netlink_batch_error (netlink_batch_route (i), errnum);
+  nl_batch.count -= nl_batch.queued;
+  nl_batch.len = 0;
+  nl_batch.queued = 0;
+}
+
+/* Send the queued messages.  */
+static void
+netlink_batch_send (void)
+{
+  struct nlmsghdr *n;
+  struct sockaddr_nl snl;
+  struct iovec iov = { (void *) nl_batch.buf, nl_batch.len };
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  int status;
+  int save_errno;
+
+  THREAD_OFF (nl_batch.t_flush);
+
+  if (nl_batch.queued == 0)
+    return;
+
+  /* Wait for room, answers must not overrun the receive buffer.  A
+     lost answer frees up room, other errors leave none.  */
+  while (nl_batch.inflight >= NL_BATCH_INFLIGHT)
+    if (netlink_batch_recv (0) < 0
+	&& nl_batch.inflight >= NL_BATCH_INFLIGHT)
+      {
+	netlink_batch_drop (EIO);
+	return;
+      }
+
+  n = (struct nlmsghdr *) (nl_batch.buf + nl_batch.last);
+  n->nlmsg_flags |= NLM_F_ACK;
+  netlink_batch_route (nl_batch.count - 1)->last = 1;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("netlink_batch_send: %s %u messages, %lu bytes",
+		netlink_batch.name, nl_batch.queued,
+		(unsigned long) nl_batch.len);
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  status = sendmsg (netlink_batch.sock, &msg, 0);
+  save_errno = errno;
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  if (status < 0)
+    {
+      zlog (NULL, LOG_ERR, "netlink_batch_send sendmsg() error: %s",
+	    safe_strerror (save_errno));
+      netlink_batch_drop (save_errno);
+    }
+  else
+    {
+      nl_batch.inflight++;
+      nl_batch.len = 0;
+      nl_batch.queued = 0;
+    }
+
+  if (nl_batch.inflight && ! nl_batch.t_read)
+    nl_batch.t_read = thread_add_read (zebrad.master, netlink_batch_read,
+				       NULL, netlink_batch.sock);
+}
+
+static int
+netlink_batch_timer (struct thread *thread)
+{
+  nl_batch.t_flush = NULL;
+  netlink_batch_send ();
+  return 0;
+}
+
+/* Queue route message N for P and RIB.  */
+static int
+netlink_batch_add (struct nlmsghdr *n, struct prefix *p, struct rib *rib)
+{
+  struct nl_batch_route *r;
+  unsigned int size;
+
+  /* Every batch in flight and the one being filled fit in the ring.  */
+  size = zebrad.nl_batch_size * (NL_BATCH_INFLIGHT + 1);
+  if (nl_batch.size < size)
+    {
+      netlink_route_flush ();
+      nl_batch.count = 0;
+      nl_batch.head = 0;
+      nl_batch.size = size;
+      nl_batch.route = XREALLOC (MTYPE_NETLINK_BATCH, nl_batch.route,
+				 size * sizeof (struct nl_batch_route));
+    }
+
+  if (nl_batch.len + NLMSG_ALIGN (n->nlmsg_len) > NL_BATCH_BUFSIZE)
+    netlink_batch_send ();
+
+  n->nlmsg_seq = ++netlink_batch.seq;
+
+  nl_batch.last = nl_batch.len;
+  memcpy (nl_batch.buf + nl_batch.len, n, n->nlmsg_len);
+  nl_batch.len += NLMSG_ALIGN (n->nlmsg_len);
+  nl_batch.queued++;
+
+  r = netlink_batch_route (nl_batch.count++);
+  r->seq = n->nlmsg_seq;
+  r->cmd = n->nlmsg_type;
+  r->last = 0;
+  prefix_copy (&r->p, p);
+  r->rib = rib;
+  r->gen = rib->gen;
+
+  if (nl_batch.queued >= zebrad.nl_batch_size)
+    netlink_batch_send ();
+  else if (! nl_batch.t_flush)
+    nl_batch.t_flush = thread_add_timer_msec (zebrad.master,
+					      netlink_batch_timer, NULL,
+					      zebrad.nl_batch_delay);
+  return 0;
+}
+
+/* Send any batched routes and wait until the kernel has answered.  */
+void
+netlink_route_flush (void)
+{
+  if (netlink_batch.sock < 0)
+    return;
+
+  netlink_batch_send ();
+  while (nl_batch.inflight)
+    if (netlink_batch_recv (0) < 0)
+      break;
+  THREAD_OFF (nl_batch.t_read);
+}
+
 /* Routing table change via netlink interface. */
 static int
 netlink_route (int cmd, int family, void *dest, int length, void *gate,
@@ -1264,6 +1760,319 @@ netlink_route (int cmd, int family, void *dest, int length, void *gate,
   return 0;
 }
 
+#ifdef RTM_NEWNEXTHOP
+/* Kernel nexthop objects, from Linux 5.3.  Each nexthop of a group is
+   an object, and routes point at an object grouping them, even when
+   there is just the one, so that it can always be replaced in place.  */
+
+/* The kernel answered the nexthop dump.  */
+static int nl_nhg_supported;
+static u_int32_t nl_nhg_last_id;
+
+/* Most nexthops in a group object.  */
+#define NL_NHG_MEMBERS_MAX 64
+
+static u_int32_t
+netlink_nhg_id (void)
+{
+  if (++nl_nhg_last_id == 0)
+    ++nl_nhg_last_id;
+  return nl_nhg_last_id;
+}
+
+/* Where NEXTHOP forwards to, 0 if an object can't say it.  */
+static int
+netlink_nhg_hop (struct nexthop *nexthop, union g_addr **gate,
+		 unsigned int *ifindex)
+{
+  u_char type;
+
+  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+    {
+      type = nexthop->rtype;
+      *gate = &nexthop->rgate;
+      *ifindex = nexthop->rifindex;
+    }
+  else
+    {
+      type = nexthop->type;
+      *gate = &nexthop->gate;
+      *ifindex = nexthop->ifindex;
+    }
+
+  switch (type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFINDEX_OL:
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+#endif /* HAVE_IPV6 */
+      break;
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IFNAME:
+      *gate = NULL;
+      break;
+    default:
+      return 0;
+    }
+
+  /* Objects other than blackholes need their interface.  */
+  return *ifindex != 0;
+}
+
+static int
+netlink_nhg_member (u_int32_t id, int family, struct nexthop *nexthop)
+{
+  union g_addr *gate;
+  unsigned int ifindex;
+
+  struct
+  {
+    struct nlmsghdr n;
+    struct nhmsg nhm;
+    char buf[256];
+  } req;
+
+  netlink_nhg_hop (nexthop, &gate, &ifindex);
+
+  memset (&req, 0, sizeof req);
+  req.n.nlmsg_len = NLMSG_LENGTH (sizeof (struct nhmsg));
+  req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_REQUEST;
+  req.n.nlmsg_type = RTM_NEWNEXTHOP;
+  req.nhm.nh_family = family;
+  req.nhm.nh_protocol = RTPROT_ZEBRA;
+  if (nexthop->type == NEXTHOP_TYPE_IPV4_IFINDEX_OL)
+    req.nhm.nh_flags = RTNH_F_ONLINK;
+
+  addattr32 (&req.n, sizeof req, NHA_ID, id);
+  if (gate)
+    addattr_l (&req.n, sizeof req, NHA_GATEWAY, gate,
+	       family == AF_INET ? 4 : 16);
+  addattr32 (&req.n, sizeof req, NHA_OIF, ifindex);
+
+  return netlink_talk (&req.n, &netlink_cmd);
+}
+
+static int
+netlink_nhg_del (u_int32_t id)
+{
+  struct
+  {
+    struct nlmsghdr n;
+    struct nhmsg nhm;
+    char buf[64];
+  } req;
+
+  memset (&req, 0, sizeof req);
+  req.n.nlmsg_len = NLMSG_LENGTH (sizeof (struct nhmsg));
+  req.n.nlmsg_flags = NLM_F_REQUEST;
+  req.n.nlmsg_type = RTM_DELNEXTHOP;
+  req.nhm.nh_family = AF_UNSPEC;
+  addattr32 (&req.n, sizeof req, NHA_ID, id);
+
+  return netlink_talk (&req.n, &netlink_cmd);
+}
+
+static void
+netlink_nhg_del_members (u_int32_t *member, int num)
+{
+  int i;
+
+  for (i = 0; i < num; i++)
+    netlink_nhg_del (member[i]);
+}
+
+int
+kernel_nhg_update (struct nhg *nhg)
+{
+  struct nexthop *hop[NL_NHG_MEMBERS_MAX];
+  struct nexthop_grp grp[NL_NHG_MEMBERS_MAX];
+  u_int32_t member[NL_NHG_MEMBERS_MAX];
+  struct nexthop *nexthop;
+  union g_addr *gate;
+  unsigned int ifindex;
+  u_int32_t id;
+  int num = 0;
+  int i;
+
+  struct
+  {
+    struct nlmsghdr n;
+    struct nhmsg nhm;
+    char buf[1024];
+  } req;
+
+  if (! nl_nhg_supported || ! nhg->active_num)
+    return 1;
+
+  /* The same nexthops installed as netlink_route_multipath() would,
+     all of which an object must be able to say.  */
+  for (nexthop = nhg->nexthop;
+       nexthop && num < NL_NHG_MEMBERS_MAX
+       && (MULTIPATH_NUM == 0 || num < MULTIPATH_NUM);
+       nexthop = nexthop->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+      {
+	if (! netlink_nhg_hop (nexthop, &gate, &ifindex))
+	  return 1;
+	hop[num++] = nexthop;
+      }
+
+  memset (grp, 0, sizeof grp);
+  for (i = 0; i < num; i++)
+    {
+      member[i] = netlink_nhg_id ();
+      if (netlink_nhg_member (member[i], nhg->family, hop[i]) < 0)
+	{
+	  netlink_nhg_del_members (member, i);
+	  return -1;
+	}
+      grp[i].id = member[i];
+    }
+
+  /* Replacing the group moves all the routes using it at once.  */
+  id = nhg->kernel_id ? nhg->kernel_id : netlink_nhg_id ();
+
+  memset (&req, 0, sizeof req);
+  req.n.nlmsg_len = NLMSG_LENGTH (sizeof (struct nhmsg));
+  req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_REQUEST;
+  if (nhg->kernel_id)
+    req.n.nlmsg_flags |= NLM_F_REPLACE;
+  req.n.nlmsg_type = RTM_NEWNEXTHOP;
+  req.nhm.nh_family = AF_UNSPEC;
+  req.nhm.nh_protocol = RTPROT_ZEBRA;
+  addattr32 (&req.n, sizeof req, NHA_ID, id);
+  addattr_l (&req.n, sizeof req, NHA_GROUP, grp,
+	     num * sizeof (struct nexthop_grp));
+
+  if (netlink_talk (&req.n, &netlink_cmd) < 0)
+    {
+      netlink_nhg_del_members (member, num);
+      return -1;
+    }
+
+  netlink_nhg_del_members (nhg->kernel_member, nhg->kernel_member_num);
+  if (nhg->kernel_member)
+    XFREE (MTYPE_NHG, nhg->kernel_member);
+  nhg->kernel_member = XMALLOC (MTYPE_NHG, num * sizeof (u_int32_t));
+  memcpy (nhg->kernel_member, member, num * sizeof (u_int32_t));
+  nhg->kernel_member_num = num;
+  nhg->kernel_id = id;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: nexthop group %u is object %u, %d nexthops",
+		__func__, nhg->id, id, num);
+  return 0;
+}
+
+void
+kernel_nhg_delete (struct nhg *nhg)
+{
+  /* Routes still using the object go with it.  */
+  netlink_nhg_del (nhg->kernel_id);
+  netlink_nhg_del_members (nhg->kernel_member, nhg->kernel_member_num);
+
+  if (nhg->kernel_member)
+    XFREE (MTYPE_NHG, nhg->kernel_member);
+  nhg->kernel_member = NULL;
+  nhg->kernel_member_num = 0;
+  nhg->kernel_id = 0;
+}
+
+/* Objects left behind by an earlier zebra.  */
+static u_int32_t *nl_nhg_stale;
+static unsigned int nl_nhg_stale_num;
+static unsigned int nl_nhg_stale_max;
+
+static int
+netlink_nhg_dump (struct sockaddr_nl *snl, struct nlmsghdr *h)
+{
+  struct nhmsg *nhm = NLMSG_DATA (h);
+  struct rtattr *tb[NHA_MAX + 1];
+  u_int32_t id;
+  int len;
+
+  if (h->nlmsg_type != RTM_NEWNEXTHOP)
+    return 0;
+
+  len = h->nlmsg_len - NLMSG_LENGTH (sizeof (struct nhmsg));
+  if (len < 0)
+    return -1;
+
+  memset (tb, 0, sizeof tb);
+  netlink_parse_rtattr (tb, NHA_MAX, (struct rtattr *) ((char *) nhm
+			+ NLMSG_ALIGN (sizeof (struct nhmsg))), len);
+  if (! tb[NHA_ID])
+    return 0;
+
+  /* Hand out IDs above those in use, whoever uses them.  */
+  id = *(u_int32_t *) RTA_DATA (tb[NHA_ID]);
+  if (id > nl_nhg_last_id)
+    nl_nhg_last_id = id;
+
+  if (nhm->nh_protocol != RTPROT_ZEBRA)
+    return 0;
+
+  if (nl_nhg_stale_num == nl_nhg_stale_max)
+    {
+      nl_nhg_stale_max = nl_nhg_stale_max ? nl_nhg_stale_max * 2 : 64;
+      nl_nhg_stale = XREALLOC (MTYPE_TMP, nl_nhg_stale,
+			       nl_nhg_stale_max * sizeof (u_int32_t));
+    }
+  nl_nhg_stale[nl_nhg_stale_num++] = id;
+  return 0;
+}
+
+/* See whether the kernel has nexthop objects, and clear out ours
+   unless the routes using them are to be kept.  */
+static void
+netlink_nhg_init (void)
+{
+  struct
+  {
+    struct nlmsghdr n;
+    struct nhmsg nhm;
+  } req;
+
+  memset (&req, 0, sizeof req);
+  req.n.nlmsg_len = sizeof req;
+  req.n.nlmsg_type = RTM_GETNEXTHOP;
+  req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  req.nhm.nh_family = AF_UNSPEC;
+
+  if (netlink_request_send (&req.n, &netlink_cmd) < 0
+      || netlink_parse_info (netlink_nhg_dump, &netlink_cmd) < 0)
+    {
+      if (IS_ZEBRA_DEBUG_KERNEL)
+	zlog_debug ("%s: no kernel nexthop objects", __func__);
+      nl_nhg_stale_num = 0;
+    }
+  else
+    nl_nhg_supported = 1;
+
+  if (! keep_kernel_mode)
+    netlink_nhg_del_members (nl_nhg_stale, nl_nhg_stale_num);
+  if (nl_nhg_stale)
+    XFREE (MTYPE_TMP, nl_nhg_stale);
+  nl_nhg_stale = NULL;
+  nl_nhg_stale_num = nl_nhg_stale_max = 0;
+}
+#else
+int
+kernel_nhg_update (struct nhg *nhg)
+{
+  return 1;
+}
+
+void
+kernel_nhg_delete (struct nhg *nhg)
+{
+}
+#endif /* RTM_NEWNEXTHOP */
+
 /* Routing table change via netlink interface. */
 static int
 netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
@@ -1274,6 +2083,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   struct nexthop *nexthop = NULL;
   int nexthop_num = 0;
   int discard;
+  int debug;
 
   struct
   {
@@ -1282,6 +2092,9 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
     char buf[1024];
   } req;
 
+  /* Not from the dataplane thread, which must not log.  */
+  debug = IS_ZEBRA_DEBUG_KERNEL && ! zebra_dplane_active ();
+
   memset (&req, 0, sizeof req);
 
   bytelen = (family == AF_INET ? 4 : 16);
@@ -1328,6 +2141,33 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
       goto skip;
     }
 
+#ifdef RTM_NEWNEXTHOP
+  /* Installed with the kernel object of its nexthop group, deleting
+     it takes just the prefix.  */
+  if (rib->fib_nhg)
+    {
+      if (cmd == RTM_NEWROUTE)
+        {
+          union g_addr *src = NULL;
+
+          addattr32 (&req.n, sizeof req, RTA_NH_ID, rib->fib_nhg->kernel_id);
+          for (nexthop = rib->nexthop;
+               nexthop && (MULTIPATH_NUM == 0 || nexthop_num < MULTIPATH_NUM);
+               nexthop = nexthop->next)
+            if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+              {
+                SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+                if (nexthop->src.ipv4.s_addr)
+                  src = &nexthop->src;
+                nexthop_num++;
+              }
+          if (src && family == AF_INET)
+            addattr_l (&req.n, sizeof req, RTA_PREFSRC, &src->ipv4, bytelen);
+        }
+      goto skip;
+    }
+#endif /* RTM_NEWNEXTHOP */
+
   /* Multipath case. */
   if (rib->nexthop_active_num == 1 || MULTIPATH_NUM == 1)
     {
@@ -1342,7 +2182,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 
               if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
                 {
-                  if (IS_ZEBRA_DEBUG_KERNEL)
+                  if (debug)
                     {
                       zlog_debug
                         ("netlink_route_multipath() (recursive, 1 hop): "
@@ -1365,7 +2205,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                       if (nexthop->src.ipv4.s_addr)
 		          addattr_l(&req.n, sizeof req, RTA_PREFSRC,
 				     &nexthop->src.ipv4, bytelen);
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (recursive, "
 				   "1 hop): nexthop via %s if %u",
 				   inet_ntoa (nexthop->rgate.ipv4),
@@ -1379,7 +2219,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		      addattr_l (&req.n, sizeof req, RTA_GATEWAY,
 				 &nexthop->rgate.ipv6, bytelen);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (recursive, "
 				   "1 hop): nexthop via %s if %u",
 				   inet6_ntoa (nexthop->rgate.ipv6),
@@ -1400,7 +2240,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                         addattr_l (&req.n, sizeof req, RTA_PREFSRC,
 				 &nexthop->src.ipv4, bytelen);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (recursive, "
 				   "1 hop): nexthop via if %u",
 				   nexthop->rifindex);
@@ -1410,7 +2250,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                 {
                   if (nexthop->type == NEXTHOP_TYPE_IPV4_IFINDEX_OL)
                     SET_FLAG (req.r.rtm_flags, RTNH_F_ONLINK);
-                  if (IS_ZEBRA_DEBUG_KERNEL)
+                  if (debug)
                     {
                       zlog_debug
                         ("netlink_route_multipath() (single hop): "
@@ -1434,7 +2274,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                         addattr_l (&req.n, sizeof req, RTA_PREFSRC,
 				 &nexthop->src.ipv4, bytelen);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (single hop): "
 				   "nexthop via %s if %u",
 				   inet_ntoa (nexthop->gate.ipv4),
@@ -1448,7 +2288,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		      addattr_l (&req.n, sizeof req, RTA_GATEWAY,
 				 &nexthop->gate.ipv6, bytelen);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (single hop): "
 				   "nexthop via %s if %u",
 				   inet6_ntoa (nexthop->gate.ipv6),
@@ -1466,7 +2306,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                         addattr_l (&req.n, sizeof req, RTA_PREFSRC,
 				 &nexthop->src.ipv4, bytelen);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (single hop): "
 				   "nexthop via if %u", nexthop->ifindex);
 		    }
@@ -1475,7 +2315,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		    {
 		      addattr32 (&req.n, sizeof req, RTA_OIF, nexthop->ifindex);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (single hop): "
 				   "nexthop via if %u", nexthop->ifindex);
 		    }
@@ -1519,7 +2359,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 
               if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
                 {
-                  if (IS_ZEBRA_DEBUG_KERNEL)
+                  if (debug)
                     {
                       zlog_debug ("netlink_route_multipath() "
                          "(recursive, multihop): %s %s/%d type %s",
@@ -1542,7 +2382,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		      if (nexthop->src.ipv4.s_addr)
                         src = &nexthop->src;
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (recursive, "
 				   "multihop): nexthop via %s if %u",
 				   inet_ntoa (nexthop->rgate.ipv4),
@@ -1556,7 +2396,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		      rta_addattr_l (rta, 4096, RTA_GATEWAY,
 				     &nexthop->rgate.ipv6, bytelen);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (recursive, "
 				   "multihop): nexthop via %s if %u",
 				   inet6_ntoa (nexthop->rgate.ipv6),
@@ -1572,7 +2412,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                       if (nexthop->src.ipv4.s_addr)
                         src = &nexthop->src;
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (recursive, "
 				   "multihop): nexthop via if %u",
 				   nexthop->rifindex);
@@ -1582,7 +2422,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		    {
 		      rtnh->rtnh_ifindex = nexthop->rifindex;
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (recursive, "
 				   "multihop): nexthop via if %u",
 				   nexthop->rifindex);
@@ -1594,7 +2434,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                 }
               else
                 {
-                  if (IS_ZEBRA_DEBUG_KERNEL)
+                  if (debug)
                     {
                       zlog_debug ("netlink_route_multipath() (multihop): "
                          "%s %s/%d, type %s", lookup (nlmsg_str, cmd),
@@ -1617,7 +2457,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		      if (nexthop->src.ipv4.s_addr)
                         src = &nexthop->src;
 
-                      if (IS_ZEBRA_DEBUG_KERNEL)
+                      if (debug)
 			zlog_debug("netlink_route_multipath() (multihop): "
 				   "nexthop via %s if %u",
 				   inet_ntoa (nexthop->gate.ipv4),
@@ -1631,7 +2471,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		      rta_addattr_l (rta, 4096, RTA_GATEWAY,
 				     &nexthop->gate.ipv6, bytelen);
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (multihop): "
 				   "nexthop via %s if %u",
 				   inet6_ntoa (nexthop->gate.ipv6),
@@ -1647,7 +2487,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		      rtnh->rtnh_ifindex = nexthop->ifindex;
 		      if (nexthop->src.ipv4.s_addr)
 			src = &nexthop->src;
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (multihop): "
 				   "nexthop via if %u", nexthop->ifindex);
 		    }
@@ -1656,7 +2496,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 		    {
 		      rtnh->rtnh_ifindex = nexthop->ifindex;
 
-		      if (IS_ZEBRA_DEBUG_KERNEL)
+		      if (debug)
 			zlog_debug("netlink_route_multipath() (multihop): "
 				   "nexthop via if %u", nexthop->ifindex);
 		    }
@@ -1682,7 +2522,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   /* If there is no useful nexthop then return. */
   if (nexthop_num == 0)
     {
-      if (IS_ZEBRA_DEBUG_KERNEL)
+      if (debug)
         zlog_debug ("netlink_route_multipath(): No useful nexthop.");
       return 0;
     }
@@ -1693,7 +2533,12 @@ skip:
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
-  /* Talk to netlink socket. */
+  /* Talk to netlink socket.  The dataplane thread has the batch socket
+     to itself. */
+  if (zebra_dplane_active ())
+    return netlink_dplane_talk (&req.n);
+  if (zebrad.nl_batch_size > 1 && netlink_batch.sock >= 0)
+    return netlink_batch_add (&req.n, p, rib);
   return netlink_talk (&req.n, &netlink_cmd);
 }
 
@@ -1808,24 +2653,26 @@ kernel_read (struct thread *thread)
 }
 
 /* Filter out messages from self that occur on listener socket,
-   caused by our actions on the command socket
+   caused by our actions on the command and batch sockets
  */
-static void netlink_install_filter (int sock, __u32 pid)
+static void netlink_install_filter (int sock, __u32 pid, __u32 pid2)
 {
   struct sock_filter filter[] = {
     /* 0: ldh [4]	          */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_H, offsetof(struct nlmsghdr, nlmsg_type)),
-    /* 1: jeq 0x18 jt 3 jf 6  */
+    /* 1: jeq 0x18 jt 3 jf 2  */
     BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_NEWROUTE), 1, 0),
-    /* 2: jeq 0x19 jt 3 jf 6  */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 3),
+    /* 2: jeq 0x19 jt 3 jf 7  */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 4),
     /* 3: ldw [12]		  */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_W, offsetof(struct nlmsghdr, nlmsg_pid)),
-    /* 4: jeq XX  jt 5 jf 6   */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 0, 1),
-    /* 5: ret 0    (skip)     */
+    /* 4: jeq XX  jt 6 jf 5   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 1, 0),
+    /* 5: jeq YY  jt 6 jf 7   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid2), 0, 1),
+    /* 6: ret 0    (skip)     */
     BPF_STMT(BPF_RET|BPF_K, 0),
-    /* 6: ret 0xffff (keep)   */
+    /* 7: ret 0xffff (keep)   */
     BPF_STMT(BPF_RET|BPF_K, 0xffff),
   };
 
@@ -1851,6 +2698,11 @@ kernel_init (void)
 #endif /* HAVE_IPV6 */
   netlink_socket (&netlink, groups);
   netlink_socket (&netlink_cmd, 0);
+  netlink_socket (&netlink_batch, 0);
+
+  /* Answers to batched routes are read from the event loop. */
+  if (netlink_batch.sock > 0 && nl_rcvbufsize)
+    netlink_recvbuf (&netlink_batch, nl_rcvbufsize);
 
   /* Register kernel socket. */
   if (netlink.sock > 0)
@@ -1864,7 +2716,14 @@ kernel_init (void)
       if (nl_rcvbufsize)
 	netlink_recvbuf (&netlink, nl_rcvbufsize);
 
-      netlink_install_filter (netlink.sock, netlink_cmd.snl.nl_pid);
+      netlink_install_filter (netlink.sock, netlink_cmd.snl.nl_pid,
+                              netlink_batch.sock >= 0
+                              ? netlink_batch.snl.nl_pid
+                              : netlink_cmd.snl.nl_pid);
       thread_add_read (zebrad.master, kernel_read, NULL, netlink.sock);
     }
+#ifdef RTM_NEWNEXTHOP
+  if (netlink_cmd.sock >= 0)
+    netlink_nhg_init ();
+#endif /* RTM_NEWNEXTHOP */
 }
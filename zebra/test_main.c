@@ -35,6 +35,7 @@
 #include "zebra/debug.h"
 #include "zebra/router-id.h"
 #include "zebra/interface.h"
+#include "zebra/zebra_nhg.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -307,6 +308,7 @@ main (int argc, char **argv)
 
   /* Zebra related initialize. */
   rib_init ();
+  zebra_nhg_init ();
   access_list_init ();
 
   /* Make kernel routing socket. */
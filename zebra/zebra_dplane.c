@@ -0,0 +1,686 @@
+/*
+ * Zebra dataplane thread.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* With "zebra dataplane thread" configured, rib_process() no longer
+   programs the kernel itself.  rib_install_kernel() and
+   rib_uninstall_kernel() queue a context holding a copy of the RIB
+   entry, and a separate thread hands those to the kernel backend in
+   order.  Finished contexts come back to the main thread through a
+   second queue, where the NEXTHOP_FLAG_FIB state the kernel backend
+   worked out is copied to the RIB entry.
+
+   Both queues are lock free: the producer pushes onto a list head with
+   compare and swap, the consumer takes the whole list at once and
+   reverses it.  Each direction has an eventfd, or a pipe, to wake up
+   the other side.
+
+   The dataplane thread touches nothing but the contexts and the kernel
+   socket, so it must not allocate memory, log or use the thread master;
+   everything else happens in the main thread.  Kernel errors come back
+   as errno in the context and are logged by dplane_result().
+
+   Nor can the thread switch privileges.  It is created with them raised
+   and keeps them, which only works with Linux capabilities: those are
+   per thread, while the user id the other privilege backends switch is
+   shared with the main thread, which keeps lowering it.  The thread is
+   not available without libcap.  */
+
+#include <zebra.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif /* HAVE_SYS_EVENTFD_H */
+
+#include "command.h"
+#include "memory.h"
+#include "thread.h"
+#include "log.h"
+#include "network.h"
+#include "privs.h"
+#include "table.h"
+#include "rib.h"
+
+#include "zebra/zserv.h"
+#include "zebra/rt.h"
+#include "zebra/debug.h"
+#include "zebra/zebra_nht.h"
+#include "zebra/zebra_dplane.h"
+
+extern struct zebra_t zebrad;
+extern struct zebra_privs_t zserv_privs;
+
+#ifdef HAVE_PTHREAD
+
+enum dplane_op
+{
+  DPLANE_OP_INSTALL,
+  DPLANE_OP_UNINSTALL,
+  DPLANE_OP_MAX,
+};
+
+static const char *dplane_op_str[DPLANE_OP_MAX] =
+{
+  "install",
+  "uninstall",
+};
+
+struct dplane_ctx
+{
+  struct dplane_ctx *next;
+
+  enum dplane_op op;
+  int ret;
+  int errnum;
+
+  /* Owned by the main thread.  */
+  struct route_node *rn;
+  struct rib *rib;
+
+  /* What the dataplane thread programs.  */
+  struct rib copy;
+
+  struct timeval t_queued;
+  struct timeval t_start;
+  struct timeval t_done;
+};
+
+struct dplane_event
+{
+  int rfd;
+  int wfd;
+};
+
+struct dplane_stats
+{
+  unsigned long count;
+  unsigned long errors;
+
+  /* Microseconds waiting in the queue and in the kernel backend.  */
+  unsigned long long wait_total;
+  unsigned long wait_max;
+  unsigned long long kernel_total;
+  unsigned long kernel_max;
+};
+
+static struct
+{
+  /* Configured, the thread runs.  */
+  int enabled;
+
+  pthread_t thread;
+  volatile int stop;
+
+  /* Main thread to dataplane, and back.  */
+  struct dplane_ctx *volatile in;
+  struct dplane_ctx *volatile out;
+  struct dplane_event wake;
+  struct dplane_event done;
+  struct thread *t_read;
+
+  /* Contexts handed out and not back yet.  */
+  unsigned long depth;
+  unsigned long depth_max;
+
+  struct dplane_stats stats[DPLANE_OP_MAX];
+} dplane;
+
+static void
+dplane_now (struct timeval *tv)
+{
+#ifdef HAVE_CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  tv->tv_sec = ts.tv_sec;
+  tv->tv_usec = ts.tv_nsec / 1000;
+#else
+  gettimeofday (tv, NULL);
+#endif /* HAVE_CLOCK_MONOTONIC */
+}
+
+static int
+dplane_event_open (struct dplane_event *ev)
+{
+#ifdef HAVE_EVENTFD
+  ev->rfd = ev->wfd = eventfd (0, 0);
+  if (ev->rfd < 0)
+    return -1;
+#else
+  int fds[2];
+
+  if (pipe (fds) < 0)
+    return -1;
+  ev->rfd = fds[0];
+  ev->wfd = fds[1];
+#endif /* HAVE_EVENTFD */
+  return 0;
+}
+
+static void
+dplane_event_close (struct dplane_event *ev)
+{
+  close (ev->rfd);
+  if (ev->wfd != ev->rfd)
+    close (ev->wfd);
+  ev->rfd = ev->wfd = -1;
+}
+
+static void
+dplane_event_post (struct dplane_event *ev)
+{
+  u_int64_t one = 1;
+
+  while (write (ev->wfd, &one, sizeof one) < 0 && errno == EINTR)
+    ;
+}
+
+/* Consume pending posts, blocks unless the descriptor is non-blocking. */
+static void
+dplane_event_clear (struct dplane_event *ev)
+{
+  u_int64_t buf[8];
+
+  while (read (ev->rfd, buf, sizeof buf) < 0 && errno == EINTR)
+    ;
+}
+
+/* Returns true if the queue was empty, only then the consumer needs
+   waking up.  */
+static int
+dplane_push (struct dplane_ctx *volatile *head, struct dplane_ctx *ctx)
+{
+  struct dplane_ctx *old;
+
+  do
+    {
+      old = *head;
+      ctx->next = old;
+    }
+  while (! __sync_bool_compare_and_swap (head, old, ctx));
+
+  return old == NULL;
+}
+
+/* Take everything queued on HEAD, oldest first.  */
+static struct dplane_ctx *
+dplane_take (struct dplane_ctx *volatile *head)
+{
+  struct dplane_ctx *list;
+  struct dplane_ctx *fifo = NULL;
+  struct dplane_ctx *next;
+
+  do
+    list = *head;
+  while (list && ! __sync_bool_compare_and_swap (head, list, NULL));
+
+  for (; list; list = next)
+    {
+      next = list->next;
+      list->next = fifo;
+      fifo = list;
+    }
+  return fifo;
+}
+
+/* Same as rib_install_kernel() and rib_uninstall_kernel(), on the copy. */
+static void
+dplane_kernel (struct dplane_ctx *ctx)
+{
+  struct prefix *p = &ctx->rn->p;
+  struct rib *rib = &ctx->copy;
+  struct nexthop *nexthop;
+
+  ctx->ret = 0;
+  switch (PREFIX_FAMILY (p))
+    {
+    case AF_INET:
+      if (ctx->op == DPLANE_OP_INSTALL)
+	ctx->ret = kernel_add_ipv4 (p, rib);
+      else
+	ctx->ret = kernel_delete_ipv4 (p, rib);
+      break;
+#ifdef HAVE_IPV6
+    case AF_INET6:
+      if (ctx->op == DPLANE_OP_INSTALL)
+	ctx->ret = kernel_add_ipv6 (p, rib);
+      else
+	ctx->ret = kernel_delete_ipv6 (p, rib);
+      break;
+#endif /* HAVE_IPV6 */
+    }
+  if (ctx->ret < 0)
+    ctx->errnum = errno;
+
+  if (ctx->op == DPLANE_OP_UNINSTALL || ctx->ret < 0)
+    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+}
+
+static void *
+dplane_thread (void *arg)
+{
+  struct dplane_ctx *list;
+  struct dplane_ctx *ctx;
+  struct dplane_ctx *next;
+
+  while (1)
+    {
+      list = dplane_take (&dplane.in);
+      if (! list)
+	{
+	  if (dplane.stop)
+	    break;
+	  dplane_event_clear (&dplane.wake);
+	  continue;
+	}
+
+      for (ctx = list; ctx; ctx = next)
+	{
+	  next = ctx->next;
+
+	  dplane_now (&ctx->t_start);
+	  dplane_kernel (ctx);
+	  dplane_now (&ctx->t_done);
+
+	  if (dplane_push (&dplane.out, ctx))
+	    dplane_event_post (&dplane.done);
+	}
+    }
+
+  return NULL;
+}
+
+static unsigned long
+dplane_usec (struct timeval *from, struct timeval *to)
+{
+  return (to->tv_sec - from->tv_sec) * 1000000UL
+	 + to->tv_usec - from->tv_usec;
+}
+
+static void
+dplane_ctx_free (struct dplane_ctx *ctx)
+{
+  struct nexthop *nexthop;
+  struct nexthop *next;
+
+  for (nexthop = ctx->copy.nexthop; nexthop; nexthop = next)
+    {
+      next = nexthop->next;
+      XFREE (MTYPE_NEXTHOP, nexthop);
+    }
+  XFREE (MTYPE_DPLANE_CTX, ctx);
+}
+
+/* A context came back from the dataplane thread.  */
+static void
+dplane_result (struct dplane_ctx *ctx)
+{
+  struct dplane_stats *stats = &dplane.stats[ctx->op];
+  struct rib *rib = ctx->rib;
+  struct nexthop *nexthop;
+  struct nexthop *copy;
+  unsigned long usec;
+  char buf[INET6_ADDRSTRLEN + 4];
+
+  dplane.depth--;
+
+  stats->count++;
+  if (ctx->ret < 0)
+    {
+      stats->errors++;
+      prefix2str (&ctx->rn->p, buf, sizeof buf);
+      zlog_err ("dataplane: can't %s %s: %s", dplane_op_str[ctx->op], buf,
+		safe_strerror (ctx->errnum));
+    }
+  else if (IS_ZEBRA_DEBUG_KERNEL)
+    {
+      prefix2str (&ctx->rn->p, buf, sizeof buf);
+      zlog_debug ("dataplane: %s %s", dplane_op_str[ctx->op], buf);
+    }
+
+  usec = dplane_usec (&ctx->t_queued, &ctx->t_start);
+  stats->wait_total += usec;
+  if (usec > stats->wait_max)
+    stats->wait_max = usec;
+  usec = dplane_usec (&ctx->t_start, &ctx->t_done);
+  stats->kernel_total += usec;
+  if (usec > stats->kernel_max)
+    stats->kernel_max = usec;
+
+  /* Only the last change queued for the entry says what the kernel
+     has now.  */
+  if (--rib->dplane_ops == 0)
+    {
+      if (CHECK_FLAG (rib->status, RIB_ENTRY_UNLINKED))
+	rib_free (rib);
+      else
+	{
+	  for (nexthop = rib->nexthop, copy = ctx->copy.nexthop;
+	       nexthop && copy;
+	       nexthop = nexthop->next, copy = copy->next)
+	    {
+	      if (CHECK_FLAG (copy->flags, NEXTHOP_FLAG_FIB))
+		SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	      else
+		UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	    }
+
+	  /* Tracked addresses and nexthops may have resolved through
+	     what the kernel refused.  */
+	  if (ctx->ret < 0)
+	    {
+	      zebra_nht_changed (ctx->rn);
+	      rib_nexthops_changed (ctx->rn, rib, NULL);
+	    }
+	}
+    }
+
+  route_unlock_node (ctx->rn);
+  dplane_ctx_free (ctx);
+}
+
+static void
+dplane_results (void)
+{
+  struct dplane_ctx *ctx;
+  struct dplane_ctx *next;
+
+  for (ctx = dplane_take (&dplane.out); ctx; ctx = next)
+    {
+      next = ctx->next;
+      dplane_result (ctx);
+    }
+}
+
+static int
+dplane_read (struct thread *thread)
+{
+  dplane.t_read = NULL;
+
+  dplane_event_clear (&dplane.done);
+  dplane_results ();
+
+  dplane.t_read = thread_add_read (zebrad.master, dplane_read, NULL,
+				   dplane.done.rfd);
+  return 0;
+}
+
+static void
+dplane_enqueue (enum dplane_op op, struct route_node *rn, struct rib *rib)
+{
+  struct dplane_ctx *ctx;
+  struct nexthop *nexthop;
+  struct nexthop *copy;
+  struct nexthop *prev = NULL;
+
+  ctx = XCALLOC (MTYPE_DPLANE_CTX, sizeof (struct dplane_ctx));
+  ctx->op = op;
+  ctx->rn = rn;
+  ctx->rib = rib;
+
+  /* The kernel backends only look at the nexthops, flags and metric,
+     interface names are not copied.  */
+  ctx->copy = *rib;
+  ctx->copy.next = ctx->copy.prev = NULL;
+  ctx->copy.nexthop = NULL;
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      copy = XMALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      *copy = *nexthop;
+      copy->ifname = NULL;
+      copy->next = NULL;
+      copy->prev = prev;
+      if (prev)
+	prev->next = copy;
+      else
+	ctx->copy.nexthop = copy;
+      prev = copy;
+    }
+
+  route_lock_node (rn);
+  rib->dplane_ops++;
+
+  if (++dplane.depth > dplane.depth_max)
+    dplane.depth_max = dplane.depth;
+
+  dplane_now (&ctx->t_queued);
+  if (dplane_push (&dplane.in, ctx))
+    dplane_event_post (&dplane.wake);
+}
+
+int
+zebra_dplane_active (void)
+{
+  return dplane.enabled;
+}
+
+void
+zebra_dplane_install (struct route_node *rn, struct rib *rib)
+{
+  struct nexthop *nexthop;
+
+  dplane_enqueue (DPLANE_OP_INSTALL, rn, rib);
+
+  /* Until the answer is back, assume the kernel takes the route, so
+     that an uninstall queued meanwhile names its nexthops.  */
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE)
+	|| (rib->flags & (ZEBRA_FLAG_BLACKHOLE | ZEBRA_FLAG_REJECT)))
+      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+}
+
+void
+zebra_dplane_uninstall (struct route_node *rn, struct rib *rib)
+{
+  dplane_enqueue (DPLANE_OP_UNINSTALL, rn, rib);
+}
+
+static int
+dplane_start (void)
+{
+  sigset_t all, old;
+  int ret;
+
+  if (dplane_event_open (&dplane.wake) < 0)
+    return -1;
+  if (dplane_event_open (&dplane.done) < 0)
+    {
+      dplane_event_close (&dplane.wake);
+      return -1;
+    }
+  set_nonblocking (dplane.done.rfd);
+
+#ifdef HAVE_NETLINK
+  /* Batched routes are in the way of the thread's socket.  */
+  netlink_route_flush ();
+#endif /* HAVE_NETLINK */
+
+  dplane.stop = 0;
+  dplane.enabled = 1;
+
+  /* Signals are for the main thread.  The thread keeps the raised
+     capabilities for good, see above.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog_err ("Can't raise privileges");
+  ret = pthread_create (&dplane.thread, NULL, dplane_thread, NULL);
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog_err ("Can't lower privileges");
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  if (ret != 0)
+    {
+      zlog_err ("Can't start dataplane thread: %s", safe_strerror (ret));
+      dplane.enabled = 0;
+      dplane_event_close (&dplane.wake);
+      dplane_event_close (&dplane.done);
+      return -1;
+    }
+
+  dplane.t_read = thread_add_read (zebrad.master, dplane_read, NULL,
+				   dplane.done.rfd);
+  return 0;
+}
+
+void
+zebra_dplane_finish (void)
+{
+  if (! dplane.enabled)
+    return;
+
+  dplane.stop = 1;
+  dplane_event_post (&dplane.wake);
+  pthread_join (dplane.thread, NULL);
+  dplane.enabled = 0;
+
+  THREAD_OFF (dplane.t_read);
+  dplane_results ();
+
+  dplane_event_close (&dplane.wake);
+  dplane_event_close (&dplane.done);
+}
+
+DEFUN (zebra_dataplane_thread,
+       zebra_dataplane_thread_cmd,
+       "zebra dataplane thread",
+       "Zebra information\n"
+       "Kernel route programming\n"
+       "Program the kernel from a separate thread\n")
+{
+  if (dplane.enabled)
+    return CMD_SUCCESS;
+
+#ifndef HAVE_LCAPS
+  vty_out (vty, "The dataplane thread needs zebra built with libcap%s",
+	   VTY_NEWLINE);
+  return CMD_WARNING;
+#endif /* HAVE_LCAPS */
+
+  if (dplane_start () < 0)
+    {
+      vty_out (vty, "Can't start the dataplane thread%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_zebra_dataplane_thread,
+       no_zebra_dataplane_thread_cmd,
+       "no zebra dataplane thread",
+       NO_STR
+       "Zebra information\n"
+       "Kernel route programming\n"
+       "Program the kernel from a separate thread\n")
+{
+  zebra_dplane_finish ();
+  return CMD_SUCCESS;
+}
+
+DEFUN (show_zebra_dataplane,
+       show_zebra_dataplane_cmd,
+       "show zebra dataplane",
+       SHOW_STR
+       "Zebra information\n"
+       "Kernel route programming\n")
+{
+  struct dplane_stats *stats;
+  int op;
+
+  vty_out (vty, "Dataplane thread is %s%s",
+	   dplane.enabled ? "running" : "not running", VTY_NEWLINE);
+  vty_out (vty, "Queue depth %lu, highest %lu%s",
+	   dplane.depth, dplane.depth_max, VTY_NEWLINE);
+  vty_out (vty, "%s%-10s %10s %8s %21s %21s%s", VTY_NEWLINE,
+	   "Operation", "Count", "Errors",
+	   "Queued avg/max (us)", "Kernel avg/max (us)", VTY_NEWLINE);
+
+  for (op = 0; op < DPLANE_OP_MAX; op++)
+    {
+      stats = &dplane.stats[op];
+      vty_out (vty, "%-10s %10lu %8lu %10llu/%-10lu %10llu/%-10lu%s",
+	       dplane_op_str[op], stats->count, stats->errors,
+	       stats->count ? stats->wait_total / stats->count : 0,
+	       stats->wait_max,
+	       stats->count ? stats->kernel_total / stats->count : 0,
+	       stats->kernel_max, VTY_NEWLINE);
+    }
+  return CMD_SUCCESS;
+}
+
+int
+zebra_dplane_config_write (struct vty *vty)
+{
+  if (dplane.enabled)
+    vty_out (vty, "zebra dataplane thread%s", VTY_NEWLINE);
+  return 0;
+}
+
+void
+zebra_dplane_init (void)
+{
+  dplane.wake.rfd = dplane.wake.wfd = -1;
+  dplane.done.rfd = dplane.done.wfd = -1;
+
+  install_element (CONFIG_NODE, &zebra_dataplane_thread_cmd);
+  install_element (CONFIG_NODE, &no_zebra_dataplane_thread_cmd);
+  install_element (VIEW_NODE, &show_zebra_dataplane_cmd);
+  install_element (ENABLE_NODE, &show_zebra_dataplane_cmd);
+}
+
+#else /* ! HAVE_PTHREAD */
+
+int
+zebra_dplane_active (void)
+{
+  return 0;
+}
+
+void
+zebra_dplane_install (struct route_node *rn, struct rib *rib)
+{
+}
+
+void
+zebra_dplane_uninstall (struct route_node *rn, struct rib *rib)
+{
+}
+
+void
+zebra_dplane_finish (void)
+{
+}
+
+int
+zebra_dplane_config_write (struct vty *vty)
+{
+  return 0;
+}
+
+void
+zebra_dplane_init (void)
+{
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,44 @@
+/*
+ * Zebra dataplane thread.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_DPLANE_H
+#define _ZEBRA_DPLANE_H
+
+#include "table.h"
+#include "vty.h"
+#include "zebra/rib.h"
+
+/* Is the kernel programmed from the dataplane thread?  The kernel
+   backends use this to pick a socket of their own.  */
+extern int zebra_dplane_active (void);
+
+/* Queue a kernel change for RN and RIB.  The RIB entry must not be
+   freed while rib->dplane_ops is set, see rib_unlink().  */
+extern void zebra_dplane_install (struct route_node *, struct rib *);
+extern void zebra_dplane_uninstall (struct route_node *, struct rib *);
+
+/* Program what is queued and stop the thread.  */
+extern void zebra_dplane_finish (void);
+
+extern int zebra_dplane_config_write (struct vty *);
+extern void zebra_dplane_init (void);
+
+#endif /* _ZEBRA_DPLANE_H */
@@ -0,0 +1,654 @@
+/*
+ * Zebra nexthop groups.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Routes asking for the same nexthops share a group, hashed on the
+   nexthops and on what decides how they resolve.  The group resolves
+   them once for all its routes, each route then only applies its
+   route map.  Any change to a route nexthops may resolve through bumps
+   a generation, and a group resolves again when next asked.  A route
+   covering one of its own gateways resolves them by itself, as it must
+   not get there through itself.
+
+   Where the kernel has nexthop objects, the routes of a group are
+   installed pointing at one.  When the nexthops resolve differently
+   the object is changed right away, and the kernel forwards all of the
+   routes the new way without a message for each of them; processing
+   the routes later only brings their FIB flags along.
+
+   Under the groups, the lookup of each gateway is kept in a route table
+   per address family, and dropped when a route covering the gateway
+   changes.  However many groups and routes use a gateway, the routing
+   table is walked for it once per change to the routes it resolves
+   through.  */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "hash.h"
+#include "jhash.h"
+#include "linklist.h"
+#include "memory.h"
+#include "thread.h"
+#include "command.h"
+#include "if.h"
+#include "log.h"
+#include "rib.h"
+
+#include "zebra/zserv.h"
+#include "zebra/rt.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_nhg.h"
+
+extern struct zebra_t zebrad;
+
+static struct hash *nhg_hash;
+
+/* Bumped whenever what nexthops resolve to may have changed.  */
+static unsigned long nhg_gen = 1;
+
+static u_int32_t nhg_last_id;
+static unsigned long nhg_resolves;
+
+/* Groups with a kernel nexthop object, resolved again as soon as
+   routes change.  */
+static struct list *nhg_kernel_list;
+static struct thread *t_nhg_refresh;
+
+/* Gateway lookups, and how they were answered.  */
+static struct route_table *nhg_gate_table[AFI_MAX];
+static unsigned long nhg_gate_count;
+static unsigned long nhg_gate_hits;
+static unsigned long nhg_gate_misses;
+
+/* Walk up from the most specific route to gateway P for a selected one
+   nexthops may resolve through.  BGP routes are not, and neither is
+   TOP, the route being resolved.  */
+static void
+nhg_gate_walk (struct route_table *table, struct prefix *p,
+	       struct route_node *top, struct nhg_gate *gate)
+{
+  struct route_node *rn;
+  struct rib *match;
+  struct nexthop *newhop;
+
+  memset (gate, 0, sizeof (struct nhg_gate));
+
+  rn = route_node_match (table, p);
+  while (rn)
+    {
+      route_unlock_node (rn);
+
+      /* If lookup self prefix return immediately. */
+      if (rn == top)
+	return;
+
+      /* Pick up selected route. */
+      for (match = rn->info; match; match = match->next)
+	{
+	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
+	    continue;
+	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
+	    break;
+	}
+
+      /* If there is no selected route or matched route is EGP, go up
+         tree. */
+      if (! match
+	  || match->type == ZEBRA_ROUTE_BGP)
+	{
+	  do {
+	    rn = rn->parent;
+	  } while (rn && rn->info == NULL);
+	  if (rn)
+	    route_lock_node (rn);
+	  continue;
+	}
+
+      if (match->type == ZEBRA_ROUTE_CONNECT)
+	{
+	  gate->found = NHG_GATE_CONNECT;
+	  newhop = match->nexthop;
+	}
+      else
+	{
+	  gate->found = NHG_GATE_ROUTE;
+	  for (newhop = match->nexthop; newhop; newhop = newhop->next)
+	    if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
+		&& ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+	      break;
+	}
+      if (newhop)
+	{
+	  gate->has_hop = 1;
+	  gate->type = newhop->type;
+	  gate->gate = newhop->gate;
+	  gate->ifindex = newhop->ifindex;
+	}
+      return;
+    }
+}
+
+struct nhg_gate *
+zebra_nhg_gate_lookup (struct prefix *p, struct route_node *top,
+		       struct nhg_gate *scratch)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct nhg_gate *gate;
+  afi_t afi;
+
+  afi = family2afi (p->family);
+  table = vrf_table (afi, SAFI_UNICAST, 0);
+  if (! table)
+    return NULL;
+
+  /* The walk for a route covering its own gateway stops at the route,
+     short of what the cache has.  */
+  if (top && top->p.family == p->family && prefix_match (&top->p, p))
+    {
+      nhg_gate_walk (table, p, top, scratch);
+      return scratch;
+    }
+
+  rn = route_node_get (nhg_gate_table[afi], p);
+  if (rn->info)
+    {
+      nhg_gate_hits++;
+      route_unlock_node (rn);
+      return rn->info;
+    }
+
+  /* The node stays locked for as long as it holds the lookup.  */
+  gate = XCALLOC (MTYPE_NHG_GATE, sizeof (struct nhg_gate));
+  nhg_gate_walk (table, p, NULL, gate);
+  rn->info = gate;
+  nhg_gate_count++;
+  nhg_gate_misses++;
+  return gate;
+}
+
+void
+zebra_nhg_gate_changed (struct route_node *rn)
+{
+  struct route_table *table;
+  struct route_node *top;
+  struct route_node *node;
+  afi_t afi;
+
+  afi = family2afi (rn->p.family);
+  if (afi != AFI_IP && afi != AFI_IP6)
+    return;
+
+  /* Nexthops are resolved in the unicast table only.  */
+  table = nhg_gate_table[afi];
+  if (! table->top || rn->table != vrf_table (afi, SAFI_UNICAST, 0))
+    return;
+
+  /* Gateways the prefix covers.  The extra lock keeps the top node,
+     which route_next_until() stops at, for the whole walk.  */
+  top = route_node_get (table, &rn->p);
+  route_lock_node (top);
+  for (node = top; node; node = route_next_until (node, top))
+    if (node->info)
+      {
+	XFREE (MTYPE_NHG_GATE, node->info);
+	node->info = NULL;
+	nhg_gate_count--;
+	route_unlock_node (node);
+      }
+  route_unlock_node (top);
+}
+
+/* Whether the nexthop names its interface, rather than resolving to
+   one.  */
+static int
+nhg_ifindex_given (struct nexthop *nexthop)
+{
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFINDEX_OL:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+static unsigned int
+nhg_hash_key (void *arg)
+{
+  struct nhg *nhg = arg;
+  struct nexthop *nexthop;
+  u_int32_t key;
+
+  key = jhash_2words (nhg->family, nhg->internal, 0);
+  for (nexthop = nhg->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      key = jhash (&nexthop->gate, sizeof (union g_addr),
+		   key ^ nexthop->type);
+      if (nhg_ifindex_given (nexthop))
+	key = jhash_1word (nexthop->ifindex, key);
+    }
+  return key;
+}
+
+static int
+nhg_nexthop_same (struct nexthop *a, struct nexthop *b)
+{
+  if (a->type != b->type
+      || memcmp (&a->gate, &b->gate, sizeof (union g_addr))
+      || memcmp (&a->src, &b->src, sizeof (union g_addr)))
+    return 0;
+  if (nhg_ifindex_given (a) && a->ifindex != b->ifindex)
+    return 0;
+  if ((a->ifname || b->ifname)
+      && (! a->ifname || ! b->ifname || strcmp (a->ifname, b->ifname)))
+    return 0;
+  return 1;
+}
+
+static int
+nhg_hash_cmp (const void *arg1, const void *arg2)
+{
+  const struct nhg *a = arg1;
+  const struct nhg *b = arg2;
+  struct nexthop *x, *y;
+
+  if (a->family != b->family || a->internal != b->internal)
+    return 0;
+  for (x = a->nexthop, y = b->nexthop; x && y; x = x->next, y = y->next)
+    if (! nhg_nexthop_same (x, y))
+      return 0;
+  return x == NULL && y == NULL;
+}
+
+static void *
+nhg_hash_alloc (void *arg)
+{
+  struct nhg *lookup = arg;
+  struct nhg *nhg;
+  struct nexthop *nexthop;
+  struct nexthop *copy;
+  struct nexthop *prev = NULL;
+
+  nhg = XCALLOC (MTYPE_NHG, sizeof (struct nhg));
+  nhg->family = lookup->family;
+  nhg->internal = lookup->internal;
+  nhg->id = ++nhg_last_id;
+
+  for (nexthop = lookup->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      copy = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      copy->type = nexthop->type;
+      copy->gate = nexthop->gate;
+      copy->src = nexthop->src;
+      if (nhg_ifindex_given (nexthop))
+	copy->ifindex = nexthop->ifindex;
+      if (nexthop->ifname)
+	copy->ifname = XSTRDUP (0, nexthop->ifname);
+
+      copy->prev = prev;
+      if (prev)
+	prev->next = copy;
+      else
+	nhg->nexthop = copy;
+      prev = copy;
+    }
+  return nhg;
+}
+
+struct nhg *
+zebra_nhg_get (struct rib *rib, u_char family)
+{
+  struct nhg lookup;
+  struct nhg *nhg;
+
+  memset (&lookup, 0, sizeof (struct nhg));
+  lookup.nexthop = rib->nexthop;
+  lookup.family = family;
+  lookup.internal = CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL) ? 1 : 0;
+
+  nhg = hash_get (nhg_hash, &lookup, nhg_hash_alloc);
+  nhg->refcnt++;
+  return nhg;
+}
+
+static void
+nhg_kernel_delete (struct nhg *nhg)
+{
+#ifdef HAVE_NETLINK
+  kernel_nhg_delete (nhg);
+#endif /* HAVE_NETLINK */
+  listnode_delete (nhg_kernel_list, nhg);
+}
+
+void
+zebra_nhg_release (struct nhg *nhg)
+{
+  struct nexthop *nexthop;
+  struct nexthop *next;
+
+  if (--nhg->refcnt > 0)
+    return;
+
+  /* No route is installed with the kernel object any more.  */
+  hash_release (nhg_hash, nhg);
+  if (nhg->kernel_id)
+    nhg_kernel_delete (nhg);
+
+  for (nexthop = nhg->nexthop; nexthop; nexthop = next)
+    {
+      next = nexthop->next;
+      nexthop_free (nexthop);
+    }
+  XFREE (MTYPE_NHG, nhg);
+}
+
+/* Program the kernel object for what the nexthops resolve to.  Returns
+   0 if the routes can point at it, 1 if the kernel cannot take it and
+   -1 if it refused it.  */
+static int
+nhg_kernel_update (struct nhg *nhg)
+{
+  u_int32_t id = nhg->kernel_id;
+  int ret = 1;
+
+#ifdef HAVE_NETLINK
+  ret = kernel_nhg_update (nhg);
+#endif /* HAVE_NETLINK */
+  if (ret == 0)
+    {
+      if (! id)
+	listnode_add (nhg_kernel_list, nhg);
+      return 0;
+    }
+
+  if (ret < 0)
+    nhg->kernel_failed = 1;
+  if (id)
+    {
+      /* Routes forward through the object as it was, have them name
+	 their nexthops again.  */
+      zlog_warn ("%s: nexthop group %u: kernel object %u can't follow its "
+		 "nexthops", __func__, nhg->id, id);
+      nhg->kernel_failed = 1;
+      rib_update ();
+    }
+  return ret;
+}
+
+static int
+nhg_resolved_same (struct nexthop *a, struct nexthop *b)
+{
+  u_char mask = NEXTHOP_FLAG_ACTIVE | NEXTHOP_FLAG_RECURSIVE;
+
+  return (a->flags & mask) == (b->flags & mask)
+	 && a->ifindex == b->ifindex
+	 && a->rtype == b->rtype
+	 && a->rifindex == b->rifindex
+	 && memcmp (&a->rgate, &b->rgate, sizeof (union g_addr)) == 0;
+}
+
+static void
+nhg_resolve (struct nhg *nhg)
+{
+  struct nexthop *nexthop;
+  struct nexthop prev;
+  int changed = 0;
+
+  nhg->active_num = 0;
+  for (nexthop = nhg->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      prev = *nexthop;
+      nexthop_resolve (nexthop, nhg->internal, 1, NULL);
+      if (! nhg_resolved_same (&prev, nexthop))
+	changed = 1;
+      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	nhg->active_num++;
+    }
+  nhg->gen = nhg_gen;
+  nhg_resolves++;
+
+  /* With nothing left to point it at, the object stays as it is, the
+     routes are withdrawn as they are processed.  */
+  if (changed && nhg->kernel_id && ! nhg->kernel_failed && nhg->active_num)
+    nhg_kernel_update (nhg);
+}
+
+/* Whether P covers the gateway of NEXTHOP.  */
+static int
+nhg_covers (struct prefix *p, struct nexthop *nexthop)
+{
+  struct prefix gate;
+
+  memset (&gate, 0, sizeof (struct prefix));
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+      gate.family = AF_INET;
+      gate.prefixlen = IPV4_MAX_BITLEN;
+      gate.u.prefix4 = nexthop->gate.ipv4;
+      break;
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+      gate.family = AF_INET6;
+      gate.prefixlen = IPV6_MAX_BITLEN;
+      gate.u.prefix6 = nexthop->gate.ipv6;
+      break;
+#endif /* HAVE_IPV6 */
+    default:
+      return 0;
+    }
+  return p->family == gate.family && prefix_match (p, &gate);
+}
+
+struct nexthop *
+zebra_nhg_resolved (struct nhg *nhg, struct route_node *top)
+{
+  struct nexthop *nexthop;
+
+  for (nexthop = nhg->nexthop; nexthop; nexthop = nexthop->next)
+    if (nhg_covers (&top->p, nexthop))
+      return NULL;
+
+  if (nhg->gen != nhg_gen)
+    nhg_resolve (nhg);
+  return nhg->nexthop;
+}
+
+/* Bring the kernel objects along with what the nexthops resolve to
+   now, before the routes using them are processed.  */
+static int
+nhg_refresh (struct thread *thread)
+{
+  struct listnode *node, *nnode;
+  struct nhg *nhg;
+
+  t_nhg_refresh = NULL;
+
+  for (ALL_LIST_ELEMENTS (nhg_kernel_list, node, nnode, nhg))
+    if (nhg->gen != nhg_gen && ! nhg->kernel_failed)
+      nhg_resolve (nhg);
+  return 0;
+}
+
+void
+zebra_nhg_invalidate (void)
+{
+  nhg_gen++;
+
+  if (! t_nhg_refresh && listcount (nhg_kernel_list))
+    t_nhg_refresh = thread_add_event (zebrad.master, nhg_refresh, NULL, 0);
+}
+
+struct nhg *
+zebra_nhg_kernel (struct rib *rib)
+{
+  struct nhg *nhg = rib->nhg;
+
+  /* The dataplane thread programs copies of the routes, it can't see
+     the objects change.  */
+  if (! nhg || zebra_dplane_active ()
+      || CHECK_FLAG (rib->flags, ZEBRA_FLAG_BLACKHOLE | ZEBRA_FLAG_REJECT)
+      || ! CHECK_FLAG (rib->status, RIB_ENTRY_NHG)
+      || nhg->kernel_failed || ! nhg->active_num)
+    return NULL;
+
+  if (! nhg->kernel_id && nhg_kernel_update (nhg) != 0)
+    return NULL;
+
+  nhg->refcnt++;
+  return nhg;
+}
+
+int
+zebra_nhg_kernel_follows (struct rib *rib)
+{
+  struct nhg *nhg = rib->fib_nhg;
+
+  return nhg && nhg == rib->nhg && ! nhg->kernel_failed && nhg->active_num
+	 && CHECK_FLAG (rib->status, RIB_ENTRY_NHG);
+}
+
+static void
+nhg_show_nexthop (struct vty *vty, struct nexthop *nexthop)
+{
+#ifdef HAVE_IPV6
+  char buf[INET6_ADDRSTRLEN];
+#endif /* HAVE_IPV6 */
+
+  vty_out (vty, "  %c",
+	   CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE) ? '*' : ' ');
+
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFINDEX_OL:
+      vty_out (vty, " %s", inet_ntoa (nexthop->gate.ipv4));
+      if (nexthop->ifindex)
+	vty_out (vty, ", via %s", ifindex2ifname (nexthop->ifindex));
+      break;
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      vty_out (vty, " %s",
+	       inet_ntop (AF_INET6, &nexthop->gate.ipv6, buf, sizeof buf));
+      if (nexthop->type == NEXTHOP_TYPE_IPV6_IFNAME)
+	vty_out (vty, ", via %s", nexthop->ifname);
+      else if (nexthop->ifindex)
+	vty_out (vty, ", via %s", ifindex2ifname (nexthop->ifindex));
+      break;
+#endif /* HAVE_IPV6 */
+    case NEXTHOP_TYPE_IFINDEX:
+      vty_out (vty, " directly connected, %s",
+	       ifindex2ifname (nexthop->ifindex));
+      break;
+    case NEXTHOP_TYPE_IFNAME:
+      vty_out (vty, " directly connected, %s", nexthop->ifname);
+      break;
+    case NEXTHOP_TYPE_BLACKHOLE:
+      vty_out (vty, " directly connected, Null0");
+      break;
+    default:
+      break;
+    }
+
+  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+    switch (nexthop->rtype)
+      {
+      case NEXTHOP_TYPE_IPV4:
+      case NEXTHOP_TYPE_IPV4_IFINDEX:
+	vty_out (vty, " (recursive via %s)", inet_ntoa (nexthop->rgate.ipv4));
+	break;
+#ifdef HAVE_IPV6
+      case NEXTHOP_TYPE_IPV6:
+      case NEXTHOP_TYPE_IPV6_IFINDEX:
+      case NEXTHOP_TYPE_IPV6_IFNAME:
+	vty_out (vty, " (recursive via %s)",
+		 inet_ntop (AF_INET6, &nexthop->rgate.ipv6, buf, sizeof buf));
+	break;
+#endif /* HAVE_IPV6 */
+      case NEXTHOP_TYPE_IFINDEX:
+      case NEXTHOP_TYPE_IFNAME:
+	vty_out (vty, " (recursive is directly connected, %s)",
+		 ifindex2ifname (nexthop->rifindex));
+	break;
+      default:
+	break;
+      }
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
+
+static void
+nhg_show (struct hash_backet *backet, void *arg)
+{
+  struct vty *vty = arg;
+  struct nhg *nhg = backet->data;
+  struct nexthop *nexthop;
+
+  vty_out (vty, "Group %u, %s%s, %lu references", nhg->id,
+	   nhg->family == AF_INET ? "IPv4" : "IPv6",
+	   nhg->internal ? ", recursive" : "", nhg->refcnt);
+  if (nhg->kernel_id)
+    vty_out (vty, ", kernel object %u%s", nhg->kernel_id,
+	     nhg->kernel_failed ? " (failed)" : "");
+  vty_out (vty, "%s", VTY_NEWLINE);
+
+  for (nexthop = nhg->nexthop; nexthop; nexthop = nexthop->next)
+    nhg_show_nexthop (vty, nexthop);
+}
+
+DEFUN (show_nexthop_group,
+       show_nexthop_group_cmd,
+       "show nexthop-group",
+       SHOW_STR
+       "Nexthop groups shared by routes\n")
+{
+  vty_out (vty, "%lu nexthop groups, %u with a kernel object, "
+	   "resolved %lu times%s", nhg_hash->count,
+	   listcount (nhg_kernel_list), nhg_resolves, VTY_NEWLINE);
+  vty_out (vty, "%lu gateways looked up, %lu lookups cached, %lu walked%s",
+	   nhg_gate_count, nhg_gate_hits, nhg_gate_misses, VTY_NEWLINE);
+  hash_iterate (nhg_hash, nhg_show, vty);
+  return CMD_SUCCESS;
+}
+
+void
+zebra_nhg_init (void)
+{
+  afi_t afi;
+
+  nhg_hash = hash_create (nhg_hash_key, nhg_hash_cmp);
+  hash_set_name (nhg_hash, "Zebra nexthop groups");
+  nhg_kernel_list = list_new ();
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    nhg_gate_table[afi] = route_table_init ();
+
+  install_element (VIEW_NODE, &show_nexthop_group_cmd);
+  install_element (ENABLE_NODE, &show_nexthop_group_cmd);
+}
@@ -0,0 +1,104 @@
+/*
+ * Zebra nexthop groups.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_NHG_H
+#define _ZEBRA_NHG_H
+
+#include "table.h"
+#include "zebra/rib.h"
+
+/* The nexthops routes ask for, shared by all the routes asking for the
+   same ones in the same order.  */
+struct nhg
+{
+  /* Copies of the routes' nexthops, holding what they resolve to.  */
+  struct nexthop *nexthop;
+
+  /* Family of the routes, and whether they may resolve through other
+     routes, ZEBRA_FLAG_INTERNAL.  */
+  u_char family;
+  u_char internal;
+
+  u_int32_t id;
+  unsigned long refcnt;
+
+  /* The nexthops are resolved as of this generation.  */
+  unsigned long gen;
+  u_char active_num;
+
+  /* Kernel nexthop object the routes are installed with, 0 if none,
+     and the objects for each of its nexthops.  */
+  u_int32_t kernel_id;
+  u_int32_t *kernel_member;
+  u_char kernel_member_num;
+
+  /* The kernel object could not follow the nexthops.  */
+  u_char kernel_failed;
+};
+
+/* What the lookup of a gateway found: the route nexthops to it resolve
+   through, and the one of its nexthops they take.  */
+struct nhg_gate
+{
+  u_char found;
+#define NHG_GATE_NONE		0	/* no route to resolve through */
+#define NHG_GATE_CONNECT	1	/* connected route, first nexthop */
+#define NHG_GATE_ROUTE		2	/* other route, first FIB nexthop
+					   that is not recursive */
+  u_char has_hop;
+  enum nexthop_types_t type;
+  union g_addr gate;
+  unsigned int ifindex;
+};
+
+/* Look up gateway P for a nexthop of the route in TOP, NULL if there
+   is no table.  Lookups are cached until a route covering the gateway
+   changes; a route covering the gateway itself has SCRATCH filled in
+   instead.  */
+extern struct nhg_gate *zebra_nhg_gate_lookup (struct prefix *,
+					       struct route_node *,
+					       struct nhg_gate *);
+
+/* The route in RN changed, drop the lookups of the gateways under it.  */
+extern void zebra_nhg_gate_changed (struct route_node *);
+
+/* Look up or make the group for the nexthops of RIB, locked.  */
+extern struct nhg *zebra_nhg_get (struct rib *, u_char family);
+extern void zebra_nhg_release (struct nhg *);
+
+/* The nexthops of the group, resolved, for the route in TOP.  NULL if
+   the route covers one of the gateways: it must not resolve them
+   through itself and has to do so on its own.  */
+extern struct nexthop *zebra_nhg_resolved (struct nhg *, struct route_node *);
+
+/* A route nexthops resolve through changed, resolve them again.  */
+extern void zebra_nhg_invalidate (void);
+
+/* The group RIB can be installed with as a kernel nexthop object,
+   locked, or NULL if it has to name its nexthops.  */
+extern struct nhg *zebra_nhg_kernel (struct rib *);
+
+/* The kernel still forwards RIB as its nexthops say.  */
+extern int zebra_nhg_kernel_follows (struct rib *);
+
+extern void zebra_nhg_init (void);
+
+#endif /* _ZEBRA_NHG_H */
@@ -0,0 +1,349 @@
+/*
+ * Zebra nexthop tracking.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Clients register the addresses they resolve their nexthops through,
+   zebra tells them whenever the route those resolve to changes.  The
+   tracked addresses sit in a route table per address family, so a
+   change to a prefix only looks at the addresses under it.  The state
+   last sent is kept as the encoded message, an update goes out only if
+   it differs.  */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "linklist.h"
+#include "stream.h"
+#include "memory.h"
+#include "thread.h"
+#include "log.h"
+#include "rib.h"
+#include "zclient.h"
+
+#include "zebra/zserv.h"
+#include "zebra/debug.h"
+#include "zebra/zebra_nht.h"
+
+extern struct zebra_t zebrad;
+
+struct zebra_nht
+{
+  /* Clients tracking this address.  */
+  struct list *clients;
+
+  /* Metric and nexthops last sent, as in ZEBRA_NEXTHOP_UPDATE.  */
+  u_char *state;
+  size_t state_len;
+
+  /* Waiting on the evaluation queue.  */
+  u_char queued;
+};
+
+/* Tracked addresses.  */
+static struct route_table *nht_table[AFI_MAX];
+
+/* Nodes to evaluate again, locked while queued.  */
+static struct list *nht_queue;
+static struct thread *t_nht;
+
+static struct stream *nht_scratch;
+
+/* Put the metric and the FIB nexthops of the route ADDR resolves to.  */
+static void
+zebra_nht_encode (struct stream *s, struct prefix *addr)
+{
+  struct rib *rib = NULL;
+  struct nexthop *nexthop;
+  unsigned long nump;
+  u_char num = 0;
+
+  if (addr->family == AF_INET)
+    rib = rib_match_ipv4 (addr->u.prefix4);
+#ifdef HAVE_IPV6
+  else if (addr->family == AF_INET6)
+    rib = rib_match_ipv6 (&addr->u.prefix6);
+#endif /* HAVE_IPV6 */
+
+  if (! rib)
+    {
+      stream_putl (s, 0);
+      stream_putc (s, 0);
+      return;
+    }
+
+  stream_putl (s, rib->metric);
+  nump = stream_get_endp (s);
+  stream_putc (s, 0);
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      {
+	stream_putc (s, nexthop->type);
+	switch (nexthop->type)
+	  {
+	  case ZEBRA_NEXTHOP_IPV4:
+	    stream_put_in_addr (s, &nexthop->gate.ipv4);
+	    break;
+	  case ZEBRA_NEXTHOP_IFINDEX:
+	  case ZEBRA_NEXTHOP_IFNAME:
+	    stream_putl (s, nexthop->ifindex);
+	    break;
+#ifdef HAVE_IPV6
+	  case ZEBRA_NEXTHOP_IPV6:
+	    stream_put (s, &nexthop->gate.ipv6, 16);
+	    break;
+	  case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	  case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	    stream_put (s, &nexthop->gate.ipv6, 16);
+	    stream_putl (s, nexthop->ifindex);
+	    break;
+#endif /* HAVE_IPV6 */
+	  default:
+	    /* do nothing */
+	    break;
+	  }
+	num++;
+      }
+  stream_putc_at (s, nump, num);
+}
+
+/* Work out the state of the address in RN again.  Returns 1 if it
+   changed.  */
+static int
+zebra_nht_evaluate (struct route_node *rn, struct zebra_nht *nht)
+{
+  size_t len;
+
+  stream_reset (nht_scratch);
+  zebra_nht_encode (nht_scratch, &rn->p);
+  len = stream_get_endp (nht_scratch);
+
+  if (nht->state && nht->state_len == len
+      && memcmp (nht->state, STREAM_DATA (nht_scratch), len) == 0)
+    return 0;
+
+  if (nht->state)
+    XFREE (MTYPE_ZEBRA_NHT_STATE, nht->state);
+  nht->state = XMALLOC (MTYPE_ZEBRA_NHT_STATE, len);
+  memcpy (nht->state, STREAM_DATA (nht_scratch), len);
+  nht->state_len = len;
+  return 1;
+}
+
+static void
+zebra_nht_free (struct route_node *rn)
+{
+  struct zebra_nht *nht = rn->info;
+
+  list_delete (nht->clients);
+  if (nht->state)
+    XFREE (MTYPE_ZEBRA_NHT_STATE, nht->state);
+  XFREE (MTYPE_ZEBRA_NHT, nht);
+
+  rn->info = NULL;
+  route_unlock_node (rn);
+}
+
+static int
+zebra_nht_process (struct thread *thread)
+{
+  struct listnode *node, *cnode;
+  struct route_node *rn;
+  struct zebra_nht *nht;
+  struct zserv *client;
+  unsigned int count = 0;
+
+  t_nht = NULL;
+
+  while ((node = listhead (nht_queue)) != NULL)
+    {
+      rn = listgetdata (node);
+      list_delete_node (nht_queue, node);
+
+      /* Unregistered meanwhile.  */
+      if ((nht = rn->info) != NULL)
+	{
+	  nht->queued = 0;
+	  if (zebra_nht_evaluate (rn, nht))
+	    {
+	      count++;
+	      for (ALL_LIST_ELEMENTS_RO (nht->clients, cnode, client))
+		zsend_nexthop_update (client, &rn->p, nht->state,
+				      nht->state_len);
+	    }
+	}
+      route_unlock_node (rn);
+    }
+
+  if (IS_ZEBRA_DEBUG_EVENT && count)
+    zlog_debug ("%s: %u tracked nexthops changed", __func__, count);
+  return 0;
+}
+
+void
+zebra_nht_changed (struct route_node *rn)
+{
+  struct route_table *table;
+  struct route_node *top;
+  struct route_node *node;
+  struct zebra_nht *nht;
+  unsigned int count = 0;
+  afi_t afi;
+
+  afi = family2afi (rn->p.family);
+  if (afi != AFI_IP && afi != AFI_IP6)
+    return;
+
+  /* Nexthops are resolved in the unicast table only.  */
+  table = nht_table[afi];
+  if (! table->top || rn->table != vrf_table (afi, SAFI_UNICAST, 0))
+    return;
+
+  /* Tracked addresses the prefix covers.  The extra lock keeps the top
+     node, which route_next_until() stops at, for the whole walk.  */
+  top = route_node_get (table, &rn->p);
+  route_lock_node (top);
+  for (node = top; node; node = route_next_until (node, top))
+    if ((nht = node->info) != NULL && ! nht->queued)
+      {
+	nht->queued = 1;
+	listnode_add (nht_queue, route_lock_node (node));
+	count++;
+      }
+  route_unlock_node (top);
+
+  if (IS_ZEBRA_DEBUG_EVENT && count)
+    {
+      char buf[INET6_ADDRSTRLEN + 4];
+
+      prefix2str (&rn->p, buf, sizeof buf);
+      zlog_debug ("%s: %s: %u tracked nexthops to evaluate", __func__, buf,
+		  count);
+    }
+
+  if (! t_nht && listcount (nht_queue))
+    t_nht = thread_add_event (zebrad.master, zebra_nht_process, NULL, 0);
+}
+
+static void
+zebra_nht_add (struct zserv *client, struct prefix *p)
+{
+  struct route_node *rn;
+  struct zebra_nht *nht;
+
+  rn = route_node_get (nht_table[family2afi (p->family)], p);
+  if (rn->info)
+    {
+      nht = rn->info;
+      route_unlock_node (rn);
+    }
+  else
+    {
+      nht = XCALLOC (MTYPE_ZEBRA_NHT, sizeof (struct zebra_nht));
+      nht->clients = list_new ();
+      rn->info = nht;
+      zebra_nht_evaluate (rn, nht);
+    }
+
+  if (! listnode_lookup (nht->clients, client))
+    listnode_add (nht->clients, client);
+
+  /* The client learns the current state right away.  */
+  zsend_nexthop_update (client, &rn->p, nht->state, nht->state_len);
+}
+
+static void
+zebra_nht_delete (struct zserv *client, struct prefix *p)
+{
+  struct route_node *rn;
+  struct zebra_nht *nht;
+
+  rn = route_node_lookup (nht_table[family2afi (p->family)], p);
+  if (! rn)
+    return;
+  route_unlock_node (rn);
+
+  nht = rn->info;
+  listnode_delete (nht->clients, client);
+  if (list_isempty (nht->clients))
+    zebra_nht_free (rn);
+}
+
+void
+zebra_nht_register (int command, struct zserv *client, u_short length)
+{
+  struct stream *s = client->ibuf;
+  struct prefix p;
+
+  while (STREAM_READABLE (s) > 0)
+    {
+      memset (&p, 0, sizeof (struct prefix));
+      p.family = stream_getc (s);
+      switch (p.family)
+	{
+	case AF_INET:
+	  p.prefixlen = IPV4_MAX_BITLEN;
+	  p.u.prefix4.s_addr = stream_get_ipv4 (s);
+	  break;
+#ifdef HAVE_IPV6
+	case AF_INET6:
+	  p.prefixlen = IPV6_MAX_BITLEN;
+	  stream_get (&p.u.prefix6, s, 16);
+	  break;
+#endif /* HAVE_IPV6 */
+	default:
+	  zlog_warn ("%s: unknown address family %u", __func__, p.family);
+	  return;
+	}
+
+      if (command == ZEBRA_NEXTHOP_REGISTER)
+	zebra_nht_add (client, &p);
+      else
+	zebra_nht_delete (client, &p);
+    }
+}
+
+void
+zebra_nht_client_close (struct zserv *client)
+{
+  struct route_node *rn;
+  struct zebra_nht *nht;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (rn = route_top (nht_table[afi]); rn; rn = route_next (rn))
+      if ((nht = rn->info) != NULL)
+	{
+	  listnode_delete (nht->clients, client);
+	  if (list_isempty (nht->clients))
+	    zebra_nht_free (rn);
+	}
+}
+
+void
+zebra_nht_init (void)
+{
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    nht_table[afi] = route_table_init ();
+  nht_queue = list_new ();
+  nht_scratch = stream_new (ZEBRA_MAX_PACKET_SIZ);
+}
@@ -0,0 +1,38 @@
+/*
+ * Zebra nexthop tracking.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_NHT_H
+#define _ZEBRA_NHT_H
+
+#include "table.h"
+#include "zebra/zserv.h"
+
+/* ZEBRA_NEXTHOP_REGISTER and ZEBRA_NEXTHOP_UNREGISTER from a client.  */
+extern void zebra_nht_register (int, struct zserv *, u_short);
+
+/* The route in RN changed, clients tracking an address it covers may
+   need an update.  */
+extern void zebra_nht_changed (struct route_node *);
+
+extern void zebra_nht_client_close (struct zserv *);
+extern void zebra_nht_init (void);
+
+#endif /* _ZEBRA_NHT_H */
@@ -40,6 +40,9 @@
 #include "zebra/zserv.h"
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_nht.h"
+#include "zebra/zebra_nhg.h"
 
 /* Default rtm_table for all clients */
 extern struct zebra_t zebrad;
@@ -113,6 +116,9 @@ vrf_alloc (const char *name)
   vrf->stable[AFI_IP][SAFI_MULTICAST] = route_table_init ();
   vrf->stable[AFI_IP6][SAFI_MULTICAST] = route_table_init ();
 
+  /* Nexthop resolution does host lookups in the unicast tables. */
+  route_table_lpm_enable (vrf->table[AFI_IP][SAFI_UNICAST]);
+  route_table_lpm_enable (vrf->table[AFI_IP6][SAFI_UNICAST]);
 
   return vrf;
 }
@@ -166,12 +172,24 @@ vrf_static_table (afi_t afi, safi_t safi, u_int32_t id)
   return vrf->stable[afi][safi];
 }
 
+/* The nexthops of RIB change, they make another group.  */
+static void
+rib_nhg_drop (struct rib *rib)
+{
+  if (rib->nhg)
+    {
+      zebra_nhg_release (rib->nhg);
+      rib->nhg = NULL;
+    }
+}
+
 /* Add nexthop to the end of the list.  */
 static void
 nexthop_add (struct rib *rib, struct nexthop *nexthop)
 {
   struct nexthop *last;
 
+  rib_nhg_drop (rib);
   for (last = rib->nexthop; last && last->next; last = last->next)
     ;
   if (last)
@@ -187,6 +205,7 @@ nexthop_add (struct rib *rib, struct nexthop *nexthop)
 static void
 nexthop_delete (struct rib *rib, struct nexthop *nexthop)
 {
+  rib_nhg_drop (rib);
   if (nexthop->next)
     nexthop->next->prev = nexthop->prev;
   if (nexthop->prev)
@@ -197,7 +216,7 @@ nexthop_delete (struct rib *rib, struct nexthop *nexthop)
 }
 
 /* Free nexthop. */
-static void
+void
 nexthop_free (struct nexthop *nexthop)
 {
   if (nexthop->ifname)
@@ -346,14 +365,12 @@ nexthop_blackhole_add (struct rib *rib)
 /* If force flag is not set, do not modify falgs at all for uninstall
    the route from FIB. */
 static int
-nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
+nexthop_active_ipv4 (int internal, struct nexthop *nexthop, int set,
 		     struct route_node *top)
 {
   struct prefix_ipv4 p;
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *match;
-  struct nexthop *newhop;
+  struct nhg_gate *gate;
+  struct nhg_gate scratch;
 
   if (nexthop->type == NEXTHOP_TYPE_IPV4)
     nexthop->ifindex = 0;
@@ -367,94 +384,50 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
   p.prefixlen = IPV4_MAX_PREFIXLEN;
   p.prefix = nexthop->gate.ipv4;
 
-  /* Lookup table.  */
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (! table)
+  gate = zebra_nhg_gate_lookup ((struct prefix *) &p, top, &scratch);
+  if (! gate)
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
+  switch (gate->found)
     {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immediately. */
-      if (rn == top)
-	return 0;
+    case NHG_GATE_CONNECT:
+      /* Directly point connected route. */
+      if (gate->has_hop && nexthop->type == NEXTHOP_TYPE_IPV4)
+	nexthop->ifindex = gate->ifindex;
+      return 1;
 
-      /* Pick up selected route. */
-      for (match = rn->info; match; match = match->next)
+    case NHG_GATE_ROUTE:
+      if (! internal || ! gate->has_hop)
+	return 0;
+      if (set)
 	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
-	    break;
+	  SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+	  nexthop->rtype = gate->type;
+	  if (gate->type == NEXTHOP_TYPE_IPV4 ||
+	      gate->type == NEXTHOP_TYPE_IPV4_IFINDEX)
+	    nexthop->rgate.ipv4 = gate->gate.ipv4;
+	  if (gate->type == NEXTHOP_TYPE_IFINDEX
+	      || gate->type == NEXTHOP_TYPE_IFNAME
+	      || gate->type == NEXTHOP_TYPE_IPV4_IFINDEX)
+	    nexthop->rifindex = gate->ifindex;
 	}
+      return 1;
 
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match 
-	  || match->type == ZEBRA_ROUTE_BGP)
-	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
-	}
-      else
-	{
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV4)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
-		  {
-		    if (set)
-		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-			nexthop->rtype = newhop->type;
-			if (newhop->type == NEXTHOP_TYPE_IPV4 ||
-			    newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX)
-			  nexthop->rgate.ipv4 = newhop->gate.ipv4;
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME
-			    || newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX)
-			  nexthop->rifindex = newhop->ifindex;
-		      }
-		    return 1;
-		  }
-	      return 0;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+    default:
+      return 0;
     }
-  return 0;
 }
 
 #ifdef HAVE_IPV6
 /* If force flag is not set, do not modify falgs at all for uninstall
    the route from FIB. */
 static int
-nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
+nexthop_active_ipv6 (int internal, struct nexthop *nexthop, int set,
 		     struct route_node *top)
 {
   struct prefix_ipv6 p;
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *match;
-  struct nexthop *newhop;
+  struct nhg_gate *gate;
+  struct nhg_gate scratch;
 
   if (nexthop->type == NEXTHOP_TYPE_IPV6)
     nexthop->ifindex = 0;
@@ -468,83 +441,40 @@ nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
   p.prefixlen = IPV6_MAX_PREFIXLEN;
   p.prefix = nexthop->gate.ipv6;
 
-  /* Lookup table.  */
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (! table)
+  gate = zebra_nhg_gate_lookup ((struct prefix *) &p, top, &scratch);
+  if (! gate)
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
+  switch (gate->found)
     {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immediately. */
-      if (rn == top)
-	return 0;
-
-      /* Pick up selected route. */
-      for (match = rn->info; match; match = match->next)
-	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
-	    break;
-	}
+    case NHG_GATE_CONNECT:
+      /* Directly point connected route. */
+      if (gate->has_hop && nexthop->type == NEXTHOP_TYPE_IPV6)
+	nexthop->ifindex = gate->ifindex;
+      return 1;
 
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match
-	  || match->type == ZEBRA_ROUTE_BGP)
+    case NHG_GATE_ROUTE:
+      if (! internal || ! gate->has_hop)
+	return 0;
+      if (set)
 	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
+	  SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+	  nexthop->rtype = gate->type;
+	  if (gate->type == NEXTHOP_TYPE_IPV6
+	      || gate->type == NEXTHOP_TYPE_IPV6_IFINDEX
+	      || gate->type == NEXTHOP_TYPE_IPV6_IFNAME)
+	    nexthop->rgate.ipv6 = gate->gate.ipv6;
+	  if (gate->type == NEXTHOP_TYPE_IFINDEX
+	      || gate->type == NEXTHOP_TYPE_IFNAME
+	      || gate->type == NEXTHOP_TYPE_IPV6_IFINDEX
+	      || gate->type == NEXTHOP_TYPE_IPV6_IFNAME)
+	    nexthop->rifindex = gate->ifindex;
 	}
-      else
-	{
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
+      return 1;
 
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV6)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
-		  {
-		    if (set)
-		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-			nexthop->rtype = newhop->type;
-			if (newhop->type == NEXTHOP_TYPE_IPV6
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
-			  nexthop->rgate.ipv6 = newhop->gate.ipv6;
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
-			  nexthop->rifindex = newhop->ifindex;
-		      }
-		    return 1;
-		  }
-	      return 0;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+    default:
+      return 0;
     }
-  return 0;
 }
 #endif /* HAVE_IPV6 */
 
@@ -796,27 +726,17 @@ rib_match_ipv6 (struct in6_addr *addr)
 #define RIB_SYSTEM_ROUTE(R) \
         ((R)->type == ZEBRA_ROUTE_KERNEL || (R)->type == ZEBRA_ROUTE_CONNECT)
 
-/* This function verifies reachability of one given nexthop, which can be
- * numbered or unnumbered, IPv4 or IPv6. The result is unconditionally stored
- * in nexthop->flags field. If the 4th parameter, 'set', is non-zero,
- * nexthop->ifindex will be updated appropriately as well.
- * An existing route map can turn (otherwise active) nexthop into inactive, but
- * not vice versa.
- *
- * The return value is the final value of 'ACTIVE' flag.
+/* Work out whether NEXTHOP is reachable, as a route that may resolve
+ * it through other routes if INTERNAL, at TOP, would.  The result is
+ * stored in the ACTIVE flag.  If 'set' is non-zero, nexthop->ifindex and
+ * the recursive nexthop are updated appropriately as well.
  */
-
-static unsigned
-nexthop_active_check (struct route_node *rn, struct rib *rib,
-		      struct nexthop *nexthop, int set)
+void
+nexthop_resolve (struct nexthop *nexthop, int internal, int set,
+		 struct route_node *top)
 {
   struct interface *ifp;
-  route_map_result_t ret = RMAP_MATCH;
-  extern char *proto_rm[AFI_MAX][ZEBRA_ROUTE_MAX+1];
-  struct route_map *rmap;
-  int family;
 
-  family = 0;
   switch (nexthop->type)
     {
     case NEXTHOP_TYPE_IFINDEX:
@@ -828,7 +748,6 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
 	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
       break;
     case NEXTHOP_TYPE_IPV6_IFNAME:
-      family = AFI_IP6;
     case NEXTHOP_TYPE_IFNAME:
       ifp = if_lookup_by_name (nexthop->ifname);
       if (ifp && if_is_operative(ifp))
@@ -846,22 +765,19 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
       break;
     case NEXTHOP_TYPE_IPV4:
     case NEXTHOP_TYPE_IPV4_IFINDEX:
-      family = AFI_IP;
-      if (nexthop_active_ipv4 (rib, nexthop, set, rn))
+      if (nexthop_active_ipv4 (internal, nexthop, set, top))
 	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
       else
 	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
       break;
 #ifdef HAVE_IPV6
     case NEXTHOP_TYPE_IPV6:
-      family = AFI_IP6;
-      if (nexthop_active_ipv6 (rib, nexthop, set, rn))
+      if (nexthop_active_ipv6 (internal, nexthop, set, top))
 	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
       else
 	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
       break;
     case NEXTHOP_TYPE_IPV6_IFINDEX:
-      family = AFI_IP6;
       if (IN6_IS_ADDR_LINKLOCAL (&nexthop->gate.ipv6))
 	{
 	  ifp = if_lookup_by_index (nexthop->ifindex);
@@ -872,7 +788,7 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
 	}
       else
 	{
-	  if (nexthop_active_ipv6 (rib, nexthop, set, rn))
+	  if (nexthop_active_ipv6 (internal, nexthop, set, top))
 	    SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
 	  else
 	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
@@ -885,9 +801,44 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
     default:
       break;
     }
+}
+
+/* Address family the route map of a nexthop is looked up for. */
+static int
+nexthop_rmap_family (struct nexthop *nexthop)
+{
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+      return AFI_IP;
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+#endif /* HAVE_IPV6 */
+      return AFI_IP6;
+    default:
+      return 0;
+    }
+}
+
+/* An existing route map can turn (otherwise active) nexthop into
+ * inactive, but not vice versa.  Returns the final value of 'ACTIVE'.
+ */
+static unsigned
+nexthop_active_filter (struct route_node *rn, struct rib *rib,
+		       struct nexthop *nexthop)
+{
+  route_map_result_t ret = RMAP_MATCH;
+  extern char *proto_rm[AFI_MAX][ZEBRA_ROUTE_MAX+1];
+  struct route_map *rmap;
+  int family;
+
   if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
     return 0;
 
+  family = nexthop_rmap_family (nexthop);
   if (RIB_SYSTEM_ROUTE(rib) ||
       (family == AFI_IP && rn->p.family != AF_INET) ||
       (family == AFI_IP6 && rn->p.family != AF_INET6))
@@ -908,12 +859,54 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
   return CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
 }
 
+/* This function verifies reachability of one given nexthop, which can be
+ * numbered or unnumbered, IPv4 or IPv6. The result is unconditionally stored
+ * in nexthop->flags field. If the 4th parameter, 'set', is non-zero,
+ * nexthop->ifindex will be updated appropriately as well.
+ *
+ * The return value is the final value of 'ACTIVE' flag.
+ */
+
+static unsigned
+nexthop_active_check (struct route_node *rn, struct rib *rib,
+		      struct nexthop *nexthop, int set)
+{
+  nexthop_resolve (nexthop, CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL),
+		   set, rn);
+  return nexthop_active_filter (rn, rib, nexthop);
+}
+
+/* Take what the group resolved NEXTHOP to, leaving it as
+ * nexthop_resolve() with the same 'set' would have.
+ */
+static void
+nexthop_copy_resolved (struct nexthop *nexthop, struct nexthop *resolved,
+		       int set)
+{
+  u_char mask = NEXTHOP_FLAG_ACTIVE;
+
+  if (set)
+    {
+      mask |= NEXTHOP_FLAG_RECURSIVE;
+      nexthop->rtype = resolved->rtype;
+      nexthop->rgate = resolved->rgate;
+      nexthop->rifindex = resolved->rifindex;
+    }
+  if (set || nexthop->type == NEXTHOP_TYPE_IPV4
+      || nexthop->type == NEXTHOP_TYPE_IPV6)
+    nexthop->ifindex = resolved->ifindex;
+  nexthop->flags = (nexthop->flags & ~mask) | (resolved->flags & mask);
+}
+
 /* Iterate over all nexthops of the given RIB entry and refresh their
  * ACTIVE flag. rib->nexthop_active_num is updated accordingly. If any
  * nexthop is found to toggle the ACTIVE flag, the whole rib structure
  * is flagged with ZEBRA_FLAG_CHANGED. The 4th 'set' argument is
  * transparently passed to nexthop_active_check().
  *
+ * Routes sharing their nexthops take what the group resolved them to,
+ * only the route maps are applied for each of them.
+ *
  * Return value is the new number of active nexthops.
  */
 
@@ -921,16 +914,38 @@ static int
 nexthop_active_update (struct route_node *rn, struct rib *rib, int set)
 {
   struct nexthop *nexthop;
+  struct nexthop *resolved = NULL;
   unsigned int prev_active, prev_index, new_active;
 
   rib->nexthop_active_num = 0;
   UNSET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
 
+  if (! rib->nhg && ! RIB_SYSTEM_ROUTE (rib))
+    rib->nhg = zebra_nhg_get (rib, PREFIX_FAMILY (&rn->p));
+  if (rib->nhg)
+    resolved = zebra_nhg_resolved (rib->nhg, rn);
+  if (resolved)
+    SET_FLAG (rib->status, RIB_ENTRY_NHG);
+  else
+    UNSET_FLAG (rib->status, RIB_ENTRY_NHG);
+
   for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
   {
     prev_active = CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
     prev_index = nexthop->ifindex;
-    if ((new_active = nexthop_active_check (rn, rib, nexthop, set)))
+    if (resolved)
+      {
+	nexthop_copy_resolved (nexthop, resolved, set);
+	new_active = nexthop_active_filter (rn, rib, nexthop);
+
+	/* A route map took one away, the group's are not ours. */
+	if (! new_active && CHECK_FLAG (resolved->flags, NEXTHOP_FLAG_ACTIVE))
+	  UNSET_FLAG (rib->status, RIB_ENTRY_NHG);
+	resolved = resolved->next;
+      }
+    else
+      new_active = nexthop_active_check (rn, rib, nexthop, set);
+    if (new_active)
       rib->nexthop_active_num++;
     if (prev_active != new_active ||
 	prev_index != nexthop->ifindex)
@@ -940,12 +955,39 @@ nexthop_active_update (struct route_node *rn, struct rib *rib, int set)
 }
 
 
+/* BGP routes are not used to resolve nexthops, a change to any other
+   selected route may change what the gateways under it and the nexthop
+   groups resolve to.  */
+void
+rib_nexthops_changed (struct route_node *rn, struct rib *fib,
+		      struct rib *select)
+{
+  if ((fib && fib->type != ZEBRA_ROUTE_BGP)
+      || (select && select->type != ZEBRA_ROUTE_BGP))
+    {
+      zebra_nhg_gate_changed (rn);
+      zebra_nhg_invalidate ();
+    }
+}
 
 static void
 rib_install_kernel (struct route_node *rn, struct rib *rib)
 {
   int ret = 0;
   struct nexthop *nexthop;
+  struct nhg *old = rib->fib_nhg;
+
+  /* Point the route at the kernel nexthop object of its group if it
+     can, the one it used before goes only once it is replaced.  */
+  rib->fib_nhg = zebra_nhg_kernel (rib);
+
+  if (zebra_dplane_active ())
+    {
+      zebra_dplane_install (rn, rib);
+      if (old)
+	zebra_nhg_release (old);
+      return;
+    }
 
   switch (PREFIX_FAMILY (&rn->p))
     {
@@ -964,7 +1006,10 @@ rib_install_kernel (struct route_node *rn, struct rib *rib)
     {
       for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
 	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      rib_nexthops_changed (rn, rib, NULL);
     }
+  if (old)
+    zebra_nhg_release (old);
 }
 
 /* Uninstall the route from kernel. */
@@ -974,24 +1019,55 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
   int ret = 0;
   struct nexthop *nexthop;
 
-  switch (PREFIX_FAMILY (&rn->p))
-    {
-    case AF_INET:
-      ret = kernel_delete_ipv4 (&rn->p, rib);
-      break;
+  if (zebra_dplane_active ())
+    zebra_dplane_uninstall (rn, rib);
+  else
+    switch (PREFIX_FAMILY (&rn->p))
+      {
+      case AF_INET:
+	ret = kernel_delete_ipv4 (&rn->p, rib);
+	break;
 #ifdef HAVE_IPV6
-    case AF_INET6:
-      ret = kernel_delete_ipv6 (&rn->p, rib);
-      break;
+      case AF_INET6:
+	ret = kernel_delete_ipv6 (&rn->p, rib);
+	break;
 #endif /* HAVE_IPV6 */
-    }
+      }
 
   for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
     UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
 
+  if (rib->fib_nhg)
+    {
+      zebra_nhg_release (rib->fib_nhg);
+      rib->fib_nhg = NULL;
+    }
   return ret;
 }
 
+/* The nexthops of a route installed with a kernel nexthop object
+   changed.  If they still are the object's, the kernel followed them
+   already and only the FIB flags need to.  */
+static int
+rib_follow_kernel (struct route_node *rn, struct rib *rib)
+{
+  struct nexthop *nexthop;
+
+  if (! rib->fib_nhg)
+    return 0;
+
+  nexthop_active_update (rn, rib, 1);
+  if (! zebra_nhg_kernel_follows (rib))
+    return 0;
+
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    else
+      UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+  return 1;
+}
+
 /* Uninstall the route from kernel. */
 static void
 rib_uninstall (struct route_node *rn, struct rib *rib)
@@ -1124,15 +1200,20 @@ rib_process (struct route_node *rn)
       if (CHECK_FLAG (select->flags, ZEBRA_FLAG_CHANGED))
         {
           redistribute_delete (&rn->p, select);
-          if (! RIB_SYSTEM_ROUTE (select))
-            rib_uninstall_kernel (rn, select);
+          if (! rib_follow_kernel (rn, select))
+            {
+              if (! RIB_SYSTEM_ROUTE (select))
+                rib_uninstall_kernel (rn, select);
 
-          /* Set real nexthop. */
-          nexthop_active_update (rn, select, 1);
-  
-          if (! RIB_SYSTEM_ROUTE (select))
-            rib_install_kernel (rn, select);
+              /* Set real nexthop. */
+              nexthop_active_update (rn, select, 1);
+
+              if (! RIB_SYSTEM_ROUTE (select))
+                rib_install_kernel (rn, select);
+            }
           redistribute_add (&rn->p, select);
+          zebra_nht_changed (rn);
+          rib_nexthops_changed (rn, select, NULL);
         }
       else if (! RIB_SYSTEM_ROUTE (select))
         {
@@ -1143,6 +1224,10 @@ rib_process (struct route_node *rn)
              This makes sure the routes are IN the kernel.
            */
 
+          /* Its kernel nexthop object could not follow the nexthops. */
+          if (select->fib_nhg && ! zebra_nhg_kernel_follows (select))
+            rib_uninstall_kernel (rn, select);
+
           for (nexthop = select->nexthop; nexthop; nexthop = nexthop->next)
             if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
             {
@@ -1150,7 +1235,11 @@ rib_process (struct route_node *rn)
               break;
             }
           if (! installed) 
-            rib_install_kernel (rn, select);
+            {
+              rib_install_kernel (rn, select);
+              zebra_nht_changed (rn);
+              rib_nexthops_changed (rn, select, NULL);
+            }
         }
       goto end;
     }
@@ -1191,6 +1280,12 @@ rib_process (struct route_node *rn)
       redistribute_add (&rn->p, select);
     }
 
+  if (fib || select)
+    {
+      zebra_nht_changed (rn);
+      rib_nexthops_changed (rn, fib, select);
+    }
+
   /* FIB route was removed, should be deleted */
   if (del)
     {
@@ -1420,12 +1515,14 @@ rib_queue_init (struct zebra_t *zebra)
 static void
 rib_link (struct route_node *rn, struct rib *rib)
 {
+  static u_int32_t gen;
   struct rib *head;
   char buf[INET6_ADDRSTRLEN];
   
   assert (rib && rn);
   
   route_lock_node (rn); /* rn route table reference */
+  rib->gen = ++gen;
 
   if (IS_ZEBRA_DEBUG_RIB)
   {
@@ -1473,7 +1570,6 @@ rib_addnode (struct route_node *rn, struct rib *rib)
 static void
 rib_unlink (struct route_node *rn, struct rib *rib)
 {
-  struct nexthop *nexthop, *next;
   char buf[INET6_ADDRSTRLEN];
 
   assert (rn && rib);
@@ -1503,15 +1599,32 @@ rib_unlink (struct route_node *rn, struct rib *rib)
         }
     }
 
-  /* free RIB and nexthops */
+  /* The dataplane thread still works on a copy, it is freed once the
+     answers are back. */
+  if (rib->dplane_ops)
+    SET_FLAG (rib->status, RIB_ENTRY_UNLINKED);
+  else
+    rib_free (rib);
+
+  route_unlock_node (rn); /* rn route table reference */
+}
+
+/* Free RIB and nexthops. */
+void
+rib_free (struct rib *rib)
+{
+  struct nexthop *nexthop, *next;
+
   for (nexthop = rib->nexthop; nexthop; nexthop = next)
     {
       next = nexthop->next;
       nexthop_free (nexthop);
     }
+  if (rib->nhg)
+    zebra_nhg_release (rib->nhg);
+  if (rib->fib_nhg)
+    zebra_nhg_release (rib->fib_nhg);
   XFREE (MTYPE_RIB, rib);
-
-  route_unlock_node (rn); /* rn route table reference */
 }
 
 static void
@@ -2849,6 +2962,9 @@ rib_update (void)
   struct route_node *rn;
   struct route_table *table;
   
+  /* Interfaces changed, which nexthops may resolve through.  */
+  zebra_nhg_invalidate ();
+
   table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
   if (table)
     for (rn = route_top (table); rn; rn = route_next (rn))
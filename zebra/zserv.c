@@ -36,12 +36,16 @@
 #include "privs.h"
 #include "network.h"
 #include "buffer.h"
+#include "zring.h"
 
 #include "zebra/zserv.h"
 #include "zebra/router-id.h"
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/ipforward.h"
+#include "zebra/rt.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_nht.h"
 
 /* Event list of zebra. */
 enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_WRITE };
@@ -55,6 +59,11 @@ extern struct zebra_privs_t zserv_privs;
 static struct route_table *vnhlist = NULL;
 
 static void zebra_client_close (struct zserv *client);
+static int zserv_header_get (struct zserv *, uint16_t *, uint16_t *);
+static int zebra_client_dispatch (struct zserv *, uint16_t, uint16_t);
+static struct rib *zread_ipv4_rib (struct stream *, u_char, u_char, u_char);
+static void zread_ipv4_gate (struct stream *, struct zapi_ipv4 *,
+			     struct in_addr *, unsigned long *);
 
 static int
 zserv_delayed_close(struct thread *thread)
@@ -98,6 +107,8 @@ zserv_flush_data(struct thread *thread)
       					 client, client->sock);
       break;
     case BUFFER_EMPTY:
+      /* The client has room for more routes. */
+      zebra_redistribute_resume (client);
       break;
     }
   return 0;
@@ -108,6 +119,26 @@ zebra_server_send_message(struct zserv *client)
 {
   if (client->t_suicide)
     return -1;
+#ifdef HAVE_ZSERV_RING
+  if (client->ring)
+    {
+      if (zring_send (client->ring, client->obuf) < 0)
+	{
+	  zlog_warn("%s: ring to zserv client fd %d broken, closing",
+		    __func__, client->sock);
+	  client->t_suicide = thread_add_event(zebrad.master,
+					       zserv_delayed_close, client, 0);
+	  return -1;
+	}
+      return 0;
+    }
+#endif /* HAVE_ZSERV_RING */
+  if (client->corked)
+    {
+      buffer_put (client->wb, STREAM_DATA(client->obuf),
+		  stream_get_endp(client->obuf));
+      return 0;
+    }
   switch (buffer_write(client->wb, client->sock, STREAM_DATA(client->obuf),
 		       stream_get_endp(client->obuf)))
     {
@@ -123,6 +154,7 @@ zebra_server_send_message(struct zserv *client)
       return -1;
     case BUFFER_EMPTY:
       THREAD_OFF(client->t_write);
+      zebra_redistribute_resume (client);
       break;
     case BUFFER_PENDING:
       THREAD_WRITE_ON(zebrad.master, client->t_write,
@@ -132,6 +164,44 @@ zebra_server_send_message(struct zserv *client)
   return 0;
 }
 
+/* Write out what was put in the buffer while corked. */
+void
+zebra_server_uncork (struct zserv *client)
+{
+  client->corked = 0;
+  if (client->t_suicide || client->t_write || buffer_empty (client->wb))
+    return;
+
+  switch (buffer_flush_available (client->wb, client->sock))
+    {
+    case BUFFER_ERROR:
+      zlog_warn("%s: buffer_flush_available failed on zserv client fd %d, "
+		"closing", __func__, client->sock);
+      client->t_suicide = thread_add_event(zebrad.master, zserv_delayed_close,
+					   client, 0);
+      break;
+    case BUFFER_PENDING:
+      client->t_write = thread_add_write(zebrad.master, zserv_flush_data,
+					 client, client->sock);
+      break;
+    case BUFFER_EMPTY:
+      break;
+    }
+}
+
+/* Bytes sent to the client that it has not taken yet. */
+size_t
+zebra_server_pending (struct zserv *client)
+{
+  size_t pending = buffer_pending (client->wb);
+
+#ifdef HAVE_ZSERV_RING
+  if (client->ring)
+    pending += zring_backlog (client->ring);
+#endif /* HAVE_ZSERV_RING */
+  return pending;
+}
+
 static void
 zserv_create_header (struct stream *s, uint16_t cmd)
 {
@@ -693,6 +763,43 @@ zsend_router_id_update (struct zserv *client, struct prefix *p)
   return zebra_server_send_message(client);
 }
 
+/* Reachability of a tracked nexthop. Send ZEBRA_NEXTHOP_UPDATE to
+   client, STATE holds the metric and the nexthops. */
+int
+zsend_nexthop_update (struct zserv *client, struct prefix *p,
+		      u_char *state, size_t len)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_NEXTHOP_UPDATE);
+  stream_putc (s, p->family);
+  stream_put (s, &p->u.prefix, prefix_blen (p));
+  stream_put (s, state, len);
+
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message(client);
+}
+
+/* Answer a hello with the capabilities we agree on. */
+static int
+zsend_hello (struct zserv *client)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_HELLO);
+  stream_putc (s, client->caps);
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message (client);
+}
+
 /* Register zebra server interface information.  Send current all
    interface and address information. */
 static int
@@ -742,32 +849,20 @@ zread_interface_delete (struct zserv *client, u_short length)
 static int
 zread_ipv4_add (struct zserv *client, u_short length)
 {
-  int i;
   struct rib *rib;
   struct prefix_ipv4 p;
-  u_char message;
-  struct in_addr nexthop;
-  u_char nexthop_num;
-  u_char nexthop_type;
+  u_char type, flags, message;
   struct stream *s;
-  unsigned int ifindex;
-  u_char ifname_len;
   safi_t safi;	
-  u_char onlink = 0;
-
 
   /* Get input stream.  */
   s = client->ibuf;
 
-  /* Allocate new rib. */
-  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
-  
   /* Type, flags, message. */
-  rib->type = stream_getc (s);
-  rib->flags = stream_getc (s);
+  type = stream_getc (s);
+  flags = stream_getc (s);
   message = stream_getc (s); 
   safi = stream_getw (s);
-  rib->uptime = time (NULL);
 
   /* IPv4 prefix. */
   memset (&p, 0, sizeof (struct prefix_ipv4));
@@ -775,6 +870,31 @@ zread_ipv4_add (struct zserv *client, u_short length)
   p.prefixlen = stream_getc (s);
   stream_get (&p.prefix, s, PSIZE (p.prefixlen));
 
+  rib = zread_ipv4_rib (s, type, flags, message);
+  rib_add_ipv4_multipath (&p, rib, safi);
+  return 0;
+}
+
+/* Make a rib of the nexthops, distance and metric of an IPv4 route
+   message. */
+static struct rib *
+zread_ipv4_rib (struct stream *s, u_char type, u_char flags, u_char message)
+{
+  int i;
+  struct rib *rib;
+  struct in_addr nexthop;
+  u_char nexthop_num;
+  u_char nexthop_type;
+  unsigned int ifindex;
+  u_char ifname_len;
+  u_char onlink = 0;
+
+  /* Allocate new rib. */
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  rib->type = type;
+  rib->flags = flags;
+  rib->uptime = time (NULL);
+
   /* Nexthop parse. */
   if (CHECK_FLAG (message, ZAPI_MESSAGE_NEXTHOP))
     {
@@ -830,7 +950,67 @@ zread_ipv4_add (struct zserv *client, u_short length)
     
   /* Table */
   rib->table=zebrad.rtm_table_default;
-  rib_add_ipv4_multipath (&p, rib, safi);
+  return rib;
+}
+
+/* Read the prefix of a batched route message at the read pointer of S
+   into P.  Returns -1 if it is no IPv4 or IPv6 prefix. */
+static int
+zread_batch_prefix (struct stream *s, struct prefix *p, u_char family)
+{
+  memset (p, 0, sizeof (struct prefix));
+  p->family = family;
+  p->prefixlen = stream_getc (s);
+  if (p->prefixlen > prefix_blen (p) * 8)
+    return -1;
+  stream_get (&p->u.prefix, s, PSIZE (p->prefixlen));
+  return 0;
+}
+
+/* ZEBRA_IPV4_ROUTE_BATCH_ADD, the nexthops, distance and metric are
+   shared by all prefixes, see zapi_ipv4_route_batch(). */
+static int
+zread_ipv4_batch_add (struct zserv *client, u_short length)
+{
+  struct stream *s;
+  struct prefix p;
+  u_char type, flags, message;
+  safi_t safi;
+  u_int16_t i, count;
+  size_t attr, next;
+
+  s = client->ibuf;
+
+  type = stream_getc (s);
+  flags = stream_getc (s);
+  message = stream_getc (s);
+  safi = stream_getw (s);
+  count = stream_getw (s);
+
+  /* Parse the shared part again for each route, it is what they are
+     made of. */
+  attr = stream_get_getp (s);
+  next = 0;
+  for (i = 0; i < count; i++)
+    {
+      struct rib *rib;
+
+      stream_set_getp (s, attr);
+      rib = zread_ipv4_rib (s, type, flags, message);
+      if (next)
+	stream_set_getp (s, next);
+
+      if (zread_batch_prefix (s, &p, AF_INET) < 0)
+	{
+	  zlog_warn ("%s: bad prefix length %d from client %d",
+		     __func__, p.prefixlen, client->sock);
+	  rib_free (rib);
+	  return -1;
+	}
+      next = stream_get_getp (s);
+
+      rib_add_ipv4_multipath ((struct prefix_ipv4 *) &p, rib, safi);
+    }
   return 0;
 }
 
@@ -838,19 +1018,13 @@ zread_ipv4_add (struct zserv *client, u_short length)
 static int
 zread_ipv4_delete (struct zserv *client, u_short length)
 {
-  int i;
   struct stream *s;
   struct zapi_ipv4 api;
   struct in_addr nexthop;
   unsigned long ifindex;
   struct prefix_ipv4 p;
-  u_char nexthop_num;
-  u_char nexthop_type;
-  u_char ifname_len;
   
   s = client->ibuf;
-  ifindex = 0;
-  nexthop.s_addr = 0;
 
   /* Type, flags, message. */
   api.type = stream_getc (s);
@@ -864,8 +1038,61 @@ zread_ipv4_delete (struct zserv *client, u_short length)
   p.prefixlen = stream_getc (s);
   stream_get (&p.prefix, s, PSIZE (p.prefixlen));
 
+  zread_ipv4_gate (s, &api, &nexthop, &ifindex);
+  rib_delete_ipv4 (api.type, api.flags, &p, &nexthop, ifindex,
+		   client->rtm_table, api.safi);
+  return 0;
+}
+
+/* ZEBRA_IPV4_ROUTE_BATCH_DELETE. */
+static int
+zread_ipv4_batch_delete (struct zserv *client, u_short length)
+{
+  struct stream *s;
+  struct zapi_ipv4 api;
+  struct in_addr nexthop;
+  unsigned long ifindex;
+  struct prefix p;
+  u_int16_t i, count;
+
+  s = client->ibuf;
+
+  api.type = stream_getc (s);
+  api.flags = stream_getc (s);
+  api.message = stream_getc (s);
+  api.safi = stream_getw (s);
+  count = stream_getw (s);
+
+  zread_ipv4_gate (s, &api, &nexthop, &ifindex);
+  for (i = 0; i < count; i++)
+    {
+      if (zread_batch_prefix (s, &p, AF_INET) < 0)
+	{
+	  zlog_warn ("%s: bad prefix length %d from client %d",
+		     __func__, p.prefixlen, client->sock);
+	  return -1;
+	}
+      rib_delete_ipv4 (api.type, api.flags, (struct prefix_ipv4 *) &p,
+		       &nexthop, ifindex, client->rtm_table, api.safi);
+    }
+  return 0;
+}
+
+/* The gateway and interface of an IPv4 route message to delete. */
+static void
+zread_ipv4_gate (struct stream *s, struct zapi_ipv4 *api,
+		 struct in_addr *nexthop, unsigned long *ifindex)
+{
+  int i;
+  u_char nexthop_num;
+  u_char nexthop_type;
+  u_char ifname_len;
+
+  *ifindex = 0;
+  nexthop->s_addr = 0;
+
   /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
     {
       nexthop_num = stream_getc (s);
 
@@ -876,14 +1103,14 @@ zread_ipv4_delete (struct zserv *client, u_short length)
 	  switch (nexthop_type)
 	    {
 	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
+	      *ifindex = stream_getl (s);
 	      break;
 	    case ZEBRA_NEXTHOP_IFNAME:
 	      ifname_len = stream_getc (s);
 	      stream_forward_getp (s, ifname_len);
 	      break;
 	    case ZEBRA_NEXTHOP_IPV4:
-	      nexthop.s_addr = stream_get_ipv4 (s);
+	      nexthop->s_addr = stream_get_ipv4 (s);
 	      break;
 	    case ZEBRA_NEXTHOP_IPV6:
 	      stream_forward_getp (s, IPV6_MAX_BYTELEN);
@@ -893,20 +1120,16 @@ zread_ipv4_delete (struct zserv *client, u_short length)
     }
 
   /* Distance. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
+    api->distance = stream_getc (s);
   else
-    api.distance = 0;
+    api->distance = 0;
 
   /* Metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
+    api->metric = stream_getl (s);
   else
-    api.metric = 0;
-    
-  rib_delete_ipv4 (api.type, api.flags, &p, &nexthop, ifindex,
-		   client->rtm_table, api.safi);
-  return 0;
+    api->metric = 0;
 }
 
 /* Nexthop lookup for IPv4. */
@@ -1071,7 +1294,10 @@ zread_bgp_ipv4_rgate_verify (struct zserv *client, const u_short length)
   gate.family = AF_INET;
   gate.prefixlen = IPV4_MAX_PREFIXLEN;
   if (vnhlist == NULL)
-    vnhlist = route_table_init();
+    {
+      vnhlist = route_table_init();
+      route_table_lpm_enable (vnhlist);
+    }
 
   /* read request */
   assert (length >= 3);
@@ -1128,79 +1354,77 @@ zread_ipv4_import_lookup (struct zserv *client, u_short length)
 }
 
 #ifdef HAVE_IPV6
-/* Zebra server IPv6 prefix add function. */
-static int
-zread_ipv6_add (struct zserv *client, u_short length)
+/* The nexthop, ifindex, distance and metric of an IPv6 route message,
+   only the last nexthop and ifindex given count. */
+static void
+zread_ipv6_gate (struct stream *s, struct zapi_ipv6 *api,
+		 struct in6_addr *nexthop, unsigned long *ifindex)
 {
   int i;
-  struct stream *s;
-  struct zapi_ipv6 api;
-  struct in6_addr nexthop;
-  unsigned long ifindex;
-  struct prefix_ipv6 p;
-  
-  s = client->ibuf;
-  ifindex = 0;
-  memset (&nexthop, 0, sizeof (struct in6_addr));
-
-  /* Type, flags, message. */
-  api.type = stream_getc (s);
-  api.flags = stream_getc (s);
-  api.message = stream_getc (s);
-  api.safi = stream_getw (s);
 
-  /* IPv4 prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv6));
-  p.family = AF_INET6;
-  p.prefixlen = stream_getc (s);
-  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+  *ifindex = 0;
+  memset (nexthop, 0, sizeof (struct in6_addr));
 
   /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
     {
       u_char nexthop_type;
 
-      api.nexthop_num = stream_getc (s);
-      for (i = 0; i < api.nexthop_num; i++)
+      api->nexthop_num = stream_getc (s);
+      for (i = 0; i < api->nexthop_num; i++)
 	{
 	  nexthop_type = stream_getc (s);
 
 	  switch (nexthop_type)
 	    {
 	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_get (&nexthop, s, 16);
+	      stream_get (nexthop, s, 16);
 	      break;
 	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
+	      *ifindex = stream_getl (s);
 	      break;
 	    }
 	}
     }
 
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
+    api->distance = stream_getc (s);
   else
-    api.distance = 0;
+    api->distance = 0;
 
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
+    api->metric = stream_getl (s);
   else
-    api.metric = 0;
-    
-  if (IN6_IS_ADDR_UNSPECIFIED (&nexthop))
-    rib_add_ipv6 (api.type, api.flags, &p, NULL, ifindex, zebrad.rtm_table_default, api.metric,
-		  api.distance, api.safi);
+    api->metric = 0;
+}
+
+static void
+zread_ipv6_rib_add (struct zapi_ipv6 *api, struct prefix_ipv6 *p,
+		    struct in6_addr *nexthop, unsigned long ifindex)
+{
+  if (IN6_IS_ADDR_UNSPECIFIED (nexthop))
+    rib_add_ipv6 (api->type, api->flags, p, NULL, ifindex, zebrad.rtm_table_default, api->metric,
+		  api->distance, api->safi);
   else
-    rib_add_ipv6 (api.type, api.flags, &p, &nexthop, ifindex, zebrad.rtm_table_default, api.metric,
-		  api.distance, api.safi);
-  return 0;
+    rib_add_ipv6 (api->type, api->flags, p, nexthop, ifindex, zebrad.rtm_table_default, api->metric,
+		  api->distance, api->safi);
 }
 
-/* Zebra server IPv6 prefix delete function. */
+static void
+zread_ipv6_rib_delete (struct zserv *client, struct zapi_ipv6 *api,
+		       struct prefix_ipv6 *p, struct in6_addr *nexthop,
+		       unsigned long ifindex)
+{
+  if (IN6_IS_ADDR_UNSPECIFIED (nexthop))
+    rib_delete_ipv6 (api->type, api->flags, p, NULL, ifindex, client->rtm_table, api->safi);
+  else
+    rib_delete_ipv6 (api->type, api->flags, p, nexthop, ifindex, client->rtm_table, api->safi);
+}
+
+/* Zebra server IPv6 prefix add and delete function. */
 static int
-zread_ipv6_delete (struct zserv *client, u_short length)
+zread_ipv6_route (struct zserv *client, u_short length, int add)
 {
-  int i;
   struct stream *s;
   struct zapi_ipv6 api;
   struct in6_addr nexthop;
@@ -1208,8 +1432,6 @@ zread_ipv6_delete (struct zserv *client, u_short length)
   struct prefix_ipv6 p;
   
   s = client->ibuf;
-  ifindex = 0;
-  memset (&nexthop, 0, sizeof (struct in6_addr));
 
   /* Type, flags, message. */
   api.type = stream_getc (s);
@@ -1217,47 +1439,54 @@ zread_ipv6_delete (struct zserv *client, u_short length)
   api.message = stream_getc (s);
   api.safi = stream_getw (s);
 
-  /* IPv4 prefix. */
+  /* IPv6 prefix. */
   memset (&p, 0, sizeof (struct prefix_ipv6));
   p.family = AF_INET6;
   p.prefixlen = stream_getc (s);
   stream_get (&p.prefix, s, PSIZE (p.prefixlen));
 
-  /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
-    {
-      u_char nexthop_type;
+  zread_ipv6_gate (s, &api, &nexthop, &ifindex);
+  if (add)
+    zread_ipv6_rib_add (&api, &p, &nexthop, ifindex);
+  else
+    zread_ipv6_rib_delete (client, &api, &p, &nexthop, ifindex);
+  return 0;
+}
 
-      api.nexthop_num = stream_getc (s);
-      for (i = 0; i < api.nexthop_num; i++)
-	{
-	  nexthop_type = stream_getc (s);
+/* ZEBRA_IPV6_ROUTE_BATCH_ADD and ZEBRA_IPV6_ROUTE_BATCH_DELETE. */
+static int
+zread_ipv6_batch (struct zserv *client, u_short length, int add)
+{
+  struct stream *s;
+  struct zapi_ipv6 api;
+  struct in6_addr nexthop;
+  unsigned long ifindex;
+  struct prefix p;
+  u_int16_t i, count;
 
-	  switch (nexthop_type)
-	    {
-	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_get (&nexthop, s, 16);
-	      break;
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
-	      break;
-	    }
+  s = client->ibuf;
+
+  api.type = stream_getc (s);
+  api.flags = stream_getc (s);
+  api.message = stream_getc (s);
+  api.safi = stream_getw (s);
+  count = stream_getw (s);
+
+  zread_ipv6_gate (s, &api, &nexthop, &ifindex);
+  for (i = 0; i < count; i++)
+    {
+      if (zread_batch_prefix (s, &p, AF_INET6) < 0)
+	{
+	  zlog_warn ("%s: bad prefix length %d from client %d",
+		     __func__, p.prefixlen, client->sock);
+	  return -1;
 	}
+      if (add)
+	zread_ipv6_rib_add (&api, (struct prefix_ipv6 *) &p, &nexthop, ifindex);
+      else
+	zread_ipv6_rib_delete (client, &api, (struct prefix_ipv6 *) &p,
+			       &nexthop, ifindex);
     }
-
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
-  else
-    api.distance = 0;
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
-  else
-    api.metric = 0;
-    
-  if (IN6_IS_ADDR_UNSPECIFIED (&nexthop))
-    rib_delete_ipv6 (api.type, api.flags, &p, NULL, ifindex, client->rtm_table, api.safi);
-  else
-    rib_delete_ipv6 (api.type, api.flags, &p, &nexthop, ifindex, client->rtm_table, api.safi);
   return 0;
 }
 
@@ -1296,14 +1525,203 @@ zread_router_id_delete (struct zserv *client, u_short length)
   return 0;
 }
 
+/* Close descriptors the client sent that no message took. */
+static void
+zserv_fds_close (struct zserv *client)
+{
+  while (client->nfds > 0)
+    close (client->fds[--client->nfds]);
+}
+
+#ifdef HAVE_ZSERV_RING
+/* What we have of ZEBRA_CAP_ALL. */
+#define ZSERV_CAPS ZEBRA_CAP_ALL
+
+/* Messages taken from a ring before others get a turn. */
+#define ZSERV_RING_BURST 100
+
+/* Like stream_read_try(), keeping descriptors sent along with the
+   data for the message they came with. */
+static ssize_t
+zserv_read_try (struct zserv *client, size_t size)
+{
+  struct stream *s = client->ibuf;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int) * ZRING_NFDS)];
+    struct cmsghdr align;
+  } control;
+  ssize_t nbytes;
+  int *fds;
+  int i, n;
+
+  if (STREAM_WRITEABLE (s) < size)
+    return -1;
+
+  iov.iov_base = STREAM_DATA (s) + stream_get_endp (s);
+  iov.iov_len = size;
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  if ((nbytes = recvmsg (client->sock, &msg, 0)) < 0)
+    {
+      if (ERRNO_IO_RETRY (errno))
+	return -2;
+      zlog_warn ("%s: recvmsg failed on fd %d: %s", __func__, client->sock,
+		 safe_strerror (errno));
+      return -1;
+    }
+  stream_forward_endp (s, nbytes);
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	continue;
+      fds = (int *) CMSG_DATA (cmsg);
+      n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+      for (i = 0; i < n; i++)
+	if (client->nfds < ZRING_NFDS)
+	  client->fds[client->nfds++] = fds[i];
+	else
+	  close (fds[i]);
+    }
+  return nbytes;
+}
+
+/* Messages from the client on its ring, and room for those waiting to
+   go to it. */
+static int
+zserv_ring_read (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+  struct zring *ring = client->ring;
+  uint16_t length, command;
+  int i, ret;
+
+  client->t_ring = NULL;
+  if (client->t_suicide)
+    {
+      zebra_client_close (client);
+      return -1;
+    }
+
+  zring_clear (ring);
+  if (zring_backlog (ring))
+    {
+      if ((ret = zring_flush (ring)) < 0)
+	goto broken;
+      if (ret == 0)
+	/* The client has room for more routes. */
+	zebra_redistribute_resume (client);
+    }
+
+  for (i = 0; client->ring_started && i < ZSERV_RING_BURST; i++)
+    {
+      stream_reset (client->ibuf);
+      if ((ret = zring_recv (ring, client->ibuf)) == 0)
+	break;
+      if (ret < ZEBRA_HEADER_SIZE
+	  || zserv_header_get (client, &length, &command) < 0)
+	goto broken;
+      if (zebra_client_dispatch (client, command, length) < 0)
+	return -1;
+    }
+  stream_reset (client->ibuf);
+
+  if (i == ZSERV_RING_BURST
+      || (client->ring_started && ! zring_sleep (ring)))
+    client->t_ring = thread_add_event (zebrad.master, zserv_ring_read,
+				       client, 0);
+  else
+    client->t_ring = thread_add_read (zebrad.master, zserv_ring_read,
+				      client, zring_fd (ring));
+  return 0;
+
+ broken:
+  zlog_warn ("%s: ring of zserv client fd %d broken, closing",
+	     __func__, client->sock);
+  zebra_client_close (client);
+  return -1;
+}
+
+/* A client asking for rings sends their size with its hello, and the
+   descriptors with the message.  It gets its answer through the
+   socket, everything after through the ring.  Its messages come
+   through the socket up to ZEBRA_RING_START, and then through the
+   ring. */
+static struct zring *
+zread_ring (struct zserv *client, u_short length)
+{
+  struct zring *ring;
+
+  if (length < 6 || client->ring || client->nfds != ZRING_NFDS)
+    return NULL;
+
+  ring = zring_attach (stream_getl (client->ibuf), client->fds);
+  client->nfds = 0;
+  return ring;
+}
+
+static void
+zread_ring_start (struct zserv *client)
+{
+  if (! client->ring || client->ring_started)
+    return;
+
+  client->ring_started = 1;
+  THREAD_OFF (client->t_ring);
+  client->t_ring = thread_add_event (zebrad.master, zserv_ring_read,
+				     client, 0);
+}
+#else
+#define ZSERV_CAPS (ZEBRA_CAP_ALL & ~ZEBRA_CAP_RING)
+
+static ssize_t
+zserv_read_try (struct zserv *client, size_t size)
+{
+  return stream_read_try (client->ibuf, client->sock, size);
+}
+#endif /* HAVE_ZSERV_RING */
+
 /* Tie up route-type and client->sock */
 static void
-zread_hello (struct zserv *client)
+zread_hello (struct zserv *client, u_short length)
 {
   /* type of protocol (lib/zebra.h) */
   u_char proto;
   proto = stream_getc (client->ibuf);
 
+  /* Newer clients follow up with the capabilities they would use, and
+     want to know which of them we have. */
+  if (length > 1)
+    {
+      client->caps = stream_getc (client->ibuf) & ZSERV_CAPS;
+#ifdef HAVE_ZSERV_RING
+      if (CHECK_FLAG (client->caps, ZEBRA_CAP_RING))
+	{
+	  struct zring *ring = zread_ring (client, length);
+
+	  if (! ring)
+	    UNSET_FLAG (client->caps, ZEBRA_CAP_RING);
+	  zsend_hello (client);
+	  if (ring)
+	    {
+	      client->ring = ring;
+	      client->t_ring = thread_add_read (zebrad.master, zserv_ring_read,
+						client, zring_fd (ring));
+	    }
+	}
+      else
+#endif /* HAVE_ZSERV_RING */
+	zsend_hello (client);
+    }
+
   /* accept only dynamic routing protocols */
   if ((proto < ZEBRA_ROUTE_MAX)
   &&  (proto > ZEBRA_ROUTE_STATIC))
@@ -1351,6 +1769,10 @@ zebra_client_close (struct zserv *client)
       client->sock = -1;
     }
 
+  /* Drop nexthops the client tracks, and routes queued for it. */
+  zebra_nht_client_close (client);
+  zebra_redistribute_client_close (client);
+
   /* Free stream buffers. */
   if (client->ibuf)
     stream_free (client->ibuf);
@@ -1358,6 +1780,11 @@ zebra_client_close (struct zserv *client)
     stream_free (client->obuf);
   if (client->wb)
     buffer_free(client->wb);
+#ifdef HAVE_ZSERV_RING
+  if (client->ring)
+    zring_free (client->ring);
+#endif /* HAVE_ZSERV_RING */
+  zserv_fds_close (client);
 
   /* Release threads. */
   if (client->t_read)
@@ -1366,6 +1793,8 @@ zebra_client_close (struct zserv *client)
     thread_cancel (client->t_write);
   if (client->t_suicide)
     thread_cancel (client->t_suicide);
+  if (client->t_ring)
+    thread_cancel (client->t_ring);
 
   /* Free client structure. */
   listnode_delete (zebrad.client_list, client);
@@ -1396,106 +1825,55 @@ zebra_client_create (int sock)
   zebra_event (ZEBRA_READ, sock, client);
 }
 
-/* Handler of zebra service request. */
+/* Check the header of the message in the client's input buffer, and
+   get the length of what follows it. */
 static int
-zebra_client_read (struct thread *thread)
+zserv_header_get (struct zserv *client, uint16_t *length, uint16_t *command)
 {
-  int sock;
-  struct zserv *client;
-  size_t already;
-  uint16_t length, command;
   uint8_t marker, version;
 
-  /* Get thread data.  Reset reading thread because I'm running. */
-  sock = THREAD_FD (thread);
-  client = THREAD_ARG (thread);
-  client->t_read = NULL;
-
-  if (client->t_suicide)
-    {
-      zebra_client_close(client);
-      return -1;
-    }
-
-  /* Read length and command (if we don't have it already). */
-  if ((already = stream_get_endp(client->ibuf)) < ZEBRA_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     ZEBRA_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed socket [%d]", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-      already = ZEBRA_HEADER_SIZE;
-    }
-
   /* Reset to read from the beginning of the incoming packet. */
   stream_set_getp(client->ibuf, 0);
 
   /* Fetch header values */
-  length = stream_getw (client->ibuf);
+  *length = stream_getw (client->ibuf);
   marker = stream_getc (client->ibuf);
   version = stream_getc (client->ibuf);
-  command = stream_getw (client->ibuf);
+  *command = stream_getw (client->ibuf);
 
   if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
     {
       zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, sock, marker, version);
-      zebra_client_close (client);
+               __func__, client->sock, marker, version);
       return -1;
     }
-  if (length < ZEBRA_HEADER_SIZE) 
+  if (*length < ZEBRA_HEADER_SIZE) 
     {
       zlog_warn("%s: socket %d message length %u is less than header size %d",
-	        __func__, sock, length, ZEBRA_HEADER_SIZE);
-      zebra_client_close (client);
+	        __func__, client->sock, *length, ZEBRA_HEADER_SIZE);
       return -1;
     }
-  if (length > STREAM_SIZE(client->ibuf))
+  if (*length > STREAM_SIZE(client->ibuf))
     {
       zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
-	        __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
-      zebra_client_close (client);
+	        __func__, client->sock, *length,
+		(u_long)STREAM_SIZE(client->ibuf));
       return -1;
     }
+  return 0;
+}
 
-  /* Read rest of data. */
-  if (already < length)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed [%d] when reading zebra data", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(length-already))
-        {
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-    }
-
+/* Handle the message read into the client's input buffer, LENGTH as
+   in its header.  Returns -1 if the client is gone. */
+static int
+zebra_client_dispatch (struct zserv *client, uint16_t command,
+		       uint16_t length)
+{
   length -= ZEBRA_HEADER_SIZE;
 
   /* Debug packet information. */
   if (IS_ZEBRA_DEBUG_EVENT)
-    zlog_debug ("zebra message comes from socket [%d]", sock);
+    zlog_debug ("zebra message comes from socket [%d]", client->sock);
 
   if (IS_ZEBRA_DEBUG_PACKET && IS_ZEBRA_DEBUG_RECV)
     zlog_debug ("zebra message received [%s] %d", 
@@ -1521,12 +1899,24 @@ zebra_client_read (struct thread *thread)
     case ZEBRA_IPV4_ROUTE_DELETE:
       zread_ipv4_delete (client, length);
       break;
+    case ZEBRA_IPV4_ROUTE_BATCH_ADD:
+      zread_ipv4_batch_add (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_BATCH_DELETE:
+      zread_ipv4_batch_delete (client, length);
+      break;
 #ifdef HAVE_IPV6
     case ZEBRA_IPV6_ROUTE_ADD:
-      zread_ipv6_add (client, length);
+      zread_ipv6_route (client, length, 1);
       break;
     case ZEBRA_IPV6_ROUTE_DELETE:
-      zread_ipv6_delete (client, length);
+      zread_ipv6_route (client, length, 0);
+      break;
+    case ZEBRA_IPV6_ROUTE_BATCH_ADD:
+      zread_ipv6_batch (client, length, 1);
+      break;
+    case ZEBRA_IPV6_ROUTE_BATCH_DELETE:
+      zread_ipv6_batch (client, length, 0);
       break;
 #endif /* HAVE_IPV6 */
     case ZEBRA_REDISTRIBUTE_ADD:
@@ -1553,11 +1943,20 @@ zebra_client_read (struct thread *thread)
       zread_ipv4_import_lookup (client, length);
       break;
     case ZEBRA_HELLO:
-      zread_hello (client);
+      zread_hello (client, length);
       break;
     case ZEBRA_BGP_IPV4_RGATE_VERIFY:
       zread_bgp_ipv4_rgate_verify (client, length);
       break;
+    case ZEBRA_NEXTHOP_REGISTER:
+    case ZEBRA_NEXTHOP_UNREGISTER:
+      zebra_nht_register (command, client, length);
+      break;
+#ifdef HAVE_ZSERV_RING
+    case ZEBRA_RING_START:
+      zread_ring_start (client);
+      break;
+#endif /* HAVE_ZSERV_RING */
     default:
       zlog_info ("Zebra received unknown command %d", command);
       break;
@@ -1569,6 +1968,81 @@ zebra_client_read (struct thread *thread)
       zebra_client_close(client);
       return -1;
     }
+  return 0;
+}
+
+/* Handler of zebra service request. */
+static int
+zebra_client_read (struct thread *thread)
+{
+  int sock;
+  struct zserv *client;
+  size_t already;
+  uint16_t length, command;
+
+  /* Get thread data.  Reset reading thread because I'm running. */
+  sock = THREAD_FD (thread);
+  client = THREAD_ARG (thread);
+  client->t_read = NULL;
+
+  if (client->t_suicide)
+    {
+      zebra_client_close(client);
+      return -1;
+    }
+
+  /* Read length and command (if we don't have it already). */
+  if ((already = stream_get_endp(client->ibuf)) < ZEBRA_HEADER_SIZE)
+    {
+      ssize_t nbyte;
+      if (((nbyte = zserv_read_try (client, ZEBRA_HEADER_SIZE-already)) == 0) ||
+	  (nbyte == -1))
+	{
+	  if (IS_ZEBRA_DEBUG_EVENT)
+	    zlog_debug ("connection closed socket [%d]", sock);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
+	{
+	  /* Try again later. */
+	  zebra_event (ZEBRA_READ, sock, client);
+	  return 0;
+	}
+      already = ZEBRA_HEADER_SIZE;
+    }
+
+  if (zserv_header_get (client, &length, &command) < 0)
+    {
+      zebra_client_close (client);
+      return -1;
+    }
+
+  /* Read rest of data. */
+  if (already < length)
+    {
+      ssize_t nbyte;
+      if (((nbyte = zserv_read_try (client, length-already)) == 0) ||
+	  (nbyte == -1))
+	{
+	  if (IS_ZEBRA_DEBUG_EVENT)
+	    zlog_debug ("connection closed [%d] when reading zebra data", sock);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      if (nbyte != (ssize_t)(length-already))
+        {
+	  /* Try again later. */
+	  zebra_event (ZEBRA_READ, sock, client);
+	  return 0;
+	}
+    }
+
+  if (zebra_client_dispatch (client, command, length) < 0)
+    return -1;
+
+  /* Descriptors are only good for the message they came with. */
+  zserv_fds_close (client);
 
   stream_reset (client->ibuf);
   zebra_event (ZEBRA_READ, sock, client);
@@ -1776,6 +2250,64 @@ DEFUN (config_table,
   return CMD_SUCCESS;
 }
 
+#ifdef HAVE_NETLINK
+DEFUN (netlink_batch,
+       netlink_batch_cmd,
+       "netlink batch <2-1024>",
+       "Kernel netlink interface\n"
+       "Send route changes to the kernel in batches\n"
+       "Maximum number of routes in a batch\n")
+{
+  VTY_GET_INTEGER_RANGE ("batch size", zebrad.nl_batch_size, argv[0],
+			 2, 1024);
+  zebrad.nl_batch_delay = NETLINK_BATCH_DELAY_DEFAULT;
+
+  if (argc > 1)
+    VTY_GET_INTEGER_RANGE ("batch delay", zebrad.nl_batch_delay, argv[1],
+			   1, 1000);
+  return CMD_SUCCESS;
+}
+
+ALIAS (netlink_batch,
+       netlink_batch_delay_cmd,
+       "netlink batch <2-1024> delay <1-1000>",
+       "Kernel netlink interface\n"
+       "Send route changes to the kernel in batches\n"
+       "Maximum number of routes in a batch\n"
+       "Longest time a route waits for its batch to fill\n"
+       "Milliseconds\n")
+
+DEFUN (no_netlink_batch,
+       no_netlink_batch_cmd,
+       "no netlink batch",
+       NO_STR
+       "Kernel netlink interface\n"
+       "Send route changes to the kernel in batches\n")
+{
+  zebrad.nl_batch_size = 0;
+  netlink_route_flush ();
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_netlink_batch,
+       no_netlink_batch_val_cmd,
+       "no netlink batch <2-1024>",
+       NO_STR
+       "Kernel netlink interface\n"
+       "Send route changes to the kernel in batches\n"
+       "Maximum number of routes in a batch\n")
+
+ALIAS (no_netlink_batch,
+       no_netlink_batch_delay_cmd,
+       "no netlink batch <2-1024> delay <1-1000>",
+       NO_STR
+       "Kernel netlink interface\n"
+       "Send route changes to the kernel in batches\n"
+       "Maximum number of routes in a batch\n"
+       "Longest time a route waits for its batch to fill\n"
+       "Milliseconds\n")
+#endif /* HAVE_NETLINK */
+
 DEFUN (ip_forwarding,
        ip_forwarding_cmd,
        "ip forwarding",
@@ -1850,6 +2382,18 @@ config_write_table (struct vty *vty)
   if (zebrad.rtm_table_default)
     vty_out (vty, "table %d%s", zebrad.rtm_table_default,
 	     VTY_NEWLINE);
+#ifdef HAVE_NETLINK
+  if (zebrad.nl_batch_size > 1)
+    {
+      if (zebrad.nl_batch_delay != NETLINK_BATCH_DELAY_DEFAULT)
+	vty_out (vty, "netlink batch %u delay %u%s", zebrad.nl_batch_size,
+		 zebrad.nl_batch_delay, VTY_NEWLINE);
+      else
+	vty_out (vty, "netlink batch %u%s", zebrad.nl_batch_size,
+		 VTY_NEWLINE);
+    }
+#endif /* HAVE_NETLINK */
+  zebra_dplane_config_write (vty);
   return 0;
 }
 
@@ -2003,6 +2547,11 @@ zebra_init (void)
   install_element (VIEW_NODE, &show_table_cmd);
   install_element (ENABLE_NODE, &show_table_cmd);
   install_element (CONFIG_NODE, &config_table_cmd);
+  install_element (CONFIG_NODE, &netlink_batch_cmd);
+  install_element (CONFIG_NODE, &netlink_batch_delay_cmd);
+  install_element (CONFIG_NODE, &no_netlink_batch_cmd);
+  install_element (CONFIG_NODE, &no_netlink_batch_val_cmd);
+  install_element (CONFIG_NODE, &no_netlink_batch_delay_cmd);
 #endif /* HAVE_NETLINK */
 
 #ifdef HAVE_IPV6
@@ -2014,6 +2563,9 @@ zebra_init (void)
 
   /* Route-map */
   zebra_route_map_init ();
+
+  /* Nexthop tracking. */
+  zebra_nht_init ();
 }
 
 /* Make zebra server socket, wiping any existing one (see bug #403). */
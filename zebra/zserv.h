@@ -25,6 +25,7 @@
 #include "rib.h"
 #include "if.h"
 #include "workqueue.h"
+#include "zring.h"
 
 /* Default port information. */
 #define ZEBRA_VTY_PORT                2601
@@ -66,6 +67,29 @@ struct zserv
 
   /* Router-id information. */
   u_char ridinfo;
+
+  /* Capabilities agreed on in ZEBRA_HELLO, ZEBRA_CAP_*. */
+  u_char caps;
+
+  /* Prefixes with redistribution to this client pending, IPv4 and
+     IPv6, see redistribute.c. */
+  struct route_table *redist_queue[2];
+  unsigned long redist_queued;
+  struct thread *t_redist;
+
+  /* Put messages in the write buffer only, zebra_server_uncork() then
+     writes them out together. */
+  int corked;
+
+  /* Descriptors that came with the message being read. */
+  int fds[ZRING_NFDS];
+  int nfds;
+
+  /* Shared memory rings, messages go out through them once set up,
+     and come in once the client sent ZEBRA_RING_START. */
+  struct zring *ring;
+  int ring_started;
+  struct thread *t_ring;
 };
 
 /* Zebra instance */
@@ -78,6 +102,11 @@ struct zebra_t
   /* default table */
   int rtm_table_default;
 
+  /* Routes per netlink batch, batching is off below 2, and the time
+     in milliseconds a batch waits to fill up.  */
+  unsigned int nl_batch_size;
+  unsigned int nl_batch_delay;
+
   /* rib work queue */
   struct work_queue *ribq;
   struct meta_queue *mq;
@@ -107,6 +136,10 @@ extern int zsend_interface_update (int, struct zserv *, struct interface *);
 extern int zsend_route_multipath (int, struct zserv *, struct prefix *, 
                                   struct rib *);
 extern int zsend_router_id_update(struct zserv *, struct prefix *);
+extern int zsend_nexthop_update (struct zserv *, struct prefix *, u_char *,
+				 size_t);
+extern void zebra_server_uncork (struct zserv *);
+extern size_t zebra_server_pending (struct zserv *);
 
 extern pid_t pid;
 